@@ -0,0 +1,421 @@
+/**
+ * @brief Benchmarks of the server and client on a simulated CAN bus
+ *
+ * Server and client run in one process. They are connected by an in-memory bus with a virtual
+ * clock, so throughput and latency results depend only on the code and the bus model and are the
+ * same on every run. The bus carries BENCH_SLOTS_PER_MS frames per millisecond (about 500 kbit/s
+ * with 8 byte classic CAN frames). Each slot arbitrates one frame, lowest arbitration ID first,
+ * delivers it and then polls the server and the client once. Each node has BENCH_TX_MAILBOXES
+ * transmit mailboxes.
+ *
+ * The CPU cost of a poll is measured with the time stamp counter where there is one, in
+ * nanoseconds otherwise. It is the only result which varies between machines.
+ *
+ * Every result is printed as one JSON object per line.
+ */
+#include "iso14229client.h"
+#include "iso14229server.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLE_UNIT "tsc"
+#else
+#define BENCH_CYCLE_UNIT "ns"
+#endif
+
+#define BENCH_SLOTS_PER_MS 4
+#define BENCH_TX_MAILBOXES 3
+#define BENCH_RX_QUEUE_SIZE 64
+#define BENCH_BUFSIZE 4095U
+#define BENCH_IMAGE_SIZE 0x10000U
+#define BENCH_TIMEOUT_MS 600000U
+
+#define BENCH_SERVER_PHYS_RECV_ID 0x7E0U
+#define BENCH_SERVER_FUNC_RECV_ID 0x7DFU
+#define BENCH_SERVER_SEND_ID 0x7E8U
+
+struct BenchFrame {
+    uint32_t arbId;
+    uint8_t data[ISO_TP_MAX_DL];
+    uint8_t size;
+};
+
+struct BenchQueue {
+    struct BenchFrame frames[BENCH_RX_QUEUE_SIZE];
+    uint16_t head;
+    uint16_t count;
+};
+
+static struct {
+    uint32_t slot; // virtual time in bus slots
+    uint32_t frames;
+    struct BenchQueue serverTx, clientTx, serverRx, clientRx;
+
+    uint8_t srvPhysLinkRxBuf[BENCH_BUFSIZE];
+    uint8_t srvPhysLinkTxBuf[BENCH_BUFSIZE];
+    uint8_t srvFuncLinkRxBuf[BENCH_BUFSIZE];
+    uint8_t srvFuncLinkTxBuf[BENCH_BUFSIZE];
+    uint8_t clientLinkRxBuf[BENCH_BUFSIZE];
+    uint8_t clientLinkTxBuf[BENCH_BUFSIZE];
+    uint8_t prefetchBuf[BENCH_BUFSIZE];
+    IsoTpLink srvPhysLink, srvFuncLink, clientLink;
+
+    Iso14229ServerConfig srvCfg; // referenced by the server
+    Iso14229Server server;
+    Iso14229Client client;
+
+    uint64_t serverCycles, clientCycles;
+    uint32_t polls;
+    uint32_t bytesReceived;
+} b;
+
+static inline uint64_t _BenchCycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+#endif
+}
+
+// ================================================
+// Simulated bus
+// ================================================
+
+static uint32_t benchGetms(void) { return b.slot / BENCH_SLOTS_PER_MS; }
+
+static void benchDebug(const char *fmt, ...) { (void)fmt; }
+
+static bool _QueuePush(struct BenchQueue *q, uint16_t capacity, uint32_t arbId,
+                       const uint8_t *data, uint8_t size) {
+    if (q->count == capacity) {
+        return false;
+    }
+    struct BenchFrame *f = &q->frames[(q->head + q->count) % BENCH_RX_QUEUE_SIZE];
+    f->arbId = arbId;
+    memmove(f->data, data, size);
+    f->size = size;
+    q->count++;
+    return true;
+}
+
+static const struct BenchFrame *_QueueFront(const struct BenchQueue *q) {
+    return q->count ? &q->frames[q->head] : NULL;
+}
+
+static void _QueuePop(struct BenchQueue *q) {
+    q->head = (q->head + 1) % BENCH_RX_QUEUE_SIZE;
+    q->count--;
+}
+
+static int benchServerCANTransmit(uint32_t arbId, const uint8_t *data, uint8_t size) {
+    return _QueuePush(&b.serverTx, BENCH_TX_MAILBOXES, arbId, data, size) ? ISOTP_RET_OK
+                                                                           : ISOTP_RET_NOSPACE;
+}
+
+static int benchClientCANTransmit(uint32_t arbId, const uint8_t *data, uint8_t size) {
+    return _QueuePush(&b.clientTx, BENCH_TX_MAILBOXES, arbId, data, size) ? ISOTP_RET_OK
+                                                                           : ISOTP_RET_NOSPACE;
+}
+
+static enum Iso14229CANRxStatus _QueueRxPoll(struct BenchQueue *q, uint32_t *arbId, uint8_t *data,
+                                             uint8_t *size) {
+    const struct BenchFrame *f = _QueueFront(q);
+    if (NULL == f) {
+        return kCANRxNone;
+    }
+    *arbId = f->arbId;
+    memmove(data, f->data, f->size);
+    *size = f->size;
+    _QueuePop(q);
+    return kCANRxSome;
+}
+
+static enum Iso14229CANRxStatus benchServerCANRxPoll(uint32_t *arbId, uint8_t *data,
+                                                     uint8_t *size) {
+    return _QueueRxPoll(&b.serverRx, arbId, data, size);
+}
+
+static enum Iso14229CANRxStatus benchClientCANRxPoll(uint32_t *arbId, uint8_t *data,
+                                                     uint8_t *size) {
+    return _QueueRxPoll(&b.clientRx, arbId, data, size);
+}
+
+/**
+ * @brief one bus slot: the pending frame with the lowest arbitration ID wins and is delivered
+ */
+static void _BusSlot(void) {
+    const struct BenchFrame *s = _QueueFront(&b.serverTx);
+    const struct BenchFrame *c = _QueueFront(&b.clientTx);
+
+    if (c && (NULL == s || c->arbId < s->arbId)) {
+        _QueuePush(&b.serverRx, BENCH_RX_QUEUE_SIZE, c->arbId, c->data, c->size);
+        _QueuePop(&b.clientTx);
+        b.frames++;
+    } else if (s) {
+        _QueuePush(&b.clientRx, BENCH_RX_QUEUE_SIZE, s->arbId, s->data, s->size);
+        _QueuePop(&b.serverTx);
+        b.frames++;
+    }
+    b.slot++;
+}
+
+static void benchSessionTimeout() {}
+
+static void _BenchInit(const Iso14229DataIdentifier *didTable, uint16_t didTableSize,
+                       enum Iso14229ResponseCode (*userRequestDownloadHandler)(
+                           const struct Iso14229ServerStatus *, void *, size_t, uint8_t,
+                           Iso14229DownloadHandler **, uint16_t *)) {
+    memset(&b, 0, sizeof(b));
+    b.srvCfg = (Iso14229ServerConfig){
+        .phys_recv_id = BENCH_SERVER_PHYS_RECV_ID,
+        .func_recv_id = BENCH_SERVER_FUNC_RECV_ID,
+        .send_id = BENCH_SERVER_SEND_ID,
+        .phys_link = &b.srvPhysLink,
+        .func_link = &b.srvFuncLink,
+        .phys_link_receive_buffer = b.srvPhysLinkRxBuf,
+        .phys_link_recv_buf_size = sizeof(b.srvPhysLinkRxBuf),
+        .phys_link_send_buffer = b.srvPhysLinkTxBuf,
+        .phys_link_send_buf_size = sizeof(b.srvPhysLinkTxBuf),
+        .func_link_receive_buffer = b.srvFuncLinkRxBuf,
+        .func_link_recv_buf_size = sizeof(b.srvFuncLinkRxBuf),
+        .func_link_send_buffer = b.srvFuncLinkTxBuf,
+        .func_link_send_buf_size = sizeof(b.srvFuncLinkTxBuf),
+        .userSessionTimeoutCallback = benchSessionTimeout,
+        .userGetms = benchGetms,
+        .userCANTransmit = benchServerCANTransmit,
+        .userCANRxPoll = benchServerCANRxPoll,
+        .userDebug = benchDebug,
+        .didTable = didTable,
+        .didTableSize = didTableSize,
+        .userRequestDownloadHandler = userRequestDownloadHandler,
+        .p2_ms = 50,
+        .p2_star_ms = 2000,
+        .s3_ms = 5000,
+    };
+    Iso14229ServerInit(&b.server, &b.srvCfg);
+
+    struct Iso14229ClientConfig cfg = {
+        .phys_send_id = BENCH_SERVER_PHYS_RECV_ID,
+        .func_send_id = BENCH_SERVER_FUNC_RECV_ID,
+        .recv_id = BENCH_SERVER_SEND_ID,
+        .p2_ms = 150,
+        .p2_star_ms = 1500,
+        .link = &b.clientLink,
+        .link_receive_buffer = b.clientLinkRxBuf,
+        .link_recv_buf_size = sizeof(b.clientLinkRxBuf),
+        .link_send_buffer = b.clientLinkTxBuf,
+        .link_send_buf_size = sizeof(b.clientLinkTxBuf),
+        .userGetms = benchGetms,
+        .userCANTransmit = benchClientCANTransmit,
+        .userCANRxPoll = benchClientCANRxPoll,
+        .userDebug = benchDebug,
+    };
+    iso14229ClientInit(&b.client, &cfg);
+}
+
+static void _ServerPoll(void) {
+    uint64_t start = _BenchCycles();
+    Iso14229ServerPoll(&b.server);
+    b.serverCycles += _BenchCycles() - start;
+}
+
+// ================================================
+// 0x36 download throughput
+// ================================================
+
+static uint16_t benchBlockLength;
+
+static enum Iso14229ResponseCode benchOnTransfer(const struct Iso14229ServerStatus *status,
+                                                 void *userCtx, const uint8_t *data,
+                                                 uint32_t len) {
+    (void)status;
+    (void)userCtx;
+    (void)data;
+    b.bytesReceived += len;
+    return kPositiveResponse;
+}
+
+static enum Iso14229ResponseCode benchOnExit(const struct Iso14229ServerStatus *status,
+                                             void *userCtx, uint16_t buffer_size,
+                                             uint8_t *transferResponseParameterRecord,
+                                             uint16_t *transferResponseParameterRecordSize) {
+    (void)status;
+    (void)userCtx;
+    (void)buffer_size;
+    (void)transferResponseParameterRecord;
+    *transferResponseParameterRecordSize = 0;
+    return kPositiveResponse;
+}
+
+static enum Iso14229ResponseCode
+benchRequestDownload(const struct Iso14229ServerStatus *status, void *memoryAddress,
+                     size_t memorySize, uint8_t dataFormatIdentifier,
+                     Iso14229DownloadHandler **handler, uint16_t *maxNumberOfBlockLength) {
+    static Iso14229DownloadHandler downloadHandler = {
+        .onTransfer = benchOnTransfer,
+        .onExit = benchOnExit,
+    };
+    (void)status;
+    (void)memoryAddress;
+    (void)memorySize;
+    (void)dataFormatIdentifier;
+    *handler = &downloadHandler;
+    *maxNumberOfBlockLength = benchBlockLength;
+    return kPositiveResponse;
+}
+
+static int32_t benchDownloadRead(void *ctx, size_t offset, uint8_t *buf, uint16_t len) {
+    (void)ctx;
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)((offset + i) * 31);
+    }
+    return len;
+}
+
+static void benchDownload(uint16_t blockLength, uint8_t bs, uint8_t stMin) {
+    _BenchInit(NULL, 0, benchRequestDownload);
+    benchBlockLength = blockLength;
+    isotp_set_flow_control(&b.srvPhysLink, bs, stMin);
+
+    Iso14229ClientDownload dl;
+    struct Iso14229ClientDownloadConfig dlCfg = {
+        .dataFormatIdentifier = 0x00,
+        .addressAndLengthFormatIdentifier = 0x44,
+        .memoryAddress = 0x08000000,
+        .memorySize = BENCH_IMAGE_SIZE,
+        .read = benchDownloadRead,
+        .prefetchBuffer = b.prefetchBuf,
+        .prefetchBufferSize = sizeof(b.prefetchBuf),
+    };
+    Iso14229ClientDownloadInit(&dl, &dlCfg);
+
+    enum Iso14229ClientError err = kISO14229_CLIENT_SEQUENCE_RUNNING;
+    while (kISO14229_CLIENT_SEQUENCE_RUNNING == err && benchGetms() < BENCH_TIMEOUT_MS) {
+        _BusSlot();
+        _ServerPoll();
+        uint64_t start = _BenchCycles();
+        err = Iso14229ClientDownloadPoll(&b.client, &dl);
+        b.clientCycles += _BenchCycles() - start;
+        b.polls++;
+    }
+
+    uint32_t ms = b.slot / BENCH_SLOTS_PER_MS;
+    printf("{\"bench\":\"download\",\"block_length\":%u,\"bs\":%u,\"st_min_ms\":%u,"
+           "\"result\":%d,\"bytes\":%" PRIu32 ",\"virtual_ms\":%" PRIu32 ",\"frames\":%" PRIu32
+           ",\"frames_per_s\":%" PRIu32 ",\"bytes_per_s\":%" PRIu32 ","
+           "\"server_cycles_per_poll\":%" PRIu64 ",\"client_cycles_per_poll\":%" PRIu64
+           ",\"cycle_unit\":\"" BENCH_CYCLE_UNIT "\"}\n",
+           dl.blockLength, bs, stMin, err, b.bytesReceived, ms, b.frames,
+           ms ? (uint32_t)((uint64_t)b.frames * 1000 / ms) : 0,
+           ms ? (uint32_t)((uint64_t)b.bytesReceived * 1000 / ms) : 0, b.serverCycles / b.polls,
+           b.clientCycles / b.polls);
+}
+
+// ================================================
+// 0x22 multi-DID latency
+// ================================================
+
+#define BENCH_NUM_DIDS 16
+#define BENCH_DID_LEN 16
+#define BENCH_RDBI_REPEAT 100
+
+static void benchRDBI(uint16_t numDIDs) {
+    static uint8_t records[BENCH_NUM_DIDS][BENCH_DID_LEN];
+    Iso14229DataIdentifier didTable[BENCH_NUM_DIDS];
+    uint16_t didList[BENCH_NUM_DIDS];
+
+    for (uint16_t i = 0; i < BENCH_NUM_DIDS; i++) {
+        didList[i] = 0x0100 + i;
+        didTable[i] = (Iso14229DataIdentifier){
+            .did = didList[i],
+            .len = BENCH_DID_LEN,
+            .data = records[i],
+            .readSessions = ISO14229_ALL_SESSIONS,
+        };
+    }
+    _BenchInit(didTable, BENCH_NUM_DIDS, NULL);
+
+    uint32_t totalSlots = 0, maxSlots = 0, errors = 0;
+    for (int n = 0; n < BENCH_RDBI_REPEAT; n++) {
+        uint32_t start = b.slot;
+        if (kISO14229_CLIENT_OK != ReadDataByIdentifier(&b.client, didList, numDIDs)) {
+            errors++;
+            continue;
+        }
+        do {
+            _BusSlot();
+            _ServerPoll();
+            uint64_t c = _BenchCycles();
+            Iso14229ClientPoll(&b.client);
+            b.clientCycles += _BenchCycles() - c;
+            b.polls++;
+        } while (kRequestStateIdle != b.client.state);
+        if (kISO14229_CLIENT_OK != b.client.err) {
+            errors++;
+        }
+        uint32_t slots = b.slot - start;
+        totalSlots += slots;
+        if (slots > maxSlots) {
+            maxSlots = slots;
+        }
+    }
+
+    printf("{\"bench\":\"rdbi\",\"dids\":%u,\"record_bytes\":%u,\"requests\":%d,\"errors\":%" PRIu32
+           ",\"mean_latency_us\":%" PRIu32 ",\"max_latency_us\":%" PRIu32 ","
+           "\"server_cycles_per_poll\":%" PRIu64 ",\"client_cycles_per_poll\":%" PRIu64
+           ",\"cycle_unit\":\"" BENCH_CYCLE_UNIT "\"}\n",
+           numDIDs, numDIDs * BENCH_DID_LEN, BENCH_RDBI_REPEAT, errors,
+           totalSlots * 1000 / BENCH_SLOTS_PER_MS / BENCH_RDBI_REPEAT,
+           maxSlots * 1000 / BENCH_SLOTS_PER_MS, b.serverCycles / b.polls,
+           b.clientCycles / b.polls);
+}
+
+// ================================================
+// Idle poll cost
+// ================================================
+
+#define BENCH_IDLE_POLLS 100000
+
+static void benchIdle(void) {
+    _BenchInit(NULL, 0, NULL);
+    for (int i = 0; i < BENCH_IDLE_POLLS; i++) {
+        _BusSlot();
+        _ServerPoll();
+        uint64_t start = _BenchCycles();
+        Iso14229ClientPoll(&b.client);
+        b.clientCycles += _BenchCycles() - start;
+        b.polls++;
+    }
+    printf("{\"bench\":\"idle\",\"polls\":%" PRIu32 ",\"server_cycles_per_poll\":%" PRIu64
+           ",\"client_cycles_per_poll\":%" PRIu64 ",\"cycle_unit\":\"" BENCH_CYCLE_UNIT "\"}\n",
+           b.polls, b.serverCycles / b.polls, b.clientCycles / b.polls);
+}
+
+int main() {
+    const uint16_t blockLengths[] = {130, 514, 1026, BENCH_BUFSIZE};
+    const uint8_t blockSizes[] = {0, 8};
+    const uint8_t stMins[] = {0, 1};
+
+    for (size_t i = 0; i < sizeof(blockLengths) / sizeof(blockLengths[0]); i++) {
+        for (size_t j = 0; j < sizeof(blockSizes); j++) {
+            for (size_t k = 0; k < sizeof(stMins); k++) {
+                benchDownload(blockLengths[i], blockSizes[j], stMins[k]);
+            }
+        }
+    }
+
+    const uint16_t numDIDs[] = {1, 4, BENCH_NUM_DIDS};
+    for (size_t i = 0; i < sizeof(numDIDs) / sizeof(numDIDs[0]); i++) {
+        benchRDBI(numDIDs[i]);
+    }
+
+    benchIdle();
+    return 0;
+}
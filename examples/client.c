@@ -26,6 +26,7 @@ static struct Iso14229ClientConfig cfg = {
     .userCANRxPoll = portCANRxPoll,
     .userGetms = portGetms,
     .userYieldms = portYieldms,
+    .userWaitRx = portWaitRx,
     .userDebug = isotp_user_debug,
 };
 
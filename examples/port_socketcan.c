@@ -1,113 +1,67 @@
 #include "../iso14229.h"
+#include "../iso14229socketcan.h"
 #include "port.h"
+#include "shared.h"
 #include <errno.h>
-#include <error.h>
-#include <linux/can.h>
-#include <linux/can/raw.h>
-#include <net/if.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
-#include <sys/socket.h>
-#include <sys/stat.h>
 #include <sys/time.h>
-#include <sys/types.h>
 #include <time.h>
-#include <unistd.h>
 
-int g_sockfd;                  // CAN socket FD
+static Iso14229SocketCAN g_can; // batched CAN_RAW socket
 bool port_should_exit = false; // flag for shutting down
 
+// 内核只转发服务器和客户端使用的ID
+// the kernel only passes the IDs the example server and client listen on
+static const uint32_t rxIds[] = {SRV_PHYS_RECV_ID, SRV_FUNC_RECV_ID, SRV_SEND_ID};
+
 /**
  * @brief poll for CAN messages
- * @return 0 if message is present, -1 otherwise
  */
 enum Iso14229CANRxStatus portCANRxPoll(uint32_t *arb_id, uint8_t *data, uint8_t *size) {
-    struct can_frame frame = {0};
-    int nbytes = read(g_sockfd, &frame, sizeof(struct can_frame));
-    if (nbytes < 0) {
-        if (EAGAIN == errno || EWOULDBLOCK == errno) {
-            return kCANRxNone;
-        } else {
-            perror("Read err");
-            exit(-1);
-        }
-    }
-    *arb_id = frame.can_id;
-    *size = frame.can_dlc;
-    memmove(data, frame.data, *size);
-    return kCANRxSome;
+    return Iso14229SocketCANRxPoll(&g_can, arb_id, data, size);
 }
 
-struct sigaction action;
-struct sockaddr_can addr;
-struct ifreq ifr;
-struct stat fd_stat;
-FILE *fd;
+static struct sigaction action;
 
 /**
- * @brief close file descriptor on SIGINT
+ * @brief stop the loops on SIGINT
  * @param signum
  */
 void teardown(int signum) {
     (void)signum;
-    if (close(g_sockfd) < 0) {
-        perror("failed to close socket");
-        exit(-1);
-    }
     port_should_exit = true;
 }
 
+/**
+ * @brief queue a frame. It is sent by the next portWaitRx() or portYieldms()
+ */
 int portSendCAN(const uint32_t arbitration_id, const uint8_t *data, const uint8_t size) {
-    struct can_frame frame = {0};
-
-    frame.can_id = arbitration_id;
-    frame.can_dlc = size;
-    memmove(frame.data, data, size);
-
-    if (write(g_sockfd, &frame, sizeof(struct can_frame)) != sizeof(struct can_frame)) {
-        perror("Write err");
-        exit(-1);
-    }
-    printf("send> 0x%03x: ", arbitration_id);
-    PRINTHEX(data, size);
-    return 0;
+    return Iso14229SocketCANTransmit(&g_can, arbitration_id, data, size);
 }
 
 void portSetup(int ac, char **av) {
+    int err;
+
     memset(&action, 0, sizeof(action));
     action.sa_handler = teardown;
     sigaction(SIGINT, &action, NULL);
 
-    if ((g_sockfd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW)) < 0) {
-        perror("Socket");
-        exit(-1);
-    }
-
     if (ac < 2) {
         printf("usage: %s [socketCAN link]\n", av[0]);
         exit(-1);
     }
 
-    strcpy(ifr.ifr_name, av[1]);
-    ioctl(g_sockfd, SIOCGIFINDEX, &ifr);
-
-    memset(&addr, 0, sizeof(addr));
-    addr.can_family = AF_CAN;
-    addr.can_ifindex = ifr.ifr_ifindex;
-
-    if (bind(g_sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("Bind");
+    err = Iso14229SocketCANOpen(&g_can, av[1], rxIds, sizeof(rxIds) / sizeof(rxIds[0]), false);
+    if (err) {
+        fprintf(stderr, "failed to open %s: %s\n", av[1], strerror(-err));
         exit(-1);
     }
 
-    // Try sending a message. This will fail if the network is down.
-    portSendCAN(0x111, (uint8_t[4]){1, 2, 3, 4}, 4);
-
     printf("listening on %s\n", av[1]);
 }
 
@@ -122,19 +76,25 @@ void portYieldms(uint32_t tms) {
     struct timespec ts;
     int ret;
 
+    Iso14229SocketCANFlush(&g_can);
+
     ts.tv_sec = tms / 1000;
     ts.tv_nsec = (tms % 1000) * 1000000;
 
     do {
         ret = nanosleep(&ts, &ts);
     } while (ret && errno == EINTR);
-
-    // return ret;
 }
 
+/**
+ * @brief send the queued frames, then block until the CAN socket is readable or timeout_ms has
+ * elapsed
+ */
+void portWaitRx(uint32_t timeout_ms) { Iso14229SocketCANWait(&g_can, timeout_ms); }
+
 void isotp_user_debug(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
     vprintf(fmt, ap);
     va_end(ap);
-}
\ No newline at end of file
+}
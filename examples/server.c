@@ -30,8 +30,8 @@ static enum Iso14229ResponseCode wdbiHandler(const struct Iso14229ServerStatus *
 
 static uint8_t isotpPhysRecvBuf[ISOTP_BUFSIZE];
 static uint8_t isotpPhysSendBuf[ISOTP_BUFSIZE];
-static uint8_t isotpFuncRecvBuf[ISOTP_BUFSIZE];
-static uint8_t isotpFuncSendBuf[ISOTP_BUFSIZE];
+// functional requests are single frames. Their responses are sent from isotpPhysSendBuf
+static uint8_t isotpFuncRecvBuf[ISO_TP_MAX_DL];
 static IsoTpLink isotpPhysLink;
 static IsoTpLink isotpFuncLink;
 
@@ -47,8 +47,6 @@ static const Iso14229ServerConfig cfg = {
     .phys_link_send_buf_size = sizeof(isotpPhysSendBuf),
     .func_link_receive_buffer = isotpFuncRecvBuf,
     .func_link_recv_buf_size = sizeof(isotpFuncRecvBuf),
-    .func_link_send_buffer = isotpFuncSendBuf,
-    .func_link_send_buf_size = sizeof(isotpFuncSendBuf),
     .userGetms = portGetms,
     .userCANTransmit = portSendCAN,
     .userCANRxPoll = portCANRxPoll,
@@ -225,7 +223,10 @@ int run_server_blocking() {
         if (ecu_reset_scheduled && Iso14229TimeAfter(ecu_reset_timer, portGetms())) {
             mockECUReset();
         }
-        portYieldms(10);
+        // sleep until a CAN frame arrives or the server has work to do. Wake up at least every
+        // 100ms to check port_should_exit and the ECU reset
+        uint32_t timeout = Iso14229ServerGetTimeoutms(&srv);
+        portWaitRx(timeout < 100 ? timeout : 100);
     }
     printf("server exiting\n");
     return 0;
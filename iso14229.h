@@ -2,6 +2,7 @@
 #define ISO14229_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include "isotp-c/isotp.h"
 
@@ -33,11 +34,30 @@ library
 #define ISO14229_0X10_RESP_LEN 6U
 #define ISO14229_0X11_REQ_MIN_LEN 2U
 #define ISO14229_0X11_RESP_BASE_LEN 2U
+#define ISO14229_0X14_REQ_MIN_LEN 4U
+#define ISO14229_0X14_RESP_LEN 1U
+#define ISO14229_0X19_REQ_MIN_LEN 2U
+#define ISO14229_0X19_REQ_BY_DTC_LEN 6U // reportType, DTC, recordNumber
+#define ISO14229_0X19_DTC_FORMAT_ISO14229_1 0x01U // DTCFormatIdentifier, ISO14229-1 2013 Table 97
 #define ISO14229_0X22_RESP_BASE_LEN 1U
+#define ISO14229_0X23_REQ_MIN_LEN 4U
+#define ISO14229_0X23_REQ_BASE_LEN 2U
+#define ISO14229_0X23_RESP_BASE_LEN 1U
 #define ISO14229_0X27_REQ_BASE_LEN 2U
 #define ISO14229_0X27_RESP_BASE_LEN 2U
 #define ISO14229_0X28_REQ_BASE_LEN 3U
 #define ISO14229_0X28_RESP_LEN 2U
+#define ISO14229_0X2A_REQ_MIN_LEN 2U
+#define ISO14229_0X2A_RESP_LEN 1U
+#define ISO14229_0X2A_DID_BASE 0xF200U // periodicDataIdentifier n reads DataIdentifier 0xF2nn
+#define ISO14229_0X2A_MAX_RECORD_LEN 7U // a periodic message is one classic CAN frame
+#define ISO14229_0X2C_REQ_MIN_LEN 2U
+#define ISO14229_0X2C_REQ_DEFINE_BASE_LEN 4U
+#define ISO14229_0X2C_SOURCE_LEN 4U // sourceDataIdentifier, positionInSourceDataRecord, memorySize
+#define ISO14229_0X2C_RESP_BASE_LEN 2U
+#define ISO14229_0X2C_REQ_DEFINE_BY_ADDRESS_BASE_LEN 5U // ..., addressAndLengthFormatIdentifier
+#define ISO14229_DYNAMIC_DID_MIN 0xF200U // ISO14229-1 2013 Table C.1
+#define ISO14229_DYNAMIC_DID_MAX 0xF3FFU
 #define ISO14229_0X2E_REQ_BASE_LEN 3U
 #define ISO14229_0X2E_REQ_MIN_LEN 4U
 #define ISO14229_0X2E_RESP_LEN 3U
@@ -45,50 +65,79 @@ library
 #define ISO14229_0X31_RESP_MIN_LEN 4U
 #define ISO14229_0X34_REQ_BASE_LEN 3U
 #define ISO14229_0X34_RESP_BASE_LEN 2U
+#define ISO14229_0X35_REQ_BASE_LEN 3U
 #define ISO14229_0X36_REQ_BASE_LEN 2U
 #define ISO14229_0X36_RESP_BASE_LEN 2U
 #define ISO14229_0X37_RESP_BASE_LEN 1U
+#define ISO14229_0X3D_REQ_MIN_LEN 5U
+#define ISO14229_0X3D_REQ_BASE_LEN 2U
+#define ISO14229_0X3D_RESP_BASE_LEN 2U
 #define ISO14229_0X3E_REQ_MIN_LEN 2U
 #define ISO14229_0X3E_RESP_LEN 2U
 #define ISO14229_0X85_REQ_BASE_LEN 2U
 #define ISO14229_0X85_RESP_LEN 2U
 
 /**
- * @brief List of tuples of (SID_IDENTIFIER, SID, internalHandlerFunction) for all services
+ * @brief bit of a diagnostic session in the allowed sessions mask of a service. Sessions 0x08 and
+ * above share bit 0.
+ */
+#define ISO14229_SESSION_BIT(sessionType) ((sessionType) < 8 ? (1U << (sessionType)) : 1U)
+#define ISO14229_ALL_SESSIONS 0xFFU
+#define ISO14229_NON_DEFAULT_SESSIONS                                                              \
+    (ISO14229_ALL_SESSIONS & ~ISO14229_SESSION_BIT(kDefaultSession))
+
+/**
+ * @brief List of tuples of (SID_IDENTIFIER, SID, internalHandlerFunction, hasSubFunction,
+ * minimumRequestLength, allowedSessions) for all services.
  * services with a NULL internalHandlerFunction are currently unsupported.
  */
 #define ISO14229_SID_LIST                                                                          \
-    X(DIAGNOSTIC_SESSION_CONTROL, 0x10, _0x10_DiagnosticSessionControl)                            \
-    X(ECU_RESET, 0x11, _0x11_ECUReset)                                                             \
-    X(CLEAR_DIAGNOSTIC_INFORMATION, 0x14, NULL)                                                    \
-    X(READ_DTC_INFORMATION, 0x19, NULL)                                                            \
-    X(READ_DATA_BY_IDENTIFIER, 0x22, _0x22_ReadDataByIdentifier)                                   \
-    X(READ_MEMORY_BY_ADDRESS, 0x23, NULL)                                                          \
-    X(READ_SCALING_DATA_BY_IDENTIFIER, 0x24, NULL)                                                 \
-    X(SECURITY_ACCESS, 0x27, _0x27_SecurityAccess)                                                 \
-    X(COMMUNICATION_CONTROL, 0x28, _0x28_CommunicationControl)                                     \
-    X(READ_PERIODIC_DATA_BY_IDENTIFIER, 0x2A, NULL)                                                \
-    X(DYNAMICALLY_DEFINE_DATA_IDENTIFIER, 0x2C, NULL)                                              \
-    X(WRITE_DATA_BY_IDENTIFIER, 0x2E, _0x2E_WriteDataByIdentifier)                                 \
-    X(INPUT_CONTROL_BY_IDENTIFIER, 0x2F, NULL)                                                     \
-    X(ROUTINE_CONTROL, 0x31, _0x31_RoutineControl)                                                 \
-    X(REQUEST_DOWNLOAD, 0x34, _0x34_RequestDownload)                                               \
-    X(REQUEST_UPLOAD, 0x35, NULL)                                                                  \
-    X(TRANSFER_DATA, 0x36, _0x36_TransferData)                                                     \
-    X(REQUEST_TRANSFER_EXIT, 0x37, _0x37_RequestTransferExit)                                      \
-    X(REQUEST_FILE_TRANSFER, 0x38, NULL)                                                           \
-    X(WRITE_MEMORY_BY_ADDRESS, 0x3D, NULL)                                                         \
-    X(TESTER_PRESENT, 0x3E, _0x3E_TesterPresent)                                                   \
-    X(ACCESS_TIMING_PARAMETER, 0x83, NULL)                                                         \
-    X(SECURED_DATA_TRANSMISSION, 0x84, NULL)                                                       \
-    X(CONTROL_DTC_SETTING, 0x85, _0x85_ControlDTCSetting)                                          \
-    X(RESPONSE_ON_EVENT, 0x86, NULL)
-
-#define X(str_ident, sid, func) kSID_##str_ident = sid,
+    X(DIAGNOSTIC_SESSION_CONTROL, 0x10, _0x10_DiagnosticSessionControl, 1, 2,                      \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(ECU_RESET, 0x11, _0x11_ECUReset, 1, ISO14229_0X11_REQ_MIN_LEN, ISO14229_ALL_SESSIONS)        \
+    X(CLEAR_DIAGNOSTIC_INFORMATION, 0x14, _0x14_ClearDiagnosticInformation, 0,                     \
+      ISO14229_0X14_REQ_MIN_LEN, ISO14229_ALL_SESSIONS)                                            \
+    X(READ_DTC_INFORMATION, 0x19, _0x19_ReadDTCInformation, 1, ISO14229_0X19_REQ_MIN_LEN,          \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(READ_DATA_BY_IDENTIFIER, 0x22, _0x22_ReadDataByIdentifier, 0, 1, ISO14229_ALL_SESSIONS)      \
+    X(READ_MEMORY_BY_ADDRESS, 0x23, _0x23_ReadMemoryByAddress, 0, ISO14229_0X23_REQ_MIN_LEN,       \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(READ_SCALING_DATA_BY_IDENTIFIER, 0x24, NULL, 0, 1, ISO14229_ALL_SESSIONS)                    \
+    X(SECURITY_ACCESS, 0x27, _0x27_SecurityAccess, 1, ISO14229_0X27_REQ_BASE_LEN,                  \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(COMMUNICATION_CONTROL, 0x28, _0x28_CommunicationControl, 1, ISO14229_0X28_REQ_BASE_LEN,      \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(READ_PERIODIC_DATA_BY_IDENTIFIER, 0x2A, _0x2A_ReadDataByPeriodicIdentifier, 0,               \
+      ISO14229_0X2A_REQ_MIN_LEN, ISO14229_NON_DEFAULT_SESSIONS)                                    \
+    X(DYNAMICALLY_DEFINE_DATA_IDENTIFIER, 0x2C, _0x2C_DynamicallyDefineDataIdentifier, 1,          \
+      ISO14229_0X2C_REQ_MIN_LEN, ISO14229_ALL_SESSIONS)                                            \
+    X(WRITE_DATA_BY_IDENTIFIER, 0x2E, _0x2E_WriteDataByIdentifier, 0, ISO14229_0X2E_REQ_MIN_LEN,   \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(INPUT_CONTROL_BY_IDENTIFIER, 0x2F, NULL, 0, 1, ISO14229_ALL_SESSIONS)                        \
+    X(ROUTINE_CONTROL, 0x31, _0x31_RoutineControl, 1, ISO14229_0X31_REQ_MIN_LEN,                   \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(REQUEST_DOWNLOAD, 0x34, _0x34_RequestDownload, 0, 1, ISO14229_ALL_SESSIONS)                  \
+    X(REQUEST_UPLOAD, 0x35, _0x35_RequestUpload, 0, ISO14229_0X35_REQ_BASE_LEN,                    \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(TRANSFER_DATA, 0x36, _0x36_TransferData, 0, ISO14229_0X36_REQ_BASE_LEN,                      \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(REQUEST_TRANSFER_EXIT, 0x37, _0x37_RequestTransferExit, 0, 1, ISO14229_ALL_SESSIONS)         \
+    X(REQUEST_FILE_TRANSFER, 0x38, NULL, 0, 1, ISO14229_ALL_SESSIONS)                              \
+    X(WRITE_MEMORY_BY_ADDRESS, 0x3D, _0x3D_WriteMemoryByAddress, 0, ISO14229_0X3D_REQ_MIN_LEN,     \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(TESTER_PRESENT, 0x3E, _0x3E_TesterPresent, 1, ISO14229_0X3E_REQ_MIN_LEN,                     \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(ACCESS_TIMING_PARAMETER, 0x83, NULL, 1, 2, ISO14229_ALL_SESSIONS)                            \
+    X(SECURED_DATA_TRANSMISSION, 0x84, NULL, 0, 1, ISO14229_ALL_SESSIONS)                          \
+    X(CONTROL_DTC_SETTING, 0x85, _0x85_ControlDTCSetting, 1, ISO14229_0X85_REQ_BASE_LEN,           \
+      ISO14229_ALL_SESSIONS)                                                                       \
+    X(RESPONSE_ON_EVENT, 0x86, NULL, 1, 2, ISO14229_ALL_SESSIONS)
+
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions) kSID_##str_ident = sid,
 enum Iso14229DiagnosticServiceId { ISO14229_SID_LIST };
 #undef X
 
-#define X(str_ident, sid, func) k##str_ident##_IDX,
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions) k##str_ident##_IDX,
 enum Iso14229DiagnosticServiceCallbackIdx {
     ISO14229_SID_LIST kISO14229_SID_NOT_SUPPORTED,
 };
@@ -202,6 +251,37 @@ enum RoutineControlType {
     kRequestRoutineResults = 3,
 };
 
+/**
+ * @brief ISO14229-1 2013 Table C.10 transmissionMode of ReadDataByPeriodicIdentifier (0x2A)
+ */
+enum Iso14229PeriodicTransmissionMode {
+    kSendAtSlowRate = 1,
+    kSendAtMediumRate = 2,
+    kSendAtFastRate = 3,
+    kStopSending = 4,
+};
+
+/**
+ * @brief ISO14229-1 2013 Table 72 sub-functions of DynamicallyDefineDataIdentifier (0x2C)
+ */
+enum Iso14229DDDISubFunction {
+    kDefineByIdentifier = 1,
+    kDefineByMemoryAddress = 2,
+    kClearDynamicallyDefinedDataIdentifier = 3,
+};
+
+/**
+ * @brief ISO14229-1 2013 Table 272 reportTypes of ReadDTCInformation (0x19) the server supports
+ */
+enum Iso14229DTCReportType {
+    kReportNumberOfDTCByStatusMask = 0x01,
+    kReportDTCByStatusMask = 0x02,
+    kReportDTCSnapshotIdentification = 0x03,
+    kReportDTCSnapshotRecordByDTCNumber = 0x04,
+    kReportDTCExtDataRecordByDTCNumber = 0x06,
+    kReportSupportedDTC = 0x0A,
+};
+
 /**
  * @addtogroup controlDTCSetting_0x85
  */
@@ -239,4 +319,68 @@ static inline bool Iso14229TimeAfter(uint32_t a, uint32_t b) {
     return ((int32_t)((int32_t)(b) - (int32_t)(a)) < 0);
 }
 
+/* returns the milliseconds until `deadline` has passed in the sense of Iso14229TimeAfter() */
+static inline uint32_t Iso14229TimeUntil(uint32_t now, uint32_t deadline) {
+    return Iso14229TimeAfter(now, deadline) ? 0 : deadline - now + 1;
+}
+
+/**
+ * @brief \~chinese 地址和长度格式标识符的字节数 \~english number of bytes of the memoryAddress and
+ * memorySize parameters described by an addressAndLengthFormatIdentifier (ISO14229-1 2013 Table
+ * H.1): the memorySize length in the high nibble, the memoryAddress length in the low nibble
+ * @return 0 if either length is 0 or does not fit a size_t
+ */
+static inline uint8_t Iso14229ALFIDLength(uint8_t addressAndLengthFormatIdentifier) {
+    uint8_t sizeLen = addressAndLengthFormatIdentifier >> 4;
+    uint8_t addressLen = addressAndLengthFormatIdentifier & 0x0F;
+    if (0 == sizeLen || 0 == addressLen || sizeLen > sizeof(size_t) ||
+        addressLen > sizeof(size_t)) {
+        return 0;
+    }
+    return sizeLen + addressLen;
+}
+
+/**
+ * @brief \~chinese 解析地址和长度 \~english decodes the big-endian memoryAddress and memorySize
+ * @param buf the memoryAddress followed by the memorySize: Iso14229ALFIDLength() bytes
+ */
+static inline void Iso14229DecodeALFID(uint8_t addressAndLengthFormatIdentifier,
+                                       const uint8_t *buf, size_t *memoryAddress,
+                                       size_t *memorySize) {
+    uint8_t sizeLen = addressAndLengthFormatIdentifier >> 4;
+    uint8_t addressLen = addressAndLengthFormatIdentifier & 0x0F;
+    size_t value = 0;
+
+    for (uint8_t i = 0; i < addressLen; i++) {
+        value = (value << 8) | *buf++;
+    }
+    *memoryAddress = value;
+    value = 0;
+    for (uint8_t i = 0; i < sizeLen; i++) {
+        value = (value << 8) | *buf++;
+    }
+    *memorySize = value;
+}
+
+/**
+ * @brief \~chinese 打包地址和长度 \~english encodes the memoryAddress and memorySize big-endian,
+ * truncated or zero-padded to the lengths in addressAndLengthFormatIdentifier
+ * @return the number of bytes written
+ */
+static inline uint8_t Iso14229EncodeALFID(uint8_t addressAndLengthFormatIdentifier, uint8_t *buf,
+                                          size_t memoryAddress, size_t memorySize) {
+    uint8_t sizeLen = addressAndLengthFormatIdentifier >> 4;
+    uint8_t addressLen = addressAndLengthFormatIdentifier & 0x0F;
+
+    for (uint8_t i = addressLen; i > 0; i--) {
+        buf[i - 1] = memoryAddress & 0xFF;
+        memoryAddress >>= 8;
+    }
+    for (uint8_t i = sizeLen; i > 0; i--) {
+        buf[addressLen + i - 1] = memorySize & 0xFF;
+        memorySize >>= 8;
+    }
+    return addressLen + sizeLen;
+}
+
 #endif
@@ -0,0 +1,69 @@
+#ifndef ISO14229ATOMIC_H
+#define ISO14229ATOMIC_H
+
+/**
+ * @brief \~chinese 无锁交接的获取/释放操作 \~english Acquire loads and release stores of the
+ * lock-free hand-offs (Iso14229CANRxRing, Iso14229ServerJob).
+ *
+ * A release store publishes every write made before it, including plain ones such as the frame a
+ * producer copied into the ring or the result of a job: a context that sees the stored value with
+ * an acquire load also sees those writes. GCC and clang use their __atomic builtins. Other
+ * compilers need C11 <stdatomic.h>: the fences order the plain accesses against the volatile load
+ * or store. Without it, define ISO14229_FENCE_ACQUIRE() and ISO14229_FENCE_RELEASE() as memory
+ * barriers of the target; on single core targets a compiler barrier is enough. volatile alone is
+ * not: the compiler may move plain accesses across a volatile one.
+ */
+
+#include <stdint.h>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ISO14229_ATOMIC_BUILTINS 1
+#elif defined(ISO14229_FENCE_ACQUIRE) && defined(ISO14229_FENCE_RELEASE)
+// user-provided barriers
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define ISO14229_FENCE_ACQUIRE() atomic_thread_fence(memory_order_acquire)
+#define ISO14229_FENCE_RELEASE() atomic_thread_fence(memory_order_release)
+#else
+#error "define ISO14229_FENCE_ACQUIRE() and ISO14229_FENCE_RELEASE() as memory barriers"
+#endif
+
+static inline uint8_t Iso14229LoadAcquire8(const uint8_t *p) {
+#ifdef ISO14229_ATOMIC_BUILTINS
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+    uint8_t v = *(const volatile uint8_t *)p;
+    ISO14229_FENCE_ACQUIRE(); // later accesses stay after the load
+    return v;
+#endif
+}
+
+static inline void Iso14229StoreRelease8(uint8_t *p, uint8_t v) {
+#ifdef ISO14229_ATOMIC_BUILTINS
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#else
+    ISO14229_FENCE_RELEASE(); // earlier accesses stay before the store
+    *(volatile uint8_t *)p = v;
+#endif
+}
+
+static inline uint16_t Iso14229LoadAcquire16(const uint16_t *p) {
+#ifdef ISO14229_ATOMIC_BUILTINS
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#else
+    uint16_t v = *(const volatile uint16_t *)p;
+    ISO14229_FENCE_ACQUIRE(); // later accesses stay after the load
+    return v;
+#endif
+}
+
+static inline void Iso14229StoreRelease16(uint16_t *p, uint16_t v) {
+#ifdef ISO14229_ATOMIC_BUILTINS
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#else
+    ISO14229_FENCE_RELEASE(); // earlier accesses stay before the store
+    *(volatile uint16_t *)p = v;
+#endif
+}
+
+#endif
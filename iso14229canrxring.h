@@ -0,0 +1,94 @@
+#ifndef ISO14229CANRXRING_H
+#define ISO14229CANRXRING_H
+
+/**
+ * @brief \~chinese 单生产者单消费者CAN接收环形缓冲器 \~english Single-producer single-consumer
+ * CAN receive ring.
+ *
+ * The producer (a CAN RX interrupt or a driver thread) calls Iso14229CANRxRingPush() for every
+ * received frame. The consumer (Iso14229ServerPoll) reads frames in place with
+ * Iso14229CANRxRingPeek() and frees them with Iso14229CANRxRingPop(). Neither side takes a lock:
+ * the producer only writes `head`, the consumer only writes `tail`. `head` is stored with release
+ * semantics after the frame is written, see iso14229atomic.h for the requirements on compilers
+ * other than GCC and clang.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "iso14229atomic.h"
+#include "isotp-c/isotp.h"
+
+/**
+ * @brief number of frames the ring can hold. Must be a power of two.
+ */
+#ifndef ISO14229_CAN_RX_RING_SIZE
+#define ISO14229_CAN_RX_RING_SIZE 32
+#endif
+
+#if (ISO14229_CAN_RX_RING_SIZE & (ISO14229_CAN_RX_RING_SIZE - 1)) != 0
+#error "ISO14229_CAN_RX_RING_SIZE must be a power of two"
+#endif
+
+struct Iso14229CANFrame {
+    uint32_t arb_id;
+    uint8_t size;
+    uint8_t data[ISO_TP_MAX_DL];
+};
+
+typedef struct {
+    struct Iso14229CANFrame frames[ISO14229_CAN_RX_RING_SIZE];
+    uint16_t head;    // written by the producer only. Free-running
+    uint16_t tail;    // written by the consumer only. Free-running
+    uint32_t dropped; // frames the producer could not push because the ring was full
+} Iso14229CANRxRing;
+
+static inline void Iso14229CANRxRingInit(Iso14229CANRxRing *ring) {
+    memset(ring, 0, sizeof(*ring));
+}
+
+/**
+ * @brief \~chinese 生产者：存入一帧 \~english Producer: store a frame
+ * @return false if the frame was dropped because the ring is full or the frame is too long
+ */
+static inline bool Iso14229CANRxRingPush(Iso14229CANRxRing *ring, uint32_t arb_id,
+                                         const uint8_t *data, uint8_t size) {
+    uint16_t head = ring->head;
+    uint16_t tail = Iso14229LoadAcquire16(&ring->tail);
+    struct Iso14229CANFrame *frame;
+
+    if ((uint16_t)(head - tail) >= ISO14229_CAN_RX_RING_SIZE || size > ISO_TP_MAX_DL) {
+        ring->dropped++;
+        return false;
+    }
+
+    frame = &ring->frames[head & (ISO14229_CAN_RX_RING_SIZE - 1)];
+    frame->arb_id = arb_id;
+    frame->size = size;
+    memcpy(frame->data, data, size);
+    Iso14229StoreRelease16(&ring->head, (uint16_t)(head + 1));
+    return true;
+}
+
+/**
+ * @brief \~chinese 消费者：读取最旧的一帧（不复制） \~english Consumer: get the oldest frame
+ * without copying it
+ * @return pointer to the frame, valid until Iso14229CANRxRingPop() is called. NULL if empty
+ */
+static inline const struct Iso14229CANFrame *Iso14229CANRxRingPeek(Iso14229CANRxRing *ring) {
+    uint16_t tail = ring->tail;
+    if (tail == Iso14229LoadAcquire16(&ring->head)) {
+        return NULL;
+    }
+    return &ring->frames[tail & (ISO14229_CAN_RX_RING_SIZE - 1)];
+}
+
+/**
+ * @brief \~chinese 消费者：释放最旧的一帧 \~english Consumer: release the frame returned by
+ * Iso14229CANRxRingPeek()
+ */
+static inline void Iso14229CANRxRingPop(Iso14229CANRxRing *ring) {
+    Iso14229StoreRelease16(&ring->tail, (uint16_t)(ring->tail + 1));
+}
+
+#endif
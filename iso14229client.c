@@ -41,16 +41,26 @@ void iso14229ClientInit(Iso14229Client *client, const struct Iso14229ClientConfi
                     cfg->link_receive_buffer, cfg->link_recv_buf_size, cfg->userGetms,
                     cfg->userCANTransmit, cfg->userDebug);
 
+    if (cfg->link_tx_dl) {
+        int err = isotp_set_tx_dl(cfg->link, cfg->link_tx_dl);
+        assert(ISOTP_RET_OK == err);
+        (void)err;
+    }
+
     client->phys_send_id = cfg->phys_send_id;
     client->func_send_id = cfg->func_send_id;
     client->recv_id = cfg->recv_id;
     client->p2_ms = cfg->p2_ms;
     client->p2_star_ms = cfg->p2_star_ms;
     client->yield_period_ms = cfg->yield_period_ms;
+    client->tester_present_ms = cfg->tester_present_ms;
+    client->tester_present_timer = cfg->userGetms() + cfg->tester_present_ms;
     client->link = cfg->link;
     client->userGetms = cfg->userGetms;
     client->userCANRxPoll = cfg->userCANRxPoll;
+    client->rxRing = cfg->rxRing;
     client->userYieldms = cfg->userYieldms;
+    client->userWaitRx = cfg->userWaitRx;
 
     clearRequestContext(client);
 }
@@ -68,6 +78,8 @@ static enum Iso14229ClientError _SendRequest(Iso14229Client *client) {
                                                client->req.len)) {
             return kISO14229_CLIENT_ERR_REQ_NOT_SENT_TPORT_ERR;
         }
+        // 功能请求也能保持会话
+        client->tester_present_timer = client->userGetms() + client->tester_present_ms;
     } else {
         if (ISOTP_RET_OK != isotp_send(client->link, client->req.buf, client->req.len)) {
             return kISO14229_CLIENT_ERR_REQ_NOT_SENT_TPORT_ERR;
@@ -78,7 +90,7 @@ static enum Iso14229ClientError _SendRequest(Iso14229Client *client) {
 }
 
 #define PRE_REQUEST_CHECK()                                                                        \
-    if (kRequestStateIdle != client->state) {                                                      \
+    if (kRequestStateIdle != client->state || client->queueCount) {                                \
         return kISO14229_CLIENT_ERR_REQ_NOT_SENT_SEND_IN_PROGRESS;                                 \
     }                                                                                              \
     clearRequestContext(client);
@@ -191,6 +203,28 @@ enum Iso14229ClientError RoutineControl(Iso14229Client *client, enum RoutineCont
     return _SendRequest(client);
 }
 
+/**
+ * @brief packs the shared request format of 0x34 RequestDownload and 0x35 RequestUpload
+ */
+static enum Iso14229ClientError _RequestMemory(Iso14229Client *client, uint8_t sid,
+                                               uint8_t dataFormatIdentifier,
+                                               uint8_t addressAndLengthFormatIdentifier,
+                                               size_t memoryAddress, size_t memorySize) {
+    PRE_REQUEST_CHECK();
+    struct Iso14229Request *req = &client->req;
+    if (0 == Iso14229ALFIDLength(addressAndLengthFormatIdentifier)) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS;
+    }
+
+    req->buf[0] = sid;
+    req->buf[1] = dataFormatIdentifier;
+    req->buf[2] = addressAndLengthFormatIdentifier;
+    req->len = ISO14229_0X34_REQ_BASE_LEN +
+               Iso14229EncodeALFID(addressAndLengthFormatIdentifier,
+                                   &req->buf[ISO14229_0X34_REQ_BASE_LEN], memoryAddress, memorySize);
+    return _SendRequest(client);
+}
+
 /**
  * @brief
  *
@@ -205,28 +239,86 @@ enum Iso14229ClientError RoutineControl(Iso14229Client *client, enum RoutineCont
 enum Iso14229ClientError RequestDownload(Iso14229Client *client, uint8_t dataFormatIdentifier,
                                          uint8_t addressAndLengthFormatIdentifier,
                                          size_t memoryAddress, size_t memorySize) {
-    PRE_REQUEST_CHECK();
-    struct Iso14229Request *req = &client->req;
-    uint8_t numMemorySizeBytes = (addressAndLengthFormatIdentifier & 0xF0) >> 4;
-    uint8_t numMemoryAddressBytes = addressAndLengthFormatIdentifier & 0x0F;
-
-    req->buf[0] = kSID_REQUEST_DOWNLOAD;
-    req->buf[1] = dataFormatIdentifier;
-    req->buf[2] = addressAndLengthFormatIdentifier;
+    return _RequestMemory(client, kSID_REQUEST_DOWNLOAD, dataFormatIdentifier,
+                          addressAndLengthFormatIdentifier, memoryAddress, memorySize);
+}
 
-    uint8_t *ptr = &req->buf[ISO14229_0X34_REQ_BASE_LEN];
+/**
+ * @brief
+ *
+ * @param client
+ * @param dataFormatIdentifier
+ * @param addressAndLengthFormatIdentifier
+ * @param memoryAddress
+ * @param memorySize
+ * @return enum Iso14229ClientError
+ * @addtogroup requestUpload_0x35
+ */
+enum Iso14229ClientError RequestUpload(Iso14229Client *client, uint8_t dataFormatIdentifier,
+                                       uint8_t addressAndLengthFormatIdentifier,
+                                       size_t memoryAddress, size_t memorySize) {
+    return _RequestMemory(client, kSID_REQUEST_UPLOAD, dataFormatIdentifier,
+                          addressAndLengthFormatIdentifier, memoryAddress, memorySize);
+}
 
-    for (int i = numMemoryAddressBytes - 1; i >= 0; i--) {
-        *ptr = (memoryAddress & (0xFF << (8 * i))) >> (8 * i);
-        ptr++;
+/**
+ * @brief
+ *
+ * @param client
+ * @param addressAndLengthFormatIdentifier
+ * @param memoryAddress
+ * @param memorySize
+ * @return enum Iso14229ClientError
+ * @addtogroup readMemoryByAddress_0x23
+ */
+enum Iso14229ClientError ReadMemoryByAddress(Iso14229Client *client,
+                                             uint8_t addressAndLengthFormatIdentifier,
+                                             size_t memoryAddress, size_t memorySize) {
+    PRE_REQUEST_CHECK();
+    struct Iso14229Request *req = &client->req;
+    if (0 == Iso14229ALFIDLength(addressAndLengthFormatIdentifier)) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS;
     }
+    req->buf[0] = kSID_READ_MEMORY_BY_ADDRESS;
+    req->buf[1] = addressAndLengthFormatIdentifier;
+    req->len = ISO14229_0X23_REQ_BASE_LEN +
+               Iso14229EncodeALFID(addressAndLengthFormatIdentifier,
+                                   &req->buf[ISO14229_0X23_REQ_BASE_LEN], memoryAddress, memorySize);
+    return _SendRequest(client);
+}
 
-    for (int i = numMemorySizeBytes - 1; i >= 0; i--) {
-        *ptr = (memorySize & (0xFF << (8 * i))) >> (8 * i);
-        ptr++;
+/**
+ * @brief
+ *
+ * @param client
+ * @param addressAndLengthFormatIdentifier
+ * @param memoryAddress
+ * @param data
+ * @param size
+ * @return enum Iso14229ClientError
+ * @addtogroup writeMemoryByAddress_0x3D
+ */
+enum Iso14229ClientError WriteMemoryByAddress(Iso14229Client *client,
+                                              uint8_t addressAndLengthFormatIdentifier,
+                                              size_t memoryAddress, const uint8_t *data,
+                                              uint16_t size) {
+    PRE_REQUEST_CHECK();
+    assert(data);
+    assert(size);
+    struct Iso14229Request *req = &client->req;
+    uint8_t alfidLen = Iso14229ALFIDLength(addressAndLengthFormatIdentifier);
+    if (0 == alfidLen) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS;
     }
-
-    req->len = ISO14229_0X34_REQ_BASE_LEN + numMemoryAddressBytes + numMemorySizeBytes;
+    if (ISO14229_0X3D_REQ_BASE_LEN + alfidLen + size > client->link->send_buf_size) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL;
+    }
+    req->buf[0] = kSID_WRITE_MEMORY_BY_ADDRESS;
+    req->buf[1] = addressAndLengthFormatIdentifier;
+    Iso14229EncodeALFID(addressAndLengthFormatIdentifier, &req->buf[ISO14229_0X3D_REQ_BASE_LEN],
+                        memoryAddress, size);
+    memmove(&req->buf[ISO14229_0X3D_REQ_BASE_LEN + alfidLen], data, size);
+    req->len = ISO14229_0X3D_REQ_BASE_LEN + alfidLen + size;
     return _SendRequest(client);
 }
 
@@ -249,7 +341,9 @@ enum Iso14229ClientError TransferData(Iso14229Client *client, uint8_t blockSeque
     struct Iso14229Request *req = &client->req;
     req->buf[0] = kSID_TRANSFER_DATA;
     req->buf[1] = blockSequenceCounter;
-    memmove(&req->buf[ISO14229_0X36_REQ_BASE_LEN], data, size);
+    if (size) { // upload requests carry no data
+        memmove(&req->buf[ISO14229_0X36_REQ_BASE_LEN], data, size);
+    }
     ISO14229USERDEBUG("size: %d, blocklength: %d\n", size, blockLength);
     req->len = ISO14229_0X36_REQ_BASE_LEN + size;
     return _SendRequest(client);
@@ -402,18 +496,13 @@ enum Iso14229ClientError UnpackRoutineControlResponse(Iso14229Client *client,
 }
 
 /**
- * @brief
- *
- * @param client
- * @param resp
- * @return enum Iso14229ClientError
- * @addtogroup requestDownload_0x34
+ * @brief unpacks the shared positive response format of 0x34 RequestDownload and 0x35 RequestUpload
  */
-enum Iso14229ClientError UnpackRequestDownloadResponse(const struct Iso14229Response *resp,
-                                                       struct RequestDownloadResponse *unpacked) {
+static enum Iso14229ClientError _UnpackMaxNumberOfBlockLength(const struct Iso14229Response *resp,
+                                                              uint8_t sid,
+                                                              size_t *maxNumberOfBlockLength) {
     assert(resp);
-    assert(unpacked);
-    if (ISO14229_RESPONSE_SID_OF(kSID_REQUEST_DOWNLOAD) != resp->buf[0]) {
+    if (ISO14229_RESPONSE_SID_OF(sid) != resp->buf[0]) {
         return kISO14229_CLIENT_ERR_RESP_SID_MISMATCH;
     }
     if (resp->len < ISO14229_0X34_RESP_BASE_LEN) {
@@ -421,19 +510,49 @@ enum Iso14229ClientError UnpackRequestDownloadResponse(const struct Iso14229Resp
     }
     uint8_t maxNumberOfBlockLengthSize = (resp->buf[1] & 0xF0) >> 4;
 
-    if (sizeof(unpacked->maxNumberOfBlockLength) < maxNumberOfBlockLengthSize) {
+    if (sizeof(*maxNumberOfBlockLength) < maxNumberOfBlockLengthSize) {
         ISO14229USERDEBUG("WARNING: sizeof(maxNumberOfBlockLength) > sizeof(size_t)");
         return kISO14229_CLIENT_ERR_RESP_CANNOT_UNPACK;
     }
-    unpacked->maxNumberOfBlockLength = 0;
+    *maxNumberOfBlockLength = 0;
     for (int byteIdx = 0; byteIdx < maxNumberOfBlockLengthSize; byteIdx++) {
         uint8_t byte = resp->buf[ISO14229_0X34_RESP_BASE_LEN + byteIdx];
         uint8_t shiftBytes = maxNumberOfBlockLengthSize - 1 - byteIdx;
-        unpacked->maxNumberOfBlockLength |= byte << (8 * shiftBytes);
+        *maxNumberOfBlockLength |= (size_t)byte << (8 * shiftBytes);
     }
     return kISO14229_CLIENT_OK;
 }
 
+/**
+ * @brief
+ *
+ * @param client
+ * @param resp
+ * @return enum Iso14229ClientError
+ * @addtogroup requestDownload_0x34
+ */
+enum Iso14229ClientError UnpackRequestDownloadResponse(const struct Iso14229Response *resp,
+                                                       struct RequestDownloadResponse *unpacked) {
+    assert(unpacked);
+    return _UnpackMaxNumberOfBlockLength(resp, kSID_REQUEST_DOWNLOAD,
+                                         &unpacked->maxNumberOfBlockLength);
+}
+
+/**
+ * @brief
+ *
+ * @param client
+ * @param resp
+ * @return enum Iso14229ClientError
+ * @addtogroup requestUpload_0x35
+ */
+enum Iso14229ClientError UnpackRequestUploadResponse(const struct Iso14229Response *resp,
+                                                     struct RequestUploadResponse *unpacked) {
+    assert(unpacked);
+    return _UnpackMaxNumberOfBlockLength(resp, kSID_REQUEST_UPLOAD,
+                                         &unpacked->maxNumberOfBlockLength);
+}
+
 /**
  * @brief Check that the response is a valid UDS response
  *
@@ -507,6 +626,78 @@ static inline void _ClientHandleResponse(Iso14229Client *client) {
     }
 }
 
+/**
+ * @brief Sends queued requests while the client is idle. A single frame request is finished when
+ * isotp_send() returns, so the next one can follow immediately. The result of the previous request
+ * stays in client->err
+ */
+static void _ClientSendQueuedRequests(Iso14229Client *client) {
+    enum Iso14229ClientError err = client->err;
+    while (client->queueCount && kRequestStateIdle == client->state &&
+           ISOTP_SEND_STATUS_INPROGRESS != client->link->send_status) {
+        const struct Iso14229QueuedRequest *q = &client->queue[client->queueHead];
+        clearRequestContext(client);
+        memmove(client->req.buf, q->buf, q->len);
+        client->req.len = q->len;
+        client->options = q->options;
+        if (kISO14229_CLIENT_OK != _SendRequest(client)) {
+            // 比如CAN发送邮箱满了：下次再发
+            client->options = client->defaultOptions;
+            break;
+        }
+        client->queueHead = (client->queueHead + 1) % ISO14229_CLIENT_REQUEST_QUEUE_SIZE;
+        client->queueCount--;
+        if (ISOTP_SEND_STATUS_IDLE == client->link->send_status) {
+            client->state = kRequestStateIdle;
+        }
+    }
+    client->err = err;
+}
+
+enum Iso14229ClientError Iso14229ClientQueueRequest(Iso14229Client *client, const uint8_t *data,
+                                                    uint16_t len,
+                                                    enum Iso14229ClientOptions options) {
+    assert(client);
+    if (NULL == data || 0 == len || !(options & SUPPRESS_POS_RESP)) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS;
+    }
+    if (len > ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN || len > client->link->send_buf_size) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL;
+    }
+    if (ISO14229_CLIENT_REQUEST_QUEUE_SIZE == client->queueCount) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_SEND_IN_PROGRESS;
+    }
+    uint8_t tail = (client->queueHead + client->queueCount) % ISO14229_CLIENT_REQUEST_QUEUE_SIZE;
+    struct Iso14229QueuedRequest *q = &client->queue[tail];
+    memmove(q->buf, data, len);
+    q->len = (uint8_t)len;
+    q->options = options;
+    client->queueCount++;
+    return kISO14229_CLIENT_OK;
+}
+
+/**
+ * @brief Sends the S3 keepalive (3E 80, functional) once tester_present_ms have passed since the
+ * last functional request. Only while no request is in progress, nothing is queued and the link
+ * is neither sending nor receiving, so it never delays a foreground request. The request context
+ * is not touched
+ */
+static void _ClientSendTesterPresent(Iso14229Client *client) {
+    static const uint8_t KEEPALIVE[] = {kSID_TESTER_PRESENT, 0x80};
+    uint32_t now = client->userGetms();
+
+    if (0 == client->tester_present_ms || kRequestStateIdle != client->state ||
+        client->queueCount || !Iso14229TimeAfter(now, client->tester_present_timer) ||
+        ISOTP_SEND_STATUS_INPROGRESS == client->link->send_status ||
+        ISOTP_RECEIVE_STATUS_IDLE != client->link->receive_status) {
+        return;
+    }
+    if (ISOTP_RET_OK == isotp_send_with_id(client->link, client->func_send_id, KEEPALIVE,
+                                           sizeof(KEEPALIVE))) {
+        client->tester_present_timer = now + client->tester_present_ms;
+    }
+}
+
 struct SMResult {
     enum Iso14229ClientRequestState state;
     enum Iso14229ClientError err;
@@ -593,14 +784,17 @@ static void _ClientProcessRequestState(Iso14229Client *client) {
     case kRequestStateSentAwaitResponse:
         break;
     case kRequestStateProcessResponse: {
-        if (ISOTP_RET_OK == isotp_receive(link, link->receive_buffer, link->receive_buf_size,
-                                          &link->receive_size)) {
-            client->resp.len = link->receive_size;
+        const uint8_t *payload;
+        uint16_t size;
+        if (ISOTP_RET_OK == isotp_receive_peek(link, &payload, &size)) {
+            client->resp.buf = payload;
+            client->resp.len = size;
             client->state = kRequestStateIdle;
             client->err = _ClientValidateResponse(client);
             if (kISO14229_CLIENT_OK == client->err) {
                 _ClientHandleResponse(client);
             }
+            isotp_receive_release(link);
         }
         break;
     }
@@ -612,34 +806,156 @@ static void _ClientProcessRequestState(Iso14229Client *client) {
 
 static void _ProcessCANRx(Iso14229Client *client) {
     uint32_t arb_id = 0;
-    uint8_t data[8] = {0}, size = 0;
+    uint8_t data[ISO_TP_MAX_DL] = {0}, size = 0;
+    if (client->rxRing) {
+        const struct Iso14229CANFrame *frame;
+        while ((frame = Iso14229CANRxRingPeek(client->rxRing))) {
+            if (frame->arb_id == client->recv_id) {
+                isotp_on_can_message(client->link, (uint8_t *)frame->data, frame->size);
+            }
+            Iso14229CANRxRingPop(client->rxRing);
+        }
+        return;
+    }
     while (kCANRxSome == client->userCANRxPoll(&arb_id, data, &size)) {
         if (arb_id == client->recv_id) {
             isotp_on_can_message(client->link, data, size);
         }
     }
-    isotp_poll(client->link);
 }
 
 void Iso14229ClientPoll(Iso14229Client *client) {
-    struct SMResult result;
     _ProcessCANRx(client);
+    Iso14229ClientProcess(client);
+}
+
+void Iso14229ClientProcess(Iso14229Client *client) {
+    struct SMResult result;
+    isotp_poll(client->link);
     result = _ClientGetNextRequestState(client);
     client->state = result.state;
     client->err = result.err;
-    if (result.err != kISO14229_CLIENT_OK) {
+    _ClientSendQueuedRequests(client);
+    _ClientSendTesterPresent(client);
+    if (client->err != kISO14229_CLIENT_OK) {
         return;
     }
     _ClientProcessRequestState(client);
 }
 
+uint32_t Iso14229ClientGetTimeoutms(Iso14229Client *client) {
+    uint32_t now = client->userGetms();
+    uint32_t timeout = client->yield_period_ms;
+    uint32_t deadline;
+
+    if (client->rxRing && Iso14229CANRxRingPeek(client->rxRing)) {
+        return 0;
+    }
+
+    switch (client->state) {
+    case kRequestStateIdle:
+        if (client->queueCount) {
+            return 0;
+        }
+        if (client->tester_present_ms &&
+            Iso14229TimeUntil(now, client->tester_present_timer) < timeout) {
+            timeout = Iso14229TimeUntil(now, client->tester_present_timer);
+        }
+        break;
+    case kRequestStateSent:
+    case kRequestStateProcessResponse:
+        return 0;
+    case kRequestStateSentAwaitResponse:
+        if (ISOTP_RECEIVE_STATUS_FULL == client->link->receive_status) {
+            return 0;
+        }
+        if (Iso14229TimeUntil(now, client->p2_timer) < timeout) {
+            timeout = Iso14229TimeUntil(now, client->p2_timer);
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (isotp_get_next_deadline(client->link, &deadline) &&
+        Iso14229TimeUntil(now, deadline) < timeout) {
+        timeout = Iso14229TimeUntil(now, deadline);
+    }
+    return timeout;
+}
+
+void Iso14229ClientMuxInit(Iso14229ClientMux *mux, struct Iso14229ClientMuxEntry *table,
+                           uint16_t tableSize,
+                           enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id,
+                                                                     uint8_t *data, uint8_t *size)) {
+    assert(mux);
+    assert(table);
+    assert(tableSize);
+    assert(userCANRxPoll);
+    memset(mux, 0, sizeof(*mux));
+    mux->table = table;
+    mux->tableSize = tableSize;
+    mux->userCANRxPoll = userCANRxPoll;
+}
+
+/**
+ * @brief index of the first entry with recv_id >= arb_id
+ */
+static uint16_t _MuxLowerBound(const Iso14229ClientMux *mux, uint32_t arb_id) {
+    uint16_t lo = 0, hi = mux->numClients;
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (mux->table[mid].recv_id < arb_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+enum Iso14229ClientError Iso14229ClientMuxAdd(Iso14229ClientMux *mux, Iso14229Client *client) {
+    assert(mux);
+    assert(client);
+    if (mux->numClients >= mux->tableSize) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL;
+    }
+    uint16_t idx = _MuxLowerBound(mux, client->recv_id);
+    if (idx < mux->numClients && mux->table[idx].recv_id == client->recv_id) {
+        return kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS;
+    }
+    memmove(&mux->table[idx + 1], &mux->table[idx],
+            (mux->numClients - idx) * sizeof(struct Iso14229ClientMuxEntry));
+    mux->table[idx] = (struct Iso14229ClientMuxEntry){.recv_id = client->recv_id, .client = client};
+    mux->numClients++;
+    return kISO14229_CLIENT_OK;
+}
+
+void Iso14229ClientMuxPoll(Iso14229ClientMux *mux) {
+    uint32_t arb_id = 0;
+    uint8_t data[ISO_TP_MAX_DL] = {0}, size = 0;
+
+    while (kCANRxSome == mux->userCANRxPoll(&arb_id, data, &size)) {
+        uint16_t idx = _MuxLowerBound(mux, arb_id);
+        if (idx < mux->numClients && mux->table[idx].recv_id == arb_id) {
+            isotp_on_can_message(mux->table[idx].client->link, data, size);
+        } else {
+            mux->droppedFrames++;
+        }
+    }
+
+    for (uint16_t i = 0; i < mux->numClients; i++) {
+        Iso14229ClientProcess(mux->table[i].client);
+    }
+}
+
 enum Iso14229ClientError iso14229SequenceRunBlocking(const struct Iso14229Sequence *seq,
                                                      Iso14229Client *client,
                                                      struct Iso14229Runner *runner) {
     assert(client);
     assert(client->userGetms);
     assert(client->userCANRxPoll);
-    assert(client->userYieldms);
+    assert(client->userYieldms || client->userWaitRx);
     assert(seq);
     assert(seq->list);
     assert(seq->len > 0);
@@ -673,7 +989,15 @@ enum Iso14229ClientError iso14229SequenceRunBlocking(const struct Iso14229Sequen
         } else {
             return status; // 故障 -- 立刻回
         }
-        client->userYieldms(client->yield_period_ms);
+
+        if (client->userWaitRx) {
+            // 等到有CAN帧或者下一个超时时间。下一个回调函数立刻跑
+            client->userWaitRx(kISO14229_CLIENT_CALLBACK_DONE == status
+                                   ? 0
+                                   : Iso14229ClientGetTimeoutms(client));
+        } else {
+            client->userYieldms(client->yield_period_ms);
+        }
     }
     return kISO14229_SEQ_ERR_TIMEOUT;
 }
@@ -694,6 +1018,407 @@ static enum Iso14229ClientError sendRequest(Iso14229Client *client, void *args)
     return kISO14229_CLIENT_OK;
 }
 
+int32_t Iso14229ClientDownloadReadFILE(void *ctx, size_t offset, uint8_t *buf, uint16_t len) {
+    (void)offset;
+    FILE *fd = (FILE *)ctx;
+    size_t n = fread(buf, 1, len, fd);
+    if (ferror(fd)) {
+        return -1;
+    }
+    return (int32_t)n;
+}
+
+void Iso14229ClientDownloadInit(Iso14229ClientDownload *dl,
+                                const struct Iso14229ClientDownloadConfig *cfg) {
+    assert(dl);
+    assert(cfg);
+    assert(cfg->read);
+    assert(cfg->prefetchBuffer);
+    assert(cfg->prefetchBufferSize > 0);
+    memset(dl, 0, sizeof(*dl));
+    dl->cfg = *cfg;
+    dl->state = kDownloadStateInit;
+    if (cfg->encoder) {
+        Iso14229LZSSEncoderInit(cfg->encoder);
+    }
+    if (cfg->digest) {
+        Iso14229DigestInit(cfg->digest, cfg->digest->type);
+    }
+}
+
+/**
+ * @brief fills the prefetch buffer with compressed data, reading the source as the encoder needs it
+ */
+static enum Iso14229ClientError _DownloadPrefetchCompressed(Iso14229ClientDownload *dl,
+                                                            uint16_t len) {
+    Iso14229LZSSEncoder *enc = dl->cfg.encoder;
+    uint16_t n = 0;
+
+    while (n < len) {
+        uint16_t space;
+        uint8_t *buf = Iso14229LZSSEncoderBuffer(enc, &space);
+        size_t remaining = dl->cfg.memorySize - dl->bytesRead;
+        if (space && remaining) {
+            if (remaining < space) {
+                space = remaining;
+            }
+            int32_t r = dl->cfg.read(dl->cfg.readCtx, dl->bytesRead, buf, space);
+            if (r <= 0 || r > space) {
+                return kISO14229_CLIENT_ERR_DOWNLOAD_READ;
+            }
+            if (dl->cfg.digest) {
+                Iso14229DigestUpdate(dl->cfg.digest, buf, r);
+            }
+            Iso14229LZSSEncoderCommit(enc, r);
+            dl->bytesRead += r;
+        }
+
+        bool final = dl->bytesRead >= dl->cfg.memorySize;
+        uint16_t out = Iso14229LZSSEncode(enc, dl->cfg.prefetchBuffer + n, len - n, final);
+        n += out;
+        if (0 == out && (final || Iso14229LZSSEncoderGroupFull(enc))) {
+            break; // 压缩完了，或者下一个组放不下
+        }
+    }
+    dl->prefetchLen = n;
+    return kISO14229_CLIENT_OK;
+}
+
+/**
+ * @brief reads the next block from the source unless one is already waiting
+ */
+static enum Iso14229ClientError _DownloadPrefetch(Iso14229ClientDownload *dl) {
+    if (0 == dl->blockLength || dl->prefetchLen) {
+        return kISO14229_CLIENT_OK;
+    }
+    if (dl->cfg.encoder) {
+        return _DownloadPrefetchCompressed(dl, dl->blockLength - ISO14229_0X36_REQ_BASE_LEN);
+    }
+    if (dl->bytesRead >= dl->cfg.memorySize) {
+        return kISO14229_CLIENT_OK;
+    }
+    size_t remaining = dl->cfg.memorySize - dl->bytesRead;
+    uint16_t len = dl->blockLength - ISO14229_0X36_REQ_BASE_LEN;
+    if (remaining < len) {
+        len = remaining;
+    }
+    int32_t n = dl->cfg.read(dl->cfg.readCtx, dl->bytesRead, dl->cfg.prefetchBuffer, len);
+    if (n <= 0 || n > len) {
+        return kISO14229_CLIENT_ERR_DOWNLOAD_READ;
+    }
+    if (dl->cfg.digest) {
+        Iso14229DigestUpdate(dl->cfg.digest, dl->cfg.prefetchBuffer, n);
+    }
+    dl->prefetchLen = n;
+    dl->bytesRead += n;
+    return kISO14229_CLIENT_OK;
+}
+
+static enum Iso14229ClientError _DownloadSendBlock(Iso14229Client *client,
+                                                   Iso14229ClientDownload *dl) {
+    enum Iso14229ClientError err = _DownloadPrefetch(dl);
+    if (err) {
+        return err;
+    }
+    err = TransferData(client, dl->blockSequenceCounter, dl->blockLength, dl->cfg.prefetchBuffer,
+                       dl->prefetchLen);
+    if (err) {
+        return err;
+    }
+    dl->inflightLen = dl->prefetchLen;
+    dl->prefetchLen = 0;
+
+    // the request has been copied to the send buffer: read the next block while it is on the bus
+    return _DownloadPrefetch(dl);
+}
+
+static enum Iso14229ClientError _DownloadCheckResponse(const Iso14229Client *client, uint8_t sid) {
+    if (0x7F == client->resp.buf[0]) {
+        return kISO14229_CLIENT_ERR_RESP_NEGATIVE;
+    }
+    if (ISO14229_RESPONSE_SID_OF(sid) != client->resp.buf[0]) {
+        return kISO14229_CLIENT_ERR_RESP_SID_MISMATCH;
+    }
+    return kISO14229_CLIENT_OK;
+}
+
+static enum Iso14229ClientError _DownloadStep(Iso14229Client *client, Iso14229ClientDownload *dl) {
+    enum Iso14229ClientError err = kISO14229_CLIENT_OK;
+
+    switch (dl->state) {
+    case kDownloadStateInit:
+        err = RequestDownload(client, dl->cfg.dataFormatIdentifier,
+                              dl->cfg.addressAndLengthFormatIdentifier, dl->cfg.memoryAddress,
+                              dl->cfg.memorySize);
+        if (kISO14229_CLIENT_OK == err) {
+            dl->state = kDownloadStateRequestDownload;
+        }
+        break;
+
+    case kDownloadStateRequestDownload: {
+        struct RequestDownloadResponse resp;
+        err = _DownloadCheckResponse(client, kSID_REQUEST_DOWNLOAD);
+        if (err) {
+            break;
+        }
+        err = UnpackRequestDownloadResponse(&client->resp, &resp);
+        if (err) {
+            break;
+        }
+
+        size_t blockLength = resp.maxNumberOfBlockLength;
+        if (blockLength > client->link->send_buf_size) {
+            blockLength = client->link->send_buf_size;
+        }
+        if (blockLength > dl->cfg.prefetchBufferSize + ISO14229_0X36_REQ_BASE_LEN) {
+            blockLength = dl->cfg.prefetchBufferSize + ISO14229_0X36_REQ_BASE_LEN;
+        }
+        if (blockLength <= ISO14229_0X36_REQ_BASE_LEN ||
+            (dl->cfg.encoder &&
+             blockLength < ISO14229_LZSS_MAX_GROUP_LEN + ISO14229_0X36_REQ_BASE_LEN)) {
+            err = kISO14229_CLIENT_ERR_RESP_CANNOT_UNPACK;
+            break;
+        }
+        dl->blockLength = blockLength;
+        dl->blockSequenceCounter = 1;
+        dl->startMs = client->userGetms();
+
+        if (0 == dl->cfg.memorySize) {
+            err = RequestTransferExit(client);
+            dl->state = kDownloadStateRequestTransferExit;
+        } else {
+            err = _DownloadSendBlock(client, dl);
+            dl->state = kDownloadStateTransferData;
+        }
+        break;
+    }
+
+    case kDownloadStateTransferData: {
+        err = _DownloadCheckResponse(client, kSID_TRANSFER_DATA);
+        if (err) {
+            break;
+        }
+        if (client->resp.len < 2 || client->resp.buf[1] != dl->blockSequenceCounter) {
+            err = kISO14229_CLIENT_ERR_RESP_UNEXPECTED;
+            break;
+        }
+
+        dl->bytesTransferred += dl->inflightLen;
+        dl->inflightLen = 0;
+        dl->blockSequenceCounter++;
+
+        uint32_t elapsed = client->userGetms() - dl->startMs;
+        if (elapsed) {
+            dl->bytesPerSecond = (uint32_t)((uint64_t)dl->bytesTransferred * 1000 / elapsed);
+        }
+
+        // 压缩后的长度事先不知道：数据源和预读缓冲区都空了就结束
+        err = _DownloadPrefetch(dl);
+        if (err) {
+            break;
+        }
+        if (0 == dl->prefetchLen) {
+            err = RequestTransferExit(client);
+            dl->state = kDownloadStateRequestTransferExit;
+        } else {
+            err = _DownloadSendBlock(client, dl);
+        }
+        break;
+    }
+
+    case kDownloadStateRequestTransferExit:
+        err = _DownloadCheckResponse(client, kSID_REQUEST_TRANSFER_EXIT);
+        if (err) {
+            break;
+        }
+        if (dl->cfg.digest) {
+            // 服务器把校验值放在transferResponseParameterRecord的最后
+            uint8_t digest[ISO14229_DIGEST_MAX_LEN];
+            uint8_t len = Iso14229DigestFinal(dl->cfg.digest, digest);
+            if (client->resp.len < ISO14229_0X37_RESP_BASE_LEN + len ||
+                memcmp(client->resp.buf + client->resp.len - len, digest, len)) {
+                err = kISO14229_CLIENT_ERR_DOWNLOAD_DIGEST;
+                break;
+            }
+        }
+        dl->state = kDownloadStateDone;
+        break;
+
+    case kDownloadStateDone:
+        break;
+
+    default:
+        assert(0);
+    }
+    return err;
+}
+
+enum Iso14229ClientError Iso14229ClientDownloadPoll(Iso14229Client *client,
+                                                    Iso14229ClientDownload *dl) {
+    enum Iso14229ClientError err;
+    assert(client);
+    assert(dl);
+    assert(!(client->options & SUPPRESS_POS_RESP));
+
+    Iso14229ClientPoll(client);
+
+    if (client->err) {
+        return client->err;
+    }
+
+    if (kRequestStateIdle != client->state) {
+        // use the time spent waiting on the server to read the next block
+        return _DownloadPrefetch(dl) ? kISO14229_CLIENT_ERR_DOWNLOAD_READ
+                                     : kISO14229_CLIENT_SEQUENCE_RUNNING;
+    }
+
+    err = _DownloadStep(client, dl);
+    if (err) {
+        return err;
+    }
+    return kDownloadStateDone == dl->state ? kISO14229_CLIENT_OK
+                                           : kISO14229_CLIENT_SEQUENCE_RUNNING;
+}
+
+int32_t Iso14229ClientUploadWriteFILE(void *ctx, size_t offset, const uint8_t *data, uint16_t len) {
+    (void)offset;
+    FILE *fd = (FILE *)ctx;
+    size_t n = fwrite(data, 1, len, fd);
+    if (ferror(fd)) {
+        return -1;
+    }
+    return (int32_t)n;
+}
+
+void Iso14229ClientUploadInit(Iso14229ClientUpload *ul,
+                              const struct Iso14229ClientUploadConfig *cfg) {
+    assert(ul);
+    assert(cfg);
+    assert(cfg->write);
+    memset(ul, 0, sizeof(*ul));
+    ul->cfg = *cfg;
+    ul->state = kUploadStateInit;
+}
+
+static enum Iso14229ClientError _UploadStep(Iso14229Client *client, Iso14229ClientUpload *ul) {
+    enum Iso14229ClientError err = kISO14229_CLIENT_OK;
+
+    switch (ul->state) {
+    case kUploadStateInit:
+        err = RequestUpload(client, ul->cfg.dataFormatIdentifier,
+                            ul->cfg.addressAndLengthFormatIdentifier, ul->cfg.memoryAddress,
+                            ul->cfg.memorySize);
+        if (kISO14229_CLIENT_OK == err) {
+            ul->state = kUploadStateRequestUpload;
+        }
+        break;
+
+    case kUploadStateRequestUpload: {
+        struct RequestUploadResponse resp;
+        err = _DownloadCheckResponse(client, kSID_REQUEST_UPLOAD);
+        if (err) {
+            break;
+        }
+        err = UnpackRequestUploadResponse(&client->resp, &resp);
+        if (err) {
+            break;
+        }
+        // the responses are received in place: they must fit the receive buffer
+        if (resp.maxNumberOfBlockLength <= ISO14229_0X36_RESP_BASE_LEN ||
+            resp.maxNumberOfBlockLength > client->link->receive_buf_size) {
+            err = kISO14229_CLIENT_ERR_RESP_CANNOT_UNPACK;
+            break;
+        }
+        ul->blockLength = resp.maxNumberOfBlockLength;
+        ul->blockSequenceCounter = 1;
+        ul->startMs = client->userGetms();
+
+        if (0 == ul->cfg.memorySize) {
+            err = RequestTransferExit(client);
+            ul->state = kUploadStateRequestTransferExit;
+        } else {
+            err = TransferData(client, ul->blockSequenceCounter, ul->blockLength, NULL, 0);
+            ul->state = kUploadStateTransferData;
+        }
+        break;
+    }
+
+    case kUploadStateTransferData: {
+        err = _DownloadCheckResponse(client, kSID_TRANSFER_DATA);
+        if (err) {
+            break;
+        }
+        uint16_t len = client->resp.len - ISO14229_0X36_RESP_BASE_LEN;
+        if (client->resp.len <= ISO14229_0X36_RESP_BASE_LEN ||
+            client->resp.buf[1] != ul->blockSequenceCounter ||
+            len > ul->cfg.memorySize - ul->bytesReceived) {
+            err = kISO14229_CLIENT_ERR_RESP_UNEXPECTED;
+            break;
+        }
+
+        int32_t n = ul->cfg.write(ul->cfg.writeCtx, ul->bytesReceived,
+                                  &client->resp.buf[ISO14229_0X36_RESP_BASE_LEN], len);
+        if (n != len) {
+            err = kISO14229_CLIENT_ERR_UPLOAD_WRITE;
+            break;
+        }
+        ul->bytesReceived += len;
+        ul->blockSequenceCounter++;
+
+        uint32_t elapsed = client->userGetms() - ul->startMs;
+        if (elapsed) {
+            ul->bytesPerSecond = (uint32_t)((uint64_t)ul->bytesReceived * 1000 / elapsed);
+        }
+
+        if (ul->bytesReceived >= ul->cfg.memorySize) {
+            err = RequestTransferExit(client);
+            ul->state = kUploadStateRequestTransferExit;
+        } else {
+            err = TransferData(client, ul->blockSequenceCounter, ul->blockLength, NULL, 0);
+        }
+        break;
+    }
+
+    case kUploadStateRequestTransferExit:
+        err = _DownloadCheckResponse(client, kSID_REQUEST_TRANSFER_EXIT);
+        if (kISO14229_CLIENT_OK == err) {
+            ul->state = kUploadStateDone;
+        }
+        break;
+
+    case kUploadStateDone:
+        break;
+
+    default:
+        assert(0);
+    }
+    return err;
+}
+
+enum Iso14229ClientError Iso14229ClientUploadPoll(Iso14229Client *client,
+                                                  Iso14229ClientUpload *ul) {
+    enum Iso14229ClientError err;
+    assert(client);
+    assert(ul);
+    assert(!(client->options & SUPPRESS_POS_RESP));
+
+    Iso14229ClientPoll(client);
+
+    if (client->err) {
+        return client->err;
+    }
+
+    if (kRequestStateIdle != client->state) {
+        return kISO14229_CLIENT_SEQUENCE_RUNNING;
+    }
+
+    err = _UploadStep(client, ul);
+    if (err) {
+        return err;
+    }
+    return kUploadStateDone == ul->state ? kISO14229_CLIENT_OK : kISO14229_CLIENT_SEQUENCE_RUNNING;
+}
+
 /**
  * @brief Helper function for reading RDBI responses
  *
@@ -7,12 +7,38 @@
 #include <stdio.h>
 #include <assert.h>
 #include "iso14229.h"
+#include "iso14229canrxring.h"
+#include "iso14229digest.h"
+#include "iso14229lzss.h"
 #include "isotp-c/isotp.h"
 
 #define ISO14229_CLIENT_DEFAULT_YIELD_PERIOD_MS (5U)
 #define ISO14229_CLIENT_DEFAULT_P2_MS (150U)
 #define ISO14229_CLIENT_DEFAULT_P2_STAR_MS (1500U)
 
+/**
+ * @brief number of requests Iso14229ClientQueueRequest() can hold
+ */
+#ifndef ISO14229_CLIENT_REQUEST_QUEUE_SIZE
+#define ISO14229_CLIENT_REQUEST_QUEUE_SIZE 4
+#endif
+
+/**
+ * @brief largest queued request. The default fits a classic CAN single frame, so a queue is sent
+ * in one poll
+ */
+#ifndef ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN
+#define ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN 7
+#endif
+
+// the queue indices and the length of a queued request are uint8_t
+#if ISO14229_CLIENT_REQUEST_QUEUE_SIZE > 255
+#error "ISO14229_CLIENT_REQUEST_QUEUE_SIZE must be at most 255"
+#endif
+#if ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN > 255
+#error "ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN must be at most 255"
+#endif
+
 enum Iso14229ClientRequestState {
     kRequestStateIdle = 0,          // 完成
     kRequestStateSending,           // 传输层现在传输数据
@@ -30,6 +56,9 @@ enum Iso14229ClientError {
     kISO14229_SEQ_ERR_TIMEOUT,       // 流程超时
     kISO14229_SEQ_ERR_NULL_CALLBACK, // 回调函数是NULL
 
+    kISO14229_CLIENT_ERR_DOWNLOAD_DIGEST = -15,     // 下载校验值对不上
+    kISO14229_CLIENT_ERR_UPLOAD_WRITE = -14,        // 上传数据写入失败
+    kISO14229_CLIENT_ERR_DOWNLOAD_READ = -13,       // 下载数据源读取失败
     kISO14229_CLIENT_ERR_RESP_SCHEMA_INVALID = -12, // 数据内容或者大小不按照应用定义(如ODX)
 
     kISO14229_CLIENT_ERR_RESP_DID_MISMATCH = -11,            // 响应DID对不上期待的DID
@@ -65,10 +94,29 @@ struct Iso14229ClientConfig {
     uint16_t link_recv_buf_size;
     uint8_t *link_send_buffer;
     uint16_t link_send_buf_size;
+    uint8_t link_tx_dl; // optional: CAN FD frame data length (12..64) used for requests. 0: 8
+    /**
+     * @brief \~chinese 可选：会话保持周期 \~english optional. S3client: period of the suppressed
+     * functional TesterPresent (3E 80) that keeps non-default sessions alive. ISO14229-2 uses 2000
+     * ms against the server's 5000 ms S3. 0: off. Enable it on one client per functional address
+     */
+    uint16_t tester_present_ms;
     uint32_t (*userGetms)();
     int (*userCANTransmit)(uint32_t arb_id, const uint8_t *data, uint8_t len);
     enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id, uint8_t *data, uint8_t *size);
+    /**
+     * @brief \~chinese 可选的接收环形缓冲器 \~english optional RX ring filled by the CAN RX interrupt
+     * or a driver thread. When set, the client reads received frames from it instead of calling
+     * userCANRxPoll
+     */
+    Iso14229CANRxRing *rxRing;
     void (*userYieldms)(uint32_t duration);
+    /**
+     * @brief \~chinese 可选：等待CAN帧 \~english optional. Blocks until a CAN frame is received or
+     * timeout_ms has elapsed, e.g. with poll() on a socket. When set, iso14229SequenceRunBlocking()
+     * calls it with the time to the next client or ISO-TP deadline instead of userYieldms.
+     */
+    void (*userWaitRx)(uint32_t timeout_ms);
     void (*userDebug)(const char *, ...);
 };
 
@@ -79,20 +127,33 @@ enum Iso14229ClientOptions {
     IGNORE_SERVER_TIMINGS = 0b00001000, // 忽略服务器给的p2和p2_star
 };
 
+/**
+ * @brief \~chinese 排队的不要响应的请求 \~english a request waiting in the client's queue
+ */
+struct Iso14229QueuedRequest {
+    uint8_t buf[ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN];
+    uint8_t len;
+    enum Iso14229ClientOptions options;
+};
+
 typedef struct Iso14229Client {
-    uint16_t phys_send_id;    // 物理发送地址
-    uint16_t func_send_id;    // 功能发送地址
-    uint16_t recv_id;         // 服务器相应地址
-    uint16_t p2_ms;           // p2 超时时间
-    uint32_t p2_star_ms;      // 0x78 p2* 超时时间
-    uint16_t yield_period_ms; // 流程中等待时间
+    uint16_t phys_send_id;      // 物理发送地址
+    uint16_t func_send_id;      // 功能发送地址
+    uint16_t recv_id;           // 服务器相应地址
+    uint16_t p2_ms;             // p2 超时时间
+    uint32_t p2_star_ms;        // 0x78 p2* 超时时间
+    uint16_t yield_period_ms;   // 流程中等待时间
+    uint16_t tester_present_ms; // 会话保持周期、0:不发
     IsoTpLink *link;
     uint32_t (*userGetms)();
     enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id, uint8_t *data, uint8_t *size);
+    Iso14229CANRxRing *rxRing;
     void (*userYieldms)(uint32_t duration);
+    void (*userWaitRx)(uint32_t timeout_ms);
 
     // 内状态
     uint32_t p2_timer;
+    uint32_t tester_present_timer; // 下一个3E 80的时间
     struct Iso14229Request req;
     struct Iso14229Response resp;
     enum Iso14229ClientRequestState state;
@@ -101,6 +162,10 @@ typedef struct Iso14229Client {
     enum Iso14229ClientOptions options;
     enum Iso14229ClientOptions defaultOptions;
     enum Iso14229ClientOptions _options_copy; // a copy of the options at the time a request is made
+
+    struct Iso14229QueuedRequest queue[ISO14229_CLIENT_REQUEST_QUEUE_SIZE]; // 排队的请求
+    uint8_t queueHead;                                                      // 下一个要发的
+    uint8_t queueCount;
 } Iso14229Client;
 
 #define kISO14229_CLIENT_CALLBACK_DONE kISO14229_CLIENT_OK // 完成成功、可以跳到下一步函数
@@ -138,6 +203,10 @@ struct RequestDownloadResponse {
     size_t maxNumberOfBlockLength;
 };
 
+struct RequestUploadResponse {
+    size_t maxNumberOfBlockLength;
+};
+
 struct RoutineControlResponse {
     uint8_t routineControlType;
     uint16_t routineIdentifier;
@@ -145,9 +214,128 @@ struct RoutineControlResponse {
     uint16_t routineStatusRecordLength;
 };
 
+/**
+ * @brief \~chinese 下载数据源 \~english Source of the data sent by Iso14229ClientDownloadPoll().
+ * Copies up to `len` bytes of the image starting at `offset` into `buf`.
+ * @return the number of bytes copied. 0 or negative if no data could be read
+ */
+typedef int32_t (*Iso14229ClientDownloadRead)(void *ctx, size_t offset, uint8_t *buf,
+                                              uint16_t len);
+
+enum Iso14229ClientDownloadState {
+    kDownloadStateInit = 0,            // 还没发RequestDownload
+    kDownloadStateRequestDownload,     // 等待0x34响应
+    kDownloadStateTransferData,        // 等待0x36响应
+    kDownloadStateRequestTransferExit, // 等待0x37响应
+    kDownloadStateDone,                // 完成
+};
+
+struct Iso14229ClientDownloadConfig {
+    uint8_t dataFormatIdentifier;
+    uint8_t addressAndLengthFormatIdentifier;
+    size_t memoryAddress;
+    size_t memorySize;
+    Iso14229ClientDownloadRead read;
+    void *readCtx;
+    uint8_t *prefetchBuffer;      // the next block is read into this buffer while the current one
+                                  // is being transferred
+    uint16_t prefetchBufferSize;  // limits the block length to prefetchBufferSize + 2
+    Iso14229LZSSEncoder *encoder; // optional: compresses the image. Use with dataFormatIdentifier
+                                  // ISO14229_DFI_LZSS. memorySize stays the uncompressed size
+    Iso14229Digest *digest; // optional: computed over the image and compared with the end of the
+                            // 0x37 response. Set its `type` before Iso14229ClientDownloadInit()
+};
+
+/**
+ * @brief \~chinese 流式下载 \~english Streaming download (0x34, 0x36 x N, 0x37)
+ */
+typedef struct {
+    struct Iso14229ClientDownloadConfig cfg;
+    enum Iso14229ClientDownloadState state;
+    uint16_t blockLength; // 0x36 request length including SID and blockSequenceCounter
+    uint8_t blockSequenceCounter;
+    uint16_t prefetchLen;     // bytes waiting in prefetchBuffer
+    uint16_t inflightLen;     // data bytes of the 0x36 request awaiting a response
+    size_t bytesRead;         // bytes read from the source
+    size_t bytesTransferred;  // bytes acknowledged by the server (compressed if cfg.encoder)
+    uint32_t startMs;         // time of the 0x34 positive response
+    uint32_t bytesPerSecond;  // average transfer rate since startMs
+} Iso14229ClientDownload;
+
+/**
+ * @brief \~chinese 上传数据接收器 \~english Sink of the data received by Iso14229ClientUploadPoll().
+ * Called with each TransferData response's data, which still lies in the ISO-TP receive buffer.
+ * @return the number of bytes consumed. Anything other than `len` stops the upload
+ */
+typedef int32_t (*Iso14229ClientUploadWrite)(void *ctx, size_t offset, const uint8_t *data,
+                                             uint16_t len);
+
+enum Iso14229ClientUploadState {
+    kUploadStateInit = 0,            // 还没发RequestUpload
+    kUploadStateRequestUpload,       // 等待0x35响应
+    kUploadStateTransferData,        // 等待0x36响应
+    kUploadStateRequestTransferExit, // 等待0x37响应
+    kUploadStateDone,                // 完成
+};
+
+struct Iso14229ClientUploadConfig {
+    uint8_t dataFormatIdentifier;
+    uint8_t addressAndLengthFormatIdentifier;
+    size_t memoryAddress;
+    size_t memorySize;
+    Iso14229ClientUploadWrite write;
+    void *writeCtx;
+};
+
+/**
+ * @brief \~chinese 流式上传 \~english Streaming upload (0x35, 0x36 x N, 0x37)
+ */
+typedef struct {
+    struct Iso14229ClientUploadConfig cfg;
+    enum Iso14229ClientUploadState state;
+    uint16_t blockLength; // 0x36 response length including SID and blockSequenceCounter
+    uint8_t blockSequenceCounter;
+    size_t bytesReceived;    // bytes passed to the sink
+    uint32_t startMs;        // time of the 0x35 positive response
+    uint32_t bytesPerSecond; // average transfer rate since startMs
+} Iso14229ClientUpload;
+
 void iso14229ClientInit(Iso14229Client *self, const struct Iso14229ClientConfig *cfg);
 void Iso14229ClientPoll(Iso14229Client *self);
 
+/**
+ * @brief Runs the client without reading CAN frames: the ISO-TP link and the request state machine.
+ * Used by Iso14229ClientMuxPoll(), which delivers received frames to the client's link.
+ * @param self
+ */
+void Iso14229ClientProcess(Iso14229Client *self);
+
+/**
+ * @brief Gets the time until Iso14229ClientPoll() has work to do next without a CAN frame being
+ * received: the p2 timeout, the next ISO-TP consecutive frame or timeout, or an immediate state
+ * transition. Never more than yield_period_ms.
+ * @param self
+ * @return uint32_t milliseconds. 0: poll again now
+ */
+uint32_t Iso14229ClientGetTimeoutms(Iso14229Client *self);
+
+/**
+ * @brief \~chinese 请求排队 \~english Queues a prepared request that expects no response, e.g. a
+ * functional TesterPresent or a 0x28/0x85 broadcast. Iso14229ClientProcess() sends queued requests
+ * back-to-back whenever no other request is in progress and the link is free, without waiting for
+ * a poll between them. Requests made with the service functions wait until the queue is empty.
+ * @param self
+ * @param data the request starting with the SID. Copied
+ * @param len at most ISO14229_CLIENT_QUEUED_REQUEST_MAX_LEN
+ * @param options must include SUPPRESS_POS_RESP. FUNCTIONAL sends on func_send_id
+ * @return kISO14229_CLIENT_OK, kISO14229_CLIENT_ERR_REQ_NOT_SENT_SEND_IN_PROGRESS if the queue is
+ * full, kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL if the request does not fit the link or
+ * kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS
+ */
+enum Iso14229ClientError Iso14229ClientQueueRequest(Iso14229Client *self, const uint8_t *data,
+                                                    uint16_t len,
+                                                    enum Iso14229ClientOptions options);
+
 enum Iso14229ClientError ECUReset(Iso14229Client *client, enum Iso14229ECUResetResetType type);
 enum Iso14229ClientError DiagnosticSessionControl(Iso14229Client *client,
                                                   enum Iso14229DiagnosticSessionType mode);
@@ -160,12 +348,22 @@ enum Iso14229ClientError ReadDataByIdentifier(Iso14229Client *client, const uint
                                               const uint16_t numDataIdentifiers);
 enum Iso14229ClientError WriteDataByIdentifier(Iso14229Client *client, uint16_t dataIdentifier,
                                                const uint8_t *data, uint16_t size);
+enum Iso14229ClientError ReadMemoryByAddress(Iso14229Client *client,
+                                             uint8_t addressAndLengthFormatIdentifier,
+                                             size_t memoryAddress, size_t memorySize);
+enum Iso14229ClientError WriteMemoryByAddress(Iso14229Client *client,
+                                              uint8_t addressAndLengthFormatIdentifier,
+                                              size_t memoryAddress, const uint8_t *data,
+                                              uint16_t size);
 enum Iso14229ClientError TesterPresent(Iso14229Client *client);
 enum Iso14229ClientError RoutineControl(Iso14229Client *client, enum RoutineControlType type,
                                         uint16_t routineIdentifier, uint8_t *data, uint16_t size);
 enum Iso14229ClientError RequestDownload(Iso14229Client *client, uint8_t dataFormatIdentifier,
                                          uint8_t addressAndLengthFormatIdentifier,
                                          size_t memoryAddress, size_t memorySize);
+enum Iso14229ClientError RequestUpload(Iso14229Client *client, uint8_t dataFormatIdentifier,
+                                       uint8_t addressAndLengthFormatIdentifier,
+                                       size_t memoryAddress, size_t memorySize);
 enum Iso14229ClientError RequestDownload_32_32(Iso14229Client *client, uint32_t memoryAddress,
                                                uint32_t memorySize);
 enum Iso14229ClientError TransferData(Iso14229Client *client, uint8_t blockSequenceCounter,
@@ -183,9 +381,99 @@ enum Iso14229ClientError UnpackRoutineControlResponse(Iso14229Client *client,
                                                       struct RoutineControlResponse *resp);
 enum Iso14229ClientError UnpackRequestDownloadResponse(const struct Iso14229Response *resp,
                                                        struct RequestDownloadResponse *unpacked);
+enum Iso14229ClientError UnpackRequestUploadResponse(const struct Iso14229Response *resp,
+                                                     struct RequestUploadResponse *unpacked);
 int RDBIReadDID(const struct Iso14229Response *resp, uint16_t did, uint8_t *data, uint16_t size,
                 uint16_t *offset);
 
+/**
+ * @brief \~chinese 用FILE读取下载数据 \~english Iso14229ClientDownloadRead for a FILE * opened for
+ * reading, passed as readCtx. The file is read sequentially from its current position.
+ */
+int32_t Iso14229ClientDownloadReadFILE(void *ctx, size_t offset, uint8_t *buf, uint16_t len);
+
+void Iso14229ClientDownloadInit(Iso14229ClientDownload *dl,
+                                const struct Iso14229ClientDownloadConfig *cfg);
+
+/**
+ * @brief Runs a download to completion, one step per call. Call it instead of Iso14229ClientPoll()
+ * until it returns something other than kISO14229_CLIENT_SEQUENCE_RUNNING.
+ * The next TransferData request is sent in the same call that receives the previous response,
+ * and its data is read from the source while the previous request is still on the bus.
+ * Response pending (0x78) is handled by the client and does not stop the download.
+ * @param client an idle client
+ * @param dl a download initialized with Iso14229ClientDownloadInit()
+ * @return kISO14229_CLIENT_SEQUENCE_RUNNING while the download is running, kISO14229_CLIENT_OK
+ * when the server has accepted RequestTransferExit, an error otherwise
+ */
+enum Iso14229ClientError Iso14229ClientDownloadPoll(Iso14229Client *client,
+                                                    Iso14229ClientDownload *dl);
+
+/**
+ * @brief \~chinese 用FILE写入上传数据 \~english Iso14229ClientUploadWrite for a FILE * opened for
+ * writing, passed as writeCtx. The data is appended at the file's current position.
+ */
+int32_t Iso14229ClientUploadWriteFILE(void *ctx, size_t offset, const uint8_t *data, uint16_t len);
+
+void Iso14229ClientUploadInit(Iso14229ClientUpload *ul,
+                              const struct Iso14229ClientUploadConfig *cfg);
+
+/**
+ * @brief Runs an upload to completion, one step per call. Call it instead of Iso14229ClientPoll()
+ * until it returns something other than kISO14229_CLIENT_SEQUENCE_RUNNING.
+ * Each TransferData response is handed to the sink straight from the ISO-TP receive buffer and
+ * the next TransferData request is sent in the same call.
+ * @param client an idle client
+ * @param ul an upload initialized with Iso14229ClientUploadInit()
+ * @return kISO14229_CLIENT_SEQUENCE_RUNNING while the upload is running, kISO14229_CLIENT_OK
+ * when the server has accepted RequestTransferExit, an error otherwise
+ */
+enum Iso14229ClientError Iso14229ClientUploadPoll(Iso14229Client *client,
+                                                  Iso14229ClientUpload *ul);
+
+struct Iso14229ClientMuxEntry {
+    uint32_t recv_id;
+    Iso14229Client *client;
+};
+
+/**
+ * @brief \~chinese 客户端多路复用器 \~english Client multiplexer. Runs several clients on one CAN
+ * channel: it owns the CAN RX poll and routes each frame to the client whose recv_id matches.
+ */
+typedef struct {
+    struct Iso14229ClientMuxEntry *table; // sorted by recv_id
+    uint16_t tableSize;
+    uint16_t numClients;
+    uint32_t droppedFrames; // frames not addressed to any client
+    enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id, uint8_t *data, uint8_t *size);
+} Iso14229ClientMux;
+
+/**
+ * @brief
+ * @param mux
+ * @param table storage for tableSize client entries
+ * @param tableSize maximum number of clients
+ * @param userCANRxPoll reads the CAN channel shared by all clients
+ */
+void Iso14229ClientMuxInit(Iso14229ClientMux *mux, struct Iso14229ClientMuxEntry *table,
+                           uint16_t tableSize,
+                           enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id,
+                                                                     uint8_t *data, uint8_t *size));
+
+/**
+ * @brief Adds an initialized client. The client's own userCANRxPoll is not used.
+ * @return kISO14229_CLIENT_OK, kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL if the table is
+ * full or kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS if another client has the same recv_id
+ */
+enum Iso14229ClientError Iso14229ClientMuxAdd(Iso14229ClientMux *mux, Iso14229Client *client);
+
+/**
+ * @brief Reads all pending CAN frames, dispatches them with a binary search on the arbitration
+ * ID and then runs every client. Call it in place of Iso14229ClientPoll() for the added clients.
+ * @param mux
+ */
+void Iso14229ClientMuxPoll(Iso14229ClientMux *mux);
+
 /**
  * @brief Run a client sequence until completion or error
  * @param client
@@ -0,0 +1,235 @@
+#ifndef ISO14229DIGEST_H
+#define ISO14229DIGEST_H
+
+/**
+ * @brief \~chinese 增量校验 \~english Incremental integrity check of downloaded data
+ *
+ * The server updates an Iso14229Digest with every block it passes to onTransfer(...) and appends
+ * the result to the 0x37 RequestTransferExit response, so no verification pass over the flash is
+ * needed afterwards. The client computes the same digest over the image it sends and compares.
+ * Digests are sent big-endian.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief set to 0 to leave out SHA-256 (about 1 KiB of code and a 256 byte table)
+ */
+#ifndef ISO14229_DIGEST_SHA256
+#define ISO14229_DIGEST_SHA256 1
+#endif
+
+#define ISO14229_DIGEST_CRC32_LEN 4U
+#define ISO14229_DIGEST_SHA256_LEN 32U
+#define ISO14229_DIGEST_MAX_LEN 32U
+
+enum Iso14229DigestType {
+    kIso14229DigestNone = 0,
+    kIso14229DigestCRC32,  // CRC-32/ISO-HDLC (zlib, Ethernet)
+    kIso14229DigestSHA256, // requires ISO14229_DIGEST_SHA256
+};
+
+typedef struct {
+    enum Iso14229DigestType type;
+    union {
+        uint32_t crc;
+#if ISO14229_DIGEST_SHA256
+        struct {
+            uint32_t h[8];
+            uint64_t len;      // bytes hashed so far
+            uint8_t block[64]; // partial block
+        } sha;
+#endif
+    } u;
+} Iso14229Digest;
+
+static const uint32_t Iso14229CRC32Table[256] = {
+    0x00000000U, 0x77073096U, 0xEE0E612CU, 0x990951BAU, 0x076DC419U, 0x706AF48FU, 0xE963A535U,
+    0x9E6495A3U, 0x0EDB8832U, 0x79DCB8A4U, 0xE0D5E91EU, 0x97D2D988U, 0x09B64C2BU, 0x7EB17CBDU,
+    0xE7B82D07U, 0x90BF1D91U, 0x1DB71064U, 0x6AB020F2U, 0xF3B97148U, 0x84BE41DEU, 0x1ADAD47DU,
+    0x6DDDE4EBU, 0xF4D4B551U, 0x83D385C7U, 0x136C9856U, 0x646BA8C0U, 0xFD62F97AU, 0x8A65C9ECU,
+    0x14015C4FU, 0x63066CD9U, 0xFA0F3D63U, 0x8D080DF5U, 0x3B6E20C8U, 0x4C69105EU, 0xD56041E4U,
+    0xA2677172U, 0x3C03E4D1U, 0x4B04D447U, 0xD20D85FDU, 0xA50AB56BU, 0x35B5A8FAU, 0x42B2986CU,
+    0xDBBBC9D6U, 0xACBCF940U, 0x32D86CE3U, 0x45DF5C75U, 0xDCD60DCFU, 0xABD13D59U, 0x26D930ACU,
+    0x51DE003AU, 0xC8D75180U, 0xBFD06116U, 0x21B4F4B5U, 0x56B3C423U, 0xCFBA9599U, 0xB8BDA50FU,
+    0x2802B89EU, 0x5F058808U, 0xC60CD9B2U, 0xB10BE924U, 0x2F6F7C87U, 0x58684C11U, 0xC1611DABU,
+    0xB6662D3DU, 0x76DC4190U, 0x01DB7106U, 0x98D220BCU, 0xEFD5102AU, 0x71B18589U, 0x06B6B51FU,
+    0x9FBFE4A5U, 0xE8B8D433U, 0x7807C9A2U, 0x0F00F934U, 0x9609A88EU, 0xE10E9818U, 0x7F6A0DBBU,
+    0x086D3D2DU, 0x91646C97U, 0xE6635C01U, 0x6B6B51F4U, 0x1C6C6162U, 0x856530D8U, 0xF262004EU,
+    0x6C0695EDU, 0x1B01A57BU, 0x8208F4C1U, 0xF50FC457U, 0x65B0D9C6U, 0x12B7E950U, 0x8BBEB8EAU,
+    0xFCB9887CU, 0x62DD1DDFU, 0x15DA2D49U, 0x8CD37CF3U, 0xFBD44C65U, 0x4DB26158U, 0x3AB551CEU,
+    0xA3BC0074U, 0xD4BB30E2U, 0x4ADFA541U, 0x3DD895D7U, 0xA4D1C46DU, 0xD3D6F4FBU, 0x4369E96AU,
+    0x346ED9FCU, 0xAD678846U, 0xDA60B8D0U, 0x44042D73U, 0x33031DE5U, 0xAA0A4C5FU, 0xDD0D7CC9U,
+    0x5005713CU, 0x270241AAU, 0xBE0B1010U, 0xC90C2086U, 0x5768B525U, 0x206F85B3U, 0xB966D409U,
+    0xCE61E49FU, 0x5EDEF90EU, 0x29D9C998U, 0xB0D09822U, 0xC7D7A8B4U, 0x59B33D17U, 0x2EB40D81U,
+    0xB7BD5C3BU, 0xC0BA6CADU, 0xEDB88320U, 0x9ABFB3B6U, 0x03B6E20CU, 0x74B1D29AU, 0xEAD54739U,
+    0x9DD277AFU, 0x04DB2615U, 0x73DC1683U, 0xE3630B12U, 0x94643B84U, 0x0D6D6A3EU, 0x7A6A5AA8U,
+    0xE40ECF0BU, 0x9309FF9DU, 0x0A00AE27U, 0x7D079EB1U, 0xF00F9344U, 0x8708A3D2U, 0x1E01F268U,
+    0x6906C2FEU, 0xF762575DU, 0x806567CBU, 0x196C3671U, 0x6E6B06E7U, 0xFED41B76U, 0x89D32BE0U,
+    0x10DA7A5AU, 0x67DD4ACCU, 0xF9B9DF6FU, 0x8EBEEFF9U, 0x17B7BE43U, 0x60B08ED5U, 0xD6D6A3E8U,
+    0xA1D1937EU, 0x38D8C2C4U, 0x4FDFF252U, 0xD1BB67F1U, 0xA6BC5767U, 0x3FB506DDU, 0x48B2364BU,
+    0xD80D2BDAU, 0xAF0A1B4CU, 0x36034AF6U, 0x41047A60U, 0xDF60EFC3U, 0xA867DF55U, 0x316E8EEFU,
+    0x4669BE79U, 0xCB61B38CU, 0xBC66831AU, 0x256FD2A0U, 0x5268E236U, 0xCC0C7795U, 0xBB0B4703U,
+    0x220216B9U, 0x5505262FU, 0xC5BA3BBEU, 0xB2BD0B28U, 0x2BB45A92U, 0x5CB36A04U, 0xC2D7FFA7U,
+    0xB5D0CF31U, 0x2CD99E8BU, 0x5BDEAE1DU, 0x9B64C2B0U, 0xEC63F226U, 0x756AA39CU, 0x026D930AU,
+    0x9C0906A9U, 0xEB0E363FU, 0x72076785U, 0x05005713U, 0x95BF4A82U, 0xE2B87A14U, 0x7BB12BAEU,
+    0x0CB61B38U, 0x92D28E9BU, 0xE5D5BE0DU, 0x7CDCEFB7U, 0x0BDBDF21U, 0x86D3D2D4U, 0xF1D4E242U,
+    0x68DDB3F8U, 0x1FDA836EU, 0x81BE16CDU, 0xF6B9265BU, 0x6FB077E1U, 0x18B74777U, 0x88085AE6U,
+    0xFF0F6A70U, 0x66063BCAU, 0x11010B5CU, 0x8F659EFFU, 0xF862AE69U, 0x616BFFD3U, 0x166CCF45U,
+    0xA00AE278U, 0xD70DD2EEU, 0x4E048354U, 0x3903B3C2U, 0xA7672661U, 0xD06016F7U, 0x4969474DU,
+    0x3E6E77DBU, 0xAED16A4AU, 0xD9D65ADCU, 0x40DF0B66U, 0x37D83BF0U, 0xA9BCAE53U, 0xDEBB9EC5U,
+    0x47B2CF7FU, 0x30B5FFE9U, 0xBDBDF21CU, 0xCABAC28AU, 0x53B39330U, 0x24B4A3A6U, 0xBAD03605U,
+    0xCDD70693U, 0x54DE5729U, 0x23D967BFU, 0xB3667A2EU, 0xC4614AB8U, 0x5D681B02U, 0x2A6F2B94U,
+    0xB40BBE37U, 0xC30C8EA1U, 0x5A05DF1BU, 0x2D02EF8DU
+};
+
+static inline uint32_t Iso14229CRC32Update(uint32_t crc, const uint8_t *data, uint32_t len) {
+    crc = ~crc;
+    while (len--) {
+        crc = Iso14229CRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+#if ISO14229_DIGEST_SHA256
+static const uint32_t Iso14229SHA256K[64] = {
+    0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU, 0x59F111F1U, 0x923F82A4U,
+    0xAB1C5ED5U, 0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU,
+    0x9BDC06A7U, 0xC19BF174U, 0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU, 0x2DE92C6FU,
+    0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU, 0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U,
+    0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U, 0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU,
+    0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U, 0xA2BFE8A1U, 0xA81A664BU,
+    0xC24B8B70U, 0xC76C51A3U, 0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U, 0x19A4C116U,
+    0x1E376C08U, 0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+    0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U, 0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U,
+    0xC67178F2U};
+
+#define ISO14229_SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static inline void _Iso14229SHA256Block(uint32_t h[8], const uint8_t *p) {
+    uint32_t w[64];
+    uint32_t a, b, c, d, e, f, g, k;
+
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) |
+               ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ISO14229_SHA256_ROTR(w[i - 15], 7) ^ ISO14229_SHA256_ROTR(w[i - 15], 18) ^
+                      (w[i - 15] >> 3);
+        uint32_t s1 = ISO14229_SHA256_ROTR(w[i - 2], 17) ^ ISO14229_SHA256_ROTR(w[i - 2], 19) ^
+                      (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t S1 = ISO14229_SHA256_ROTR(e, 6) ^ ISO14229_SHA256_ROTR(e, 11) ^
+                      ISO14229_SHA256_ROTR(e, 25);
+        uint32_t t1 = k + S1 + ((e & f) ^ (~e & g)) + Iso14229SHA256K[i] + w[i];
+        uint32_t S0 = ISO14229_SHA256_ROTR(a, 2) ^ ISO14229_SHA256_ROTR(a, 13) ^
+                      ISO14229_SHA256_ROTR(a, 22);
+        uint32_t t2 = S0 + ((a & b) ^ (a & c) ^ (b & c));
+        k = g, g = f, f = e, e = d + t1, d = c, c = b, b = a, a = t1 + t2;
+    }
+    h[0] += a, h[1] += b, h[2] += c, h[3] += d, h[4] += e, h[5] += f, h[6] += g, h[7] += k;
+}
+#endif
+
+static inline uint8_t Iso14229DigestLength(enum Iso14229DigestType type) {
+    switch (type) {
+    case kIso14229DigestCRC32:
+        return ISO14229_DIGEST_CRC32_LEN;
+#if ISO14229_DIGEST_SHA256
+    case kIso14229DigestSHA256:
+        return ISO14229_DIGEST_SHA256_LEN;
+#endif
+    default:
+        return 0;
+    }
+}
+
+static inline void Iso14229DigestInit(Iso14229Digest *d, enum Iso14229DigestType type) {
+    memset(d, 0, sizeof(*d));
+    d->type = type;
+#if ISO14229_DIGEST_SHA256
+    if (kIso14229DigestSHA256 == type) {
+        static const uint32_t init[8] = {0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU,
+                                         0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U};
+        memcpy(d->u.sha.h, init, sizeof(init));
+    }
+#endif
+}
+
+static inline void Iso14229DigestUpdate(Iso14229Digest *d, const uint8_t *data, uint32_t len) {
+    switch (d->type) {
+    case kIso14229DigestCRC32:
+        d->u.crc = Iso14229CRC32Update(d->u.crc, data, len);
+        break;
+#if ISO14229_DIGEST_SHA256
+    case kIso14229DigestSHA256: {
+        uint32_t used = d->u.sha.len % 64;
+        d->u.sha.len += len;
+        if (used) {
+            uint32_t n = 64 - used < len ? 64 - used : len;
+            memcpy(d->u.sha.block + used, data, n);
+            data += n;
+            len -= n;
+            if (used + n < 64) {
+                break;
+            }
+            _Iso14229SHA256Block(d->u.sha.h, d->u.sha.block);
+        }
+        // whole blocks straight from the input
+        for (; len >= 64; data += 64, len -= 64) {
+            _Iso14229SHA256Block(d->u.sha.h, data);
+        }
+        memcpy(d->u.sha.block, data, len);
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief \~chinese 取得结果 \~english Writes the digest to `out` (ISO14229_DIGEST_MAX_LEN bytes
+ * are enough). The digest can not be updated afterwards
+ * @return the length of the digest. 0 for kIso14229DigestNone
+ */
+static inline uint8_t Iso14229DigestFinal(Iso14229Digest *d, uint8_t *out) {
+    switch (d->type) {
+    case kIso14229DigestCRC32:
+        for (int i = 0; i < 4; i++) {
+            out[i] = (uint8_t)(d->u.crc >> (24 - 8 * i));
+        }
+        return ISO14229_DIGEST_CRC32_LEN;
+#if ISO14229_DIGEST_SHA256
+    case kIso14229DigestSHA256: {
+        uint64_t bits = d->u.sha.len * 8;
+        uint32_t used = d->u.sha.len % 64;
+        d->u.sha.block[used++] = 0x80;
+        if (used > 56) {
+            memset(d->u.sha.block + used, 0, 64 - used);
+            _Iso14229SHA256Block(d->u.sha.h, d->u.sha.block);
+            used = 0;
+        }
+        memset(d->u.sha.block + used, 0, 56 - used);
+        for (int i = 0; i < 8; i++) {
+            d->u.sha.block[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+        _Iso14229SHA256Block(d->u.sha.h, d->u.sha.block);
+        for (int i = 0; i < 32; i++) {
+            out[i] = (uint8_t)(d->u.sha.h[i / 4] >> (24 - 8 * (i % 4)));
+        }
+        return ISO14229_DIGEST_SHA256_LEN;
+    }
+#endif
+    default:
+        return 0;
+    }
+}
+
+#endif
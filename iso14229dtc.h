@@ -0,0 +1,436 @@
+#ifndef ISO14229DTC_H
+#define ISO14229DTC_H
+
+/**
+ * @brief \~chinese 故障码存储 \~english Fault memory for 0x14 ClearDiagnosticInformation and
+ * 0x19 ReadDTCInformation.
+ *
+ * The DTCs an ECU supports are fixed when the store is initialized and kept in an array sorted by
+ * DTC number. Next to the status byte of each DTC the store keeps one bitmap per status bit, so the
+ * DTCs matching a status mask are found and counted by scanning ISO14229_DTC_WORDS words per
+ * status bit instead of visiting every record. Change statuses only with the functions below, which
+ * keep the bitmaps up to date.
+ *
+ * Each DTC holds one snapshot record (DTCSnapshotRecordNumber 0x01), captured by the application
+ * with Iso14229DTCStoreSnapshot(), and two extended data records kept by the store: 0x01 the
+ * occurrence counter, 0x02 the aging counter.
+ *
+ * Changed records are written back to NVM in batches: Iso14229DTCStorePoll(), called by
+ * Iso14229ServerPoll(), waits `nvmWriteDelayms` after a change and then writes every run of
+ * adjacent changed records with one `nvmWrite` call.
+ *
+ * All functions must be called from the context that calls Iso14229ServerPoll().
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "iso14229.h"
+
+/**
+ * @brief number of DTCs a store holds
+ */
+#ifndef ISO14229_DTC_MAX_DTCS
+#define ISO14229_DTC_MAX_DTCS 32
+#endif
+
+/**
+ * @brief size of the snapshot record of each DTC, see Iso14229DTCRecord.snapshot
+ */
+#ifndef ISO14229_DTC_SNAPSHOT_SIZE
+#define ISO14229_DTC_SNAPSHOT_SIZE 16
+#endif
+
+/**
+ * @brief operation cycles without a failure after which a confirmed DTC is no longer confirmed
+ */
+#ifndef ISO14229_DTC_AGING_THRESHOLD
+#define ISO14229_DTC_AGING_THRESHOLD 40
+#endif
+
+#define ISO14229_DTC_WORDS ((ISO14229_DTC_MAX_DTCS + 31) / 32)
+#define ISO14229_DTC_GROUP_ALL 0xFFFFFFU
+
+#if defined(__GNUC__) || defined(__clang__)
+#define ISO14229_DTC_CTZ(x) __builtin_ctz(x)
+#define ISO14229_DTC_POPCOUNT(x) __builtin_popcount(x)
+#else
+static inline int ISO14229_DTC_CTZ(uint32_t x) {
+    int n = 0;
+    while (!(x & 1U)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+}
+static inline int ISO14229_DTC_POPCOUNT(uint32_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) {
+        n++;
+    }
+    return n;
+}
+#endif
+
+/**
+ * @brief DTC status bits, ISO14229-1 2013 D.2
+ */
+enum Iso14229DTCStatusBit {
+    kDTCTestFailed = 0x01,
+    kDTCTestFailedThisOperationCycle = 0x02,
+    kDTCPendingDTC = 0x04,
+    kDTCConfirmedDTC = 0x08,
+    kDTCTestNotCompletedSinceLastClear = 0x10,
+    kDTCTestFailedSinceLastClear = 0x20,
+    kDTCTestNotCompletedThisOperationCycle = 0x40,
+    kDTCWarningIndicatorRequested = 0x80,
+};
+
+#define ISO14229_DTC_STATUS_CLEARED                                                                \
+    (kDTCTestNotCompletedSinceLastClear | kDTCTestNotCompletedThisOperationCycle)
+
+/**
+ * @brief \~chinese 故障码记录 \~english The record of one DTC. Written to and read from NVM as is
+ */
+typedef struct {
+    uint32_t dtc;        // DTC number, 3 bytes
+    uint8_t status;      // DTC status byte, see enum Iso14229DTCStatusBit
+    uint8_t occurrences; // extended data record 0x01: rising edges of testFailed, saturating
+    uint8_t aging;       // extended data record 0x02: operation cycles without failure while
+                         // confirmed
+    uint8_t snapshotLen; // 0: no snapshot record
+    // DTCSnapshotRecordNumberOfIdentifiers followed by the DIDs and their data
+    uint8_t snapshot[ISO14229_DTC_SNAPSHOT_SIZE];
+} Iso14229DTCRecord;
+
+typedef struct {
+    Iso14229DTCRecord records[ISO14229_DTC_MAX_DTCS]; // sorted by ascending `dtc`
+    uint16_t numDTCs;
+    uint8_t availabilityMask; // DTCStatusAvailabilityMask: the status bits this ECU supports
+    bool settingOff;          // 0x85 DTCSettingType off: statuses and snapshots are not updated
+
+    uint32_t statusBits[8][ISO14229_DTC_WORDS]; // bit i of statusBits[b]: bit b of records[i]
+    uint32_t dirty[ISO14229_DTC_WORDS];         // records changed since they were last written
+    bool writeScheduled;
+    uint32_t writeTime; // the dirty records are written once this time has passed
+
+    // optional, set after Iso14229DTCStoreInit(): writes `count` records starting at `index`.
+    // Returns 0 on success, otherwise the records are written again nvmWriteDelayms later
+    int (*nvmWrite)(void *nvmCtx, uint16_t index, const Iso14229DTCRecord *records,
+                    uint16_t count);
+    void *nvmCtx;
+    uint16_t nvmWriteDelayms; // collects the changes of this many ms into one write
+    uint32_t nvmErrors;
+} Iso14229DTCStore;
+
+static inline void _Iso14229DTCStoreIndex(Iso14229DTCStore *store, uint16_t idx) {
+    uint32_t bit = 1UL << (idx % 32);
+    uint8_t status = store->records[idx].status;
+
+    for (uint8_t b = 0; b < 8; b++) {
+        if (status & (1U << b)) {
+            store->statusBits[b][idx / 32] |= bit;
+        } else {
+            store->statusBits[b][idx / 32] &= ~bit;
+        }
+    }
+}
+
+static inline void _Iso14229DTCStoreMarkDirty(Iso14229DTCStore *store, uint16_t idx) {
+    store->dirty[idx / 32] |= 1UL << (idx % 32);
+}
+
+/**
+ * @brief \~chinese 初始化 \~english Initializes a store with no faults recorded
+ * @param dtcs the supported DTC numbers, sorted ascending. Up to ISO14229_DTC_MAX_DTCS
+ * @param availabilityMask the status bits reported. Others read as 0
+ */
+static inline void Iso14229DTCStoreInit(Iso14229DTCStore *store, const uint32_t *dtcs,
+                                        uint16_t numDTCs, uint8_t availabilityMask) {
+    assert(numDTCs <= ISO14229_DTC_MAX_DTCS);
+    memset(store, 0, sizeof(*store));
+    store->numDTCs = numDTCs;
+    store->availabilityMask = availabilityMask;
+    for (uint16_t i = 0; i < numDTCs; i++) {
+        assert(0 == i || dtcs[i - 1] < dtcs[i]); // the DTCs must be sorted
+        store->records[i].dtc = dtcs[i] & ISO14229_DTC_GROUP_ALL;
+        store->records[i].status = ISO14229_DTC_STATUS_CLEARED & availabilityMask;
+        _Iso14229DTCStoreIndex(store, i);
+    }
+}
+
+/**
+ * @brief \~chinese 查找 \~english index of `dtc` in `records`
+ * @return -1 if the DTC is not supported
+ */
+static inline int32_t Iso14229DTCStoreFind(const Iso14229DTCStore *store, uint32_t dtc) {
+    int32_t lo = 0, hi = (int32_t)store->numDTCs - 1;
+
+    while (lo <= hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (store->records[mid].dtc == dtc) {
+            return mid;
+        } else if (store->records[mid].dtc < dtc) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief \~chinese 从NVM恢复 \~english Restores records read back from NVM, e.g. at startup.
+ * Records of DTCs which are no longer supported are skipped. Nothing is marked for writing
+ * @return the number of records restored
+ */
+static inline uint16_t Iso14229DTCStoreLoad(Iso14229DTCStore *store,
+                                            const Iso14229DTCRecord *records, uint16_t count) {
+    uint16_t restored = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t idx = Iso14229DTCStoreFind(store, records[i].dtc);
+        if (idx < 0 || records[i].snapshotLen > ISO14229_DTC_SNAPSHOT_SIZE) {
+            continue;
+        }
+        store->records[idx] = records[i];
+        store->records[idx].status &= store->availabilityMask;
+        _Iso14229DTCStoreIndex(store, (uint16_t)idx);
+        restored++;
+    }
+    return restored;
+}
+
+/**
+ * @brief \~chinese 设置状态 \~english Sets the status byte of the record at `idx`
+ */
+static inline void Iso14229DTCStoreSetStatus(Iso14229DTCStore *store, uint16_t idx,
+                                             uint8_t status) {
+    status &= store->availabilityMask;
+    if (store->records[idx].status != status) {
+        store->records[idx].status = status;
+        _Iso14229DTCStoreIndex(store, idx);
+        _Iso14229DTCStoreMarkDirty(store, idx);
+    }
+}
+
+/**
+ * @brief \~chinese 报告测试结果 \~english Reports the result of the test monitoring `dtc`. A failed
+ * test sets testFailed, pending and confirmed right away: debouncing is up to the monitor
+ * @return false if the DTC is not supported
+ */
+static inline bool Iso14229DTCStoreReportResult(Iso14229DTCStore *store, uint32_t dtc,
+                                                bool failed) {
+    int32_t idx = Iso14229DTCStoreFind(store, dtc);
+    if (idx < 0) {
+        return false;
+    }
+    if (store->settingOff) {
+        return true;
+    }
+
+    Iso14229DTCRecord *record = &store->records[idx];
+    uint8_t status = record->status & ~ISO14229_DTC_STATUS_CLEARED;
+    if (failed) {
+        if (!(record->status & kDTCTestFailed) && record->occurrences < UINT8_MAX) {
+            record->occurrences++;
+            _Iso14229DTCStoreMarkDirty(store, (uint16_t)idx);
+        }
+        if (record->aging) {
+            record->aging = 0;
+            _Iso14229DTCStoreMarkDirty(store, (uint16_t)idx);
+        }
+        status |= kDTCTestFailed | kDTCTestFailedThisOperationCycle | kDTCPendingDTC |
+                  kDTCConfirmedDTC | kDTCTestFailedSinceLastClear;
+    } else {
+        status &= ~kDTCTestFailed;
+    }
+    Iso14229DTCStoreSetStatus(store, (uint16_t)idx, status);
+    return true;
+}
+
+/**
+ * @brief \~chinese 保存快照 \~english Stores the snapshot record of `dtc`, replacing the last one
+ * @param data DTCSnapshotRecordNumberOfIdentifiers followed by the DIDs and their data
+ * @return false if the DTC is not supported or the record is longer than
+ * ISO14229_DTC_SNAPSHOT_SIZE
+ */
+static inline bool Iso14229DTCStoreSnapshot(Iso14229DTCStore *store, uint32_t dtc,
+                                            const uint8_t *data, uint8_t len) {
+    int32_t idx = Iso14229DTCStoreFind(store, dtc);
+    if (idx < 0 || len > ISO14229_DTC_SNAPSHOT_SIZE) {
+        return false;
+    }
+    if (!store->settingOff) {
+        memcpy(store->records[idx].snapshot, data, len);
+        store->records[idx].snapshotLen = len;
+        _Iso14229DTCStoreMarkDirty(store, (uint16_t)idx);
+    }
+    return true;
+}
+
+/**
+ * @brief \~chinese 新的运行周期 \~english Starts a new operation cycle: DTCs which did not fail
+ * in the last one are no longer pending and age, confirmed DTCs are no longer confirmed after
+ * ISO14229_DTC_AGING_THRESHOLD cycles
+ */
+static inline void Iso14229DTCStoreNewOperationCycle(Iso14229DTCStore *store) {
+    if (store->settingOff) {
+        return;
+    }
+    for (uint16_t i = 0; i < store->numDTCs; i++) {
+        Iso14229DTCRecord *record = &store->records[i];
+        uint8_t status = record->status;
+
+        if (!(status & kDTCTestFailedThisOperationCycle)) {
+            status &= ~kDTCPendingDTC;
+            if (status & kDTCConfirmedDTC) {
+                if (++record->aging >= ISO14229_DTC_AGING_THRESHOLD) {
+                    status &= ~kDTCConfirmedDTC;
+                    record->aging = 0;
+                }
+                _Iso14229DTCStoreMarkDirty(store, i);
+            }
+        }
+        status &= ~kDTCTestFailedThisOperationCycle;
+        status |= kDTCTestNotCompletedThisOperationCycle;
+        Iso14229DTCStoreSetStatus(store, i, status);
+    }
+}
+
+/**
+ * @brief \~chinese 清除 \~english Clears the status, snapshot and extended data of the DTCs in
+ * `groupOfDTC`: ISO14229_DTC_GROUP_ALL or a single DTC
+ * @return false if the group is not supported
+ */
+static inline bool Iso14229DTCStoreClear(Iso14229DTCStore *store, uint32_t groupOfDTC) {
+    uint16_t first = 0, end = store->numDTCs;
+
+    if (ISO14229_DTC_GROUP_ALL != groupOfDTC) {
+        int32_t idx = Iso14229DTCStoreFind(store, groupOfDTC);
+        if (idx < 0) {
+            return false;
+        }
+        first = (uint16_t)idx;
+        end = first + 1;
+    }
+
+    for (uint16_t i = first; i < end; i++) {
+        Iso14229DTCRecord *record = &store->records[i];
+        if (record->occurrences || record->aging || record->snapshotLen ||
+            record->status != (ISO14229_DTC_STATUS_CLEARED & store->availabilityMask)) {
+            record->occurrences = 0;
+            record->aging = 0;
+            record->snapshotLen = 0;
+            _Iso14229DTCStoreMarkDirty(store, i);
+        }
+        Iso14229DTCStoreSetStatus(store, i, ISO14229_DTC_STATUS_CLEARED);
+    }
+    return true;
+}
+
+/**
+ * @brief the DTCs among `records[32 * word ...]` with a status bit in `statusMask` set, one bit
+ * per DTC
+ */
+static inline uint32_t Iso14229DTCStoreMatch(const Iso14229DTCStore *store, uint8_t statusMask,
+                                             uint16_t word) {
+    uint32_t match = 0;
+
+    statusMask &= store->availabilityMask;
+    for (uint8_t b = 0; statusMask; b++, statusMask >>= 1) {
+        if (statusMask & 1U) {
+            match |= store->statusBits[b][word];
+        }
+    }
+    return match;
+}
+
+/**
+ * @brief \~chinese 计数 \~english the number of DTCs with a status bit in `statusMask` set
+ */
+static inline uint16_t Iso14229DTCStoreCount(const Iso14229DTCStore *store, uint8_t statusMask) {
+    uint16_t count = 0;
+
+    for (uint16_t w = 0; w < ISO14229_DTC_WORDS; w++) {
+        count += ISO14229_DTC_POPCOUNT(Iso14229DTCStoreMatch(store, statusMask, w));
+    }
+    return count;
+}
+
+/**
+ * @brief \~chinese 写回NVM \~english Writes all changed records now, e.g. before a reset
+ * @return true if nothing is left to write
+ */
+static inline bool Iso14229DTCStoreFlush(Iso14229DTCStore *store) {
+    uint16_t i = 0;
+
+    store->writeScheduled = false;
+    while (i < store->numDTCs) {
+        if (!(store->dirty[i / 32] & (1UL << (i % 32)))) {
+            i++;
+            continue;
+        }
+        uint16_t end = i + 1;
+        while (end < store->numDTCs && store->dirty[end / 32] & (1UL << (end % 32))) {
+            end++;
+        }
+        if (store->nvmWrite &&
+            0 != store->nvmWrite(store->nvmCtx, i, &store->records[i], end - i)) {
+            store->nvmErrors++;
+            return false;
+        }
+        for (; i < end; i++) {
+            store->dirty[i / 32] &= ~(1UL << (i % 32));
+        }
+    }
+    return true;
+}
+
+static inline bool _Iso14229DTCStoreDirty(const Iso14229DTCStore *store) {
+    for (uint16_t w = 0; w < ISO14229_DTC_WORDS; w++) {
+        if (store->dirty[w]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief \~chinese 轮询 \~english Schedules the write back of changed records and writes them
+ * once nvmWriteDelayms has passed. Called by Iso14229ServerPoll() for its store
+ */
+static inline void Iso14229DTCStorePoll(Iso14229DTCStore *store, uint32_t now) {
+    if (!store->writeScheduled) {
+        if (!_Iso14229DTCStoreDirty(store)) {
+            return;
+        }
+        store->writeScheduled = true;
+        store->writeTime = now + store->nvmWriteDelayms;
+    }
+    if (Iso14229TimeAfter(now, store->writeTime) && !Iso14229DTCStoreFlush(store)) {
+        // retry later
+        store->writeScheduled = true;
+        store->writeTime = now + store->nvmWriteDelayms;
+    }
+}
+
+/**
+ * @brief the time Iso14229DTCStorePoll() has to be called next
+ * @return false if no record needs to be written
+ */
+static inline bool Iso14229DTCStoreNextDeadline(const Iso14229DTCStore *store, uint32_t now,
+                                                uint32_t *deadline) {
+    if (store->writeScheduled) {
+        *deadline = store->writeTime;
+        return true;
+    }
+    if (_Iso14229DTCStoreDirty(store)) {
+        *deadline = now; // not scheduled yet
+        return true;
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,274 @@
+#ifndef ISO14229LZSS_H
+#define ISO14229LZSS_H
+
+/**
+ * @brief \~chinese 流式LZSS压缩/解压 \~english Streaming LZSS compression for 0x34/0x36
+ * downloads
+ *
+ * The stream is a sequence of groups. Each group starts with a flag byte followed by up to 8
+ * items, least significant flag bit first. A set bit is a literal byte. A clear bit is a 2 byte
+ * big-endian reference: the upper ISO14229_LZSS_WINDOW_BITS bits hold distance - 1, the lower
+ * ISO14229_LZSS_LENGTH_BITS bits hold length - ISO14229_LZSS_MIN_MATCH. The stream ends with the
+ * data, so the last group may hold fewer than 8 items.
+ *
+ * The decoder (server) works in static memory: a window of ISO14229_LZSS_WINDOW_SIZE bytes that
+ * is also the output buffer. The encoder (client) is larger and keeps a hash chain to find
+ * matches.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief log2 of the window size. Part of the stream format: client and server must agree
+ */
+#ifndef ISO14229_LZSS_WINDOW_BITS
+#define ISO14229_LZSS_WINDOW_BITS 10
+#endif
+
+#if ISO14229_LZSS_WINDOW_BITS < 8 || ISO14229_LZSS_WINDOW_BITS > 12
+#error "ISO14229_LZSS_WINDOW_BITS must be between 8 and 12"
+#endif
+
+#define ISO14229_LZSS_WINDOW_SIZE (1U << ISO14229_LZSS_WINDOW_BITS)
+#define ISO14229_LZSS_LENGTH_BITS (16 - ISO14229_LZSS_WINDOW_BITS)
+#define ISO14229_LZSS_MIN_MATCH 3U
+#define ISO14229_LZSS_MAX_MATCH (ISO14229_LZSS_MIN_MATCH + (1U << ISO14229_LZSS_LENGTH_BITS) - 1)
+#define ISO14229_LZSS_MAX_GROUP_LEN (1U + 2U * 8U)
+
+/**
+ * @brief dataFormatIdentifier of an LZSS compressed download: compressionMethod 1, no encryption
+ */
+#define ISO14229_DFI_LZSS 0x10U
+#define ISO14229_DFI_COMPRESSION_METHOD(dfi) (((dfi) >> 4) & 0x0FU)
+
+/**
+ * @brief number of entries of the encoder's hash table. Must be a power of two
+ */
+#ifndef ISO14229_LZSS_HASH_SIZE
+#define ISO14229_LZSS_HASH_SIZE 1024
+#endif
+
+/**
+ * @brief how many earlier positions the encoder compares before taking the best match so far
+ */
+#ifndef ISO14229_LZSS_MAX_CHAIN
+#define ISO14229_LZSS_MAX_CHAIN 32
+#endif
+
+typedef struct {
+    uint8_t window[ISO14229_LZSS_WINDOW_SIZE]; // decoded history and output buffer
+    uint16_t pos;       // index of the next decoded byte. Wraps to 0 on the call after it reaches
+                        // ISO14229_LZSS_WINDOW_SIZE
+    uint16_t matchDist; // distance of the reference being copied
+    uint16_t matchLen;  // bytes of the reference still to copy
+    uint8_t flags;      // flag bits of the current group not yet used
+    uint8_t flagBits;   // items left in the current group
+    uint8_t refHigh;    // first byte of a reference split across two inputs
+    bool haveRefHigh;
+} Iso14229LZSSDecoder;
+
+static inline void Iso14229LZSSDecoderInit(Iso14229LZSSDecoder *d) { memset(d, 0, sizeof(*d)); }
+
+/**
+ * @brief \~chinese 解压 \~english Decodes `in` until it is used up or the window is full.
+ * The decoded bytes are returned in place: `*out` points into the window and stays valid until
+ * the next call. Call again with the rest of the input (or with len 0) while `*outLen` is not 0.
+ * @return the number of input bytes consumed
+ */
+static inline uint16_t Iso14229LZSSDecode(Iso14229LZSSDecoder *d, const uint8_t *in,
+                                          uint16_t len, const uint8_t **out, uint16_t *outLen) {
+    uint16_t n = 0;
+    uint16_t start;
+
+    if (ISO14229_LZSS_WINDOW_SIZE == d->pos) {
+        d->pos = 0;
+    }
+    start = d->pos;
+
+    while (d->pos < ISO14229_LZSS_WINDOW_SIZE) {
+        if (d->matchLen) {
+            // byte by byte: a reference may overlap the bytes it produces
+            d->window[d->pos] =
+                d->window[(uint16_t)(d->pos - d->matchDist) & (ISO14229_LZSS_WINDOW_SIZE - 1)];
+            d->pos++;
+            d->matchLen--;
+            continue;
+        }
+        if (n == len) {
+            break;
+        }
+        if (0 == d->flagBits) {
+            d->flags = in[n++];
+            d->flagBits = 8;
+        } else if (d->flags & 1) {
+            d->window[d->pos++] = in[n++];
+            d->flags >>= 1;
+            d->flagBits--;
+        } else if (!d->haveRefHigh) {
+            d->refHigh = in[n++];
+            d->haveRefHigh = true;
+        } else {
+            uint16_t code = (uint16_t)((d->refHigh << 8) | in[n++]);
+            d->haveRefHigh = false;
+            d->matchDist = (code >> ISO14229_LZSS_LENGTH_BITS) + 1;
+            d->matchLen =
+                (code & ((1U << ISO14229_LZSS_LENGTH_BITS) - 1)) + ISO14229_LZSS_MIN_MATCH;
+            d->flags >>= 1;
+            d->flagBits--;
+        }
+    }
+
+    *out = &d->window[start];
+    *outLen = d->pos - start;
+    return n;
+}
+
+typedef struct {
+    uint8_t buf[2 * ISO14229_LZSS_WINDOW_SIZE]; // history followed by input not yet encoded
+    uint32_t base;                              // stream position of buf[0]
+    uint16_t cursor;                            // index in buf of the next byte to encode
+    uint16_t end;                               // index in buf after the last byte written
+    uint32_t head[ISO14229_LZSS_HASH_SIZE];     // latest stream position + 1 of each hash
+    uint32_t prev[ISO14229_LZSS_WINDOW_SIZE];   // earlier position + 1 with the same hash
+    uint8_t group[ISO14229_LZSS_MAX_GROUP_LEN]; // the group being built
+    uint8_t groupLen;
+    uint8_t groupItems;
+} Iso14229LZSSEncoder;
+
+static inline void Iso14229LZSSEncoderInit(Iso14229LZSSEncoder *e) { memset(e, 0, sizeof(*e)); }
+
+/**
+ * @brief \~chinese 取得输入缓冲区 \~english Returns where the next input bytes go. Write
+ * up to `*space` bytes there and pass the count to Iso14229LZSSEncoderCommit()
+ */
+static inline uint8_t *Iso14229LZSSEncoderBuffer(Iso14229LZSSEncoder *e, uint16_t *space) {
+    if (sizeof(e->buf) == e->end && e->cursor > ISO14229_LZSS_WINDOW_SIZE) {
+        // keep one window of history behind the cursor
+        uint16_t shift = e->cursor - ISO14229_LZSS_WINDOW_SIZE;
+        memmove(e->buf, e->buf + shift, e->end - shift);
+        e->base += shift;
+        e->cursor -= shift;
+        e->end -= shift;
+    }
+    *space = sizeof(e->buf) - e->end;
+    return e->buf + e->end;
+}
+
+static inline void Iso14229LZSSEncoderCommit(Iso14229LZSSEncoder *e, uint16_t len) {
+    e->end += len;
+}
+
+static inline uint16_t _Iso14229LZSSHash(const uint8_t *p) {
+    return (uint16_t)(((p[0] << 8) ^ (p[1] << 4) ^ p[2]) & (ISO14229_LZSS_HASH_SIZE - 1));
+}
+
+static inline void _Iso14229LZSSInsert(Iso14229LZSSEncoder *e, uint16_t idx) {
+    if (idx + ISO14229_LZSS_MIN_MATCH > e->end) {
+        return;
+    }
+    uint32_t pos = e->base + idx;
+    uint16_t h = _Iso14229LZSSHash(&e->buf[idx]);
+    e->prev[pos & (ISO14229_LZSS_WINDOW_SIZE - 1)] = e->head[h];
+    e->head[h] = pos + 1;
+}
+
+static inline void _Iso14229LZSSEncodeItem(Iso14229LZSSEncoder *e) {
+    uint16_t avail = e->end - e->cursor;
+    uint32_t pos = e->base + e->cursor;
+    uint16_t bestLen = 0;
+    uint16_t bestDist = 0;
+
+    if (avail >= ISO14229_LZSS_MIN_MATCH) {
+        uint16_t maxLen = avail < ISO14229_LZSS_MAX_MATCH ? avail : ISO14229_LZSS_MAX_MATCH;
+        uint32_t cand = e->head[_Iso14229LZSSHash(&e->buf[e->cursor])];
+        uint32_t limit = pos;
+        for (int chain = 0; cand && chain < ISO14229_LZSS_MAX_CHAIN; chain++) {
+            uint32_t candPos = cand - 1;
+            if (candPos >= limit || pos - candPos > ISO14229_LZSS_WINDOW_SIZE) {
+                break; // overwritten entry or out of the window
+            }
+            limit = candPos;
+            const uint8_t *a = &e->buf[candPos - e->base];
+            const uint8_t *b = &e->buf[e->cursor];
+            uint16_t l = 0;
+            while (l < maxLen && a[l] == b[l]) {
+                l++;
+            }
+            if (l > bestLen) {
+                bestLen = l;
+                bestDist = (uint16_t)(pos - candPos);
+                if (l == maxLen) {
+                    break;
+                }
+            }
+            cand = e->prev[candPos & (ISO14229_LZSS_WINDOW_SIZE - 1)];
+        }
+    }
+
+    if (0 == e->groupItems) {
+        e->group[0] = 0;
+        e->groupLen = 1;
+    }
+
+    uint16_t n;
+    if (bestLen >= ISO14229_LZSS_MIN_MATCH) {
+        uint16_t code = (uint16_t)(((bestDist - 1) << ISO14229_LZSS_LENGTH_BITS) |
+                                   (bestLen - ISO14229_LZSS_MIN_MATCH));
+        e->group[e->groupLen++] = code >> 8;
+        e->group[e->groupLen++] = code & 0xFF;
+        n = bestLen;
+    } else {
+        e->group[0] |= 1 << e->groupItems;
+        e->group[e->groupLen++] = e->buf[e->cursor];
+        n = 1;
+    }
+    e->groupItems++;
+
+    while (n--) {
+        _Iso14229LZSSInsert(e, e->cursor);
+        e->cursor++;
+    }
+}
+
+/**
+ * @brief \~chinese 压缩 \~english Encodes the input committed so far into whole groups
+ * @param out
+ * @param size stops before a group that does not fit. Must be at least ISO14229_LZSS_MAX_GROUP_LEN
+ * @param final true once all input has been committed: flushes the rest of the stream
+ * @return the number of bytes written to `out`. 0 when more input is needed, when the encoder is
+ * drained (final) or when the next group does not fit in `size`
+ */
+static inline uint16_t Iso14229LZSSEncode(Iso14229LZSSEncoder *e, uint8_t *out, uint16_t size,
+                                          bool final) {
+    uint16_t n = 0;
+    for (;;) {
+        if (8 == e->groupItems || (final && e->groupItems && e->cursor == e->end)) {
+            if (e->groupLen > size - n) {
+                break;
+            }
+            memcpy(out + n, e->group, e->groupLen);
+            n += e->groupLen;
+            e->groupItems = 0;
+            e->groupLen = 0;
+            continue;
+        }
+        // only take a match shorter than the maximum once no more input will come
+        uint16_t avail = e->end - e->cursor;
+        if (0 == avail || (!final && avail < ISO14229_LZSS_MAX_MATCH)) {
+            break;
+        }
+        _Iso14229LZSSEncodeItem(e);
+    }
+    return n;
+}
+
+/**
+ * @brief \~chinese 是否有待输出的组 \~english true if a complete group is waiting for space
+ */
+static inline bool Iso14229LZSSEncoderGroupFull(const Iso14229LZSSEncoder *e) {
+    return 8 == e->groupItems;
+}
+
+#endif
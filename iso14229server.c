@@ -40,10 +40,16 @@ static inline enum Iso14229ResponseCode NegativeResponse(Iso14229ServerRequestCo
     resp->requestSid = ctx->req.buf[0];
     resp->responseCode = response_code;
     ctx->resp.len = ISO14229_NEG_RESP_LEN;
+    ctx->numSegments = 0;
     return response_code;
 }
 
-static inline void NoResponse(Iso14229ServerRequestContext *ctx) { ctx->resp.len = 0; }
+static inline void NoResponse(Iso14229ServerRequestContext *ctx) {
+    ctx->resp.len = 0;
+    ctx->numSegments = 0;
+}
+
+static void _ClearAllDynamicDIDs(Iso14229ServerNode *node);
 
 /**
  * @brief 0x10 DiagnosticSessionControl
@@ -58,14 +64,14 @@ static enum Iso14229ResponseCode _0x10_DiagnosticSessionControl(Iso14229Server *
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    if (NULL == self->userDiagnosticSessionControlHandler) {
+    if (NULL == self->cfg->userDiagnosticSessionControlHandler) {
         return NegativeResponse(ctx, kServiceNotSupported);
     }
 
     uint8_t diagSessionType = ctx->req.buf[1] & 0x4F;
 
     enum Iso14229ResponseCode err =
-        self->userDiagnosticSessionControlHandler(&self->status, diagSessionType);
+        self->cfg->userDiagnosticSessionControlHandler(&self->node->status, diagSessionType);
 
     if (kPositiveResponse != err) {
         return NegativeResponse(ctx, err);
@@ -77,23 +83,33 @@ static enum Iso14229ResponseCode _0x10_DiagnosticSessionControl(Iso14229Server *
     case kProgrammingSession:
     case kExtendedDiagnostic:
     default:
-        self->s3_session_timeout_timer = self->userGetms() + self->s3_ms;
+        self->node->s3_session_timeout_timer = self->now + self->cfg->s3_ms;
         break;
     }
 
-    self->status.sessionType = diagSessionType;
+    self->node->status.sessionType = diagSessionType;
+
+    // periodic transmissions end with the session they were started in
+    self->node->numPeriodic = 0;
+    if (kDefaultSession == diagSessionType) {
+        _ClearAllDynamicDIDs(self->node);
+        // like 0x2A and 0x2C, DTC setting off ends with the non-default session
+        if (self->cfg->dtcStore) {
+            self->cfg->dtcStore->settingOff = false;
+        }
+    }
 
     ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_DIAGNOSTIC_SESSION_CONTROL);
     ctx->resp.buf[1] = diagSessionType;
 
     // ISO14229-1-2013: Table 29
     // resolution: 1ms
-    ctx->resp.buf[2] = self->p2_ms >> 8;
-    ctx->resp.buf[3] = self->p2_ms;
+    ctx->resp.buf[2] = self->cfg->p2_ms >> 8;
+    ctx->resp.buf[3] = self->cfg->p2_ms;
 
     // resolution: 10ms
-    ctx->resp.buf[4] = (self->p2_star_ms / 10) >> 8;
-    ctx->resp.buf[5] = self->p2_star_ms / 10;
+    ctx->resp.buf[4] = (self->cfg->p2_star_ms / 10) >> 8;
+    ctx->resp.buf[5] = self->cfg->p2_star_ms / 10;
 
     ctx->resp.len = ISO14229_0X10_RESP_LEN;
     return kPositiveResponse;
@@ -115,12 +131,12 @@ static enum Iso14229ResponseCode _0x11_ECUReset(Iso14229Server *self,
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    if (NULL == self->userECUResetHandler) {
+    if (NULL == self->cfg->userECUResetHandler) {
         return NegativeResponse(ctx, kGeneralProgrammingFailure);
     }
 
     enum Iso14229ResponseCode err =
-        self->userECUResetHandler(&self->status, resetType, &powerDownTime);
+        self->cfg->userECUResetHandler(&self->node->status, resetType, &powerDownTime);
     if (kPositiveResponse == err) {
         self->notReadyToReceive = true;
         self->ecuResetScheduled = true;
@@ -140,23 +156,313 @@ static enum Iso14229ResponseCode _0x11_ECUReset(Iso14229Server *self,
     return kPositiveResponse;
 }
 
+/**
+ * @brief 0x14 ClearDiagnosticInformation
+ * @addtogroup clearDiagnosticInformation_0x14
+ * @details groupOfDTC 0xFFFFFF clears all DTCs, any other value the DTC with that number.
+ */
+static enum Iso14229ResponseCode
+_0x14_ClearDiagnosticInformation(Iso14229Server *self, Iso14229ServerRequestContext *ctx) {
+    if (ctx->req.len != ISO14229_0X14_REQ_MIN_LEN) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+    if (NULL == self->cfg->dtcStore) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+
+    uint32_t groupOfDTC = ((uint32_t)ctx->req.buf[1] << 16) | (ctx->req.buf[2] << 8) |
+                          ctx->req.buf[3];
+    if (!Iso14229DTCStoreClear(self->cfg->dtcStore, groupOfDTC)) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_CLEAR_DIAGNOSTIC_INFORMATION);
+    ctx->resp.len = ISO14229_0X14_RESP_LEN;
+    return kPositiveResponse;
+}
+
+static uint8_t *_PutDTC(uint8_t *p, const Iso14229DTCStore *store, uint16_t idx) {
+    const Iso14229DTCRecord *record = &store->records[idx];
+    p[0] = record->dtc >> 16;
+    p[1] = record->dtc >> 8;
+    p[2] = record->dtc;
+    p[3] = record->status & store->availabilityMask;
+    return p + 4;
+}
+
+/**
+ * @brief the DTCs of `records[32 * word ...]` which exist, one bit per DTC
+ */
+static uint32_t _SupportedDTCs(const Iso14229DTCStore *store, uint16_t word) {
+    int32_t remaining = (int32_t)store->numDTCs - 32 * word;
+    if (remaining <= 0) {
+        return 0;
+    }
+    return remaining >= 32 ? UINT32_MAX : (1UL << remaining) - 1;
+}
+
+/**
+ * @brief responds DTCStatusAvailabilityMask and DTCAndStatusRecords, found by scanning the
+ * status bitmaps of the store
+ * @param supported true: all DTCs, false: the DTCs with a status bit in statusMask set
+ */
+static enum Iso14229ResponseCode _0x19_DTCList(Iso14229DTCStore *store,
+                                               Iso14229ServerRequestContext *ctx,
+                                               uint8_t statusMask, bool supported) {
+    uint16_t count = supported ? store->numDTCs : Iso14229DTCStoreCount(store, statusMask);
+    if (3U + 4U * count > ctx->resp.buffer_size) {
+        return NegativeResponse(ctx, kResponseTooLong);
+    }
+
+    uint8_t *p = &ctx->resp.buf[3];
+    ctx->resp.buf[2] = store->availabilityMask;
+    for (uint16_t w = 0; w < ISO14229_DTC_WORDS; w++) {
+        uint32_t match = supported ? _SupportedDTCs(store, w)
+                                   : Iso14229DTCStoreMatch(store, statusMask, w);
+        while (match) {
+            p = _PutDTC(p, store, 32 * w + ISO14229_DTC_CTZ(match));
+            match &= match - 1;
+        }
+    }
+    ctx->resp.len = p - ctx->resp.buf;
+    return kPositiveResponse;
+}
+
+/**
+ * @brief responds DTCAndStatusRecord and the snapshot or extended data records numbered
+ * recordNumber (0xFF: all) of one DTC
+ */
+static enum Iso14229ResponseCode _0x19_DTCRecords(Iso14229DTCStore *store,
+                                                  Iso14229ServerRequestContext *ctx,
+                                                  uint8_t reportType) {
+    uint32_t dtc = ((uint32_t)ctx->req.buf[2] << 16) | (ctx->req.buf[3] << 8) | ctx->req.buf[4];
+    uint8_t recordNumber = ctx->req.buf[5];
+    int32_t idx = Iso14229DTCStoreFind(store, dtc);
+    if (idx < 0) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+
+    const Iso14229DTCRecord *record = &store->records[idx];
+    uint8_t *p = _PutDTC(&ctx->resp.buf[2], store, (uint16_t)idx);
+    if (kReportDTCSnapshotRecordByDTCNumber == reportType) {
+        if (0x01 != recordNumber && 0xFF != recordNumber) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+        if (record->snapshotLen) {
+            if (7U + record->snapshotLen > ctx->resp.buffer_size) {
+                return NegativeResponse(ctx, kResponseTooLong);
+            }
+            *p++ = 0x01;
+            memmove(p, record->snapshot, record->snapshotLen);
+            p += record->snapshotLen;
+        }
+    } else {
+        // extended data records: 0x01 occurrence counter, 0x02 aging counter
+        if (0x01 != recordNumber && 0x02 != recordNumber && 0xFF != recordNumber) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+        if (10U > ctx->resp.buffer_size) {
+            return NegativeResponse(ctx, kResponseTooLong);
+        }
+        if (0x02 != recordNumber) {
+            *p++ = 0x01;
+            *p++ = record->occurrences;
+        }
+        if (0x01 != recordNumber) {
+            *p++ = 0x02;
+            *p++ = record->aging;
+        }
+    }
+    ctx->resp.len = p - ctx->resp.buf;
+    return kPositiveResponse;
+}
+
+/**
+ * @brief 0x19 ReadDTCInformation
+ * @addtogroup readDTCInformation_0x19
+ * @details answered from the DTC store. Supports the reportTypes in enum Iso14229DTCReportType.
+ */
+static enum Iso14229ResponseCode _0x19_ReadDTCInformation(Iso14229Server *self,
+                                                          Iso14229ServerRequestContext *ctx) {
+    Iso14229DTCStore *store = self->cfg->dtcStore;
+
+    if (ctx->req.len < ISO14229_0X19_REQ_MIN_LEN) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+    if (NULL == store) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+
+    uint8_t reportType = ctx->req.buf[1] & 0x7F;
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_READ_DTC_INFORMATION);
+    ctx->resp.buf[1] = reportType;
+
+    switch (reportType) {
+    case kReportNumberOfDTCByStatusMask: {
+        if (3 != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        uint16_t count = Iso14229DTCStoreCount(store, ctx->req.buf[2]);
+        ctx->resp.buf[2] = store->availabilityMask;
+        ctx->resp.buf[3] = ISO14229_0X19_DTC_FORMAT_ISO14229_1;
+        ctx->resp.buf[4] = count >> 8;
+        ctx->resp.buf[5] = count;
+        ctx->resp.len = 6;
+        return kPositiveResponse;
+    }
+    case kReportDTCByStatusMask:
+        if (3 != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        return _0x19_DTCList(store, ctx, ctx->req.buf[2], false);
+    case kReportSupportedDTC:
+        if (2 != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        return _0x19_DTCList(store, ctx, 0, true);
+    case kReportDTCSnapshotIdentification: {
+        if (2 != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        uint8_t *p = &ctx->resp.buf[2];
+        for (uint16_t i = 0; i < store->numDTCs; i++) {
+            const Iso14229DTCRecord *record = &store->records[i];
+            if (0 == record->snapshotLen) {
+                continue;
+            }
+            if (p + 4 > ctx->resp.buf + ctx->resp.buffer_size) {
+                return NegativeResponse(ctx, kResponseTooLong);
+            }
+            p = _PutDTC(p, store, i);
+            p[-1] = 0x01; // DTCSnapshotRecordNumber instead of the status
+        }
+        ctx->resp.len = p - ctx->resp.buf;
+        return kPositiveResponse;
+    }
+    case kReportDTCSnapshotRecordByDTCNumber:
+    case kReportDTCExtDataRecordByDTCNumber:
+        if (ISO14229_0X19_REQ_BY_DTC_LEN != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        return _0x19_DTCRecords(store, ctx, reportType);
+    default:
+        return NegativeResponse(ctx, kSubFunctionNotSupported);
+    }
+}
+
+/**
+ * @brief \~chinese 在数据标识符表中二分查找 \~english binary search of the DID table
+ * @return NULL if the DID is not in the table
+ */
+static const Iso14229DataIdentifier *_FindTableDID(const Iso14229Server *self,
+                                                   uint16_t dataId) {
+    uint16_t lo = 0;
+    uint16_t hi = self->cfg->didTableSize;
+
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        const Iso14229DataIdentifier *entry = &self->cfg->didTable[mid];
+        if (entry->did == dataId) {
+            return entry;
+        } else if (entry->did < dataId) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static enum Iso14229ResponseCode _CheckAccess(const struct Iso14229ServerStatus *status,
+                                                 uint8_t sessions, uint8_t securityLevel) {
+    if (0 == (sessions & ISO14229_SESSION_BIT(status->sessionType))) {
+        return kRequestOutOfRange;
+    }
+    if (0 != securityLevel && status->securityLevel != securityLevel) {
+        return kSecurityAccessDenied;
+    }
+    return kPositiveResponse;
+}
+
+static struct Iso14229DynamicDID *_FindDynamicDID(Iso14229ServerNode *node, uint16_t dataId) {
+    for (uint8_t i = 0; i < ISO14229_SERVER_MAX_DYNAMIC_DIDS; i++) {
+        if (node->dynamicDIDs[i].entry.did == dataId) {
+            return &node->dynamicDIDs[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief find a DID in the DID table or among the active node's dynamically defined DIDs
+ * @return NULL if the DID is not known
+ */
+static const Iso14229DataIdentifier *_FindDID(const Iso14229Server *self, uint16_t dataId) {
+    const Iso14229DataIdentifier *entry = _FindTableDID(self, dataId);
+    if (NULL == entry && dataId >= ISO14229_DYNAMIC_DID_MIN && dataId <= ISO14229_DYNAMIC_DID_MAX) {
+        struct Iso14229DynamicDID *dynamic = _FindDynamicDID(self->node, dataId);
+        if (dynamic) {
+            entry = &dynamic->entry;
+        }
+    }
+    return entry;
+}
+
+/**
+ * @brief \~chinese 在存储区表中二分查找 \~english binary search of the memory region table
+ * @return the region holding all memorySize bytes at memoryAddress. NULL if there is none
+ */
+static const Iso14229MemoryRegion *_FindMemoryRegion(const Iso14229Server *self,
+                                                     size_t memoryAddress, size_t memorySize) {
+    uint16_t lo = 0;
+    uint16_t hi = self->cfg->numMemoryRegions;
+
+    // the last region starting at or before memoryAddress
+    while (lo < hi) {
+        uint16_t mid = lo + (hi - lo) / 2;
+        if (self->cfg->memoryRegions[mid].base <= memoryAddress) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (0 == lo) {
+        return NULL;
+    }
+
+    const Iso14229MemoryRegion *region = &self->cfg->memoryRegions[lo - 1];
+    size_t offset = memoryAddress - region->base;
+    if (offset >= region->size || memorySize > region->size - offset) {
+        return NULL;
+    }
+    return region;
+}
+
 /**
  * @brief 0x22 ReadDataByIdentifier
  * @addtogroup readDataByIdentifier_0x22
+ * @details The response is checked against the response buffer before any record is read. Records
+ * of table entries without a `read` function are not copied: the response is sent as a list of
+ * segments pointing at them, as long as ISO_TP_MAX_SEND_SEGMENTS allows.
  * @param self
  * @param data
  * @param size
  */
 static enum Iso14229ResponseCode _0x22_ReadDataByIdentifier(Iso14229Server *self,
                                                             Iso14229ServerRequestContext *ctx) {
-    uint8_t numDIDs;
+    const struct Iso14229ServerStatus *status = &self->node->status;
+    uint16_t numDIDs;
     const uint8_t *data_location = NULL;
     uint16_t dataRecordSize = 0;
-    uint16_t responseLength = 1;
+    uint32_t requiredLength = ISO14229_0X22_RESP_BASE_LEN; // known response length
+    uint32_t responseLength = ISO14229_0X22_RESP_BASE_LEN; // total, including external segments
+    uint16_t bufferLength = ISO14229_0X22_RESP_BASE_LEN;   // bytes written to resp.buf
+    uint16_t segmentStart = 0; // start of the part of resp.buf not yet in a segment
     uint16_t dataId = 0;
     enum Iso14229ResponseCode rdbi_response;
 
-    if (NULL == self->userRDBIHandler) {
+    if (NULL == self->cfg->userRDBIHandler && 0 == self->cfg->didTableSize &&
+        0 == self->cfg->numMemoryRegions) {
         return NegativeResponse(ctx, kServiceNotSupported);
     }
 
@@ -170,23 +476,82 @@ static enum Iso14229ResponseCode _0x22_ReadDataByIdentifier(Iso14229Server *self
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    for (int did = 0; did < numDIDs; did++) {
+    // resolve and access-check every DID in the table, and check the response length
+    for (uint16_t did = 0; did < numDIDs; did++) {
+        uint16_t idx = 1 + did * 2;
+        dataId = (ctx->req.buf[idx] << 8) + ctx->req.buf[idx + 1];
+        const Iso14229DataIdentifier *entry = _FindDID(self, dataId);
+
+        requiredLength += sizeof(uint16_t);
+        if (entry) {
+            rdbi_response = _CheckAccess(status, entry->readSessions, entry->readSecurityLevel);
+            if (kPositiveResponse != rdbi_response) {
+                return NegativeResponse(ctx, rdbi_response);
+            }
+            requiredLength += entry->len;
+        } else if (NULL == self->cfg->userRDBIHandler) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+    }
+    if (requiredLength > ctx->resp.buffer_size) {
+        return NegativeResponse(ctx, kResponseTooLong);
+    }
+
+    for (uint16_t did = 0; did < numDIDs; did++) {
         uint16_t idx = 1 + did * 2;
         dataId = (ctx->req.buf[idx] << 8) + ctx->req.buf[idx + 1];
-        rdbi_response =
-            self->userRDBIHandler(&self->status, dataId, &data_location, &dataRecordSize);
-
-        if (kPositiveResponse == rdbi_response) {
-            // TODO: make this safe: ensure that the offset doesn't exceed the
-            // response buffer
-            uint8_t *copylocation = ctx->resp.buf + responseLength;
-            copylocation[0] = dataId >> 8;
-            copylocation[1] = dataId;
+        const Iso14229DataIdentifier *entry = _FindDID(self, dataId);
+        uint8_t *copylocation = ctx->resp.buf + bufferLength;
+
+        copylocation[0] = dataId >> 8;
+        copylocation[1] = dataId;
+        bufferLength += sizeof(uint16_t);
+        responseLength += sizeof(uint16_t);
+
+        if (NULL == entry) {
+            rdbi_response =
+                self->cfg->userRDBIHandler(status, dataId, &data_location, &dataRecordSize);
+            if (kPositiveResponse != rdbi_response) {
+                return NegativeResponse(ctx, rdbi_response);
+            }
+            // the length of handler records is only known now
+            requiredLength += dataRecordSize;
+            if (requiredLength > ctx->resp.buffer_size) {
+                return NegativeResponse(ctx, kResponseTooLong);
+            }
             memmove(copylocation + sizeof(uint16_t), data_location, dataRecordSize);
-            responseLength += sizeof(uint16_t) + dataRecordSize;
+        } else if (entry->read) {
+            // the record is produced directly into the response
+            dataRecordSize = entry->len;
+            rdbi_response =
+                entry->read(status, entry, copylocation + sizeof(uint16_t), &dataRecordSize);
+            if (kPositiveResponse != rdbi_response) {
+                return NegativeResponse(ctx, rdbi_response);
+            }
+            if (dataRecordSize > entry->len) {
+                return NegativeResponse(ctx, kGeneralProgrammingFailure);
+            }
+        } else if (ctx->numSegments + 3 <= ISO_TP_MAX_SEND_SEGMENTS) {
+            // close the buffered part and send the record from where it is. One segment is kept
+            // free for the rest of the buffer
+            ctx->segments[ctx->numSegments++] = (IsoTpSegment){
+                .data = ctx->resp.buf + segmentStart, .len = bufferLength - segmentStart};
+            ctx->segments[ctx->numSegments++] =
+                (IsoTpSegment){.data = entry->data, .len = entry->len};
+            segmentStart = bufferLength;
+            responseLength += entry->len;
+            continue;
         } else {
-            return NegativeResponse(ctx, rdbi_response);
+            dataRecordSize = entry->len;
+            memmove(copylocation + sizeof(uint16_t), entry->data, dataRecordSize);
         }
+        bufferLength += dataRecordSize;
+        responseLength += dataRecordSize;
+    }
+
+    if (ctx->numSegments && bufferLength > segmentStart) {
+        ctx->segments[ctx->numSegments++] = (IsoTpSegment){.data = ctx->resp.buf + segmentStart,
+                                                           .len = bufferLength - segmentStart};
     }
 
     ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_READ_DATA_BY_IDENTIFIER);
@@ -194,6 +559,68 @@ static enum Iso14229ResponseCode _0x22_ReadDataByIdentifier(Iso14229Server *self
     return kPositiveResponse;
 }
 
+/**
+ * @brief 0x23 ReadMemoryByAddress
+ * @addtogroup readMemoryByAddress_0x23
+ * @details regions without a `read` function are sent directly from their `data`
+ * @param self
+ * @param ctx
+ */
+static enum Iso14229ResponseCode _0x23_ReadMemoryByAddress(Iso14229Server *self,
+                                                           Iso14229ServerRequestContext *ctx) {
+    const struct Iso14229ServerStatus *status = &self->node->status;
+    uint8_t addressAndLengthFormatIdentifier = ctx->req.buf[1];
+    uint8_t alfidLen = Iso14229ALFIDLength(addressAndLengthFormatIdentifier);
+    size_t memoryAddress = 0;
+    size_t memorySize = 0;
+    enum Iso14229ResponseCode err;
+
+    if (0 == self->cfg->numMemoryRegions) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+    if (0 == alfidLen) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+    if (ctx->req.len != ISO14229_0X23_REQ_BASE_LEN + alfidLen) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+
+    Iso14229DecodeALFID(addressAndLengthFormatIdentifier,
+                        &ctx->req.buf[ISO14229_0X23_REQ_BASE_LEN], &memoryAddress, &memorySize);
+    const Iso14229MemoryRegion *region = _FindMemoryRegion(self, memoryAddress, memorySize);
+    if (NULL == region || 0 == memorySize || (NULL == region->read && NULL == region->data)) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+    err = _CheckAccess(status, region->readSessions, region->readSecurityLevel);
+    if (kPositiveResponse != err) {
+        return NegativeResponse(ctx, err);
+    }
+    if (memorySize > UINT16_MAX - ISO14229_0X23_RESP_BASE_LEN) {
+        return NegativeResponse(ctx, kResponseTooLong);
+    }
+
+    size_t offset = memoryAddress - region->base;
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_READ_MEMORY_BY_ADDRESS);
+    if (region->read) {
+        if (memorySize > ctx->resp.buffer_size - ISO14229_0X23_RESP_BASE_LEN) {
+            return NegativeResponse(ctx, kResponseTooLong);
+        }
+        err = region->read(status, region, offset, &ctx->resp.buf[ISO14229_0X23_RESP_BASE_LEN],
+                           memorySize);
+        if (kPositiveResponse != err) {
+            return NegativeResponse(ctx, err);
+        }
+    } else {
+        ctx->segments[0] =
+            (IsoTpSegment){.data = ctx->resp.buf, .len = ISO14229_0X23_RESP_BASE_LEN};
+        ctx->segments[1] =
+            (IsoTpSegment){.data = (const uint8_t *)region->data + offset, .len = memorySize};
+        ctx->numSegments = 2;
+    }
+    ctx->resp.len = ISO14229_0X23_RESP_BASE_LEN + memorySize;
+    return kPositiveResponse;
+}
+
 /**
  * @brief 0x27 SecurityAccess
  * @addtogroup securityAccess_0x27
@@ -210,8 +637,8 @@ static enum Iso14229ResponseCode _0x27_SecurityAccess(Iso14229Server *self,
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    if (NULL == self->userSecurityAccessGenerateSeed ||
-        NULL == self->userSecurityAccessValidateKey) {
+    if (NULL == self->cfg->userSecurityAccessGenerateSeed ||
+        NULL == self->cfg->userSecurityAccessValidateKey) {
         return NegativeResponse(ctx, kServiceNotSupported);
     }
 
@@ -220,14 +647,14 @@ static enum Iso14229ResponseCode _0x27_SecurityAccess(Iso14229Server *self,
 
     // Even: sendKey
     if (0 == subFunction % 2) {
-        response = self->userSecurityAccessValidateKey(&self->status, subFunction,
-                                                       &ctx->req.buf[ISO14229_0X27_REQ_BASE_LEN],
-                                                       ctx->req.len - ISO14229_0X27_REQ_BASE_LEN);
+        response = self->cfg->userSecurityAccessValidateKey(
+            &self->node->status, subFunction, &ctx->req.buf[ISO14229_0X27_REQ_BASE_LEN],
+            ctx->req.len - ISO14229_0X27_REQ_BASE_LEN);
 
         if (kPositiveResponse != response) {
             return NegativeResponse(ctx, response);
         }
-        self->status.securityLevel = subFunction - 1;
+        self->node->status.securityLevel = subFunction - 1;
         ctx->resp.len = ISO14229_0X27_RESP_BASE_LEN;
         return kPositiveResponse;
     }
@@ -244,8 +671,8 @@ static enum Iso14229ResponseCode _0x27_SecurityAccess(Iso14229Server *self,
 
         uint16_t buffer_size_remaining = ctx->resp.buffer_size - ISO14229_0X27_RESP_BASE_LEN;
 
-        response = self->userSecurityAccessGenerateSeed(
-            &self->status, subFunction, &ctx->req.buf[ISO14229_0X27_REQ_BASE_LEN],
+        response = self->cfg->userSecurityAccessGenerateSeed(
+            &self->node->status, subFunction, &ctx->req.buf[ISO14229_0X27_REQ_BASE_LEN],
             ctx->req.len - ISO14229_0X27_REQ_BASE_LEN, &ctx->resp.buf[ISO14229_0X27_RESP_BASE_LEN],
             buffer_size_remaining, &seedLength);
 
@@ -279,12 +706,12 @@ static enum Iso14229ResponseCode _0x28_CommunicationControl(Iso14229Server *self
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    if (NULL == self->userCommunicationControlHandler) {
+    if (NULL == self->cfg->userCommunicationControlHandler) {
         return NegativeResponse(ctx, kServiceNotSupported);
     }
 
-    enum Iso14229ResponseCode err =
-        self->userCommunicationControlHandler(&self->status, controlType, communicationType);
+    enum Iso14229ResponseCode err = self->cfg->userCommunicationControlHandler(
+        &self->node->status, controlType, communicationType);
     if (kPositiveResponse != err) {
         return NegativeResponse(ctx, err);
     }
@@ -295,185 +722,512 @@ static enum Iso14229ResponseCode _0x28_CommunicationControl(Iso14229Server *self
     return kPositiveResponse;
 }
 
-/**
- * @brief 0x2E WriteDataByIdentifier
- *
- * @param self
- * @param data
- * @param size
- */
-static enum Iso14229ResponseCode _0x2E_WriteDataByIdentifier(Iso14229Server *self,
-                                                             Iso14229ServerRequestContext *ctx) {
-    uint16_t dataLen = 0;
-    uint16_t dataId = 0;
-    enum Iso14229ResponseCode wdbi_response;
-
-    /* ISO14229-1 2013 Figure 21 Key 1 */
-    if (ctx->req.len < ISO14229_0X2E_REQ_MIN_LEN) {
-        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+static int _FindPeriodic(const Iso14229ServerNode *node, uint8_t pdid) {
+    for (int i = 0; i < node->numPeriodic; i++) {
+        if (node->periodic[i].pdid == pdid) {
+            return i;
+        }
     }
+    return -1;
+}
 
-    dataId = (ctx->req.buf[1] << 8) + ctx->req.buf[2];
-    dataLen = ctx->req.len - ISO14229_0X2E_REQ_BASE_LEN;
+static void _RemovePeriodic(Iso14229ServerNode *node, int idx) {
+    memmove(&node->periodic[idx], &node->periodic[idx + 1],
+            (node->numPeriodic - idx - 1) * sizeof(node->periodic[0]));
+    node->numPeriodic--;
+}
 
-    if (NULL != self->userWDBIHandler) {
-        wdbi_response = self->userWDBIHandler(&self->status, dataId,
-                                              &ctx->req.buf[ISO14229_0X2E_REQ_BASE_LEN], dataLen);
-        if (kPositiveResponse != wdbi_response) {
-            return NegativeResponse(ctx, wdbi_response);
-        }
-    } else {
-        return NegativeResponse(ctx, kServiceNotSupported);
+/**
+ * @brief insert into the schedule, behind the entries with the same or a shorter period
+ */
+static void _SchedulePeriodic(Iso14229ServerNode *node, uint8_t pdid, uint16_t period_ms,
+                              uint32_t now) {
+    int idx = _FindPeriodic(node, pdid);
+    if (idx >= 0) {
+        _RemovePeriodic(node, idx);
     }
-
-    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_WRITE_DATA_BY_IDENTIFIER);
-    ctx->resp.buf[1] = dataId >> 8;
-    ctx->resp.buf[2] = dataId;
-    ctx->resp.len = ISO14229_0X2E_RESP_LEN;
-    return kPositiveResponse;
+    for (idx = node->numPeriodic; idx > 0 && node->periodic[idx - 1].period_ms > period_ms;
+         idx--) {
+        node->periodic[idx] = node->periodic[idx - 1];
+    }
+    node->periodic[idx] = (struct Iso14229PeriodicEntry){
+        .pdid = pdid,
+        .period_ms = period_ms,
+        .due = now,
+    };
+    node->numPeriodic++;
 }
 
 /**
- * @brief 0x31 RoutineControl
- *
- * @addtogroup routineControl_0x31
+ * @brief 0x2A ReadDataByPeriodicIdentifier
+ * @addtogroup readDataByPeriodicIdentifier_0x2A
+ * @details periodic messages are sent by Iso14229ServerPoll() as single CAN frames on the node's
+ * periodic_send_id: the periodicDataIdentifier followed by the data record of DataIdentifier
+ * 0xF200 + periodicDataIdentifier (ISO14229-1 2013 Annex C.4 periodic message type 1). These
+ * frames have no ISO-TP header, so they need an arbitration ID of their own: without a
+ * periodic_send_id nothing can be scheduled (conditionsNotCorrect).
  * @param self
- * @param data
- * @param size
+ * @param ctx
  */
-static enum Iso14229ResponseCode _0x31_RoutineControl(Iso14229Server *self,
-                                                      Iso14229ServerRequestContext *ctx) {
-    enum Iso14229ResponseCode err = kPositiveResponse;
-    if (ctx->req.len < ISO14229_0X31_REQ_MIN_LEN) {
-        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
-    }
-    if (NULL == self->userRoutineControlHandler) {
+static enum Iso14229ResponseCode
+_0x2A_ReadDataByPeriodicIdentifier(Iso14229Server *self, Iso14229ServerRequestContext *ctx) {
+    Iso14229ServerNode *node = self->node;
+    uint8_t transmissionMode = ctx->req.buf[1];
+    const uint8_t *pdids = &ctx->req.buf[ISO14229_0X2A_REQ_MIN_LEN];
+    uint16_t numPDIDs = ctx->req.len - ISO14229_0X2A_REQ_MIN_LEN;
+    uint16_t numNew = 0;
+
+    if (NULL == self->cfg->userRDBIHandler && 0 == self->cfg->didTableSize &&
+        0 == self->cfg->numMemoryRegions) {
         return NegativeResponse(ctx, kServiceNotSupported);
     }
-    uint8_t routineControlType = ctx->req.buf[1];
-    uint16_t routineIdentifier = (ctx->req.buf[2] << 8) + ctx->req.buf[3];
-    const uint8_t *optionRecord = &ctx->req.buf[ISO14229_0X31_REQ_MIN_LEN];
-    uint16_t optionRecordLength = ctx->req.len - ISO14229_0X31_REQ_MIN_LEN;
-    uint16_t statusRecordBufferSize = ctx->resp.buffer_size - ISO14229_0X31_RESP_MIN_LEN;
-    uint16_t statusRecordLength = 0; // The actual statusRecord length written by the routine
-
-    Iso14229RoutineControlArgs args = {
-        .optionRecord = optionRecord,
-        .optionRecordLength = optionRecordLength,
-        .statusRecord = &ctx->resp.buf[ISO14229_0X31_RESP_MIN_LEN],
-        .statusRecordBufferSize = statusRecordBufferSize,
-        .statusRecordLength = &statusRecordLength,
-    };
 
-    switch (routineControlType) {
-    case kStartRoutine:
-    case kStopRoutine:
-    case kRequestRoutineResults:
-        err = self->userRoutineControlHandler(&self->status, routineControlType, routineIdentifier,
-                                              &args);
-        if (kPositiveResponse != err) {
-            return NegativeResponse(ctx, err);
+    switch (transmissionMode) {
+    case kSendAtSlowRate:
+    case kSendAtMediumRate:
+    case kSendAtFastRate:
+        if (0 == numPDIDs) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        if (0 == node->periodicSendId) {
+            return NegativeResponse(ctx, kConditionsNotCorrect);
+        }
+        for (uint16_t i = 0; i < numPDIDs; i++) {
+            const Iso14229DataIdentifier *entry = _FindDID(self, ISO14229_0X2A_DID_BASE | pdids[i]);
+            if (entry) {
+                enum Iso14229ResponseCode err =
+                    _CheckAccess(&node->status, entry->readSessions, entry->readSecurityLevel);
+                if (kPositiveResponse != err) {
+                    return NegativeResponse(ctx, err);
+                }
+                if (entry->len > ISO14229_0X2A_MAX_RECORD_LEN) {
+                    return NegativeResponse(ctx, kRequestOutOfRange);
+                }
+            } else if (NULL == self->cfg->userRDBIHandler) {
+                return NegativeResponse(ctx, kRequestOutOfRange);
+            }
+            if (_FindPeriodic(node, pdids[i]) < 0) {
+                numNew++;
+            }
+        }
+        if (node->numPeriodic + numNew > ISO14229_SERVER_MAX_PERIODIC_DIDS) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+        for (uint16_t i = 0; i < numPDIDs; i++) {
+            _SchedulePeriodic(node, pdids[i], self->periodic_ms[transmissionMode - 1],
+                              self->now);
+        }
+        break;
+    case kStopSending:
+        if (0 == numPDIDs) {
+            node->numPeriodic = 0;
+        }
+        for (uint16_t i = 0; i < numPDIDs; i++) {
+            int idx = _FindPeriodic(node, pdids[i]);
+            if (idx >= 0) {
+                _RemovePeriodic(node, idx);
+            }
         }
         break;
     default:
-        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
-    }
-
-    if (statusRecordLength > args.statusRecordBufferSize) {
-        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+        return NegativeResponse(ctx, kRequestOutOfRange);
     }
 
-    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_ROUTINE_CONTROL);
-    ctx->resp.buf[1] = routineControlType;
-    ctx->resp.buf[2] = routineIdentifier >> 8;
-    ctx->resp.buf[3] = routineIdentifier;
-    ctx->resp.len = ISO14229_0X31_RESP_MIN_LEN + statusRecordLength;
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_READ_PERIODIC_DATA_BY_IDENTIFIER);
+    ctx->resp.len = ISO14229_0X2A_RESP_LEN;
     return kPositiveResponse;
 }
 
 /**
- * @brief 0x34 RequestDownload
- *
- * @param self
- * @param data
- * @param size
+ * @brief \~chinese 执行动态数据标识符的复制计划 \~english read a dynamically defined DID: run
+ * its copy plan
  */
-static enum Iso14229ResponseCode _0x34_RequestDownload(Iso14229Server *self,
-                                                       Iso14229ServerRequestContext *ctx) {
-    enum Iso14229ResponseCode err;
-    uint16_t maxNumberOfBlockLength = 0;
-    size_t memoryAddress = 0;
-    size_t memorySize = 0;
-
-    if (NULL == self->userRequestDownloadHandler) {
-        return NegativeResponse(ctx, kServiceNotSupported);
+static enum Iso14229ResponseCode _DynamicDIDRead(const struct Iso14229ServerStatus *status,
+                                                 const struct Iso14229DataIdentifier *entry,
+                                                 uint8_t *buf, uint16_t *len) {
+    const struct Iso14229DynamicDID *dynamic = (const struct Iso14229DynamicDID *)entry;
+
+    for (uint8_t i = 0; i < dynamic->numSteps; i++) {
+        const struct Iso14229DDDICopyStep *step = &dynamic->steps[i];
+        enum Iso14229ResponseCode err =
+            step->source
+                ? _CheckAccess(status, step->source->readSessions, step->source->readSecurityLevel)
+                : _CheckAccess(status, step->region->readSessions, step->region->readSecurityLevel);
+        if (kPositiveResponse != err) {
+            return err;
+        }
+        memmove(buf, step->src, step->len);
+        buf += step->len;
     }
+    *len = entry->len;
+    return kPositiveResponse;
+}
 
-    if (NULL != self->downloadHandler) {
-        return NegativeResponse(ctx, kConditionsNotCorrect);
-    }
+static void _ClearDynamicDID(Iso14229ServerNode *node, struct Iso14229DynamicDID *dynamic) {
+    struct Iso14229DDDICopyStep *end = dynamic->steps + dynamic->numSteps;
+    int periodicIdx;
 
-    if (ctx->req.len < ISO14229_0X34_REQ_BASE_LEN) {
-        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    // keep the remaining steps contiguous
+    memmove(dynamic->steps, end,
+            (node->dddiSteps + node->numDDDISteps - end) * sizeof(struct Iso14229DDDICopyStep));
+    for (uint8_t i = 0; i < ISO14229_SERVER_MAX_DYNAMIC_DIDS; i++) {
+        if (node->dynamicDIDs[i].entry.did && node->dynamicDIDs[i].steps >= end) {
+            node->dynamicDIDs[i].steps -= dynamic->numSteps;
+        }
     }
+    node->numDDDISteps -= dynamic->numSteps;
 
-    uint8_t dataFormatIdentifier = ctx->req.buf[1];
-    uint8_t memorySizeLength = (ctx->req.buf[2] & 0xF0) >> 4;
-    uint8_t memoryAddressLength = ctx->req.buf[2] & 0x0F;
+    // a periodic transmission of the DID ends with it
+    if ((dynamic->entry.did & 0xFF00) == ISO14229_0X2A_DID_BASE &&
+        (periodicIdx = _FindPeriodic(node, dynamic->entry.did & 0xFF)) >= 0) {
+        _RemovePeriodic(node, periodicIdx);
+    }
+    memset(dynamic, 0, sizeof(*dynamic));
+}
 
-    if (memorySizeLength == 0 || memorySizeLength > sizeof(memorySize)) {
-        return NegativeResponse(ctx, kRequestOutOfRange);
+static void _ClearAllDynamicDIDs(Iso14229ServerNode *node) {
+    for (uint8_t i = 0; i < ISO14229_SERVER_MAX_DYNAMIC_DIDS; i++) {
+        if (node->dynamicDIDs[i].entry.did) {
+            _ClearDynamicDID(node, &node->dynamicDIDs[i]);
+        }
+    }
+}
+
+/**
+ * @brief resolve source `idx` of a 0x2C define request to a copy step
+ */
+static enum Iso14229ResponseCode _ResolveDDDISource(const Iso14229Server *self,
+                                                    const Iso14229ServerRequestContext *ctx,
+                                                    uint16_t idx,
+                                                    struct Iso14229DDDICopyStep *step) {
+    const struct Iso14229ServerStatus *status = &self->node->status;
+
+    if (kDefineByIdentifier == (ctx->req.buf[1] & 0x7F)) {
+        const uint8_t *source =
+            &ctx->req.buf[ISO14229_0X2C_REQ_DEFINE_BASE_LEN + idx * ISO14229_0X2C_SOURCE_LEN];
+        const Iso14229DataIdentifier *entry = _FindTableDID(self, (source[0] << 8) + source[1]);
+        uint8_t position = source[2];
+        uint8_t size = source[3];
+
+        if (NULL == entry || NULL == entry->data || 0 == position || 0 == size ||
+            position - 1 + size > entry->len) {
+            return kRequestOutOfRange;
+        }
+        *step = (struct Iso14229DDDICopyStep){
+            .src = (const uint8_t *)entry->data + position - 1,
+            .source = entry,
+            .len = size,
+        };
+        return _CheckAccess(status, entry->readSessions, entry->readSecurityLevel);
+    } else {
+        uint8_t addressAndLengthFormatIdentifier = ctx->req.buf[ISO14229_0X2C_REQ_DEFINE_BASE_LEN];
+        uint8_t alfidLen = Iso14229ALFIDLength(addressAndLengthFormatIdentifier);
+        size_t memoryAddress = 0;
+        size_t memorySize = 0;
+
+        Iso14229DecodeALFID(
+            addressAndLengthFormatIdentifier,
+            &ctx->req.buf[ISO14229_0X2C_REQ_DEFINE_BY_ADDRESS_BASE_LEN + idx * alfidLen],
+            &memoryAddress, &memorySize);
+        const Iso14229MemoryRegion *region = _FindMemoryRegion(self, memoryAddress, memorySize);
+        if (NULL == region || NULL == region->data || 0 == memorySize ||
+            memorySize > UINT16_MAX) {
+            return kRequestOutOfRange;
+        }
+        *step = (struct Iso14229DDDICopyStep){
+            .src = (const uint8_t *)region->data + (memoryAddress - region->base),
+            .region = region,
+            .len = memorySize,
+        };
+        return _CheckAccess(status, region->readSessions, region->readSecurityLevel);
     }
+}
 
-    if (memoryAddressLength == 0 || memoryAddressLength > sizeof(memoryAddress)) {
+/**
+ * @brief 0x2C defineByIdentifier and defineByMemoryAddress: append the sources to the copy plan of
+ * the dynamic DID
+ */
+static enum Iso14229ResponseCode _DefineDynamicDID(Iso14229Server *self,
+                                                   Iso14229ServerRequestContext *ctx,
+                                                   uint16_t dynamicId) {
+    Iso14229ServerNode *node = self->node;
+    uint16_t numSources;
+    struct Iso14229DynamicDID *dynamic;
+    uint32_t recordLen = 0;
+    uint16_t numSteps = node->numDDDISteps;
+    struct Iso14229DDDICopyStep prev = {0};
+    struct Iso14229DDDICopyStep step;
+    enum Iso14229ResponseCode err;
+
+    if (kDefineByIdentifier == (ctx->req.buf[1] & 0x7F)) {
+        if (ctx->req.len < ISO14229_0X2C_REQ_DEFINE_BASE_LEN + ISO14229_0X2C_SOURCE_LEN ||
+            0 != (ctx->req.len - ISO14229_0X2C_REQ_DEFINE_BASE_LEN) % ISO14229_0X2C_SOURCE_LEN) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        numSources = (ctx->req.len - ISO14229_0X2C_REQ_DEFINE_BASE_LEN) / ISO14229_0X2C_SOURCE_LEN;
+    } else {
+        if (0 == self->cfg->numMemoryRegions) {
+            return NegativeResponse(ctx, kSubFunctionNotSupported);
+        }
+        if (ctx->req.len <= ISO14229_0X2C_REQ_DEFINE_BY_ADDRESS_BASE_LEN) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        uint8_t alfidLen = Iso14229ALFIDLength(ctx->req.buf[ISO14229_0X2C_REQ_DEFINE_BASE_LEN]);
+        if (0 == alfidLen) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+        if (0 != (ctx->req.len - ISO14229_0X2C_REQ_DEFINE_BY_ADDRESS_BASE_LEN) % alfidLen) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        }
+        numSources = (ctx->req.len - ISO14229_0X2C_REQ_DEFINE_BY_ADDRESS_BASE_LEN) / alfidLen;
+    }
+
+    dynamic = _FindDynamicDID(node, dynamicId);
+    if (NULL == dynamic) {
+        dynamic = _FindDynamicDID(node, 0);
+        if (NULL == dynamic || _FindTableDID(self, dynamicId)) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
+    } else if (dynamic->numSteps) {
+        prev = dynamic->steps[dynamic->numSteps - 1];
+        recordLen = dynamic->entry.len;
+    }
+
+    // compile: resolve and check every source before changing anything. Adjacent ranges of the
+    // same source merge into one step
+    for (uint16_t i = 0; i < numSources; i++) {
+        err = _ResolveDDDISource(self, ctx, i, &step);
+        if (kPositiveResponse != err) {
+            return NegativeResponse(ctx, err);
+        }
+        if (0 == prev.len || step.src != prev.src + prev.len || step.source != prev.source ||
+            step.region != prev.region) {
+            numSteps++;
+        }
+        prev = step;
+        recordLen += step.len;
+    }
+    if (numSteps > ISO14229_SERVER_DDDI_STEPS || recordLen > UINT16_MAX) {
         return NegativeResponse(ctx, kRequestOutOfRange);
     }
 
-    if (ctx->req.len < ISO14229_0X34_REQ_BASE_LEN + memorySizeLength + memoryAddressLength) {
-        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    if (0 == dynamic->entry.did) {
+        dynamic->entry = (Iso14229DataIdentifier){
+            .did = dynamicId,
+            .readSessions = ISO14229_ALL_SESSIONS,
+            .read = _DynamicDIDRead,
+        };
+        dynamic->steps = node->dddiSteps + node->numDDDISteps;
+        dynamic->numSteps = 0;
+    }
+
+    // make room behind the existing steps of this DID
+    struct Iso14229DDDICopyStep *end = dynamic->steps + dynamic->numSteps;
+    uint8_t added = numSteps - node->numDDDISteps;
+    memmove(end + added, end,
+            (node->dddiSteps + node->numDDDISteps - end) * sizeof(struct Iso14229DDDICopyStep));
+    for (uint8_t i = 0; i < ISO14229_SERVER_MAX_DYNAMIC_DIDS; i++) {
+        if (node->dynamicDIDs[i].entry.did && node->dynamicDIDs[i].steps >= end &&
+            &node->dynamicDIDs[i] != dynamic) {
+            node->dynamicDIDs[i].steps += added;
+        }
+    }
+    node->numDDDISteps = numSteps;
+
+    for (uint16_t i = 0; i < numSources; i++) {
+        _ResolveDDDISource(self, ctx, i, &step);
+        struct Iso14229DDDICopyStep *last =
+            dynamic->numSteps ? &dynamic->steps[dynamic->numSteps - 1] : NULL;
+
+        if (last && last->src + last->len == step.src && last->source == step.source &&
+            last->region == step.region) {
+            last->len += step.len;
+        } else {
+            dynamic->steps[dynamic->numSteps++] = step;
+        }
     }
+    dynamic->entry.len = recordLen;
+    return kPositiveResponse;
+}
 
-    for (int byteIdx = 0; byteIdx < memoryAddressLength; byteIdx++) {
-        uint8_t byte = ctx->req.buf[ISO14229_0X34_REQ_BASE_LEN + byteIdx];
-        uint8_t shiftBytes = memoryAddressLength - 1 - byteIdx;
-        memoryAddress |= byte << (8 * shiftBytes);
+/**
+ * @brief 0x2C DynamicallyDefineDataIdentifier
+ * @addtogroup dynamicallyDefineDataIdentifier_0x2C
+ * @details a definition is compiled into a copy plan of (source, length) steps when it is received,
+ * so reading the dynamic DID with 0x22 or 0x2A is a loop of memory copies. Sources must be didTable
+ * entries or memoryRegions with `data`. Definitions are cleared when the node returns to the
+ * default session.
+ * @param self
+ * @param ctx
+ */
+static enum Iso14229ResponseCode
+_0x2C_DynamicallyDefineDataIdentifier(Iso14229Server *self, Iso14229ServerRequestContext *ctx) {
+    uint8_t subFunction = ctx->req.buf[1] & 0x7F;
+    uint16_t dynamicId = 0;
+    enum Iso14229ResponseCode err;
+
+    if (0 == self->cfg->didTableSize && 0 == self->cfg->numMemoryRegions) {
+        return NegativeResponse(ctx, kServiceNotSupported);
     }
 
-    for (int byteIdx = 0; byteIdx < memorySizeLength; byteIdx++) {
-        uint8_t byte = ctx->req.buf[ISO14229_0X34_REQ_BASE_LEN + memoryAddressLength + byteIdx];
-        uint8_t shiftBytes = memorySizeLength - 1 - byteIdx;
-        memorySize |= byte << (8 * shiftBytes);
+    if (ctx->req.len >= ISO14229_0X2C_REQ_DEFINE_BASE_LEN) {
+        dynamicId = (ctx->req.buf[2] << 8) + ctx->req.buf[3];
+        if (dynamicId < ISO14229_DYNAMIC_DID_MIN || dynamicId > ISO14229_DYNAMIC_DID_MAX) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        }
     }
 
-    assert(self->userRequestDownloadHandler);
-    assert(NULL == self->downloadHandler);
-    err = self->userRequestDownloadHandler(&self->status, (void *)memoryAddress, memorySize,
-                                           dataFormatIdentifier, &self->downloadHandler,
-                                           &maxNumberOfBlockLength);
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_DYNAMICALLY_DEFINE_DATA_IDENTIFIER);
+    ctx->resp.buf[1] = subFunction;
 
-    if (kPositiveResponse != err) {
-        self->downloadHandler = NULL;
-        return NegativeResponse(ctx, err);
-    } else {
-        if (NULL == self->downloadHandler) {
-            ISO14229USERDEBUG("ERROR: handler must not be NULL!");
-            return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    switch (subFunction) {
+    case kDefineByIdentifier:
+    case kDefineByMemoryAddress:
+        err = _DefineDynamicDID(self, ctx, dynamicId);
+        if (kPositiveResponse != err) {
+            return err;
         }
-        if (NULL == self->downloadHandler->onTransfer || NULL == self->downloadHandler->onExit) {
-            ISO14229USERDEBUG("ERROR: onTransfer and onExit must be implemented!");
-            return NegativeResponse(ctx, kGeneralProgrammingFailure);
+        break;
+    case kClearDynamicallyDefinedDataIdentifier:
+        if (ISO14229_0X2C_REQ_MIN_LEN == ctx->req.len) {
+            _ClearAllDynamicDIDs(self->node);
+            ctx->resp.len = ISO14229_0X2C_RESP_BASE_LEN;
+            return kPositiveResponse;
+        } else if (ISO14229_0X2C_REQ_DEFINE_BASE_LEN != ctx->req.len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
         }
+        struct Iso14229DynamicDID *dynamic = _FindDynamicDID(self->node, dynamicId);
+        if (dynamic) {
+            _ClearDynamicDID(self->node, dynamic);
+        }
+        break;
+    default:
+        return NegativeResponse(ctx, kSubFunctionNotSupported);
     }
 
-    if (maxNumberOfBlockLength < 3) {
-        ISO14229USERDEBUG("ERROR: maxNumberOfBlockLength too short");
-        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    ctx->resp.buf[2] = dynamicId >> 8;
+    ctx->resp.buf[3] = dynamicId;
+    ctx->resp.len = ISO14229_0X2C_RESP_BASE_LEN + sizeof(uint16_t);
+    return kPositiveResponse;
+}
+
+/**
+ * @brief 0x2E WriteDataByIdentifier
+ *
+ * @param self
+ * @param data
+ * @param size
+ */
+static enum Iso14229ResponseCode _0x2E_WriteDataByIdentifier(Iso14229Server *self,
+                                                             Iso14229ServerRequestContext *ctx) {
+    uint16_t dataLen = 0;
+    uint16_t dataId = 0;
+    enum Iso14229ResponseCode wdbi_response;
+
+    /* ISO14229-1 2013 Figure 21 Key 1 */
+    if (ctx->req.len < ISO14229_0X2E_REQ_MIN_LEN) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
 
-    Iso14229DownloadHandlerInit(self->downloadHandler, memorySize);
+    dataId = (ctx->req.buf[1] << 8) + ctx->req.buf[2];
+    dataLen = ctx->req.len - ISO14229_0X2E_REQ_BASE_LEN;
 
-    // ISO-14229-1:2013 Table 401:
-    uint8_t lengthFormatIdentifier = sizeof(maxNumberOfBlockLength) << 4;
+    const uint8_t *data = &ctx->req.buf[ISO14229_0X2E_REQ_BASE_LEN];
+    const Iso14229DataIdentifier *entry = _FindDID(self, dataId);
+
+    if (entry) {
+        wdbi_response =
+            _CheckAccess(&self->node->status, entry->writeSessions, entry->writeSecurityLevel);
+        if (kPositiveResponse != wdbi_response) {
+            return NegativeResponse(ctx, wdbi_response);
+        }
+        if (entry->write) {
+            wdbi_response = entry->write(&self->node->status, entry, data, dataLen);
+            if (kPositiveResponse != wdbi_response) {
+                return NegativeResponse(ctx, wdbi_response);
+            }
+        } else if (NULL == entry->data) {
+            return NegativeResponse(ctx, kRequestOutOfRange);
+        } else if (dataLen != entry->len) {
+            return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+        } else {
+            memmove(entry->data, data, dataLen);
+        }
+    } else if (NULL != self->cfg->userWDBIHandler) {
+        wdbi_response = self->cfg->userWDBIHandler(&self->node->status, dataId, data, dataLen);
+        if (kPositiveResponse != wdbi_response) {
+            return NegativeResponse(ctx, wdbi_response);
+        }
+    } else if (0 != self->cfg->didTableSize) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    } else {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_WRITE_DATA_BY_IDENTIFIER);
+    ctx->resp.buf[1] = dataId >> 8;
+    ctx->resp.buf[2] = dataId;
+    ctx->resp.len = ISO14229_0X2E_RESP_LEN;
+    return kPositiveResponse;
+}
+
+/**
+ * @brief 0x31 RoutineControl
+ *
+ * @addtogroup routineControl_0x31
+ * @param self
+ * @param data
+ * @param size
+ */
+static enum Iso14229ResponseCode _0x31_RoutineControl(Iso14229Server *self,
+                                                      Iso14229ServerRequestContext *ctx) {
+    enum Iso14229ResponseCode err = kPositiveResponse;
+    if (ctx->req.len < ISO14229_0X31_REQ_MIN_LEN) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+    if (NULL == self->cfg->userRoutineControlHandler) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+    uint8_t routineControlType = ctx->req.buf[1];
+    uint16_t routineIdentifier = (ctx->req.buf[2] << 8) + ctx->req.buf[3];
+    const uint8_t *optionRecord = &ctx->req.buf[ISO14229_0X31_REQ_MIN_LEN];
+    uint16_t optionRecordLength = ctx->req.len - ISO14229_0X31_REQ_MIN_LEN;
+    uint16_t statusRecordBufferSize = ctx->resp.buffer_size - ISO14229_0X31_RESP_MIN_LEN;
+    uint16_t statusRecordLength = 0; // The actual statusRecord length written by the routine
+
+    Iso14229RoutineControlArgs args = {
+        .optionRecord = optionRecord,
+        .optionRecordLength = optionRecordLength,
+        .statusRecord = &ctx->resp.buf[ISO14229_0X31_RESP_MIN_LEN],
+        .statusRecordBufferSize = statusRecordBufferSize,
+        .statusRecordLength = &statusRecordLength,
+    };
+
+    switch (routineControlType) {
+    case kStartRoutine:
+    case kStopRoutine:
+    case kRequestRoutineResults:
+        err = self->cfg->userRoutineControlHandler(&self->node->status, routineControlType,
+                                                   routineIdentifier, &args);
+        if (kPositiveResponse != err) {
+            return NegativeResponse(ctx, err);
+        }
+        break;
+    default:
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+
+    if (statusRecordLength > args.statusRecordBufferSize) {
+        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    }
+
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_ROUTINE_CONTROL);
+    ctx->resp.buf[1] = routineControlType;
+    ctx->resp.buf[2] = routineIdentifier >> 8;
+    ctx->resp.buf[3] = routineIdentifier;
+    ctx->resp.len = ISO14229_0X31_RESP_MIN_LEN + statusRecordLength;
+    return kPositiveResponse;
+}
 
 // ISO-15764-2-2004 section 5.3.3
 #define ISOTP_MTU 4095UL
@@ -487,9 +1241,37 @@ data-parameters present in the TransferData request message.
 */
 #define MAX_TRANSFER_DATA_PAYLOAD_LEN (ISOTP_MTU)
 
-    maxNumberOfBlockLength = MIN(maxNumberOfBlockLength, MAX_TRANSFER_DATA_PAYLOAD_LEN);
+/**
+ * @brief decode the memoryAddress and memorySize of a 0x34 or 0x35 request
+ */
+static enum Iso14229ResponseCode _DecodeMemoryRequest(const Iso14229ServerRequestContext *ctx,
+                                                      size_t *memoryAddress, size_t *memorySize) {
+    if (ctx->req.len < ISO14229_0X34_REQ_BASE_LEN) {
+        return kIncorrectMessageLengthOrInvalidFormat;
+    }
 
-    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_REQUEST_DOWNLOAD);
+    uint8_t alfidLen = Iso14229ALFIDLength(ctx->req.buf[2]);
+    if (0 == alfidLen) {
+        return kRequestOutOfRange;
+    }
+    if (ctx->req.len < ISO14229_0X34_REQ_BASE_LEN + alfidLen) {
+        return kIncorrectMessageLengthOrInvalidFormat;
+    }
+
+    Iso14229DecodeALFID(ctx->req.buf[2], &ctx->req.buf[ISO14229_0X34_REQ_BASE_LEN], memoryAddress,
+                        memorySize);
+    return kPositiveResponse;
+}
+
+/**
+ * @brief positive response of 0x34 and 0x35: lengthFormatIdentifier and maxNumberOfBlockLength
+ */
+static enum Iso14229ResponseCode _RespondMaxNumberOfBlockLength(Iso14229ServerRequestContext *ctx,
+                                                                uint16_t maxNumberOfBlockLength) {
+    // ISO-14229-1:2013 Table 401:
+    uint8_t lengthFormatIdentifier = sizeof(maxNumberOfBlockLength) << 4;
+
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(ctx->req.buf[0]);
     ctx->resp.buf[1] = lengthFormatIdentifier;
     for (uint8_t idx = 0; idx < sizeof(maxNumberOfBlockLength); idx++) {
         uint8_t shiftBytes = sizeof(maxNumberOfBlockLength) - 1 - idx;
@@ -500,6 +1282,227 @@ data-parameters present in the TransferData request message.
     return kPositiveResponse;
 }
 
+/**
+ * @brief 0x34 RequestDownload
+ *
+ * @param self
+ * @param data
+ * @param size
+ */
+static enum Iso14229ResponseCode _0x34_RequestDownload(Iso14229Server *self,
+                                                       Iso14229ServerRequestContext *ctx) {
+    enum Iso14229ResponseCode err;
+    uint16_t maxNumberOfBlockLength = 0;
+    size_t memoryAddress = 0;
+    size_t memorySize = 0;
+
+    if (NULL == self->cfg->userRequestDownloadHandler) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+
+    if (NULL != self->node->downloadHandler || NULL != self->node->uploadHandler) {
+        return NegativeResponse(ctx, kConditionsNotCorrect);
+    }
+
+    err = _DecodeMemoryRequest(ctx, &memoryAddress, &memorySize);
+    if (kPositiveResponse != err) {
+        return NegativeResponse(ctx, err);
+    }
+    uint8_t dataFormatIdentifier = ctx->req.buf[1];
+
+    assert(self->cfg->userRequestDownloadHandler);
+    assert(NULL == self->node->downloadHandler);
+    err = self->cfg->userRequestDownloadHandler(
+        &self->node->status, (void *)memoryAddress, memorySize, dataFormatIdentifier,
+        &self->node->downloadHandler, &maxNumberOfBlockLength);
+
+    if (kPositiveResponse != err) {
+        self->node->downloadHandler = NULL;
+        return NegativeResponse(ctx, err);
+    } else {
+        if (NULL == self->node->downloadHandler) {
+            ISO14229USERDEBUG("ERROR: handler must not be NULL!");
+            return NegativeResponse(ctx, kGeneralProgrammingFailure);
+        }
+        if (NULL == self->node->downloadHandler->onTransfer || NULL == self->node->downloadHandler->onExit) {
+            ISO14229USERDEBUG("ERROR: onTransfer and onExit must be implemented!");
+            return NegativeResponse(ctx, kGeneralProgrammingFailure);
+        }
+    }
+
+    if (maxNumberOfBlockLength < 3) {
+        ISO14229USERDEBUG("ERROR: maxNumberOfBlockLength too short");
+        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    }
+
+    Iso14229DownloadHandlerInit(self->node->downloadHandler, memorySize);
+
+    maxNumberOfBlockLength = MIN(maxNumberOfBlockLength, MAX_TRANSFER_DATA_PAYLOAD_LEN);
+    return _RespondMaxNumberOfBlockLength(ctx, maxNumberOfBlockLength);
+}
+
+/**
+ * @brief 0x35 RequestUpload
+ * @addtogroup requestUpload_0x35
+ * @param self
+ * @param ctx
+ */
+static enum Iso14229ResponseCode _0x35_RequestUpload(Iso14229Server *self,
+                                                     Iso14229ServerRequestContext *ctx) {
+    enum Iso14229ResponseCode err;
+    uint16_t maxNumberOfBlockLength = 0;
+    size_t memoryAddress = 0;
+    size_t memorySize = 0;
+    Iso14229UploadHandler *handler = NULL;
+
+    if (NULL == self->cfg->userRequestUploadHandler) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+
+    if (NULL != self->node->downloadHandler || NULL != self->node->uploadHandler) {
+        return NegativeResponse(ctx, kConditionsNotCorrect);
+    }
+
+    err = _DecodeMemoryRequest(ctx, &memoryAddress, &memorySize);
+    if (kPositiveResponse != err) {
+        return NegativeResponse(ctx, err);
+    }
+
+    err = self->cfg->userRequestUploadHandler(&self->node->status, (void *)memoryAddress,
+                                              memorySize, ctx->req.buf[1], &handler,
+                                              &maxNumberOfBlockLength);
+    if (kPositiveResponse != err) {
+        return NegativeResponse(ctx, err);
+    }
+    if (NULL == handler || (NULL == handler->onTransfer && NULL == handler->memory)) {
+        ISO14229USERDEBUG("ERROR: handler with onTransfer or memory required!");
+        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    }
+    if (maxNumberOfBlockLength <= ISO14229_0X36_RESP_BASE_LEN) {
+        ISO14229USERDEBUG("ERROR: maxNumberOfBlockLength too short");
+        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    }
+
+    maxNumberOfBlockLength = MIN(maxNumberOfBlockLength, MAX_TRANSFER_DATA_PAYLOAD_LEN);
+    if (handler->onTransfer) {
+        // onTransfer writes the block into the send buffer
+        maxNumberOfBlockLength = MIN(maxNumberOfBlockLength, ctx->resp.buffer_size);
+    }
+    handler->maxNumberOfBlockLength = maxNumberOfBlockLength;
+    Iso14229UploadHandlerInit(handler, memorySize);
+    self->node->uploadHandler = handler;
+    return _RespondMaxNumberOfBlockLength(ctx, maxNumberOfBlockLength);
+}
+
+/**
+ * @brief 0x36 TransferData of an upload: the response carries the next block
+ */
+static enum Iso14229ResponseCode _TransferUploadBlock(Iso14229Server *self,
+                                                      Iso14229ServerRequestContext *ctx) {
+    Iso14229UploadHandler *handler = self->node->uploadHandler;
+    enum Iso14229ResponseCode err;
+    uint8_t blockSequenceCounter = ctx->req.buf[1];
+    uint16_t len = handler->maxNumberOfBlockLength - ISO14229_0X36_RESP_BASE_LEN;
+
+    if (ctx->req.len != ISO14229_0X36_REQ_BASE_LEN) {
+        err = kIncorrectMessageLengthOrInvalidFormat;
+        goto fail;
+    }
+
+    if (!self->node->status.RCRRP) {
+        if (blockSequenceCounter != handler->blockSequenceCounter ||
+            handler->numBytesTransferred >= handler->requestedTransferSize) {
+            err = kRequestSequenceError;
+            goto fail;
+        }
+        handler->blockSequenceCounter++;
+    }
+
+    if (handler->requestedTransferSize - handler->numBytesTransferred < len) {
+        len = handler->requestedTransferSize - handler->numBytesTransferred;
+    }
+
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_TRANSFER_DATA);
+    ctx->resp.buf[1] = blockSequenceCounter;
+
+    if (NULL == handler->onTransfer) {
+        // sent straight from memory
+        ctx->segments[0] =
+            (IsoTpSegment){.data = ctx->resp.buf, .len = ISO14229_0X36_RESP_BASE_LEN};
+        ctx->segments[1] = (IsoTpSegment){
+            .data = handler->memory + handler->numBytesTransferred,
+            .len = len,
+        };
+        ctx->numSegments = 2;
+    } else {
+        uint16_t out_len = 0;
+        err = handler->onTransfer(&self->node->status, handler->userCtx,
+                                  &ctx->resp.buf[ISO14229_0X36_RESP_BASE_LEN], len, &out_len);
+        if (kRequestCorrectlyReceived_ResponsePending == err) {
+            return NegativeResponse(ctx, err);
+        }
+        if (kPositiveResponse != err) {
+            goto fail;
+        }
+        if (0 == out_len || out_len > len) {
+            err = kGeneralProgrammingFailure;
+            goto fail;
+        }
+        len = out_len;
+    }
+
+    handler->numBytesTransferred += len;
+    ctx->resp.len = ISO14229_0X36_RESP_BASE_LEN + len;
+    return kPositiveResponse;
+
+fail:
+    self->node->uploadHandler = NULL;
+    return NegativeResponse(ctx, err);
+}
+
+/**
+ * @brief feeds a compressed TransferData block through the download handler's decoder and passes
+ * the decoded bytes to onTransfer(...). A 0x78 from onTransfer(...) keeps the decoder's position so
+ * that the same bytes are offered again when the service is called again
+ */
+static enum Iso14229ResponseCode _TransferDecompressed(Iso14229Server *self,
+                                                       Iso14229ServerRequestContext *ctx,
+                                                       uint16_t request_data_len) {
+    Iso14229DownloadHandler *handler = self->node->downloadHandler;
+    const uint8_t *data = &ctx->req.buf[ISO14229_0X36_REQ_BASE_LEN];
+    enum Iso14229ResponseCode err;
+
+    for (;;) {
+        if (0 == handler->decodedLen) {
+            handler->decodeOffset +=
+                Iso14229LZSSDecode(handler->decoder, data + handler->decodeOffset,
+                                   request_data_len - handler->decodeOffset, &handler->decodedData,
+                                   &handler->decodedLen);
+            if (0 == handler->decodedLen) {
+                break; // block used up and nothing left in the window
+            }
+            if (handler->numBytesTransferred + handler->decodedLen >
+                handler->requestedTransferSize) {
+                return kTransferDataSuspended;
+            }
+        }
+
+        err = handler->onTransfer(&self->node->status, handler->userCtx, handler->decodedData,
+                                  handler->decodedLen);
+        if (kPositiveResponse != err) {
+            return err;
+        }
+        if (handler->digest) {
+            Iso14229DigestUpdate(handler->digest, handler->decodedData, handler->decodedLen);
+        }
+        handler->numBytesTransferred += handler->decodedLen;
+        handler->decodedLen = 0;
+    }
+
+    handler->decodeOffset = 0;
+    return kPositiveResponse;
+}
+
 /**
  * @brief 0x36 TransferData
  * @addtogroup transferData_0x36
@@ -519,34 +1522,55 @@ static enum Iso14229ResponseCode _0x36_TransferData(Iso14229Server *self,
 
     uint8_t blockSequenceCounter = ctx->req.buf[1];
 
-    if (NULL == self->downloadHandler) {
+    if (self->node->uploadHandler) {
+        return _TransferUploadBlock(self, ctx);
+    }
+
+    if (NULL == self->node->downloadHandler) {
         return NegativeResponse(ctx, kUploadDownloadNotAccepted);
     }
 
-    assert(self->downloadHandler);
+    assert(self->node->downloadHandler);
 
-    if (!self->status.RCRRP) {
-        if (blockSequenceCounter != self->downloadHandler->blockSequenceCounter) {
+    if (!self->node->status.RCRRP) {
+        if (blockSequenceCounter != self->node->downloadHandler->blockSequenceCounter) {
             err = kRequestSequenceError;
             goto fail;
         } else {
-            self->downloadHandler->blockSequenceCounter++;
+            self->node->downloadHandler->blockSequenceCounter++;
         }
     }
 
-    if (self->downloadHandler->numBytesTransferred + request_data_len >
-        self->downloadHandler->requestedTransferSize) {
+    if (self->node->downloadHandler->decoder) {
+        err = _TransferDecompressed(self, ctx, request_data_len);
+        if (kPositiveResponse == err) {
+            ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_TRANSFER_DATA);
+            ctx->resp.buf[1] = blockSequenceCounter;
+            ctx->resp.len = ISO14229_0X36_RESP_BASE_LEN;
+            return kPositiveResponse;
+        } else if (kRequestCorrectlyReceived_ResponsePending == err) {
+            return NegativeResponse(ctx, kRequestCorrectlyReceived_ResponsePending);
+        }
+        goto fail;
+    }
+
+    if (self->node->downloadHandler->numBytesTransferred + request_data_len >
+        self->node->downloadHandler->requestedTransferSize) {
         err = kTransferDataSuspended;
         goto fail;
     }
 
-    err = self->downloadHandler->onTransfer(&self->status, self->downloadHandler->userCtx,
+    err = self->node->downloadHandler->onTransfer(&self->node->status, self->node->downloadHandler->userCtx,
                                             &ctx->req.buf[ISO14229_0X36_REQ_BASE_LEN],
                                             request_data_len);
 
     switch (err) {
     case kPositiveResponse:
-        self->downloadHandler->numBytesTransferred += request_data_len;
+        if (self->node->downloadHandler->digest) {
+            Iso14229DigestUpdate(self->node->downloadHandler->digest,
+                                 &ctx->req.buf[ISO14229_0X36_REQ_BASE_LEN], request_data_len);
+        }
+        self->node->downloadHandler->numBytesTransferred += request_data_len;
         ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_TRANSFER_DATA);
         ctx->resp.buf[1] = blockSequenceCounter;
         ctx->resp.len = ISO14229_0X36_RESP_BASE_LEN; // TODO: 加transferResponseParameterRecord
@@ -558,7 +1582,7 @@ static enum Iso14229ResponseCode _0x36_TransferData(Iso14229Server *self,
     }
 
 fail:
-    self->downloadHandler = NULL;
+    self->node->downloadHandler = NULL;
     return NegativeResponse(ctx, err);
 }
 
@@ -572,31 +1596,119 @@ fail:
 static enum Iso14229ResponseCode _0x37_RequestTransferExit(Iso14229Server *self,
                                                            Iso14229ServerRequestContext *ctx) {
     enum Iso14229ResponseCode err;
+    Iso14229UploadHandler *upload = self->node->uploadHandler;
+
+    if (upload) {
+        uint16_t recordSize = 0;
+        if (upload->onExit) {
+            err = upload->onExit(&self->node->status, upload->userCtx,
+                                 ctx->resp.buffer_size - ISO14229_0X37_RESP_BASE_LEN,
+                                 &ctx->resp.buf[ISO14229_0X37_RESP_BASE_LEN], &recordSize);
+            if (err != kPositiveResponse) {
+                return NegativeResponse(ctx, err);
+            }
+            if (recordSize > ctx->resp.buffer_size - ISO14229_0X37_RESP_BASE_LEN) {
+                return NegativeResponse(ctx, kGeneralProgrammingFailure);
+            }
+        }
+        self->node->uploadHandler = NULL;
+        ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_REQUEST_TRANSFER_EXIT);
+        ctx->resp.len = ISO14229_0X37_RESP_BASE_LEN + recordSize;
+        return kPositiveResponse;
+    }
 
-    if (NULL == self->downloadHandler) {
+    if (NULL == self->node->downloadHandler) {
         return NegativeResponse(ctx, kUploadDownloadNotAccepted);
     }
 
-    assert(self->downloadHandler);
+    assert(self->node->downloadHandler);
 
     uint16_t buffer_size = ctx->resp.buffer_size - ISO14229_0X37_RESP_BASE_LEN;
     uint16_t transferResponseParameterRecordSize = 0;
 
-    err = self->downloadHandler->onExit(&self->status, self->downloadHandler->userCtx, buffer_size,
-                                        &ctx->resp.buf[ISO14229_0X37_RESP_BASE_LEN],
-                                        &transferResponseParameterRecordSize);
+    err = self->node->downloadHandler->onExit(&self->node->status, self->node->downloadHandler->userCtx, buffer_size,
+                                        &ctx->resp.buf[ISO14229_0X37_RESP_BASE_LEN],
+                                        &transferResponseParameterRecordSize);
+
+    if (err != kPositiveResponse) {
+        return NegativeResponse(ctx, err);
+    }
+
+    if (transferResponseParameterRecordSize > buffer_size) {
+        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    }
+
+    Iso14229Digest *digest = self->node->downloadHandler->digest;
+    if (digest) {
+        uint16_t offset = ISO14229_0X37_RESP_BASE_LEN + transferResponseParameterRecordSize;
+        uint8_t digestLen = Iso14229DigestLength(digest->type);
+        if (buffer_size - transferResponseParameterRecordSize < digestLen) {
+            return NegativeResponse(ctx, kResponseTooLong);
+        }
+        transferResponseParameterRecordSize += Iso14229DigestFinal(digest, &ctx->resp.buf[offset]);
+    }
+
+    self->node->downloadHandler = NULL;
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_REQUEST_TRANSFER_EXIT);
+    ctx->resp.len = ISO14229_0X37_RESP_BASE_LEN + transferResponseParameterRecordSize;
+    return kPositiveResponse;
+}
+
+/**
+ * @brief 0x3D WriteMemoryByAddress
+ * @addtogroup writeMemoryByAddress_0x3D
+ * @details the data record is copied from the request straight to the region
+ * @param self
+ * @param ctx
+ */
+static enum Iso14229ResponseCode _0x3D_WriteMemoryByAddress(Iso14229Server *self,
+                                                            Iso14229ServerRequestContext *ctx) {
+    const struct Iso14229ServerStatus *status = &self->node->status;
+    uint8_t addressAndLengthFormatIdentifier = ctx->req.buf[1];
+    uint8_t alfidLen = Iso14229ALFIDLength(addressAndLengthFormatIdentifier);
+    size_t memoryAddress = 0;
+    size_t memorySize = 0;
+    enum Iso14229ResponseCode err;
+
+    if (0 == self->cfg->numMemoryRegions) {
+        return NegativeResponse(ctx, kServiceNotSupported);
+    }
+    if (0 == alfidLen) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+    if (ctx->req.len <= ISO14229_0X3D_REQ_BASE_LEN + alfidLen) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
 
-    if (err != kPositiveResponse) {
+    Iso14229DecodeALFID(addressAndLengthFormatIdentifier,
+                        &ctx->req.buf[ISO14229_0X3D_REQ_BASE_LEN], &memoryAddress, &memorySize);
+    if (memorySize != ctx->req.len - ISO14229_0X3D_REQ_BASE_LEN - alfidLen) {
+        return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    }
+    const Iso14229MemoryRegion *region = _FindMemoryRegion(self, memoryAddress, memorySize);
+    if (NULL == region || (NULL == region->write && NULL == region->data)) {
+        return NegativeResponse(ctx, kRequestOutOfRange);
+    }
+    err = _CheckAccess(status, region->writeSessions, region->writeSecurityLevel);
+    if (kPositiveResponse != err) {
         return NegativeResponse(ctx, err);
     }
 
-    if (transferResponseParameterRecordSize > buffer_size) {
-        return NegativeResponse(ctx, kGeneralProgrammingFailure);
+    size_t offset = memoryAddress - region->base;
+    const uint8_t *data = &ctx->req.buf[ISO14229_0X3D_REQ_BASE_LEN + alfidLen];
+    if (region->write) {
+        err = region->write(status, region, offset, data, memorySize);
+        if (kPositiveResponse != err) {
+            return NegativeResponse(ctx, err);
+        }
+    } else {
+        memmove((uint8_t *)region->data + offset, data, memorySize);
     }
 
-    self->downloadHandler = NULL;
-    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_REQUEST_TRANSFER_EXIT);
-    ctx->resp.len = ISO14229_0X37_RESP_BASE_LEN + transferResponseParameterRecordSize;
+    // echo addressAndLengthFormatIdentifier, memoryAddress and memorySize
+    ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_WRITE_MEMORY_BY_ADDRESS);
+    memmove(&ctx->resp.buf[1], &ctx->req.buf[1], 1 + alfidLen);
+    ctx->resp.len = ISO14229_0X3D_RESP_BASE_LEN + alfidLen;
     return kPositiveResponse;
 }
 
@@ -612,7 +1724,7 @@ static enum Iso14229ResponseCode _0x3E_TesterPresent(Iso14229Server *self,
     if (ctx->req.len < ISO14229_0X3E_REQ_MIN_LEN) {
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
-    self->s3_session_timeout_timer = self->userGetms() + self->s3_ms;
+    self->node->s3_session_timeout_timer = self->now + self->cfg->s3_ms;
     uint8_t zeroSubFunction = ctx->req.buf[1];
     ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_TESTER_PRESENT);
     ctx->resp.buf[1] = zeroSubFunction & 0x3F;
@@ -629,101 +1741,116 @@ static enum Iso14229ResponseCode _0x3E_TesterPresent(Iso14229Server *self,
  */
 static enum Iso14229ResponseCode _0x85_ControlDTCSetting(Iso14229Server *self,
                                                          Iso14229ServerRequestContext *ctx) {
-    (void)self;
     if (ctx->req.len < ISO14229_0X85_REQ_BASE_LEN) {
         return NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
     }
     uint8_t dtcSettingType = ctx->req.buf[1] & 0x3F;
 
+    if (self->cfg->dtcStore) {
+        switch (dtcSettingType) {
+        case kDTCSettingON:
+            self->cfg->dtcStore->settingOff = false;
+            break;
+        case kDTCSettingOFF:
+            self->cfg->dtcStore->settingOff = true;
+            break;
+        default:
+            return NegativeResponse(ctx, kSubFunctionNotSupported);
+        }
+    }
+
     ctx->resp.buf[0] = ISO14229_RESPONSE_SID_OF(kSID_CONTROL_DTC_SETTING);
     ctx->resp.buf[1] = dtcSettingType;
     ctx->resp.len = ISO14229_0X85_RESP_LEN;
     return kPositiveResponse;
 }
 
+// user services are defined in the application
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions)                                 \
+    enum Iso14229ResponseCode func(Iso14229Server *self, Iso14229ServerRequestContext *ctx);
+ISO14229_SERVER_USER_SID_LIST
+#undef X
+
+/**
+ * @brief \~chinese 服务表 \~english Service table, indexed by request SID
+ */
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions)                                 \
+    [sid] = {func, hasSubFunction, minLen, sessions},
+static const Iso14229ServiceEntry serviceTable[0x100] = {
+    ISO14229_SID_LIST ISO14229_SERVER_USER_SID_LIST};
+#undef X
+
+#if ISO14229_SERVER_METRICS
+/**
+ * @brief metrics slot + 1 of each SID. 0: kIso14229MetricsOtherSID
+ */
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions)                                 \
+    [sid] = kIso14229MetricsSID_##str_ident + 1,
+static const uint8_t metricsSlot[0x100] = {ISO14229_SID_LIST ISO14229_SERVER_USER_SID_LIST};
+#undef X
+
+/**
+ * @brief SID of each metrics slot
+ */
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions) sid,
+static const uint8_t metricsSID[ISO14229_SERVER_METRICS_NUM_SIDS] = {
+    ISO14229_SID_LIST ISO14229_SERVER_USER_SID_LIST 0x00};
+#undef X
+
+static void _RecordMetrics(Iso14229Server *self, uint8_t sid, enum Iso14229ResponseCode response,
+                           bool newRequest) {
+    Iso14229ServerMetrics *metrics = &self->metrics;
+    uint8_t slot = metricsSlot[sid] ? metricsSlot[sid] - 1 : kIso14229MetricsOtherSID;
+
+    if (newRequest) {
+        metrics->requests[slot]++;
+        if (kRequestCorrectlyReceived_ResponsePending == response) {
+            metrics->responsePending++;
+        }
+    }
+    if (kRequestCorrectlyReceived_ResponsePending == response) {
+        return; // not the final response yet
+    }
+    if (kPositiveResponse != response) {
+        metrics->negativeResponses[slot]++;
+        metrics->nrcs[ISO14229_SERVER_METRICS_NRC_SLOT(response)]++;
+    }
+    isotp_histogram_add(&metrics->latency, self->now - self->node->requestTime);
+}
+#endif
+
 /**
  * @brief Call the service if it exists, modifying the response if the spec calls for it.
  * @note see ISO14229-1 2013 7.5.5 Pseudo code example of server response behavior
  *
  * @param self
- * @param service NULL if the service is not supported
+ * @param service the service table entry of the requested SID
  * @param ctx
  */
 static enum Iso14229ResponseCode evaluateServiceResponse(Iso14229Server *self,
-                                                         Iso14229Service service,
+                                                         const Iso14229ServiceEntry *service,
                                                          Iso14229ServerRequestContext *ctx) {
     enum Iso14229ResponseCode response = kPositiveResponse;
     bool suppressResponse = false;
-    uint8_t sid = ctx->req.buf[0];
-
-    if (NULL == service) {
-        return NegativeResponse(ctx, kServiceNotSupported);
-    }
-
-    switch (sid) {
-    /* CASE Service_with_sub-function */
-    /* test if service with sub-function is supported */
-    case kSID_DIAGNOSTIC_SESSION_CONTROL:
-    case kSID_ECU_RESET:
-    case kSID_READ_DTC_INFORMATION:
-    case kSID_SECURITY_ACCESS:
-    case kSID_COMMUNICATION_CONTROL:
-    case kSID_ROUTINE_CONTROL:
-    case kSID_TESTER_PRESENT:
-    case kSID_ACCESS_TIMING_PARAMETER:
-    case kSID_SECURED_DATA_TRANSMISSION:
-    case kSID_CONTROL_DTC_SETTING:
-    case kSID_RESPONSE_ON_EVENT:
-
-        /* check minimum length of message with sub-function */
-        if (ctx->req.len >= 2) {
-            /* get sub-function parameter value without bit 7 */
-            // switch (ctx->req.as.raw[0] & 0x7F) {
-
-            // }
-            // Let the service callback determine whether or not the sub-function parameter value is
-            // supported
-            response = service(self, ctx);
-        } else {
-            /* NRC 0x13: incorrectMessageLengthOrInvalidFormat */
-            response = kIncorrectMessageLengthOrInvalidFormat;
-        }
 
-        bool suppressPosRspMsgIndicationBit = ctx->req.buf[1] & 0x80;
+    if (NULL == service->func) {
+        ISO14229USERDEBUG("no handler for request SID %x.\n", ctx->req.buf[0]);
+        response = NegativeResponse(ctx, kServiceNotSupported);
+    } else if (ctx->req.len < service->minLen) {
+        /* NRC 0x13: incorrectMessageLengthOrInvalidFormat */
+        response = NegativeResponse(ctx, kIncorrectMessageLengthOrInvalidFormat);
+    } else if (!(service->sessions & ISO14229_SESSION_BIT(self->node->status.sessionType))) {
+        response = NegativeResponse(ctx, kServiceNotSupportedInActiveSession);
+    } else {
+        // Let the service callback determine whether or not the sub-function parameter value is
+        // supported
+        response = service->func(self, ctx);
 
         /* test if positive response is required and if responseCode is positive 0x00 */
-        if ((suppressPosRspMsgIndicationBit) && (response == kPositiveResponse) &&
-            (
-                // TODO: *not yet a NRC 0x78 response sent*
-                true)) {
+        if (service->hasSubFunction && (ctx->req.buf[1] & 0x80) &&
+            (response == kPositiveResponse) && !self->node->rcrrpSent) {
             suppressResponse = true;
-        } else {
-            suppressResponse = false;
         }
-        break;
-
-    /* CASE Service_without_sub-function */
-    /* test if service without sub-function is supported */
-    case kSID_READ_DATA_BY_IDENTIFIER:
-    case kSID_READ_MEMORY_BY_ADDRESS:
-    case kSID_READ_SCALING_DATA_BY_IDENTIFIER:
-    case kSID_READ_PERIODIC_DATA_BY_IDENTIFIER:
-    case kSID_DYNAMICALLY_DEFINE_DATA_IDENTIFIER:
-    case kSID_WRITE_DATA_BY_IDENTIFIER:
-    case kSID_REQUEST_DOWNLOAD:
-    case kSID_REQUEST_UPLOAD:
-    case kSID_TRANSFER_DATA:
-    case kSID_REQUEST_TRANSFER_EXIT:
-    case kSID_REQUEST_FILE_TRANSFER:
-    case kSID_WRITE_MEMORY_BY_ADDRESS:
-    case kSID_CLEAR_DIAGNOSTIC_INFORMATION:
-    case kSID_INPUT_CONTROL_BY_IDENTIFIER:
-        response = service(self, ctx);
-        break;
-
-    default:
-        response = kServiceNotSupported;
-        break;
     }
 
     if ((kAddressingSchemeFunctional == ctx->req.addressingScheme) &&
@@ -731,9 +1858,7 @@ static enum Iso14229ResponseCode evaluateServiceResponse(Iso14229Server *self,
          (kServiceNotSupportedInActiveSession == response) ||
          (kSubFunctionNotSupportedInActiveSession == response) ||
          (kRequestOutOfRange == response)) &&
-        (
-            // TODO: *not yet a NRC 0x78 response sent*
-            true)) {
+        !self->node->rcrrpSent) {
         suppressResponse = true; /* Suppress negative response message */
         NoResponse(ctx);
     } else {
@@ -746,19 +1871,6 @@ static enum Iso14229ResponseCode evaluateServiceResponse(Iso14229Server *self,
     return response;
 }
 
-static Iso14229Service getServiceForSID(enum Iso14229DiagnosticServiceId sid) {
-#define X(str_ident, sid, func)                                                                    \
-    case sid:                                                                                      \
-        return func;
-    switch (sid) {
-        ISO14229_SID_LIST
-#undef X
-    default:
-        ISO14229USERDEBUG("no handler for request SID %x.\n", sid);
-        return NULL;
-    }
-}
-
 /**
  * @brief Call the service matching the requested SID
  *
@@ -766,30 +1878,51 @@ static Iso14229Service getServiceForSID(enum Iso14229DiagnosticServiceId sid) {
  * @param buf   incoming data from ISO-TP layer
  * @param size  size of buf
  */
-void iso14229ProcessUDSLayer(Iso14229Server *self, IsoTpLink *link,
-                             enum Iso14229AddressingScheme addressingScheme) {
-    uint8_t sid = link->receive_buffer[0];
-    Iso14229Service handler = getServiceForSID(sid);
+void iso14229ProcessUDSLayer(Iso14229Server *self, IsoTpLink *link, const uint8_t *req,
+                             uint16_t req_len, enum Iso14229AddressingScheme addressingScheme) {
     Iso14229ServerRequestContext ctx = {
         .req =
             {
-                .buf = link->receive_buffer,
-                .len = link->receive_size,
+                .buf = req,
+                .len = req_len,
                 .addressingScheme = addressingScheme,
             },
         .resp = {.buf = link->send_buffer, .len = 0, .buffer_size = link->send_buf_size},
     };
 
-    enum Iso14229ResponseCode response = evaluateServiceResponse(self, handler, &ctx);
+    if (0 == req_len) {
+        return;
+    }
+
+    Iso14229ServerNode *node = self->node;
+#if ISO14229_SERVER_METRICS
+    bool newRequest = !node->status.RCRRP;
+#endif
+    enum Iso14229ResponseCode response = evaluateServiceResponse(self, &serviceTable[req[0]], &ctx);
+#if ISO14229_SERVER_METRICS
+    _RecordMetrics(self, req[0], response, newRequest);
+#endif
 
     if (kRequestCorrectlyReceived_ResponsePending == response) {
-        self->status.RCRRP = true;
-        self->notReadyToReceive = true;
+        uint32_t now = self->now;
+        if (node->rcrrpSent) {
+            NoResponse(&ctx); // still working: the keepalives are sent by _ProcessNode
+        } else {
+            node->rcrrpSent = true;
+            node->rcrrpKeepaliveTime = now + (uint32_t)self->cfg->p2_star_ms *
+                                                 ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT / 100;
+        }
+        node->rcrrpRecallTime = now + self->cfg->rcrrp_recall_ms;
+        node->status.RCRRP = true;
+        node->notReadyToReceive = true;
     } else {
-        self->status.RCRRP = false;
+        node->status.RCRRP = false;
+        node->rcrrpSent = false;
     }
 
-    if (ctx.resp.len) {
+    if (ctx.numSegments) {
+        isotp_send_segments(link, link->send_arbitration_id, ctx.segments, ctx.numSegments);
+    } else if (ctx.resp.len) {
         isotp_send(link, ctx.resp.buf, ctx.resp.len);
     }
 }
@@ -798,6 +1931,65 @@ void iso14229ProcessUDSLayer(Iso14229Server *self, IsoTpLink *link,
 //                             Public Functions
 // ========================================================================
 
+static inline uint16_t _AddressHash(uint16_t arb_id) {
+    return ((uint32_t)arb_id * 0x9E3779B1U) >> 16 & (ISO14229_SERVER_ADDRESS_TABLE_SIZE - 1);
+}
+
+static void _AddressTableInsert(Iso14229Server *self, uint16_t arb_id, IsoTpLink *link) {
+    uint16_t idx = _AddressHash(arb_id);
+    while (self->addressTable[idx].link) {
+        idx = (idx + 1) & (ISO14229_SERVER_ADDRESS_TABLE_SIZE - 1);
+    }
+    self->addressTable[idx] = (struct Iso14229ServerAddress){.link = link, .arb_id = arb_id};
+}
+
+static void _NodeInit(Iso14229Server *self, Iso14229ServerNode *node,
+                      const Iso14229ServerNodeConfig *cfg, uint8_t nodeIdx) {
+    assert(cfg->phys_link);
+    assert(cfg->func_link);
+    assert(cfg->phys_link_send_buffer);
+    assert(cfg->phys_link_send_buf_size > 2);
+    assert(cfg->phys_link_receive_buffer);
+    assert(cfg->phys_link_recv_buf_size > 2);
+    assert(cfg->func_link_send_buffer || 0 == cfg->func_link_send_buf_size);
+    assert(NULL == cfg->func_link_send_buffer || cfg->func_link_send_buf_size > 2);
+    assert(cfg->func_link_receive_buffer);
+    assert(cfg->func_link_recv_buf_size > 2);
+
+    isotp_init_link(cfg->phys_link, cfg->send_id, cfg->phys_link_send_buffer,
+                    cfg->phys_link_send_buf_size, cfg->phys_link_receive_buffer,
+                    cfg->phys_link_recv_buf_size, self->cfg->userGetms, self->cfg->userCANTransmit,
+                    self->cfg->userDebug);
+
+    // the functional link may respond from the physical link's send buffer
+    node->sharedSendBuffer = NULL == cfg->func_link_send_buffer ||
+                             cfg->func_link_send_buffer == cfg->phys_link_send_buffer;
+    isotp_init_link(cfg->func_link, cfg->send_id,
+                    node->sharedSendBuffer ? cfg->phys_link_send_buffer
+                                           : cfg->func_link_send_buffer,
+                    node->sharedSendBuffer ? cfg->phys_link_send_buf_size
+                                           : cfg->func_link_send_buf_size,
+                    cfg->func_link_receive_buffer,
+                    cfg->func_link_recv_buf_size, self->cfg->userGetms, self->cfg->userCANTransmit,
+                    self->cfg->userDebug);
+
+    node->phys_recv_id = cfg->phys_recv_id;
+    node->func_recv_id = cfg->func_recv_id;
+    node->phys_link = cfg->phys_link;
+    node->func_link = cfg->func_link;
+    node->status.sessionType = kDefaultSession;
+    node->status.nodeIdx = nodeIdx;
+    // type 1 periodic frames on send_id would be taken for ISO-TP frames by the client
+    assert(cfg->periodic_send_id != cfg->send_id || 0 == cfg->periodic_send_id);
+    node->periodicSendId = cfg->periodic_send_id;
+
+    // Set the session timeout for s3 milliseconds from now.
+    node->s3_session_timeout_timer = self->now + self->cfg->s3_ms;
+
+    _AddressTableInsert(self, cfg->phys_recv_id, cfg->phys_link);
+    _AddressTableInsert(self, cfg->func_recv_id, cfg->func_link);
+}
+
 /**
  * @brief \~chinese 初始化服务器 \~english Initialize the server
  *
@@ -808,140 +2000,491 @@ void iso14229ProcessUDSLayer(Iso14229Server *self, IsoTpLink *link,
 void Iso14229ServerInit(Iso14229Server *self, const Iso14229ServerConfig *cfg) {
     assert(self);
     assert(cfg);
-    assert(cfg->phys_link);
-    assert(cfg->func_link);
-    assert(cfg->phys_link_send_buffer);
-    assert(cfg->phys_link_send_buf_size > 2);
-    assert(cfg->phys_link_receive_buffer);
-    assert(cfg->phys_link_recv_buf_size > 2);
-    assert(cfg->func_link_send_buffer);
-    assert(cfg->func_link_send_buf_size > 2);
-    assert(cfg->func_link_receive_buffer);
-    assert(cfg->func_link_recv_buf_size > 2);
     assert(cfg->userGetms);
     assert(cfg->userSessionTimeoutCallback);
     assert(cfg->userCANTransmit);
-    assert(cfg->userCANRxPoll);
+    assert(cfg->numNodes < ISO14229_SERVER_MAX_NODES);
+    assert(cfg->nodes || 0 == cfg->numNodes);
+    assert(cfg->didTable || 0 == cfg->didTableSize);
+    assert(cfg->memoryRegions || 0 == cfg->numMemoryRegions);
+#ifndef NDEBUG
+    for (uint16_t i = 1; i < cfg->didTableSize; i++) {
+        assert(cfg->didTable[i - 1].did < cfg->didTable[i].did); // the table must be sorted
+    }
+    for (uint16_t i = 1; i < cfg->numMemoryRegions; i++) {
+        const Iso14229MemoryRegion *prev = &cfg->memoryRegions[i - 1];
+        // sorted and not overlapping
+        assert(prev->base < cfg->memoryRegions[i].base);
+        assert(cfg->memoryRegions[i].base - prev->base >= prev->size);
+    }
+#endif
 
-    isotp_init_link(cfg->phys_link, cfg->send_id, cfg->phys_link_send_buffer,
-                    cfg->phys_link_send_buf_size, cfg->phys_link_receive_buffer,
-                    cfg->phys_link_recv_buf_size, cfg->userGetms, cfg->userCANTransmit,
-                    cfg->userDebug);
+    memset(self, 0, sizeof(Iso14229Server));
 
-    isotp_init_link(cfg->func_link, cfg->send_id, cfg->func_link_send_buffer,
-                    cfg->func_link_send_buf_size, cfg->func_link_receive_buffer,
-                    cfg->func_link_recv_buf_size, cfg->userGetms, cfg->userCANTransmit,
-                    cfg->userDebug);
+    self->cfg = cfg;
+    self->now = cfg->userGetms();
+    self->periodic_ms[kSendAtSlowRate - 1] =
+        cfg->periodic_slow_ms ? cfg->periodic_slow_ms : ISO14229_SERVER_PERIODIC_SLOW_MS;
+    self->periodic_ms[kSendAtMediumRate - 1] =
+        cfg->periodic_medium_ms ? cfg->periodic_medium_ms : ISO14229_SERVER_PERIODIC_MEDIUM_MS;
+    self->periodic_ms[kSendAtFastRate - 1] =
+        cfg->periodic_fast_ms ? cfg->periodic_fast_ms : ISO14229_SERVER_PERIODIC_FAST_MS;
+
+    // node 0: the addresses in the server config
+    const Iso14229ServerNodeConfig node0 = {
+        .phys_recv_id = cfg->phys_recv_id,
+        .func_recv_id = cfg->func_recv_id,
+        .send_id = cfg->send_id,
+        .phys_link = cfg->phys_link,
+        .func_link = cfg->func_link,
+        .phys_link_receive_buffer = cfg->phys_link_receive_buffer,
+        .phys_link_recv_buf_size = cfg->phys_link_recv_buf_size,
+        .phys_link_send_buffer = cfg->phys_link_send_buffer,
+        .phys_link_send_buf_size = cfg->phys_link_send_buf_size,
+        .func_link_receive_buffer = cfg->func_link_receive_buffer,
+        .func_link_recv_buf_size = cfg->func_link_recv_buf_size,
+        .func_link_send_buffer = cfg->func_link_send_buffer,
+        .func_link_send_buf_size = cfg->func_link_send_buf_size,
+        .periodic_send_id = cfg->periodic_send_id,
+    };
+    _NodeInit(self, &self->nodes[0], &node0, 0);
+    for (uint8_t i = 0; i < cfg->numNodes; i++) {
+        _NodeInit(self, &self->nodes[i + 1], &cfg->nodes[i], i + 1);
+    }
+    self->numNodes = cfg->numNodes + 1;
+    self->node = &self->nodes[0];
 
-    memset(self, 0, sizeof(Iso14229Server));
+    if (cfg->phys_link_receive_buffer2) {
+        isotp_set_receive_double_buffer(cfg->phys_link, cfg->phys_link_receive_buffer2);
+    }
 
-    self->phys_link = cfg->phys_link;
-    self->func_link = cfg->func_link;
-    self->phys_recv_id = cfg->phys_recv_id;
-    self->func_recv_id = cfg->func_recv_id;
-    self->p2_ms = cfg->p2_ms;
-    self->p2_star_ms = cfg->p2_star_ms;
-    self->s3_ms = cfg->s3_ms;
-    self->userSessionTimeoutCallback = cfg->userSessionTimeoutCallback;
-    self->userGetms = cfg->userGetms;
-    self->userCANTransmit = cfg->userCANTransmit;
-    self->userCANRxPoll = cfg->userCANRxPoll;
-    self->userDebug = cfg->userDebug;
-    self->userDiagnosticSessionControlHandler = cfg->userDiagnosticSessionControlHandler;
-    self->userECUResetHandler = cfg->userECUResetHandler;
-    self->userRDBIHandler = cfg->userRDBIHandler;
-    self->userWDBIHandler = cfg->userWDBIHandler;
-    self->userCommunicationControlHandler = cfg->userCommunicationControlHandler;
-    self->userSecurityAccessGenerateSeed = cfg->userSecurityAccessGenerateSeed;
-    self->userSecurityAccessValidateKey = cfg->userSecurityAccessValidateKey;
-    self->userRoutineControlHandler = cfg->userRoutineControlHandler;
-    self->userRequestDownloadHandler = cfg->userRequestDownloadHandler;
-
-    self->status.sessionType = kDefaultSession;
-
-    // Initialize p2_timer to an already past time, otherwise the server's
-    // response to incoming messages will be delayed.
-    self->p2_timer = self->userGetms() - self->p2_ms;
+    if (cfg->link_tx_dl) {
+        for (uint8_t i = 0; i < self->numNodes; i++) {
+            int err = isotp_set_tx_dl(self->nodes[i].phys_link, cfg->link_tx_dl) |
+                      isotp_set_tx_dl(self->nodes[i].func_link, cfg->link_tx_dl);
+            assert(ISOTP_RET_OK == err);
+            (void)err;
+        }
+    }
+}
 
-    // Set the session timeout for s3 milliseconds from now.
-    self->s3_session_timeout_timer = self->userGetms() + self->s3_ms;
+/**
+ * @brief Process the request on a link, if there is one. The request is read in place from the
+ * link's receive buffer and stays there until the service has completed, also while it responds
+ * with RCRRP.
+ * @return true if a request was processed
+ */
+static bool _ProcessLink(Iso14229Server *self, IsoTpLink *link,
+                         enum Iso14229AddressingScheme addressingScheme) {
+    Iso14229ServerNode *node = self->node;
+    const uint8_t *req;
+    uint16_t req_len;
+
+    if (ISOTP_RET_OK != isotp_receive_peek(link, &req, &req_len)) {
+        return false;
+    }
+
+    if (!node->status.RCRRP) {
+        // a new request, not a service being called again after RCRRP
+        struct Iso14229ServerLinkStats *stats = &node->linkStats[addressingScheme];
+        stats->requests++;
+#if ISO14229_SERVER_METRICS
+        node->requestTime = stats->waiting ? stats->waitingSince : self->now;
+#endif
+        if (stats->waiting) {
+            uint32_t wait = self->now - stats->waitingSince;
+            stats->totalWaitMs += wait;
+            if (wait > stats->maxWaitMs) {
+                stats->maxWaitMs = wait;
+            }
+            if (wait >= self->cfg->p2_ms) {
+                stats->p2Missed++;
+            }
+            stats->waiting = false;
+        }
+    }
+
+    iso14229ProcessUDSLayer(self, link, req, req_len, addressingScheme);
+
+    if (node->status.RCRRP) {
+        node->rcrrpLink = link;
+        node->rcrrpAddressingScheme = addressingScheme;
+    } else {
+        isotp_receive_release(link);
+    }
+    return true;
 }
 
-static void _ProcessLinks(Iso14229Server *self) {
-    int recv_status = ISOTP_RET_NO_DATA;
+/**
+ * @brief send a 0x78 keepalive for the request held on the node's rcrrpLink
+ */
+static void _SendResponsePending(Iso14229ServerNode *node) {
+    const uint8_t *req;
+    uint16_t req_len;
 
-    // If the user service handler responded RCRRP and the send link is now idle,
-    // the response has been sent and the long-running service can now be called.
-    if (self->status.RCRRP && ISOTP_SEND_STATUS_IDLE == self->phys_link->send_status) {
-        iso14229ProcessUDSLayer(self, self->phys_link, kAddressingSchemePhysical);
-        self->notReadyToReceive = self->status.RCRRP;
+    if (ISOTP_RET_OK != isotp_receive_peek(node->rcrrpLink, &req, &req_len)) {
         return;
     }
+    uint8_t resp[ISO14229_NEG_RESP_LEN] = {0x7F, req[0], kRequestCorrectlyReceived_ResponsePending};
+    isotp_send(node->rcrrpLink, resp, sizeof(resp));
+}
+
+/**
+ * @brief true while `link` cannot build a response: it is sending, or it shares its send buffer
+ * with the node's other link and that one is sending
+ */
+static bool _LinkBusy(const Iso14229ServerNode *node, const IsoTpLink *link) {
+    const IsoTpLink *other = link == node->phys_link ? node->func_link : node->phys_link;
+    return ISOTP_SEND_STATUS_INPROGRESS == link->send_status ||
+           (node->sharedSendBuffer && ISOTP_SEND_STATUS_INPROGRESS == other->send_status);
+}
+
+static void _ProcessNode(Iso14229Server *self, Iso14229ServerNode *node) {
+    self->node = node;
+
+    // A service which responded RCRRP is called again once the 0x78 has been sent, every
+    // rcrrp_recall_ms. The server keeps the client's P2* from expiring in the meantime.
+    if (node->status.RCRRP && ISOTP_SEND_STATUS_IDLE == node->rcrrpLink->send_status &&
+        !_LinkBusy(node, node->rcrrpLink)) {
+        uint32_t now = self->now;
+        if (!Iso14229TimeAfter(node->rcrrpKeepaliveTime, now)) {
+            _SendResponsePending(node);
+            node->rcrrpKeepaliveTime = now + (uint32_t)self->cfg->p2_star_ms *
+                                                 ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT / 100;
+        } else if (!Iso14229TimeAfter(node->rcrrpRecallTime, now)) {
+            _ProcessLink(self, node->rcrrpLink, node->rcrrpAddressingScheme);
+            node->notReadyToReceive = node->status.RCRRP;
+        }
+    }
 
     if (self->notReadyToReceive) {
         return;
     }
 
-    // new data may be processed only after p2 has elapsed
-    if (Iso14229TimeAfter(self->userGetms(), self->p2_timer)) {
+    // a complete request is processed right away unless its send buffer is still sending the
+    // previous response (the response is built in the link's send buffer) or a service is
+    // responding RCRRP.
+    // The link served first alternates so that neither starves the other.
+    uint8_t first = node->nextLink;
+    for (uint8_t i = 0; i < 2; i++) {
+        enum Iso14229AddressingScheme scheme = (first + i) & 1;
+        IsoTpLink *link = kAddressingSchemePhysical == scheme ? node->phys_link : node->func_link;
+
+        if (node->status.RCRRP && link == node->rcrrpLink) {
+            continue; // holds the request being served
+        }
+        if (node->notReadyToReceive || _LinkBusy(node, link)) {
+            struct Iso14229ServerLinkStats *stats = &node->linkStats[scheme];
+            if (!stats->waiting && ISOTP_RECEIVE_STATUS_FULL == link->receive_status) {
+                stats->waiting = true;
+                stats->waitingSince = self->now;
+                stats->deferred++;
+            }
+            continue;
+        }
 
-        // priority goes to the physical link
-        recv_status =
-            isotp_receive(self->phys_link, self->phys_link->receive_buffer,
-                          self->phys_link->receive_buf_size, &self->phys_link->receive_size);
-        switch (recv_status) {
-        case ISOTP_RET_OK:
-            iso14229ProcessUDSLayer(self, self->phys_link, kAddressingSchemePhysical);
-            self->p2_timer = self->userGetms() + self->p2_ms;
-            return;
-            break;
-        case ISOTP_RET_NO_DATA:
-            break;
-        default:
-            assert(0);
-            break;
+        if (_ProcessLink(self, link, scheme)) {
+            node->nextLink = (scheme + 1) & 1;
+        }
+    }
+}
+
+/**
+ * @brief read the data record of a scheduled periodicDataIdentifier
+ */
+static enum Iso14229ResponseCode _ReadPeriodicRecord(Iso14229Server *self,
+                                                     const Iso14229ServerNode *node, uint8_t pdid,
+                                                     uint8_t *buf, uint16_t *len) {
+    uint16_t dataId = ISO14229_0X2A_DID_BASE | pdid;
+    const Iso14229DataIdentifier *entry = _FindDID(self, dataId);
+    const uint8_t *data_location = NULL;
+    enum Iso14229ResponseCode err;
+
+    if (entry) {
+        err = _CheckAccess(&node->status, entry->readSessions, entry->readSecurityLevel);
+        if (kPositiveResponse != err) {
+            return err;
         }
+        if (entry->len > ISO14229_0X2A_MAX_RECORD_LEN) {
+            return kResponseTooLong; // a dynamically defined DID grew after it was scheduled
+        }
+        *len = entry->len;
+        if (entry->read) {
+            err = entry->read(&node->status, entry, buf, len);
+            return *len > entry->len ? kGeneralProgrammingFailure : err;
+        }
+        memmove(buf, entry->data, entry->len);
+        return kPositiveResponse;
+    }
 
-        recv_status =
-            isotp_receive(self->func_link, self->func_link->receive_buffer,
-                          self->func_link->receive_buf_size, &self->func_link->receive_size);
+    if (NULL == self->cfg->userRDBIHandler) {
+        return kRequestOutOfRange; // e.g. a dynamically defined DID that was cleared
+    }
+    err = self->cfg->userRDBIHandler(&node->status, dataId, &data_location, len);
+    if (kPositiveResponse != err) {
+        return err;
+    }
+    if (*len > ISO14229_0X2A_MAX_RECORD_LEN) {
+        return kResponseTooLong;
+    }
+    memmove(buf, data_location, *len);
+    return kPositiveResponse;
+}
 
-        switch (recv_status) {
-        case ISOTP_RET_OK:
-            iso14229ProcessUDSLayer(self, self->func_link, kAddressingSchemeFunctional);
-            self->p2_timer = self->userGetms() + self->p2_ms;
-            return;
-            break;
-        case ISOTP_RET_NO_DATA:
-            break;
-        default:
-            assert(0);
-            break;
+/**
+ * @brief send the periodic messages which are due, fastest rate first. Each rate keeps its phase:
+ * the next message is due one period after the previous due time, not after the time it was sent.
+ * A message more than one period late is not caught up on.
+ */
+static void _ProcessPeriodic(Iso14229Server *self, Iso14229ServerNode *node, uint32_t now) {
+    uint8_t budget = ISOTP_SEND_STATUS_INPROGRESS == node->phys_link->send_status
+                         ? 1
+                         : ISO14229_SERVER_PERIODIC_FRAMES_PER_POLL;
+
+    self->node = node;
+
+    for (uint8_t i = 0; i < node->numPeriodic && budget; i++) {
+        struct Iso14229PeriodicEntry *entry = &node->periodic[i];
+        uint8_t frame[1 + ISO14229_0X2A_MAX_RECORD_LEN];
+        uint16_t len = 0;
+
+        if (Iso14229TimeAfter(entry->due, now)) {
+            continue;
+        }
+
+        frame[0] = entry->pdid;
+        if (kPositiveResponse == _ReadPeriodicRecord(self, node, entry->pdid, frame + 1, &len)) {
+            if (ISOTP_RET_OK != self->cfg->userCANTransmit(node->periodicSendId, frame, 1 + len)) {
+                break; // the bus is busy, retry on the next poll
+            }
+            budget--;
+        }
+
+        entry->due += entry->period_ms;
+        if (Iso14229TimeAfter(now, entry->due)) {
+            entry->due = now + entry->period_ms;
         }
     }
 }
 
-void Iso14229ServerPoll(Iso14229Server *self) {
+/**
+ * @brief pass a frame to the links listening on its arbitration ID. A functional ID shared by
+ * several nodes reaches all of them.
+ */
+static inline void _DispatchCANFrame(Iso14229Server *self, uint32_t arb_id, const uint8_t *data,
+                                     uint8_t size) {
+    if (arb_id > UINT16_MAX) {
+        return;
+    }
+    uint16_t idx = _AddressHash(arb_id);
+    while (self->addressTable[idx].link) {
+        if (self->addressTable[idx].arb_id == arb_id) {
+            isotp_on_can_message(self->addressTable[idx].link, (uint8_t *)data, size);
+        }
+        idx = (idx + 1) & (ISO14229_SERVER_ADDRESS_TABLE_SIZE - 1);
+    }
+}
+
+/**
+ * @brief take up to ISO14229_SERVER_MAX_RX_FRAMES_PER_POLL frames from the RX ring, or from
+ * userCANRxPoll when there is no ring, and pass them to the ISO-TP links
+ */
+static void _ReceiveCANFrames(Iso14229Server *self) {
     uint32_t arb_id;
-    uint8_t data[8];
+    uint8_t data[ISO_TP_MAX_DL];
     uint8_t size;
 
-    if (kCANRxSome == self->userCANRxPoll(&arb_id, data, &size)) {
-        if (arb_id == self->phys_recv_id) {
-            isotp_on_can_message(self->phys_link, (uint8_t *)data, size);
-        } else if (arb_id == self->func_recv_id) {
-            isotp_on_can_message(self->func_link, (uint8_t *)data, size);
+    for (unsigned int i = 0; i < ISO14229_SERVER_MAX_RX_FRAMES_PER_POLL; i++) {
+        if (self->cfg->rxRing) {
+            const struct Iso14229CANFrame *frame = Iso14229CANRxRingPeek(self->cfg->rxRing);
+            if (NULL == frame) {
+                break;
+            }
+            _DispatchCANFrame(self, frame->arb_id, frame->data, frame->size);
+            Iso14229CANRxRingPop(self->cfg->rxRing);
+        } else if (self->cfg->userCANRxPoll &&
+                   kCANRxSome == self->cfg->userCANRxPoll(&arb_id, data, &size)) {
+            _DispatchCANFrame(self, arb_id, data, size);
+        } else {
+            self->rxBacklog = false;
+            return;
+        }
+    }
+    self->rxBacklog = true; // stopped at the limit: there may be more frames
+}
+
+void Iso14229ServerReceiveCANFrame(Iso14229Server *self, uint32_t arb_id, const uint8_t *data,
+                                   uint8_t size) {
+    _DispatchCANFrame(self, arb_id, data, size);
+}
+
+void Iso14229ServerPoll(Iso14229Server *self) {
+    self->now = self->cfg->userGetms();
+    _ReceiveCANFrames(self);
+
+    for (uint8_t i = 0; i < self->numNodes; i++) {
+        Iso14229ServerNode *node = &self->nodes[i];
+
+        isotp_poll_at(node->phys_link, self->now);
+        isotp_poll_at(node->func_link, self->now);
+
+        // ISO14229-1-2013 Figure 38: Session Timeout (S3)
+        if (kDefaultSession != node->status.sessionType &&
+            Iso14229TimeAfter(self->now, node->s3_session_timeout_timer)) {
+            self->node = node;
+            self->cfg->userSessionTimeoutCallback();
+        }
+
+        _ProcessNode(self, node);
+
+        if (node->numPeriodic && !self->notReadyToReceive) {
+            _ProcessPeriodic(self, node, self->now);
+        }
+    }
+
+    if (self->cfg->dtcStore) {
+        Iso14229DTCStorePoll(self->cfg->dtcStore, self->now);
+    }
+}
+
+static inline void _EarliestDeadline(uint32_t *timeout, uint32_t now, uint32_t deadline) {
+    if (Iso14229TimeUntil(now, deadline) < *timeout) {
+        *timeout = Iso14229TimeUntil(now, deadline);
+    }
+}
+
+/**
+ * @brief true if a complete request on `link` would be processed by the next poll
+ */
+static bool _RequestReady(const Iso14229Server *self, const Iso14229ServerNode *node,
+                          const IsoTpLink *link) {
+    return ISOTP_RECEIVE_STATUS_FULL == link->receive_status && !self->notReadyToReceive &&
+           !node->notReadyToReceive && !_LinkBusy(node, link) &&
+           !(node->status.RCRRP && link == node->rcrrpLink);
+}
+
+uint32_t Iso14229ServerGetTimeoutms(Iso14229Server *self) {
+    uint32_t now = self->cfg->userGetms();
+    uint32_t timeout = UINT32_MAX;
+    uint32_t deadline;
+
+    if (self->rxBacklog || (self->cfg->rxRing && Iso14229CANRxRingPeek(self->cfg->rxRing))) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < self->numNodes; i++) {
+        const Iso14229ServerNode *node = &self->nodes[i];
+        IsoTpLink *links[] = {node->phys_link, node->func_link};
+
+        for (uint8_t j = 0; j < 2; j++) {
+            if (_RequestReady(self, node, links[j])) {
+                return 0;
+            }
+            // STmin, N_Bs, N_Cr
+            if (isotp_get_next_deadline(links[j], &deadline)) {
+                _EarliestDeadline(&timeout, now, deadline);
+            }
+        }
+
+        if (kDefaultSession != node->status.sessionType) {
+            _EarliestDeadline(&timeout, now, node->s3_session_timeout_timer);
         }
+        if (node->status.RCRRP) {
+            _EarliestDeadline(&timeout, now, node->rcrrpKeepaliveTime);
+            _EarliestDeadline(&timeout, now, node->rcrrpRecallTime);
+        }
+        if (!self->notReadyToReceive) {
+            for (uint8_t k = 0; k < node->numPeriodic; k++) {
+                _EarliestDeadline(&timeout, now, node->periodic[k].due);
+            }
+        }
+    }
+    if (self->cfg->dtcStore && Iso14229DTCStoreNextDeadline(self->cfg->dtcStore, now, &deadline)) {
+        _EarliestDeadline(&timeout, now, deadline);
+    }
+    return timeout;
+}
+
+#if ISO14229_SERVER_METRICS
+static uint8_t *_PutMetric(uint8_t *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+    return p + 4;
+}
+
+static uint8_t *_PutHistogram(uint8_t *p, const IsoTpHistogram *histogram) {
+    for (uint8_t i = 0; i < ISOTP_HISTOGRAM_BUCKETS; i++) {
+        p = _PutMetric(p, histogram->count[i]);
+    }
+    return _PutMetric(p, histogram->max);
+}
+
+#define ISO14229_METRICS_HISTOGRAM_LEN (4 * (ISOTP_HISTOGRAM_BUCKETS + 1))
+
+enum Iso14229ResponseCode Iso14229ServerMetricsRead(const struct Iso14229ServerStatus *status,
+                                                    const Iso14229DataIdentifier *entry,
+                                                    uint8_t *buf, uint16_t *len) {
+    const Iso14229Server *self = entry->data;
+    const Iso14229ServerMetrics *metrics = &self->metrics;
+    uint32_t requests = 0, negativeResponses = 0;
+    uint8_t numSIDs = 0, numNRCs = 0;
+
+    for (uint8_t i = 0; i < ISO14229_SERVER_METRICS_NUM_SIDS; i++) {
+        requests += metrics->requests[i];
+        negativeResponses += metrics->negativeResponses[i];
+        numSIDs += metrics->requests[i] ? 1 : 0;
+    }
+    for (uint8_t i = 0; i < ISO14229_SERVER_METRICS_NUM_NRCS; i++) {
+        numNRCs += metrics->nrcs[i] ? 1 : 0;
+    }
+
+    uint32_t recordLen = 12 + ISO14229_METRICS_HISTOGRAM_LEN + 1 + 9 * numSIDs + 1 + 5 * numNRCs;
+#if ISO_TP_METRICS
+    recordLen += 16 + 3 * ISO14229_METRICS_HISTOGRAM_LEN;
+#endif
+    if (recordLen > *len) {
+        return kResponseTooLong;
     }
 
-    isotp_poll(self->phys_link);
-    isotp_poll(self->func_link);
+    uint8_t *p = buf;
+    p = _PutMetric(p, requests);
+    p = _PutMetric(p, negativeResponses);
+    p = _PutMetric(p, metrics->responsePending);
+    p = _PutHistogram(p, &metrics->latency);
+
+    *p++ = numSIDs;
+    for (uint8_t i = 0; i < ISO14229_SERVER_METRICS_NUM_SIDS; i++) {
+        if (metrics->requests[i]) {
+            *p++ = metricsSID[i];
+            p = _PutMetric(p, metrics->requests[i]);
+            p = _PutMetric(p, metrics->negativeResponses[i]);
+        }
+    }
 
-    // ISO14229-1-2013 Figure 38: Session Timeout (S3)
-    if (kDefaultSession != self->status.sessionType &&
-        Iso14229TimeAfter(self->userGetms(), self->s3_session_timeout_timer)) {
-        self->userSessionTimeoutCallback();
+    *p++ = numNRCs;
+    for (uint8_t i = 0; i < ISO14229_SERVER_METRICS_NUM_NRCS; i++) {
+        if (metrics->nrcs[i]) {
+            *p++ = i < ISO14229_SERVER_METRICS_NUM_NRCS - 1 ? 0x10 + i : 0x00;
+            p = _PutMetric(p, metrics->nrcs[i]);
+        }
     }
 
-    _ProcessLinks(self);
+#if ISO_TP_METRICS
+    const IsoTpLinkMetrics *link = &self->nodes[status->nodeIdx].phys_link->metrics;
+    p = _PutMetric(p, link->cf_sent);
+    p = _PutMetric(p, link->cf_received);
+    p = _PutMetric(p, link->n_bs_timeouts);
+    p = _PutMetric(p, link->n_cr_timeouts);
+    p = _PutHistogram(p, &link->cf_tx_gap);
+    p = _PutHistogram(p, &link->cf_rx_gap);
+    p = _PutHistogram(p, &link->fc_wait);
+#else
+    (void)status;
+#endif
+
+    *len = (uint16_t)(p - buf);
+    return kPositiveResponse;
 }
+#endif
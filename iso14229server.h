@@ -7,7 +7,12 @@
 #include <assert.h>
 #include "isotp-c/isotp.h"
 #include "iso14229.h"
+#include "iso14229canrxring.h"
+#include "iso14229digest.h"
+#include "iso14229dtc.h"
+#include "iso14229lzss.h"
 #include "iso14229serverconfig.h"
+#include "iso14229serverjob.h"
 
 typedef struct Iso14229Server Iso14229Server;
 struct Iso14229ServerStatus;
@@ -39,11 +44,27 @@ typedef struct {
         const enum Iso14229AddressingScheme addressingScheme;
     } req;
     struct Iso14229Response resp;
+    // optional: the response as a scatter list, sent with isotp_send_segments(). When numSegments
+    // is not 0, resp.len is the total length of the segments
+    IsoTpSegment segments[ISO_TP_MAX_SEND_SEGMENTS];
+    uint8_t numSegments;
 } Iso14229ServerRequestContext;
 
 typedef enum Iso14229ResponseCode (*Iso14229Service)(Iso14229Server *self,
                                                      Iso14229ServerRequestContext *req);
 
+/**
+ * @brief \~chinese 服务表项 \~english Service table entry, see ISO14229_SID_LIST and
+ * ISO14229_SERVER_USER_SID_LIST. The server checks the request length and the active session
+ * before calling `func`.
+ */
+typedef struct {
+    Iso14229Service func;   // NULL: service not supported
+    uint8_t hasSubFunction; // the suppressPosRspMsgIndicationBit applies. Requires minLen >= 2
+    uint8_t minLen;         // minimum request length including the SID
+    uint8_t sessions;       // allowed sessions, a mask of ISO14229_SESSION_BIT()
+} Iso14229ServiceEntry;
+
 /**
  * @brief User-Defined handler for 0x34 RequestDownload, 0x36 TransferData, and
  * 0x37 RequestTransferExit
@@ -93,6 +114,24 @@ typedef struct {
                                         uint8_t *transferResponseParameterRecord,
                                         uint16_t *transferResponseParameterRecordSize);
 
+    /**
+     * @brief optional: decompresses the TransferData blocks before onTransfer(...) sees them. Set
+     * it in userRequestDownloadHandler(...) when dataFormatIdentifier is ISO14229_DFI_LZSS.
+     * Leave it NULL for uncompressed downloads. requestedTransferSize and numBytesTransferred then
+     * count decompressed bytes, and onTransfer(...) receives up to ISO14229_LZSS_WINDOW_SIZE bytes
+     * per call
+     */
+    Iso14229LZSSDecoder *decoder;
+    uint16_t decodeOffset;      // bytes of the current request already fed to the decoder
+    const uint8_t *decodedData; // decoded bytes onTransfer(...) has not yet accepted
+    uint16_t decodedLen;
+
+    /**
+     * @brief optional: updated with every block onTransfer(...) accepts. Set its `type` in
+     * userRequestDownloadHandler(...). 0x37 appends the digest after the record written by
+     * onExit(...)
+     */
+    Iso14229Digest *digest;
 } Iso14229DownloadHandler;
 
 static inline void Iso14229DownloadHandlerInit(Iso14229DownloadHandler *handler,
@@ -102,8 +141,305 @@ static inline void Iso14229DownloadHandlerInit(Iso14229DownloadHandler *handler,
     handler->requestedTransferSize = memorySize;
     handler->blockSequenceCounter = 1;
     handler->numBytesTransferred = 0;
+    handler->decodeOffset = 0;
+    handler->decodedLen = 0;
+    if (handler->decoder) {
+        Iso14229LZSSDecoderInit(handler->decoder);
+    }
+    if (handler->digest) {
+        Iso14229DigestInit(handler->digest, handler->digest->type);
+    }
+}
+
+/**
+ * @brief User-Defined handler for 0x35 RequestUpload, 0x36 TransferData, and
+ * 0x37 RequestTransferExit. Each TransferData response is built in place: either sent straight
+ * from `memory`, or filled by onTransfer directly into the ISO-TP send buffer.
+ */
+typedef struct {
+    uint8_t blockSequenceCounter; // the next expected blockSequenceCounter. Starts at 0x01
+    size_t requestedTransferSize; // total transfer size in bytes requested by the client
+    size_t numBytesTransferred;   // total number of bytes sent
+
+    void *userCtx;                   // optional: pointer to context
+    uint16_t maxNumberOfBlockLength; // set by the server: largest TransferData response including
+                                     // SID and blockSequenceCounter
+    // optional: the memory being uploaded. Used when onTransfer is NULL. It must stay unchanged
+    // while a TransferData response is being sent
+    const uint8_t *memory;
+
+    /**
+     * @brief optional: callback function to produce the next block
+     * @param status
+     * @param userCtx
+     * @param buf where the block goes: the TransferData response in the send buffer
+     * @param len number of bytes requested: the block length or what remains of the transfer
+     * @param out_len set to the number of bytes written, 1..len
+     * @return 0x0 kPositiveResponse: the block is in buf
+     * @return 0x78 kRequestCorrectlyReceived_ResponsePending: notify the client before calling
+     * this function again
+     */
+    enum Iso14229ResponseCode (*onTransfer)(const struct Iso14229ServerStatus *status,
+                                            void *userCtx, uint8_t *buf, uint16_t len,
+                                            uint16_t *out_len);
+    /**
+     * @brief optional: callback function to complete the transfer, see Iso14229DownloadHandler
+     */
+    enum Iso14229ResponseCode (*onExit)(const struct Iso14229ServerStatus *status, void *userCtx,
+                                        uint16_t buffer_size,
+                                        uint8_t *transferResponseParameterRecord,
+                                        uint16_t *transferResponseParameterRecordSize);
+} Iso14229UploadHandler;
+
+static inline void Iso14229UploadHandlerInit(Iso14229UploadHandler *handler, size_t memorySize) {
+    assert(handler);
+    assert(handler->onTransfer || handler->memory);
+    handler->requestedTransferSize = memorySize;
+    handler->blockSequenceCounter = 1;
+    handler->numBytesTransferred = 0;
 }
 
+/**
+ * @brief \~chinese 数据标识符表项 \~english DataIdentifier table entry for
+ * ReadDataByIdentifier (0x22) and WriteDataByIdentifier (0x2E), see Iso14229ServerConfig.didTable.
+ * The server checks the session and security level and copies the data record itself. Entries
+ * with `read` or `write` set call that function instead of accessing `data`.
+ */
+typedef struct Iso14229DataIdentifier {
+    uint16_t did;
+    uint16_t len; // size of the data record. With `read` set: the largest record it returns
+    // data record. NULL: only `read` and `write` are used. ReadDataByIdentifier sends multi-frame
+    // responses directly from `data`: use `read` for records that change while being sent
+    void *data;
+    uint8_t readSessions;  // sessions in which the DID may be read, a mask of
+                           // ISO14229_SESSION_BIT(). 0: not readable
+    uint8_t writeSessions; // sessions in which the DID may be written. 0: not writable
+    uint8_t readSecurityLevel;  // required Iso14229ServerStatus.securityLevel. 0: always allowed
+    uint8_t writeSecurityLevel; // required Iso14229ServerStatus.securityLevel. 0: always allowed
+
+    /**
+     * @brief optional: produce the data record into `buf` (`len` bytes available) and set `*len`
+     * to its size
+     */
+    enum Iso14229ResponseCode (*read)(const struct Iso14229ServerStatus *status,
+                                      const struct Iso14229DataIdentifier *entry, uint8_t *buf,
+                                      uint16_t *len);
+    /**
+     * @brief optional: store a data record. Without it, records of exactly `len` bytes are copied
+     * to `data`
+     */
+    enum Iso14229ResponseCode (*write)(const struct Iso14229ServerStatus *status,
+                                       const struct Iso14229DataIdentifier *entry,
+                                       const uint8_t *data, uint16_t len);
+} Iso14229DataIdentifier;
+
+/**
+ * @brief \~chinese 存储区表项 \~english memory region table entry for ReadMemoryByAddress (0x23),
+ * WriteMemoryByAddress (0x3D) and DynamicallyDefineDataIdentifier (0x2C) defineByMemoryAddress,
+ * see Iso14229ServerConfig.memoryRegions. Requests must lie within one region. Regions with
+ * `read` or `write` set call that function instead of accessing `data`.
+ */
+typedef struct Iso14229MemoryRegion {
+    size_t base; // memoryAddress of the first byte, as addressed by the client
+    size_t size;
+    // the memory. NULL: only `read` and `write` are used. ReadMemoryByAddress sends multi-frame
+    // responses directly from `data`
+    void *data;
+    uint8_t readSessions;       // a mask of ISO14229_SESSION_BIT(). 0: not readable
+    uint8_t writeSessions;      // 0: not writable
+    uint8_t readSecurityLevel;  // required Iso14229ServerStatus.securityLevel. 0: always allowed
+    uint8_t writeSecurityLevel; // required Iso14229ServerStatus.securityLevel. 0: always allowed
+
+    /**
+     * @brief optional: read `len` bytes starting `offset` bytes into the region
+     */
+    enum Iso14229ResponseCode (*read)(const struct Iso14229ServerStatus *status,
+                                      const struct Iso14229MemoryRegion *region, size_t offset,
+                                      uint8_t *buf, uint16_t len);
+    /**
+     * @brief optional: write `len` bytes starting `offset` bytes into the region
+     */
+    enum Iso14229ResponseCode (*write)(const struct Iso14229ServerStatus *status,
+                                       const struct Iso14229MemoryRegion *region, size_t offset,
+                                       const uint8_t *data, uint16_t len);
+} Iso14229MemoryRegion;
+
+/**
+ * @brief \~chinese 动态数据标识符复制步骤 \~english one step of the copy plan of a dynamically
+ * defined DataIdentifier (0x2C)
+ */
+struct Iso14229DDDICopyStep {
+    const uint8_t *src;                   // first byte to copy
+    const Iso14229DataIdentifier *source; // the source DID, whose access is checked on every read
+    const Iso14229MemoryRegion *region;   // or the source memory region
+    uint16_t len;
+};
+
+/**
+ * @brief \~chinese 动态定义的数据标识符 \~english DataIdentifier defined by a client with 0x2C.
+ * `entry` serves it to 0x22 and 0x2A like a didTable entry; its `read` runs the copy plan.
+ */
+struct Iso14229DynamicDID {
+    Iso14229DataIdentifier entry; // entry.did 0: unused slot
+    struct Iso14229DDDICopyStep *steps;
+    uint8_t numSteps;
+};
+
+/**
+ * @brief public subset of server state for user handlers. Each logical node has its own.
+ */
+struct Iso14229ServerStatus {
+    enum Iso14229DiagnosticSessionType sessionType;
+    uint8_t securityLevel; // Current SecurityAccess (0x27) level
+    // this variable set to true when a user handler returns 0x78
+    // requestCorrectlyReceivedResponsePending. After a response has been sent on the transport
+    // layer, this variable is set to false and the user handler will be called again. It is the
+    // responsibility of the user handler to track the call count.
+    bool RCRRP;
+    uint8_t nodeIdx; // the logical node receiving the request. 0: the addresses in the server config
+};
+
+/**
+ * @brief \~chinese 逻辑节点配置 \~english Addresses and links of an additional logical node
+ * (ECU address) hosted by the server, see Iso14229ServerConfig.nodes
+ */
+typedef struct {
+    uint16_t phys_recv_id;
+    uint16_t func_recv_id; // may be shared with other nodes
+    uint16_t send_id;
+
+    IsoTpLink *phys_link;
+    IsoTpLink *func_link;
+
+    uint8_t *phys_link_receive_buffer;
+    uint16_t phys_link_recv_buf_size;
+    uint8_t *phys_link_send_buffer;
+    uint16_t phys_link_send_buf_size;
+
+    // functional requests are single frames: a receive buffer of 8 bytes (64 with CAN FD) is enough
+    uint8_t *func_link_receive_buffer;
+    uint16_t func_link_recv_buf_size;
+    uint8_t *func_link_send_buffer; // optional: NULL responds from phys_link_send_buffer
+    uint16_t func_link_send_buf_size;
+    // optional: arbitration ID of 0x2A periodic messages, other than send_id. 0: 0x2A cannot
+    // schedule any periodicDataIdentifier
+    uint16_t periodic_send_id;
+} Iso14229ServerNodeConfig;
+
+/**
+ * @brief \~chinese 周期数据标识符调度表项 \~english scheduled periodicDataIdentifier (0x2A)
+ */
+struct Iso14229PeriodicEntry {
+    uint8_t pdid;
+    uint16_t period_ms;
+    uint32_t due; // time the next periodic message is sent
+};
+
+/**
+ * @brief \~chinese 链路排队统计 \~english Queueing statistics of one receive link. A request
+ * waits when the link is still sending its previous response or while a service of the node
+ * responds RCRRP. Indexed by enum Iso14229AddressingScheme in Iso14229ServerNode.linkStats
+ */
+struct Iso14229ServerLinkStats {
+    uint32_t requests;     // requests processed
+    uint32_t deferred;     // requests which could not be processed in the poll that found them
+    uint32_t totalWaitMs;  // sum of the waits of the deferred requests
+    uint32_t maxWaitMs;    // longest wait
+    uint32_t p2Missed;     // requests which waited p2_ms or longer before they were processed
+    uint32_t waitingSince; // time the waiting request was found
+    bool waiting;
+};
+
+#if ISO14229_SERVER_METRICS
+/**
+ * @brief slots of the per-service counters in Iso14229ServerMetrics: one per service in
+ * ISO14229_SID_LIST and ISO14229_SERVER_USER_SID_LIST, and one for all other SIDs
+ */
+#define X(str_ident, sid, func, hasSubFunction, minLen, sessions) kIso14229MetricsSID_##str_ident,
+enum Iso14229ServerMetricsSlot {
+    ISO14229_SID_LIST ISO14229_SERVER_USER_SID_LIST kIso14229MetricsOtherSID,
+    ISO14229_SERVER_METRICS_NUM_SIDS,
+};
+#undef X
+
+// NRCs 0x10..0x93 have a counter each, the last slot counts all other codes
+#define ISO14229_SERVER_METRICS_NUM_NRCS (0x93 - 0x10 + 2)
+#define ISO14229_SERVER_METRICS_NRC_SLOT(nrc)                                                     \
+    ((nrc) >= 0x10 && (nrc) <= 0x93 ? (nrc)-0x10 : ISO14229_SERVER_METRICS_NUM_NRCS - 1)
+
+/**
+ * @brief \~chinese 性能统计 \~english Counters and latency of the requests a server processed,
+ * see ISO14229_SERVER_METRICS. The frame timings of each link are in IsoTpLink.metrics
+ */
+typedef struct {
+    // indexed by enum Iso14229ServerMetricsSlot. Negative responses include suppressed ones
+    uint32_t requests[ISO14229_SERVER_METRICS_NUM_SIDS];
+    uint32_t negativeResponses[ISO14229_SERVER_METRICS_NUM_SIDS];
+    uint32_t nrcs[ISO14229_SERVER_METRICS_NUM_NRCS]; // see ISO14229_SERVER_METRICS_NRC_SLOT()
+    uint32_t responsePending;                        // requests answered with 0x78 at least once
+    IsoTpHistogram latency; // ms from finding a complete request to sending its final response
+} Iso14229ServerMetrics;
+#endif
+
+/**
+ * @brief \~chinese 逻辑节点 \~english State of one logical node: its links and its diagnostic
+ * session. The services and user handlers are shared by all nodes.
+ */
+typedef struct {
+    uint16_t phys_recv_id;
+    uint16_t func_recv_id;
+    IsoTpLink *phys_link;
+    IsoTpLink *func_link;
+    bool sharedSendBuffer; // func_link responds from phys_link's send buffer
+
+    struct Iso14229ServerStatus status;
+
+    // The active download handler. NULL indicates that there is not currently a download in
+    // progress.
+    Iso14229DownloadHandler *downloadHandler;
+    // The active upload handler. NULL indicates that there is not currently an upload in progress.
+    Iso14229UploadHandler *uploadHandler;
+
+    uint32_t s3_session_timeout_timer; // for knowing when the diagnostic
+                                       // session has timed out
+
+    // set while a service responds RCRRP. Further requests to this node are not processed.
+    bool notReadyToReceive;
+
+    // the link holding the request of a service which responded RCRRP
+    IsoTpLink *rcrrpLink;
+    enum Iso14229AddressingScheme rcrrpAddressingScheme;
+    bool rcrrpSent;              // a 0x78 has been sent for the request: its final response is
+                                 // sent even if it would otherwise be suppressed
+    uint32_t rcrrpKeepaliveTime; // the next 0x78 is due at this time
+    uint32_t rcrrpRecallTime;    // the service is called again at this time
+
+    // requests are taken as soon as they are complete. The links take turns to go first
+    struct Iso14229ServerLinkStats linkStats[2];
+    uint8_t nextLink;
+#if ISO14229_SERVER_METRICS
+    uint32_t requestTime; // when the request being served was found complete
+#endif
+
+    // 0x2A schedule, sorted by ascending period: faster rates are served first
+    struct Iso14229PeriodicEntry periodic[ISO14229_SERVER_MAX_PERIODIC_DIDS];
+    uint8_t numPeriodic;
+    uint16_t periodicSendId; // 0: none
+
+    // 0x2C definitions. The steps of all dynamic DIDs are kept contiguous in dddiSteps
+    struct Iso14229DynamicDID dynamicDIDs[ISO14229_SERVER_MAX_DYNAMIC_DIDS];
+    struct Iso14229DDDICopyStep dddiSteps[ISO14229_SERVER_DDDI_STEPS];
+    uint8_t numDDDISteps;
+} Iso14229ServerNode;
+
+/**
+ * @brief maps a receive arbitration ID to a node's link
+ */
+struct Iso14229ServerAddress {
+    IsoTpLink *link; // NULL: empty slot
+    uint16_t arb_id;
+};
+
 typedef struct {
     uint16_t phys_recv_id;
     uint16_t func_recv_id;
@@ -113,15 +449,42 @@ typedef struct {
     IsoTpLink *func_link;
 
     uint8_t *phys_link_receive_buffer;
+    uint8_t *phys_link_receive_buffer2; // optional: second buffer of phys_link_recv_buf_size bytes.
+                                        // The next request is received while one is processed
     uint16_t phys_link_recv_buf_size;
     uint8_t *phys_link_send_buffer;
     uint16_t phys_link_send_buf_size;
 
+    /**
+     * @brief functional requests are single frames: a receive buffer of 8 bytes (64 with CAN FD)
+     * is enough. func_link_send_buffer is optional: NULL makes the functional link respond from
+     * phys_link_send_buffer. A response is then deferred while the other link is sending
+     */
     uint8_t *func_link_receive_buffer;
     uint16_t func_link_recv_buf_size;
     uint8_t *func_link_send_buffer;
     uint16_t func_link_send_buf_size;
 
+    uint8_t link_tx_dl; // optional: CAN FD frame data length (12..64) used for responses. 0: 8
+    // optional: arbitration ID of 0x2A periodic messages, other than send_id. 0: 0x2A cannot
+    // schedule any periodicDataIdentifier
+    uint16_t periodic_send_id;
+
+    /**
+     * @brief \~chinese 可选的接收环形缓冲器 \~english optional RX ring. When set, the server reads
+     * received frames from this ring instead of calling userCANRxPoll. The ring must be filled by
+     * exactly one producer, e.g. the CAN RX interrupt, with Iso14229CANRxRingPush().
+     */
+    Iso14229CANRxRing *rxRing;
+
+    /**
+     * @brief \~chinese 可选的额外逻辑节点 \~english optional: additional logical nodes, e.g. the
+     * sub-nodes of a gateway. The addresses and links above are node 0. Up to
+     * ISO14229_SERVER_MAX_NODES - 1 entries.
+     */
+    const Iso14229ServerNodeConfig *nodes;
+    uint8_t numNodes;
+
     /**
      * @brief \~chinese 服务器时间参数（毫秒） \~ Server time constants (milliseconds) \~
      */
@@ -131,6 +494,15 @@ typedef struct {
                          // server for the activated diagnostic session.
     uint16_t s3_ms;      // Session timeout
 
+    // optional: time between calls of a service that responded RCRRP. 0: every poll. The 0x78
+    // keepalives are sent by the server in between
+    uint16_t rcrrp_recall_ms;
+
+    // optional: periods of the 0x2A transmission modes. 0: ISO14229_SERVER_PERIODIC_*_MS
+    uint16_t periodic_slow_ms;
+    uint16_t periodic_medium_ms;
+    uint16_t periodic_fast_ms;
+
     /**
     * @brief \~chinese 会话超时处理函数。这个函数应该立刻进行ECU复位。
     \~english user-provided session timeout callback. This function should reset the ECU
@@ -156,6 +528,10 @@ typedef struct {
      */
     int (*userCANTransmit)(uint32_t arb_id, const uint8_t *data, uint8_t len);
 
+    /**
+     * @brief optional: called by Iso14229ServerPoll() for received frames. NULL with no rxRing:
+     * frames are passed in with Iso14229ServerReceiveCANFrame()
+     */
     enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id, uint8_t *data, uint8_t *size);
 
     void (*userDebug)(const char *, ...);
@@ -205,6 +581,29 @@ typedef struct {
     enum Iso14229ResponseCode (*userRDBIHandler)(const struct Iso14229ServerStatus *status,
                                                  uint16_t dataId, const uint8_t **data_location,
                                                  uint16_t *len);
+
+    /**
+     * @brief \~chinese 可选的数据标识符表 \~english optional: DataIdentifier table, sorted by
+     * ascending `did`. DIDs found in the table are served without calling userRDBIHandler or
+     * userWDBIHandler. Those handlers are still called for DIDs that are not in the table.
+     */
+    const Iso14229DataIdentifier *didTable;
+    uint16_t didTableSize;
+
+    /**
+     * @brief \~chinese 可选的存储区表 \~english optional: memory region table, sorted by
+     * ascending `base`, regions must not overlap. Enables 0x23 and 0x3D.
+     */
+    const Iso14229MemoryRegion *memoryRegions;
+    uint16_t numMemoryRegions;
+
+    /**
+     * @brief \~chinese 可选的故障码存储 \~english optional: fault memory. Enables 0x14 and 0x19,
+     * and 0x85 stops and resumes its status updates. Shared by all nodes. The server polls it, which
+     * writes changed records back to NVM
+     */
+    Iso14229DTCStore *dtcStore;
+
     /**
      * @brief ~\chinese 用户定义写入标识符指定数据回调函数 ~\english user-provided WDBI handler. ~\
      * @addtogroup writeDataByIdentifier_0x2E
@@ -290,6 +689,21 @@ typedef struct {
         uint8_t dataFormatIdentifier, Iso14229DownloadHandler **handler,
         uint16_t *maxNumberOfBlockLength);
 
+    /**
+     * @brief optional: 0x35 RequestUpload
+     * @param memoryAddress
+     * @param memorySize
+     * @param dataFormatIdentifier
+     * @param handler set this pointer to the address of an Iso14229UploadHandler instance
+     * @param maxNumberOfBlockLength the largest TransferData response, including SID and
+     * blockSequenceCounter. Must be at least 3
+     * @return one of [kPositiveResponse, kRequestOutOfRange, kSecurityAccessDenied]
+     */
+    enum Iso14229ResponseCode (*userRequestUploadHandler)(
+        const struct Iso14229ServerStatus *status, void *memoryAddress, size_t memorySize,
+        uint8_t dataFormatIdentifier, Iso14229UploadHandler **handler,
+        uint16_t *maxNumberOfBlockLength);
+
 } Iso14229ServerConfig;
 
 /**
@@ -297,79 +711,41 @@ typedef struct {
  *
  */
 typedef struct Iso14229Server {
-    uint16_t phys_recv_id;
-    uint16_t func_recv_id;
-    IsoTpLink *phys_link;
-    IsoTpLink *func_link;
+    /**
+     * @brief \~chinese 服务器配置 \~english the configuration passed to Iso14229ServerInit(). The
+     * timings, handlers and tables are read from it and not copied: it must stay valid and
+     * unchanged for the lifetime of the server, e.g. a `static const` placed in flash
+     */
+    const Iso14229ServerConfig *cfg;
 
-    uint16_t p2_ms;
-    uint16_t p2_star_ms;
-    uint16_t s3_ms;
+    Iso14229ServerNode nodes[ISO14229_SERVER_MAX_NODES];
+    uint8_t numNodes;
+    Iso14229ServerNode *node; // the node whose request is being processed
 
-    Iso14229Service services[ISO14229_NUM_SERVICES];
+    // receive arbitration ID -> link, open addressing
+    struct Iso14229ServerAddress addressTable[ISO14229_SERVER_ADDRESS_TABLE_SIZE];
 
-    // The active download handler. NULL indicates that there is not currently a download in
-    // progress.
-    Iso14229DownloadHandler *downloadHandler;
+    bool rxBacklog; // the last poll stopped receiving at ISO14229_SERVER_MAX_RX_FRAMES_PER_POLL
 
-    bool ecuResetScheduled;            // indicates that an ECUReset has been scheduled
-    uint32_t ecuResetTimer;            // for delaying resetting until a response
-                                       // has been sent to the client
-    uint32_t p2_timer;                 // for rate limiting server responses
-    uint32_t s3_session_timeout_timer; // for knowing when the diagnostic
-                                       // session has timed out
+    uint32_t now; // time of the current poll: userGetms() is read once per Iso14229ServerPoll()
 
-    /**
-     * @brief public subset of server state for user handlers
-     */
-    struct Iso14229ServerStatus {
-        enum Iso14229DiagnosticSessionType sessionType;
-        uint8_t securityLevel; // Current SecurityAccess (0x27) level
-        // this variable set to true when a user handler returns 0x78
-        // requestCorrectlyReceivedResponsePending. After a response has been sent on the transport
-        // layer, this variable is set to false and the user handler will be called again. It is the
-        // responsibility of the user handler to track the call count.
-        bool RCRRP;
-    } status;
+    uint16_t periodic_ms[3]; // 0x2A periods, indexed by transmissionMode - 1
+
+    bool ecuResetScheduled; // indicates that an ECUReset has been scheduled
+    uint32_t ecuResetTimer; // for delaying resetting until a response
+                            // has been sent to the client
 
     // ISO14229-1 2013 defines the following conditions under which the server does not
     // process incoming requests:
     // - not ready to receive (Table A.1 0x78)
     // - not accepting request messages and not sending responses (9.3.1)
     //
-    // when this variable is set to true, incoming ISO-TP data will not be processed.
+    // when this variable is set to true, incoming ISO-TP data will not be processed on any node.
     bool notReadyToReceive;
 
-    void (*userSessionTimeoutCallback)();
-    uint32_t (*userGetms)();
-    int (*userCANTransmit)(uint32_t arb_id, const uint8_t *data, uint8_t len);
-    enum Iso14229CANRxStatus (*userCANRxPoll)(uint32_t *arb_id, uint8_t *data, uint8_t *size);
-    void (*userDebug)(const char *, ...);
-    enum Iso14229ResponseCode (*userDiagnosticSessionControlHandler)(
-        const struct Iso14229ServerStatus *status, enum Iso14229DiagnosticSessionType type);
-    enum Iso14229ResponseCode (*userECUResetHandler)(const struct Iso14229ServerStatus *status,
-                                                     uint8_t resetType, uint8_t *powerDownTime);
-    enum Iso14229ResponseCode (*userRDBIHandler)(const struct Iso14229ServerStatus *status,
-                                                 uint16_t dataId, const uint8_t **data_location,
-                                                 uint16_t *len);
-    enum Iso14229ResponseCode (*userWDBIHandler)(const struct Iso14229ServerStatus *status,
-                                                 uint16_t dataId, const uint8_t *data,
-                                                 uint16_t len);
-    enum Iso14229ResponseCode (*userCommunicationControlHandler)(
-        const struct Iso14229ServerStatus *status, uint8_t controlType, uint8_t communicationType);
-    enum Iso14229ResponseCode (*userSecurityAccessGenerateSeed)(
-        const struct Iso14229ServerStatus *status, uint8_t level, const uint8_t *in_data,
-        uint16_t in_size, uint8_t *out_data, uint16_t out_bufsize, uint16_t *out_size);
-    enum Iso14229ResponseCode (*userSecurityAccessValidateKey)(
-        const struct Iso14229ServerStatus *status, uint8_t level, const uint8_t *key,
-        uint16_t size);
-    enum Iso14229ResponseCode (*userRoutineControlHandler)(
-        const struct Iso14229ServerStatus *status, enum RoutineControlType routineControlType,
-        uint16_t routineIdentifier, Iso14229RoutineControlArgs *args);
-    enum Iso14229ResponseCode (*userRequestDownloadHandler)(
-        const struct Iso14229ServerStatus *status, void *memoryAddress, size_t memorySize,
-        uint8_t dataFormatIdentifier, Iso14229DownloadHandler **handler,
-        uint16_t *maxNumberOfBlockLength);
+#if ISO14229_SERVER_METRICS
+    Iso14229ServerMetrics metrics;
+#endif
 } Iso14229Server;
 
 // ========================================================================
@@ -380,12 +756,55 @@ void Iso14229ServerInit(Iso14229Server *self, const Iso14229ServerConfig *cfg);
 
 /**
  * @brief Poll the iso14229 object and its children. Call this function
- * periodically.
+ * periodically, or when a CAN frame has been received and when Iso14229ServerGetTimeoutms() has
+ * passed.
  *
  * @param self: pointer to initialized Iso14229Server
  */
 void Iso14229ServerPoll(Iso14229Server *self);
 
+/**
+ * @brief Gets the time until Iso14229ServerPoll() has work to do next without a CAN frame being
+ * received: the S3 session timeout, the next 0x78 keepalive or RCRRP service call, the next 0x2A
+ * periodic message, the DTC store's NVM write back, the next ISO-TP consecutive frame (STmin) or
+ * timeout (N_Bs, N_Cr), or a request that can be processed right away. Lets the caller sleep, or
+ * block an RTOS task, until a CAN frame arrives or the timeout passes instead of polling
+ * continuously.
+ * @param self
+ * @return uint32_t milliseconds. 0: poll again now. UINT32_MAX: nothing is scheduled
+ */
+uint32_t Iso14229ServerGetTimeoutms(Iso14229Server *self);
+
+/**
+ * @brief \~chinese 接收事件 \~english Passes a received CAN frame to the server, e.g. from the
+ * RX event of a driver, instead of returning it from userCANRxPoll. Call it from the context that
+ * calls Iso14229ServerPoll(), and poll once the frames at hand have been passed in. Use the RX ring
+ * (Iso14229ServerConfig.rxRing) to receive frames in an interrupt.
+ */
+void Iso14229ServerReceiveCANFrame(Iso14229Server *self, uint32_t arb_id, const uint8_t *data,
+                                   uint8_t size);
+
+#if ISO14229_SERVER_METRICS
+/**
+ * @brief \~chinese 读性能统计 \~english `read` accessor exposing the metrics as a
+ * ReadDataByIdentifier record. Add an entry to the didTable with `data` pointing to the
+ * Iso14229Server and `len` set to the largest record the response buffer allows.
+ *
+ * The record, all counters 4 byte big-endian:
+ * - requests, negative responses, requests answered with 0x78
+ * - latency histogram: ISOTP_HISTOGRAM_BUCKETS counters and the maximum
+ * - 1 byte count n, then n times SID (0x00: other SIDs), requests, negative responses for every
+ *   service that received requests
+ * - 1 byte count m, then m times NRC (0x00: other codes), count for every NRC that was sent
+ * - with ISO_TP_METRICS, for the physical link of the requesting node: cf_sent, cf_received,
+ *   n_bs_timeouts, n_cr_timeouts and the cf_tx_gap, cf_rx_gap and fc_wait histograms
+ * @return kResponseTooLong if the record is longer than `*len`
+ */
+enum Iso14229ResponseCode Iso14229ServerMetricsRead(const struct Iso14229ServerStatus *status,
+                                                    const Iso14229DataIdentifier *entry,
+                                                    uint8_t *buf, uint16_t *len);
+#endif
+
 enum Iso14229BootManagerSMState {
     kBootManagerSMStateWaitForProgrammingRequest = 0, // 等待外部下载请求
     kBootManagerSMStateReprogramming,                 // 收到了下载请求或者应用不得行
@@ -431,7 +850,7 @@ static inline void Iso14229BootManagerInit(struct Iso14229BootManager *mgr,
     assert(enterApplication);
     mgr->applicationIsValid = applicationIsValid;
     mgr->enterApplication = enterApplication;
-    mgr->extRequestWindowTimer = srv->userGetms() + extRequestWindowTimems;
+    mgr->extRequestWindowTimer = srv->cfg->userGetms() + extRequestWindowTimems;
     mgr->srv = srv;
 }
 
@@ -443,13 +862,13 @@ static inline void Iso14229BootManagerInit(struct Iso14229BootManager *mgr,
 static inline void Iso14229BootManagerPoll(struct Iso14229BootManager *mgr) {
     switch (mgr->sm_state) {
     case kBootManagerSMStateWaitForProgrammingRequest:
-        if (Iso14229TimeAfter(mgr->srv->userGetms(), mgr->extRequestWindowTimer)) {
+        if (Iso14229TimeAfter(mgr->srv->cfg->userGetms(), mgr->extRequestWindowTimer)) {
             if (mgr->applicationIsValid()) {
                 mgr->enterApplication();
             } else {
                 mgr->sm_state = kBootManagerSMStateReprogramming;
             }
-        } else if (kDefaultSession != mgr->srv->status.sessionType) {
+        } else if (kDefaultSession != mgr->srv->nodes[0].status.sessionType) {
             mgr->sm_state = kBootManagerSMStateReprogramming;
         }
         break;
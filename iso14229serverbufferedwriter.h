@@ -2,8 +2,10 @@
  * @file iso14229serverbufferedwriter.h
  *
  * [ UDS接收缓冲器 ] -BufferedWriterWrite()-> [FLASH扇区缓冲器] -writeFunc()-> [FLASH]
+ * - 页对齐的输入直接传给writeFunc()、不经过扇区缓冲器
  *
  * - 写到FLASH时、要先发一个0x78响应然后去写
+ * - 异步驱动 (eraseStart/programStart/flashPoll)：写入在后台进行、每次调用只查询完成状态
  */
 
 #ifndef BUFFEREDWRITER_H
@@ -16,6 +18,16 @@
 #include <assert.h>
 #include "iso14229.h"
 
+/**
+ * @brief number of erase and program operations the asynchronous backend can queue
+ */
+#ifndef BUFFERED_WRITER_QUEUE_SIZE
+#define BUFFERED_WRITER_QUEUE_SIZE 4
+#endif
+
+// returned by flashPoll() while the last started operation is still running
+#define BUFFERED_WRITER_BUSY 1
+
 typedef struct {
     /**
      * @brief writes to the program flash logical partition
@@ -29,68 +41,178 @@ typedef struct {
     const uint32_t logicalPartitionSize;
     const uint8_t *pageBuffer;     // pointer to a buffer that is the size of a flash page
     const uint32_t pageBufferSize; // size of a flash page in bytes
+
+    /**
+     * @brief \~chinese 可选的异步FLASH驱动 \~english optional: asynchronous flash backend, used
+     * instead of writeFunc when programStart is set. The start functions return at once, 0 on
+     * success; flashPoll() reports the completion of the last started operation.
+     */
+    int (*eraseStart)(void *address, const uint32_t length); // optional: erase a page first
+    int (*programStart)(void *address, const uint8_t *data, const uint32_t length);
+    int (*flashPoll)(void); // BUFFERED_WRITER_BUSY while running, 0 when done, negative on failure
 } BufferedWriterConfig;
 
+enum BufferedWriterOpType {
+    kBufferedWriterErase,
+    kBufferedWriterProgram,
+};
+
+struct BufferedWriterOp {
+    enum BufferedWriterOpType type;
+    void *address;
+    const uint8_t *data;
+    uint32_t length;
+};
+
 typedef struct {
     const BufferedWriterConfig *cfg;
     uint32_t pageBufIdx;
     uint32_t flashOffset;
     uint32_t iBufIdx;
     bool writePending;
+    // the page to write: pageBuffer, or a page-aligned span of the input written without copying
+    const uint8_t *pageData;
+    int err; // first error returned by the flash functions. 0: none
+
+    struct BufferedWriterOp queue[BUFFERED_WRITER_QUEUE_SIZE];
+    uint8_t queueHead;
+    uint8_t queueLen;
+    bool opStarted; // the operation at queueHead has been started
 } BufferedWriter;
 
 static inline void bufferedWriterInit(BufferedWriter *self, const BufferedWriterConfig *cfg) {
-    assert(cfg->writeFunc);
+    assert(cfg->writeFunc || (cfg->programStart && cfg->flashPoll));
     assert(cfg->logicalPartitionStartAddr);
     assert(cfg->pageBuffer);
     assert(cfg->pageBufferSize > 0);
     assert(cfg->logicalPartitionSize >= cfg->pageBufferSize);
     assert(cfg->logicalPartitionSize % cfg->pageBufferSize == 0);
 
-    self->writePending = false;
+    memset(self, 0, sizeof(*self));
     self->cfg = cfg;
-    self->iBufIdx = 0;
-    self->pageBufIdx = 0;
-    self->flashOffset = 0;
-    memset((void *)cfg->pageBuffer, 0, cfg->pageBufferSize);
 }
 
-static inline void _BufferedWriterCopy(BufferedWriter *self, const uint8_t *ibuf, uint32_t size) {
-    if (0 == size) {
-        return;
-    }
+static inline void _BufferedWriterEnqueue(BufferedWriter *self, enum BufferedWriterOpType type,
+                                          void *address, const uint8_t *data, uint32_t length) {
+    assert(self->queueLen < BUFFERED_WRITER_QUEUE_SIZE);
+    struct BufferedWriterOp *op =
+        &self->queue[(self->queueHead + self->queueLen) % BUFFERED_WRITER_QUEUE_SIZE];
+    op->type = type;
+    op->address = address;
+    op->data = data;
+    op->length = length;
+    self->queueLen++;
+}
+
+/**
+ * @brief 启动和查询排队的FLASH操作
+ * @return true 还在忙
+ */
+static inline bool _BufferedWriterRunQueue(BufferedWriter *self) {
     const BufferedWriterConfig *cfg = self->cfg;
-    uint32_t bufferUnusedBytes = cfg->pageBufferSize - self->pageBufIdx;
-    uint32_t copyLen =
-        size - self->iBufIdx < bufferUnusedBytes ? size - self->iBufIdx : bufferUnusedBytes;
-    memmove((void *)(cfg->pageBuffer + self->pageBufIdx), ibuf + self->iBufIdx, copyLen);
-    self->pageBufIdx += copyLen;
-    self->iBufIdx += copyLen;
+
+    while (self->queueLen) {
+        struct BufferedWriterOp *op = &self->queue[self->queueHead];
+        int ret = 0;
+
+        if (!self->opStarted) {
+            ret = kBufferedWriterErase == op->type
+                      ? cfg->eraseStart(op->address, op->length)
+                      : cfg->programStart(op->address, op->data, op->length);
+            self->opStarted = true;
+        }
+        if (0 == ret) {
+            ret = cfg->flashPoll();
+            if (BUFFERED_WRITER_BUSY == ret) {
+                return true;
+            }
+        }
+        if (0 != ret && 0 == self->err) {
+            self->err = ret;
+        }
+        self->queueHead = (self->queueHead + 1) % BUFFERED_WRITER_QUEUE_SIZE;
+        self->queueLen--;
+        self->opStarted = false;
+    }
+    return false;
 }
 
-static inline void _BufferedWriterWrite(BufferedWriter *self) {
+/**
+ * @brief 写入准备好的扇区。异步驱动：返回false如果FLASH还在忙
+ */
+static inline bool _BufferedWriterWrite(BufferedWriter *self) {
     const BufferedWriterConfig *cfg = self->cfg;
-    cfg->writeFunc((void *)((uint8_t *)cfg->logicalPartitionStartAddr + self->flashOffset),
-                   cfg->pageBuffer, cfg->pageBufferSize);
+    void *address = (uint8_t *)cfg->logicalPartitionStartAddr + self->flashOffset;
+
+    if (cfg->programStart) {
+        if (_BufferedWriterRunQueue(self)) {
+            return false;
+        }
+    } else {
+        int ret = cfg->writeFunc(address, self->pageData, cfg->pageBufferSize);
+        if (ret && 0 == self->err) {
+            self->err = ret;
+        }
+    }
     self->flashOffset += cfg->pageBufferSize;
-    self->pageBufIdx = 0;
-    memset((void *)cfg->pageBuffer, 0, cfg->pageBufferSize);
+    if (self->pageData == cfg->pageBuffer) {
+        self->pageBufIdx = 0;
+    }
+    self->pageData = NULL;
+    return true;
+}
+
+/**
+ * @brief 准备下一个扇区。对齐的输入直接写入、不复制到扇区缓冲器
+ */
+static inline void _BufferedWriterFill(BufferedWriter *self, const uint8_t *ibuf, uint32_t size) {
+    const BufferedWriterConfig *cfg = self->cfg;
+    uint32_t remaining = size - self->iBufIdx;
+
+    if (0 == self->pageBufIdx && remaining >= cfg->pageBufferSize) {
+        // 页对齐：直接写入
+        self->pageData = ibuf + self->iBufIdx;
+        self->iBufIdx += cfg->pageBufferSize;
+        return;
+    }
+
+    uint32_t bufferUnusedBytes = cfg->pageBufferSize - self->pageBufIdx;
+    uint32_t copyLen = remaining < bufferUnusedBytes ? remaining : bufferUnusedBytes;
+    if (copyLen) {
+        memmove((void *)(cfg->pageBuffer + self->pageBufIdx), ibuf + self->iBufIdx, copyLen);
+        self->pageBufIdx += copyLen;
+        self->iBufIdx += copyLen;
+    }
+
+    if (self->pageBufIdx == cfg->pageBufferSize) {
+        // 扇区缓冲器充满了、要写入
+        self->pageData = cfg->pageBuffer;
+    } else if (0 != self->pageBufIdx && 0 == size) {
+        // 扇区缓冲器有数据、用户要完成写入：清除最后一个扇区的剩余部分
+        memset((void *)(cfg->pageBuffer + self->pageBufIdx), 0,
+               cfg->pageBufferSize - self->pageBufIdx);
+        self->pageData = cfg->pageBuffer;
+    }
 }
 
 /**
  * @brief 处理flash写入、包含0x78 RequestCorrectlyReceived_ResponsePending响应。
  * 为了了解更多关于0x78的作用、可以参考ISO-14229-1:2013。
+ * 页对齐的输入直接传给writeFunc、不复制。有异步驱动时、FLASH在忙的时候每次调用只查询完成状态。
  *
  * @param self 指针到驱动实例
  * @param ibuf 输入缓冲器 (UDS接收缓冲器)
  * @param size 输入缓冲器大小
  * @return true 等待写入。你应该返回0x78。不要换输入缓冲器。我还没读完。
- * @return false 不在等、可以返回0x01。
+ * @return false 不在等、可以返回0x01。检查self->err确认写入成功。
  */
 static inline bool BufferedWriterProcess(BufferedWriter *self, const uint8_t *ibuf, uint32_t size) {
+    const BufferedWriterConfig *cfg = self->cfg;
 
     if (self->writePending) { // 要写入
-        _BufferedWriterWrite(self);
+        if (!_BufferedWriterWrite(self)) {
+            return true; // FLASH在忙
+        }
         if (self->iBufIdx == size) {
             // 输入缓冲器用完了、我要新数据
             self->iBufIdx = 0;
@@ -98,13 +220,20 @@ static inline bool BufferedWriterProcess(BufferedWriter *self, const uint8_t *ib
         }
     }
 
-    _BufferedWriterCopy(self, ibuf, size);
+    _BufferedWriterFill(self, ibuf, size);
 
-    if (
-        // 扇区缓冲器充满了、要写入
-        (self->pageBufIdx == self->cfg->pageBufferSize) ||
-        // 扇区缓冲器有数据、用户要完成写入
-        (0 != self->pageBufIdx && 0 == size)) {
+    if (self->pageData) {
+        if (cfg->programStart) {
+            // 马上开始、0x78发送的时候FLASH已经在写
+            void *address = (uint8_t *)cfg->logicalPartitionStartAddr + self->flashOffset;
+            if (cfg->eraseStart) {
+                _BufferedWriterEnqueue(self, kBufferedWriterErase, address, NULL,
+                                       cfg->pageBufferSize);
+            }
+            _BufferedWriterEnqueue(self, kBufferedWriterProgram, address, self->pageData,
+                                   cfg->pageBufferSize);
+            _BufferedWriterRunQueue(self);
+        }
         return self->writePending = true;
     } else {
         self->iBufIdx = 0;
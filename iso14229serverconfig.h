@@ -4,3 +4,109 @@ provide a comma separated list of diagnostic mode enumeration specifiers
 #ifndef ISO14229_SERVER_USER_DIAGNOSTIC_MODES
 #define ISO14229_SERVER_USER_DIAGNOSTIC_MODES
 #endif
+
+/*
+user defined services, in the format of ISO14229_SID_LIST:
+X(SID_IDENTIFIER, SID, handlerFunction, hasSubFunction, minimumRequestLength, allowedSessions)
+The handler functions are Iso14229Service functions defined by the application (not static).
+e.g.
+#define ISO14229_SERVER_USER_SID_LIST X(MY_SERVICE, 0xBA, myService, 0, 1, ISO14229_ALL_SESSIONS)
+*/
+#ifndef ISO14229_SERVER_USER_SID_LIST
+#define ISO14229_SERVER_USER_SID_LIST
+#endif
+
+/*
+maximum number of CAN frames Iso14229ServerPoll() takes from userCANRxPoll() or from the RX ring
+in a single call
+*/
+#ifndef ISO14229_SERVER_MAX_RX_FRAMES_PER_POLL
+#define ISO14229_SERVER_MAX_RX_FRAMES_PER_POLL 16
+#endif
+
+/*
+maximum number of periodicDataIdentifiers (0x2A) each node schedules at the same time
+*/
+#ifndef ISO14229_SERVER_MAX_PERIODIC_DIDS
+#define ISO14229_SERVER_MAX_PERIODIC_DIDS 8
+#endif
+
+/*
+maximum number of periodic messages a node sends in one Iso14229ServerPoll() call. While a
+diagnostic response is being sent on the node's physical link, at most one periodic message is sent
+per call so that both share the bus
+*/
+#ifndef ISO14229_SERVER_PERIODIC_FRAMES_PER_POLL
+#define ISO14229_SERVER_PERIODIC_FRAMES_PER_POLL 4
+#endif
+
+/*
+default periods (milliseconds) of the 0x2A transmission modes, used when the server config leaves
+them 0
+*/
+#ifndef ISO14229_SERVER_PERIODIC_SLOW_MS
+#define ISO14229_SERVER_PERIODIC_SLOW_MS 1000
+#endif
+#ifndef ISO14229_SERVER_PERIODIC_MEDIUM_MS
+#define ISO14229_SERVER_PERIODIC_MEDIUM_MS 200
+#endif
+#ifndef ISO14229_SERVER_PERIODIC_FAST_MS
+#define ISO14229_SERVER_PERIODIC_FAST_MS 20
+#endif
+
+/*
+maximum number of DataIdentifiers each node lets a client define with 0x2C, and the number of copy
+steps they share. Adjacent source ranges are merged into one step
+*/
+#ifndef ISO14229_SERVER_MAX_DYNAMIC_DIDS
+#define ISO14229_SERVER_MAX_DYNAMIC_DIDS 4
+#endif
+#ifndef ISO14229_SERVER_DDDI_STEPS
+#define ISO14229_SERVER_DDDI_STEPS 16
+#endif
+
+// the step counts are uint8_t
+#if ISO14229_SERVER_DDDI_STEPS > 255
+#error "ISO14229_SERVER_DDDI_STEPS must be at most 255"
+#endif
+
+/*
+while a service responds RCRRP, the server repeats the 0x78 response every
+ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT percent of p2_star_ms, well before the client's P2* expires
+*/
+#ifndef ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT
+#define ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT 50
+#endif
+
+/*
+set to 1 to count requests per service and negative responses per NRC and to record a histogram
+of request processing latency in Iso14229Server.metrics, see Iso14229ServerMetricsRead(). Together
+with ISO_TP_METRICS the links' frame timings are recorded as well
+*/
+#ifndef ISO14229_SERVER_METRICS
+#define ISO14229_SERVER_METRICS 0
+#endif
+
+/*
+maximum number of logical nodes (ECU addresses) a server hosts, including the one in the server
+config
+*/
+#ifndef ISO14229_SERVER_MAX_NODES
+#define ISO14229_SERVER_MAX_NODES 4
+#endif
+
+/*
+number of slots in the server's arbitration ID lookup table. Must be a power of two and at least
+twice the number of receive IDs (2 per node)
+*/
+#ifndef ISO14229_SERVER_ADDRESS_TABLE_SIZE
+#define ISO14229_SERVER_ADDRESS_TABLE_SIZE 16
+#endif
+
+#if (ISO14229_SERVER_ADDRESS_TABLE_SIZE & (ISO14229_SERVER_ADDRESS_TABLE_SIZE - 1)) != 0
+#error "ISO14229_SERVER_ADDRESS_TABLE_SIZE must be a power of two"
+#endif
+
+#if ISO14229_SERVER_ADDRESS_TABLE_SIZE < 4 * ISO14229_SERVER_MAX_NODES
+#error "ISO14229_SERVER_ADDRESS_TABLE_SIZE must be at least 4 * ISO14229_SERVER_MAX_NODES"
+#endif
@@ -0,0 +1,88 @@
+#ifndef ISO14229SERVERJOB_H
+#define ISO14229SERVERJOB_H
+
+/**
+ * @brief \~chinese 长时间服务的工作线程交接 \~english Hands a long-running service off to a
+ * worker context.
+ *
+ * A service handler runs in the UDS context (the caller of Iso14229ServerPoll()) and must return
+ * quickly: frames are received and 0x78 keepalives are sent in the same context. Work that takes
+ * longer, e.g. erasing flash or running a routine, is moved to a lower-priority task with a job:
+ *
+ *  - the handler calls Iso14229ServerJobStep() and returns its result. The first call starts the
+ *    job and returns 0x78, which the server answers with a 0x78 and then calls the handler again
+ *    every rcrrp_recall_ms. Once the job is done, the call returns the job's result
+ *  - the worker calls Iso14229ServerJobRun(), e.g. after `notify` woke it up, which runs the job's
+ *    `run` function in the worker context
+ *
+ * The state is handed over without a lock: the UDS context only moves it from idle to queued and
+ * from done to idle, the worker only from queued to done. The worker stores `result` before it
+ * releases the state to done, see iso14229atomic.h for the requirements on compilers other than
+ * GCC and clang. One job serves one service at a time.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "iso14229.h"
+#include "iso14229atomic.h"
+
+enum Iso14229ServerJobState {
+    kIso14229JobIdle = 0, // owned by the UDS context
+    kIso14229JobQueued,   // owned by the worker
+    kIso14229JobDone,     // owned by the UDS context, `result` is valid
+};
+
+typedef struct Iso14229ServerJob {
+    /**
+     * @brief mandatory: the long-running work, called in the worker context
+     * @return the final response code of the service. Not 0x78
+     */
+    enum Iso14229ResponseCode (*run)(struct Iso14229ServerJob *job);
+    /**
+     * @brief optional: called in the UDS context when the job is queued, e.g. to give a semaphore
+     * the worker waits on
+     */
+    void (*notify)(struct Iso14229ServerJob *job);
+    void *ctx; // optional: passed to `run` through the job
+
+    uint8_t state; // enum Iso14229ServerJobState
+    enum Iso14229ResponseCode result;
+} Iso14229ServerJob;
+
+/**
+ * @brief \~chinese 服务处理函数：启动或检查 \~english UDS context, from a service handler:
+ * starts the job or checks on it
+ * @return kRequestCorrectlyReceived_ResponsePending while the job is queued or running, the
+ * job's result once it is done
+ */
+static inline enum Iso14229ResponseCode Iso14229ServerJobStep(Iso14229ServerJob *job) {
+    switch (Iso14229LoadAcquire8(&job->state)) {
+    case kIso14229JobIdle:
+        Iso14229StoreRelease8(&job->state, (uint8_t)kIso14229JobQueued);
+        if (job->notify) {
+            job->notify(job);
+        }
+        return kRequestCorrectlyReceived_ResponsePending;
+    case kIso14229JobDone:
+        Iso14229StoreRelease8(&job->state, (uint8_t)kIso14229JobIdle);
+        return job->result;
+    default:
+        return kRequestCorrectlyReceived_ResponsePending;
+    }
+}
+
+/**
+ * @brief \~chinese 工作线程：运行排队的作业 \~english Worker context: runs the job if it is
+ * queued
+ * @return true if the job was run
+ */
+static inline bool Iso14229ServerJobRun(Iso14229ServerJob *job) {
+    if (kIso14229JobQueued != Iso14229LoadAcquire8(&job->state)) {
+        return false;
+    }
+    job->result = job->run(job);
+    Iso14229StoreRelease8(&job->state, (uint8_t)kIso14229JobDone);
+    return true;
+}
+
+#endif
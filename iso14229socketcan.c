@@ -0,0 +1,356 @@
+#define _GNU_SOURCE
+#include "iso14229socketcan.h"
+#include <errno.h>
+#include <linux/can/isotp.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+static int _BindInterface(int fd, const char *ifname, struct sockaddr_can *addr) {
+    unsigned int ifindex = if_nametoindex(ifname);
+    if (0 == ifindex) {
+        return -errno;
+    }
+    addr->can_family = AF_CAN;
+    addr->can_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static inline canid_t _CANID(uint32_t arb_id) {
+    return arb_id > CAN_SFF_MASK ? (arb_id & CAN_EFF_MASK) | CAN_EFF_FLAG : arb_id;
+}
+
+// ================================================
+// CAN_RAW
+// ================================================
+
+int Iso14229SocketCANOpen(Iso14229SocketCAN *self, const char *ifname, const uint32_t *rxIds,
+                          uint8_t numRxIds, bool canfd) {
+    struct sockaddr_can addr = {0};
+    int one = 1;
+    int err;
+
+    memset(self, 0, sizeof(*self));
+    if (numRxIds > ISO14229_SOCKETCAN_MAX_FILTERS) {
+        return -EINVAL;
+    }
+
+    self->fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+    if (self->fd < 0) {
+        return -errno;
+    }
+
+    if (rxIds) {
+        struct can_filter filters[ISO14229_SOCKETCAN_MAX_FILTERS];
+        for (uint8_t i = 0; i < numRxIds; i++) {
+            filters[i].can_id = _CANID(rxIds[i]);
+            filters[i].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG |
+                                  (rxIds[i] > CAN_SFF_MASK ? CAN_EFF_MASK : CAN_SFF_MASK);
+        }
+        // no filters at all: receive nothing until a filter is set
+        if (setsockopt(self->fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+                       numRxIds * sizeof(filters[0])) < 0) {
+            goto fail;
+        }
+    }
+    if (canfd && setsockopt(self->fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &one, sizeof(one)) < 0) {
+        goto fail;
+    }
+    self->canfd = canfd;
+
+    // optional: kernel timestamps and the drop counter are only reported when supported
+    (void)setsockopt(self->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    (void)setsockopt(self->fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+
+    err = _BindInterface(self->fd, ifname, &addr);
+    if (err) {
+        close(self->fd);
+        self->fd = -1;
+        return err;
+    }
+
+    for (int i = 0; i < ISO14229_SOCKETCAN_BATCH; i++) {
+        self->rxIov[i] = (struct iovec){.iov_base = &self->rxFrames[i],
+                                        .iov_len = sizeof(self->rxFrames[i])};
+        self->txIov[i].iov_base = &self->txFrames[i];
+    }
+    return 0;
+
+fail:
+    err = -errno;
+    close(self->fd);
+    self->fd = -1;
+    return err;
+}
+
+void Iso14229SocketCANClose(Iso14229SocketCAN *self) {
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+}
+
+static void _ReadCmsg(Iso14229SocketCAN *self, struct msghdr *msg, struct timespec *stamp) {
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (SOL_SOCKET != c->cmsg_level) {
+            continue;
+        }
+        if (SCM_TIMESTAMPNS == c->cmsg_type) {
+            memcpy(stamp, CMSG_DATA(c), sizeof(*stamp));
+        } else if (SO_RXQ_OVFL == c->cmsg_type) {
+            memcpy(&self->rxOverflows, CMSG_DATA(c), sizeof(self->rxOverflows)); // cumulative
+        }
+    }
+}
+
+static int _ReceiveBatch(Iso14229SocketCAN *self) {
+    struct mmsghdr msgs[ISO14229_SOCKETCAN_BATCH];
+
+    for (int i = 0; i < ISO14229_SOCKETCAN_BATCH; i++) {
+        msgs[i] = (struct mmsghdr){0};
+        msgs[i].msg_hdr = (struct msghdr){
+            .msg_iov = &self->rxIov[i],
+            .msg_iovlen = 1,
+            .msg_control = self->rxCmsg[i],
+            .msg_controllen = sizeof(self->rxCmsg[i]),
+        };
+    }
+
+    int n = recvmmsg(self->fd, msgs, ISO14229_SOCKETCAN_BATCH, MSG_DONTWAIT, NULL);
+    if (n < 0) {
+        if (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno) {
+            self->rxErrors++;
+        }
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++) {
+        self->rxLens[i] = msgs[i].msg_len;
+        self->rxStamps[i] = (struct timespec){0};
+        _ReadCmsg(self, &msgs[i].msg_hdr, &self->rxStamps[i]);
+    }
+    self->rxIdx = 0;
+    self->rxCount = n;
+    return n;
+}
+
+enum Iso14229CANRxStatus Iso14229SocketCANRxPoll(Iso14229SocketCAN *self, uint32_t *arb_id,
+                                                 uint8_t *data, uint8_t *size) {
+    for (;;) {
+        if (self->rxIdx == self->rxCount && 0 == _ReceiveBatch(self)) {
+            return kCANRxNone;
+        }
+        const struct canfd_frame *frame = &self->rxFrames[self->rxIdx];
+        unsigned int len = self->rxLens[self->rxIdx];
+        self->rxTimestamp = self->rxStamps[self->rxIdx];
+        self->rxIdx++;
+
+        if ((CAN_MTU != len && CANFD_MTU != len) || frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG) ||
+            frame->len > ISO_TP_MAX_DL) {
+            continue; // not a data frame this build can handle
+        }
+        *arb_id = frame->can_id & (frame->can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK);
+        *size = frame->len;
+        memcpy(data, frame->data, frame->len);
+        return kCANRxSome;
+    }
+}
+
+int Iso14229SocketCANFlush(Iso14229SocketCAN *self) {
+    struct mmsghdr msgs[ISO14229_SOCKETCAN_BATCH];
+
+    if (0 == self->txCount) {
+        return 0;
+    }
+
+    for (uint16_t i = 0; i < self->txCount; i++) {
+        msgs[i] = (struct mmsghdr){0};
+        msgs[i].msg_hdr = (struct msghdr){.msg_iov = &self->txIov[i], .msg_iovlen = 1};
+    }
+
+    int n = sendmmsg(self->fd, msgs, self->txCount, MSG_DONTWAIT);
+    if (n < 0) {
+        int err = errno;
+        if (EAGAIN == err || EWOULDBLOCK == err || ENOBUFS == err || EINTR == err) {
+            return 0; // the kernel TX queue is full: try again later
+        }
+        self->txErrors += self->txCount;
+        self->txCount = 0;
+        return -err;
+    }
+
+    // keep the frames the kernel did not take, in order
+    memmove(self->txFrames, &self->txFrames[n], (self->txCount - n) * sizeof(self->txFrames[0]));
+    for (uint16_t i = 0; i < self->txCount - n; i++) {
+        self->txIov[i].iov_len = self->txIov[i + n].iov_len;
+    }
+    self->txCount -= n;
+    return n;
+}
+
+int Iso14229SocketCANTransmit(Iso14229SocketCAN *self, uint32_t arb_id, const uint8_t *data,
+                              uint8_t size) {
+    if (size > (self->canfd ? CANFD_MAX_DLEN : CAN_MAX_DLEN)) {
+        return ISOTP_RET_LENGTH;
+    }
+    if (ISO14229_SOCKETCAN_BATCH == self->txCount) {
+        Iso14229SocketCANFlush(self);
+        if (ISO14229_SOCKETCAN_BATCH == self->txCount) {
+            return ISOTP_RET_NOSPACE;
+        }
+    }
+
+    struct canfd_frame *frame = &self->txFrames[self->txCount];
+    memset(frame, 0, sizeof(*frame));
+    frame->can_id = _CANID(arb_id);
+    frame->len = size;
+    memcpy(frame->data, data, size);
+    self->txIov[self->txCount].iov_len = size > CAN_MAX_DLEN ? CANFD_MTU : CAN_MTU;
+    self->txCount++;
+    return ISOTP_RET_OK;
+}
+
+int Iso14229SocketCANWait(Iso14229SocketCAN *self, uint32_t timeout_ms) {
+    struct pollfd pfd = {.fd = self->fd, .events = POLLIN};
+    int ret;
+
+    if (self->rxIdx < self->rxCount) {
+        return 1;
+    }
+    Iso14229SocketCANFlush(self);
+    if (self->txCount && timeout_ms > 1) {
+        timeout_ms = 1;
+    }
+    ret = poll(&pfd, 1, timeout_ms > INT32_MAX ? -1 : (int)timeout_ms);
+    if (ret < 0) {
+        return EINTR == errno ? 0 : -errno;
+    }
+    return ret;
+}
+
+// ================================================
+// CAN_ISOTP
+// ================================================
+
+static Iso14229SocketCANISOTP *isotpSockets[ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS];
+
+int Iso14229SocketCANISOTPOpen(Iso14229SocketCANISOTP *self, const char *ifname, uint32_t tx_id,
+                               uint32_t rx_id, IsoTpLink *link, uint32_t flags) {
+    struct sockaddr_can addr = {0};
+    int err;
+    int slot = -1;
+
+    memset(self, 0, sizeof(*self));
+    self->fd = -1;
+    for (int i = 0; i < ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS; i++) {
+        if (NULL == isotpSockets[i]) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        return -ENOSPC;
+    }
+
+    self->fd = socket(PF_CAN, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_ISOTP);
+    if (self->fd < 0) {
+        return -errno;
+    }
+
+    if (flags) {
+        struct can_isotp_options opts = {
+            .flags = flags,
+            .txpad_content = CAN_ISOTP_DEFAULT_PAD_CONTENT,
+            .rxpad_content = CAN_ISOTP_DEFAULT_PAD_CONTENT,
+            .ext_address = CAN_ISOTP_DEFAULT_EXT_ADDRESS,
+        };
+        if (setsockopt(self->fd, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &opts, sizeof(opts)) < 0) {
+            err = -errno;
+            Iso14229SocketCANISOTPClose(self);
+            return err;
+        }
+    }
+
+    addr.can_addr.tp.tx_id = _CANID(tx_id);
+    addr.can_addr.tp.rx_id = _CANID(rx_id);
+    err = _BindInterface(self->fd, ifname, &addr);
+    if (err) {
+        Iso14229SocketCANISOTPClose(self);
+        return err;
+    }
+
+    self->tx_id = tx_id;
+    self->rx_id = rx_id;
+    self->link = link;
+    isotpSockets[slot] = self;
+    if (link) {
+        isotp_set_pdu_mode(link, Iso14229SocketCANISOTPSendPDU);
+    }
+    return 0;
+}
+
+void Iso14229SocketCANISOTPClose(Iso14229SocketCANISOTP *self) {
+    for (int i = 0; i < ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS; i++) {
+        if (self == isotpSockets[i]) {
+            isotpSockets[i] = NULL;
+        }
+    }
+    if (self->fd >= 0) {
+        close(self->fd);
+        self->fd = -1;
+    }
+}
+
+int Iso14229SocketCANISOTPReceive(Iso14229SocketCANISOTP *self) {
+    int count = 0;
+
+    for (;;) {
+        ssize_t n = recv(self->fd, self->buf, sizeof(self->buf), MSG_DONTWAIT | MSG_TRUNC);
+        if (n < 0) {
+            if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) {
+                return count;
+            }
+            self->rxErrors++;
+            return -errno;
+        }
+        if ((size_t)n > sizeof(self->buf) || NULL == self->link ||
+            ISOTP_RET_OK != isotp_on_pdu(self->link, self->buf, (uint16_t)n)) {
+            self->rxDropped++;
+            continue;
+        }
+        count++;
+    }
+}
+
+int Iso14229SocketCANISOTPSendPDU(const uint32_t arbitration_id, const IsoTpSegment *segments,
+                                  const uint8_t count) {
+    struct iovec iov[ISO_TP_MAX_SEND_SEGMENTS];
+    Iso14229SocketCANISOTP *sock = NULL;
+
+    for (int i = 0; i < ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS && NULL == sock; i++) {
+        if (isotpSockets[i] && isotpSockets[i]->tx_id == arbitration_id) {
+            sock = isotpSockets[i];
+        }
+    }
+    if (NULL == sock || count > ISO_TP_MAX_SEND_SEGMENTS) {
+        return ISOTP_RET_ERROR;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        iov[i] = (struct iovec){.iov_base = (void *)segments[i].data, .iov_len = segments[i].len};
+    }
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = count};
+    if (sendmsg(sock->fd, &msg, MSG_DONTWAIT) < 0) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno) {
+            return ISOTP_RET_INPROGRESS;
+        }
+        sock->txErrors++;
+        return ISOTP_RET_ERROR;
+    }
+    return ISOTP_RET_OK;
+}
@@ -0,0 +1,168 @@
+#ifndef ISO14229SOCKETCAN_H
+#define ISO14229SOCKETCAN_H
+
+/**
+ * @brief \~chinese Linux SocketCAN端口 \~english Linux SocketCAN port
+ *
+ * Two backends:
+ *  - raw: a CAN_RAW socket. Frames are received and sent in batches of up to
+ *    ISO14229_SOCKETCAN_BATCH with recvmmsg() and sendmmsg(). A kernel CAN_RAW_FILTER passes only
+ *    the IDs the server or client listens on, so other bus traffic never reaches userspace. Every
+ *    received frame carries its kernel receive timestamp.
+ *  - isotp: one CAN_ISOTP socket per address pair. The kernel segments, sends flow control and
+ *    keeps the ISO-TP timings. The IsoTpLink runs in PDU mode (isotp_set_pdu_mode()), so the
+ *    server and client only see whole messages.
+ *
+ * Nothing here prints or exits. Functions return ISOTP_RET_* or -errno and count errors.
+ * The functions of one socket must be called from one thread.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <linux/can.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include "iso14229.h"
+#include "isotp-c/isotp.h"
+
+/**
+ * @brief frames per recvmmsg()/sendmmsg() call
+ */
+#ifndef ISO14229_SOCKETCAN_BATCH
+#define ISO14229_SOCKETCAN_BATCH 32
+#endif
+
+/**
+ * @brief receive IDs a raw socket can filter on
+ */
+#ifndef ISO14229_SOCKETCAN_MAX_FILTERS
+#define ISO14229_SOCKETCAN_MAX_FILTERS 8
+#endif
+
+/**
+ * @brief largest message received on a CAN_ISOTP socket
+ */
+#ifndef ISO14229_SOCKETCAN_ISOTP_MAX_PDU
+#define ISO14229_SOCKETCAN_ISOTP_MAX_PDU 4095
+#endif
+
+/**
+ * @brief CAN_ISOTP sockets Iso14229SocketCANISOTPSendPDU() can send on
+ */
+#ifndef ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS
+#define ISO14229_SOCKETCAN_MAX_ISOTP_SOCKETS 4
+#endif
+
+#define ISO14229_SOCKETCAN_CMSG_LEN                                                                \
+    (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)))
+
+typedef struct {
+    int fd;
+    bool canfd; // CAN FD frames enabled
+
+    // frames of the last recvmmsg() not yet returned by Iso14229SocketCANRxPoll()
+    struct canfd_frame rxFrames[ISO14229_SOCKETCAN_BATCH];
+    struct timespec rxStamps[ISO14229_SOCKETCAN_BATCH];
+    uint16_t rxLens[ISO14229_SOCKETCAN_BATCH]; // bytes received into each frame
+    struct iovec rxIov[ISO14229_SOCKETCAN_BATCH];
+    uint8_t rxCmsg[ISO14229_SOCKETCAN_BATCH][ISO14229_SOCKETCAN_CMSG_LEN];
+    uint16_t rxCount;
+    uint16_t rxIdx;
+    struct timespec rxTimestamp; // kernel receive time of the frame last returned
+
+    // frames waiting for Iso14229SocketCANFlush()
+    struct canfd_frame txFrames[ISO14229_SOCKETCAN_BATCH];
+    struct iovec txIov[ISO14229_SOCKETCAN_BATCH];
+    uint16_t txCount;
+
+    uint32_t rxOverflows; // frames dropped by the kernel because the socket queue was full
+    uint32_t rxErrors;
+    uint32_t txErrors; // frames dropped after a send error other than a full TX queue
+} Iso14229SocketCAN;
+
+/**
+ * @brief \~chinese 打开原始CAN套接字 \~english Opens a CAN_RAW socket on `ifname`
+ * @param rxIds the arbitration IDs to receive. IDs above 0x7FF are 29 bit IDs. NULL: all frames
+ * @param numRxIds up to ISO14229_SOCKETCAN_MAX_FILTERS
+ * @param canfd true to send and receive CAN FD frames
+ * @return 0 or -errno
+ */
+int Iso14229SocketCANOpen(Iso14229SocketCAN *self, const char *ifname, const uint32_t *rxIds,
+                          uint8_t numRxIds, bool canfd);
+void Iso14229SocketCANClose(Iso14229SocketCAN *self);
+
+/**
+ * @brief \~chinese 接收一帧 \~english Returns the next received frame, reading a new batch with
+ * one recvmmsg() when the last one is used up. Use it as userCANRxPoll. `rxTimestamp` is the
+ * frame's kernel receive time
+ */
+enum Iso14229CANRxStatus Iso14229SocketCANRxPoll(Iso14229SocketCAN *self, uint32_t *arb_id,
+                                                 uint8_t *data, uint8_t *size);
+
+/**
+ * @brief \~chinese 发送一帧（排队） \~english Queues a frame for the next Iso14229SocketCANFlush().
+ * Use it as userCANTransmit. A full queue is flushed first
+ * @return ISOTP_RET_OK, ISOTP_RET_NOSPACE when the kernel TX queue is full: the ISO-TP layer
+ * retries the frame in the next poll
+ */
+int Iso14229SocketCANTransmit(Iso14229SocketCAN *self, uint32_t arb_id, const uint8_t *data,
+                              uint8_t size);
+
+/**
+ * @brief \~chinese 批量发送 \~english Sends the queued frames with sendmmsg(). Call it after each
+ * Iso14229ServerPoll() or Iso14229ClientPoll(), and before waiting
+ * @return the number of frames sent, or -errno. Frames which did not fit in the kernel TX queue
+ * stay queued
+ */
+int Iso14229SocketCANFlush(Iso14229SocketCAN *self);
+
+/**
+ * @brief \~chinese 等待 \~english Flushes, then blocks until a frame can be received or
+ * timeout_ms has passed. While frames are still queued, waits at most 1 ms
+ * @return > 0 when frames can be received, 0 on timeout, or -errno
+ */
+int Iso14229SocketCANWait(Iso14229SocketCAN *self, uint32_t timeout_ms);
+
+typedef struct {
+    int fd;
+    uint32_t tx_id;
+    uint32_t rx_id;
+    IsoTpLink *link; // receives the messages. NULL: send only, e.g. functional requests
+    uint8_t buf[ISO14229_SOCKETCAN_ISOTP_MAX_PDU];
+    uint32_t rxDropped; // messages larger than the buffer or without a free receive buffer
+    uint32_t rxErrors;
+    uint32_t txErrors;
+} Iso14229SocketCANISOTP;
+
+/**
+ * @brief \~chinese 打开内核ISO-TP套接字 \~english Opens a CAN_ISOTP socket sending on tx_id
+ * and receiving on rx_id, and puts `link` in PDU mode with Iso14229SocketCANISOTPSendPDU().
+ * Open the physical socket of an address before the functional one: messages sent on an
+ * arbitration ID go out on the first socket opened with that tx_id
+ * @param link the server's phys_link or func_link, or the client's link, after init. May be NULL
+ * @param flags CAN_ISOTP_* option flags, e.g. CAN_ISOTP_SF_BROADCAST for a client's functional
+ * requests. 0: defaults
+ * @return 0 or -errno
+ */
+int Iso14229SocketCANISOTPOpen(Iso14229SocketCANISOTP *self, const char *ifname, uint32_t tx_id,
+                               uint32_t rx_id, IsoTpLink *link, uint32_t flags);
+void Iso14229SocketCANISOTPClose(Iso14229SocketCANISOTP *self);
+
+/**
+ * @brief \~chinese 接收消息 \~english Reads the messages waiting on the socket and passes them to
+ * the link with isotp_on_pdu(). Call it before Iso14229ServerPoll() or Iso14229ClientPoll()
+ * @return the number of messages received, or -errno
+ */
+int Iso14229SocketCANISOTPReceive(Iso14229SocketCANISOTP *self);
+
+/**
+ * @brief isotp_user_send_pdu of the links opened with Iso14229SocketCANISOTPOpen(). Sends the
+ * segments as one message with a single sendmsg()
+ * @return ISOTP_RET_OK, ISOTP_RET_INPROGRESS if the kernel is still sending the previous message,
+ * ISOTP_RET_ERROR
+ */
+int Iso14229SocketCANISOTPSendPDU(const uint32_t arbitration_id, const IsoTpSegment *segments,
+                                  const uint8_t count);
+
+#endif
@@ -33,10 +33,45 @@ static uint8_t isotp_st_min_to_ms(uint8_t st_min) {
     return ms;
 }
 
+/* CAN FD only allows data lengths of 0..8, 12, 16, 20, 24, 32, 48 and 64 bytes */
+static uint8_t isotp_can_dl_round_up(uint8_t len) {
+    if (len <= 8) {
+        return len;
+    } else if (len <= 24) {
+        return (uint8_t) ((len + 3) & ~3);
+    } else if (len <= 32) {
+        return 32;
+    } else if (len <= 48) {
+        return 48;
+    }
+    return 64;
+}
+
+/* largest payload which fits a single frame for the given data length */
+static uint16_t isotp_single_frame_max_dl(uint8_t dl) {
+    if (dl <= ISOTP_CAN_DL) {
+        return ISOTP_CAN_DL - 1;
+    }
+    return dl - 2;
+}
+
+/* pad a frame holding len bytes to a valid CAN (FD) data length and send it */
+static int isotp_send_frame(IsoTpLink* link, uint32_t id, IsoTpCanMessage *message, uint8_t len) {
+    uint8_t frame_len;
+
+#ifdef ISO_TP_FRAME_PADDING
+    frame_len = isotp_can_dl_round_up(len < ISOTP_CAN_DL ? ISOTP_CAN_DL : len);
+#else
+    frame_len = isotp_can_dl_round_up(len);
+#endif
+    (void) memset(message->as.data_array.ptr + len, 0, frame_len - len);
+
+    return link->isotp_user_send_can(id, message->as.data_array.ptr, frame_len);
+}
+
 static int isotp_send_flow_control(IsoTpLink* link, uint8_t flow_status, uint8_t block_size, uint8_t st_min_ms) {
 
     IsoTpCanMessage message;
-    int ret;
 
     /* setup message  */
     message.as.flow_control.type = ISOTP_PCI_TYPE_FLOW_CONTROL_FRAME;
@@ -45,62 +80,97 @@ static int isotp_send_flow_control(IsoTpLink* link, uint8_t flow_status, uint8_t
     message.as.flow_control.STmin = isotp_ms_to_st_min(st_min_ms);
 
     /* send message */
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.flow_control.reserve, 0, sizeof(message.as.flow_control.reserve));
-    ret = link->isotp_user_send_can(link->send_arbitration_id, message.as.data_array.ptr, sizeof(message));
-#else    
-    ret = link->isotp_user_send_can(link->send_arbitration_id,
-            message.as.data_array.ptr,
-            3);
-#endif
+    return isotp_send_frame(link, link->send_arbitration_id, &message, 3);
+}
 
-    return ret;
+/* copy len bytes of the message being sent, starting at offset, to dst */
+static void isotp_copy_send_data(IsoTpLink *link, uint8_t *dst, uint16_t offset, uint16_t len) {
+    uint8_t i;
+
+    if (0 == link->send_segment_count) {
+        (void) memcpy(dst, link->send_buffer + offset, len);
+        return;
+    }
+
+    for (i = 0; i < link->send_segment_count && len > 0; i++) {
+        const IsoTpSegment *segment = &link->send_segments[i];
+        uint16_t n;
+
+        if (offset >= segment->len) {
+            offset -= segment->len;
+            continue;
+        }
+        n = segment->len - offset;
+        if (n > len) {
+            n = len;
+        }
+        (void) memcpy(dst, segment->data + offset, n);
+        dst += n;
+        len -= n;
+        offset = 0;
+    }
 }
 
 static int isotp_send_single_frame(IsoTpLink* link, uint32_t id) {
 
     IsoTpCanMessage message;
-    int ret;
 
-    /* multi frame message length must greater than 7  */
-    assert(link->send_size <= 7);
+    /* multi frame message length must greater than the single frame capacity */
+    assert(link->send_size <= isotp_single_frame_max_dl(link->tx_dl));
 
     /* setup message  */
     message.as.single_frame.type = ISOTP_PCI_TYPE_SINGLE;
-    message.as.single_frame.SF_DL = (uint8_t) link->send_size;
-    (void) memcpy(message.as.single_frame.data, link->send_buffer, link->send_size);
+    if (link->send_size <= ISOTP_CAN_DL - 1) {
+        message.as.single_frame.SF_DL = (uint8_t) link->send_size;
+        isotp_copy_send_data(link, message.as.single_frame.data, 0, link->send_size);
 
-    /* send message */
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.single_frame.data + link->send_size, 0, sizeof(message.as.single_frame.data) - link->send_size);
-    ret = link->isotp_user_send_can(id, message.as.data_array.ptr, sizeof(message));
-#else
-    ret = link->isotp_user_send_can(id,
-            message.as.data_array.ptr,
-            link->send_size + 1);
-#endif
+        /* send message */
+        return isotp_send_frame(link, id, &message, (uint8_t) (link->send_size + 1));
+    }
 
-    return ret;
+    /* CAN FD single frame escape sequence: SF_DL = 0, length in the second byte */
+    message.as.single_frame.SF_DL = 0;
+    message.as.single_frame.data[0] = (uint8_t) link->send_size;
+    isotp_copy_send_data(link, message.as.single_frame.data + 1, 0, link->send_size);
+
+    /* send message */
+    return isotp_send_frame(link, id, &message, (uint8_t) (link->send_size + 2));
 }
 
 static int isotp_send_first_frame(IsoTpLink* link, uint32_t id) {
     
     IsoTpCanMessage message;
+    uint8_t *data;
+    uint8_t data_length;
     int ret;
 
-    /* multi frame message length must greater than 7  */
-    assert(link->send_size > 7);
+    /* multi frame message length must greater than the single frame capacity */
+    assert(link->send_size > isotp_single_frame_max_dl(link->tx_dl));
 
     /* setup message  */
     message.as.first_frame.type = ISOTP_PCI_TYPE_FIRST_FRAME;
-    message.as.first_frame.FF_DL_low = (uint8_t) link->send_size;
-    message.as.first_frame.FF_DL_high = (uint8_t) (0x0F & (link->send_size >> 8));
-    (void) memcpy(message.as.first_frame.data, link->send_buffer, sizeof(message.as.first_frame.data));
+    if (link->send_size <= ISOTP_FF_DL_12BIT_MAX) {
+        message.as.first_frame.FF_DL_low = (uint8_t) link->send_size;
+        message.as.first_frame.FF_DL_high = (uint8_t) (0x0F & (link->send_size >> 8));
+        data = message.as.first_frame.data;
+        data_length = link->tx_dl - 2;
+    } else {
+        /* escape sequence: FF_DL = 0 followed by a 32 bit FF_DL */
+        message.as.first_frame.FF_DL_low = 0;
+        message.as.first_frame.FF_DL_high = 0;
+        message.as.first_frame.data[0] = 0;
+        message.as.first_frame.data[1] = 0;
+        message.as.first_frame.data[2] = (uint8_t) (link->send_size >> 8);
+        message.as.first_frame.data[3] = (uint8_t) link->send_size;
+        data = message.as.first_frame.data + 4;
+        data_length = link->tx_dl - 6;
+    }
+    isotp_copy_send_data(link, data, 0, data_length);
 
     /* send message */
-    ret = link->isotp_user_send_can(id, message.as.data_array.ptr, sizeof(message));
+    ret = link->isotp_user_send_can(id, message.as.data_array.ptr, link->tx_dl);
     if (ISOTP_RET_OK == ret) {
-        link->send_offset += sizeof(message.as.first_frame.data);
+        link->send_offset += data_length;
         link->send_sn = 1;
     }
 
@@ -113,27 +183,20 @@ static int isotp_send_consecutive_frame(IsoTpLink* link) {
     uint16_t data_length;
     int ret;
 
-    /* multi frame message length must greater than 7  */
-    assert(link->send_size > 7);
+    /* multi frame message length must greater than the single frame capacity */
+    assert(link->send_size > isotp_single_frame_max_dl(link->tx_dl));
 
     /* setup message  */
     message.as.consecutive_frame.type = TSOTP_PCI_TYPE_CONSECUTIVE_FRAME;
     message.as.consecutive_frame.SN = link->send_sn;
     data_length = link->send_size - link->send_offset;
-    if (data_length > sizeof(message.as.consecutive_frame.data)) {
-        data_length = sizeof(message.as.consecutive_frame.data);
+    if (data_length > link->tx_dl - 1) {
+        data_length = link->tx_dl - 1;
     }
-    (void) memcpy(message.as.consecutive_frame.data, link->send_buffer + link->send_offset, data_length);
+    isotp_copy_send_data(link, message.as.consecutive_frame.data, link->send_offset, data_length);
 
     /* send message */
-#ifdef ISO_TP_FRAME_PADDING
-    (void) memset(message.as.consecutive_frame.data + data_length, 0, sizeof(message.as.consecutive_frame.data) - data_length);
-    ret = link->isotp_user_send_can(link->send_arbitration_id, message.as.data_array.ptr, sizeof(message));
-#else
-    ret = link->isotp_user_send_can(link->send_arbitration_id,
-            message.as.data_array.ptr,
-            data_length + 1);
-#endif
+    ret = isotp_send_frame(link, link->send_arbitration_id, &message, (uint8_t) (data_length + 1));
     if (ISOTP_RET_OK == ret) {
         link->send_offset += data_length;
         if (++(link->send_sn) > 0x0F) {
@@ -145,23 +208,43 @@ static int isotp_send_consecutive_frame(IsoTpLink* link) {
 }
 
 static int isotp_receive_single_frame(IsoTpLink *link, IsoTpCanMessage *message, uint8_t len) {
+    uint8_t *data = message->as.single_frame.data;
+    uint8_t data_length;
+
+    if (0 != message->as.single_frame.SF_DL) {
+        data_length = message->as.single_frame.SF_DL;
+    } else if (len > ISOTP_CAN_DL) {
+        /* CAN FD single frame escape sequence */
+        data = message->as.single_frame.data + 1;
+        data_length = message->as.single_frame.data[0];
+    } else {
+        data_length = 0;
+    }
+
     /* check data length */
-    if ((0 == message->as.single_frame.SF_DL) || (message->as.single_frame.SF_DL > (len - 1))) {
+    if ((0 == data_length) || (data_length > (len - (data - message->as.data_array.ptr)))) {
         link->isotp_user_debug("Single-frame length too small.");
         return ISOTP_RET_LENGTH;
     }
 
+    if (data_length > link->receive_buf_size) {
+        link->isotp_user_debug("Single-frame too large for receiving buffer.");
+        return ISOTP_RET_OVERFLOW;
+    }
+
     /* copying data */
-    (void) memcpy(link->receive_buffer, message->as.single_frame.data, message->as.single_frame.SF_DL);
-    link->receive_size = message->as.single_frame.SF_DL;
+    (void) memcpy(link->receive_buffer, data, data_length);
+    link->receive_size = data_length;
     
     return ISOTP_RET_OK;
 }
 
 static int isotp_receive_first_frame(IsoTpLink *link, IsoTpCanMessage *message, uint8_t len) {
-    uint16_t payload_length;
+    uint32_t payload_length;
+    uint8_t *data;
 
-    if (8 != len) {
+    /* the first frame determines the data length of the sender (RX_DL) */
+    if (len < ISOTP_CAN_DL || isotp_can_dl_round_up(len) != len) {
         link->isotp_user_debug("First frame should be 8 bytes in length.");
         return ISOTP_RET_LENGTH;
     }
@@ -169,9 +252,24 @@ static int isotp_receive_first_frame(IsoTpLink *link, IsoTpCanMessage *message,
     /* check data length */
     payload_length = message->as.first_frame.FF_DL_high;
     payload_length = (payload_length << 8) + message->as.first_frame.FF_DL_low;
+    data = message->as.first_frame.data;
+
+    if (0 == payload_length) {
+        /* escape sequence: 32 bit FF_DL */
+        payload_length = ((uint32_t) message->as.first_frame.data[0] << 24) |
+                         ((uint32_t) message->as.first_frame.data[1] << 16) |
+                         ((uint32_t) message->as.first_frame.data[2] << 8) |
+                         ((uint32_t) message->as.first_frame.data[3]);
+        data += 4;
+
+        if (payload_length <= ISOTP_FF_DL_12BIT_MAX) {
+            link->isotp_user_debug("Should not use the first frame escape sequence.");
+            return ISOTP_RET_LENGTH;
+        }
+    }
 
     /* should not use multiple frame transmition */
-    if (payload_length <= 7) {
+    if (payload_length <= isotp_single_frame_max_dl(len)) {
         link->isotp_user_debug("Should not use multiple frame transmission.");
         return ISOTP_RET_LENGTH;
     }
@@ -182,9 +280,10 @@ static int isotp_receive_first_frame(IsoTpLink *link, IsoTpCanMessage *message,
     }
     
     /* copying data */
-    (void) memcpy(link->receive_buffer, message->as.first_frame.data, sizeof(message->as.first_frame.data));
-    link->receive_size = payload_length;
-    link->receive_offset = sizeof(message->as.first_frame.data);
+    link->rx_dl = len;
+    link->receive_offset = (uint16_t) (len - (data - message->as.data_array.ptr));
+    (void) memcpy(link->receive_buffer, data, link->receive_offset);
+    link->receive_size = (uint16_t) payload_length;
     link->receive_sn = 1;
 
     return ISOTP_RET_OK;
@@ -200,8 +299,8 @@ static int isotp_receive_consecutive_frame(IsoTpLink *link, IsoTpCanMessage *mes
 
     /* check data length */
     remaining_bytes = link->receive_size - link->receive_offset;
-    if (remaining_bytes > sizeof(message->as.consecutive_frame.data)) {
-        remaining_bytes = sizeof(message->as.consecutive_frame.data);
+    if (remaining_bytes > link->rx_dl - 1) {
+        remaining_bytes = link->rx_dl - 1;
     }
     if (remaining_bytes > len - 1) {
         link->isotp_user_debug("Consecutive frame too short.");
@@ -219,6 +318,47 @@ static int isotp_receive_consecutive_frame(IsoTpLink *link, IsoTpCanMessage *mes
     return ISOTP_RET_OK;
 }
 
+/* status of the message being assembled. With a second receive buffer, the next message is
+ * assembled while the previous one still waits to be received */
+static uint8_t* isotp_assembly_status(IsoTpLink *link) {
+    if (NULL != link->receive_alt_buffer && ISOTP_RECEIVE_STATUS_FULL == link->receive_status) {
+        return &link->receive_next_status;
+    }
+    return &link->receive_status;
+}
+
+/* true when there is no buffer a new message could be assembled into */
+static int isotp_receive_buffer_busy(IsoTpLink *link, uint8_t *receive_status) {
+    if (receive_status == &link->receive_next_status) {
+        /* both buffers hold a message */
+        return ISOTP_RECEIVE_STATUS_FULL == *receive_status;
+    }
+    return ISOTP_RECEIVE_STATUS_FULL == *receive_status && link->receive_borrowed;
+}
+
+/* the message in receive_buffer is complete */
+static void isotp_receive_complete(IsoTpLink *link, uint8_t *receive_status) {
+    uint8_t *buffer;
+
+    if (receive_status == &link->receive_next_status) {
+        /* queued behind the message which is waiting to be received */
+        link->receive_next_status = ISOTP_RECEIVE_STATUS_FULL;
+        return;
+    }
+
+    link->receive_full_buffer = link->receive_buffer;
+    link->receive_full_size = link->receive_size;
+    link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
+
+    /* continue in the other buffer */
+    if (NULL != link->receive_alt_buffer) {
+        buffer = link->receive_buffer;
+        link->receive_buffer = link->receive_alt_buffer;
+        link->receive_alt_buffer = buffer;
+        link->receive_next_status = ISOTP_RECEIVE_STATUS_IDLE;
+    }
+}
+
 static int isotp_receive_flow_control_frame(IsoTpLink *link, IsoTpCanMessage *message, uint8_t len) {
     /* check message length */
     if (len < 3) {
@@ -237,9 +377,49 @@ int isotp_send(IsoTpLink *link, const uint8_t payload[], uint16_t size) {
     return isotp_send_with_id(link, link->send_arbitration_id, payload, size);
 }
 
-int isotp_send_with_id(IsoTpLink *link, uint32_t id, const uint8_t payload[], uint16_t size) {
+/* start sending the message described by send_size and send_buffer or send_segments */
+static int isotp_start_send(IsoTpLink *link, uint32_t id) {
     int ret;
 
+    link->send_offset = 0;
+
+    /* pdu mode: the whole message is passed on */
+    if (NULL != link->isotp_user_send_pdu) {
+        IsoTpSegment whole = {link->send_buffer, link->send_size};
+        if (0 == link->send_segment_count) {
+            return link->isotp_user_send_pdu(id, &whole, 1);
+        }
+        return link->isotp_user_send_pdu(id, link->send_segments, link->send_segment_count);
+    }
+
+    if (link->send_size <= isotp_single_frame_max_dl(link->tx_dl)) {
+        /* send single frame */
+        ret = isotp_send_single_frame(link, id);
+    } else {
+        /* send multi-frame */
+        ret = isotp_send_first_frame(link, id);
+
+        /* init multi-frame control flags */
+        if (ISOTP_RET_OK == ret) {
+            link->send_bs_remain = 0;
+            link->send_st_min = 0;
+            link->send_wtf_count = 0;
+            uint32_t now = link->isotp_user_get_ms();
+            link->send_timer_st = now;
+            link->send_timer_bs = now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+            link->send_protocol_result = ISOTP_PROTOCOL_RESULT_OK;
+            link->send_status = ISOTP_SEND_STATUS_INPROGRESS;
+#if ISO_TP_METRICS
+            link->metrics_send_time = now;
+            link->metrics_fc_wait_start = now;
+#endif
+        }
+    }
+
+    return ret;
+}
+
+int isotp_send_with_id(IsoTpLink *link, uint32_t id, const uint8_t payload[], uint16_t size) {
     if (link == 0x0) {
         link->isotp_user_debug("Link is null!");
         return ISOTP_RET_ERROR;
@@ -257,48 +437,68 @@ int isotp_send_with_id(IsoTpLink *link, uint32_t id, const uint8_t payload[], ui
         return ISOTP_RET_INPROGRESS;
     }
 
-    /* copy into local buffer */
+    /* copy into local buffer, unless the message was built there */
     link->send_size = size;
-    link->send_offset = 0;
-    (void) memcpy(link->send_buffer, payload, size);
+    link->send_segment_count = 0;
+    if (payload != link->send_buffer) {
+        (void) memcpy(link->send_buffer, payload, size);
+    }
 
-    if (link->send_size < 8) {
-        /* send single frame */
-        ret = isotp_send_single_frame(link, id);
-    } else {
-        /* send multi-frame */
-        ret = isotp_send_first_frame(link, id);
+    return isotp_start_send(link, id);
+}
 
-        /* init multi-frame control flags */
-        if (ISOTP_RET_OK == ret) {
-            link->send_bs_remain = 0;
-            link->send_st_min = 0;
-            link->send_wtf_count = 0;
-            link->send_timer_st = link->isotp_user_get_ms();
-            link->send_timer_bs = link->isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
-            link->send_protocol_result = ISOTP_PROTOCOL_RESULT_OK;
-            link->send_status = ISOTP_SEND_STATUS_INPROGRESS;
-        }
+int isotp_send_segments(IsoTpLink *link, uint32_t id, const IsoTpSegment segments[], uint8_t count) {
+    uint32_t size = 0;
+    uint8_t i;
+
+    if (count > ISO_TP_MAX_SEND_SEGMENTS) {
+        link->isotp_user_debug("Too many segments. Increase ISO_TP_MAX_SEND_SEGMENTS\n");
+        return ISOTP_RET_OVERFLOW;
     }
 
-    return ret;
+    for (i = 0; i < count; i++) {
+        size += segments[i].len;
+    }
+    if (size > 0xFFFF) {
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        link->isotp_user_debug("Abort previous message, transmission in progress.\n");
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->send_size = (uint16_t) size;
+    link->send_segment_count = count;
+    (void) memcpy(link->send_segments, segments, count * sizeof(IsoTpSegment));
+
+    return isotp_start_send(link, id);
 }
 
 void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
     IsoTpCanMessage message;
+    uint8_t *receive_status;
     int ret;
     
-    if (len < 2 || len > 8) {
+    if (len < 2 || len > ISO_TP_MAX_DL) {
         return;
     }
 
     memcpy(message.as.data_array.ptr, data, len);
     memset(message.as.data_array.ptr + len, 0, sizeof(message.as.data_array.ptr) - len);
 
+    receive_status = isotp_assembly_status(link);
+
     switch (message.as.common.type) {
         case ISOTP_PCI_TYPE_SINGLE: {
+            /* no free receive buffer for the message */
+            if (isotp_receive_buffer_busy(link, receive_status)) {
+                link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+                break;
+            }
+
             /* update protocol result */
-            if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
+            if (ISOTP_RECEIVE_STATUS_INPROGRESS == *receive_status) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_UNEXP_PDU;
             } else {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_OK;
@@ -306,16 +506,29 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
 
             /* handle message */
             ret = isotp_receive_single_frame(link, &message, len);
+
+            if (ISOTP_RET_OVERFLOW == ret) {
+                link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+                *receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+                break;
+            }
             
             if (ISOTP_RET_OK == ret) {
                 /* change status */
-                link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
+                isotp_receive_complete(link, receive_status);
             }
             break;
         }
         case ISOTP_PCI_TYPE_FIRST_FRAME: {
+            /* no free receive buffer for the message */
+            if (isotp_receive_buffer_busy(link, receive_status)) {
+                link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+                isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
+                break;
+            }
+
             /* update protocol result */
-            if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
+            if (ISOTP_RECEIVE_STATUS_INPROGRESS == *receive_status) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_UNEXP_PDU;
             } else {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_OK;
@@ -329,7 +542,7 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
                 /* update protocol result */
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
                 /* change status */
-                link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+                *receive_status = ISOTP_RECEIVE_STATUS_IDLE;
                 /* send error message */
                 isotp_send_flow_control(link, PCI_FLOW_STATUS_OVERFLOW, 0, 0);
                 break;
@@ -338,19 +551,23 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
             /* if receive successful */
             if (ISOTP_RET_OK == ret) {
                 /* change status */
-                link->receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
+                *receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
                 /* send fc frame */
-                link->receive_bs_count = ISO_TP_DEFAULT_BLOCK_SIZE;
-                isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, ISO_TP_DEFAULT_ST_MIN);
+                link->receive_bs_count = link->receive_block_size;
+                isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, link->receive_st_min);
                 /* refresh timer cs */
-                link->receive_timer_cr = link->isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                uint32_t now = link->isotp_user_get_ms();
+                link->receive_timer_cr = now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+#if ISO_TP_METRICS
+                link->metrics_receive_time = now;
+#endif
             }
             
             break;
         }
         case TSOTP_PCI_TYPE_CONSECUTIVE_FRAME: {
             /* check if in receiving status */
-            if (ISOTP_RECEIVE_STATUS_INPROGRESS != link->receive_status) {
+            if (ISOTP_RECEIVE_STATUS_INPROGRESS != *receive_status) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_UNEXP_PDU;
                 break;
             }
@@ -361,7 +578,7 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
             /* if wrong sn */
             if (ISOTP_RET_WRONG_SN == ret) {
                 link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_WRONG_SN;
-                link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+                *receive_status = ISOTP_RECEIVE_STATUS_IDLE;
                 break;
             }
 
@@ -369,16 +586,22 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
             /* if success */
             if (ISOTP_RET_OK == ret) {
                 /* refresh timer cs */
-                link->receive_timer_cr = link->isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                uint32_t now = link->isotp_user_get_ms();
+                link->receive_timer_cr = now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+#if ISO_TP_METRICS
+                link->metrics.cf_received++;
+                isotp_histogram_add(&link->metrics.cf_rx_gap, now - link->metrics_receive_time);
+                link->metrics_receive_time = now;
+#endif
                 
                 /* receive finished */
                 if (link->receive_offset >= link->receive_size) {
-                    link->receive_status = ISOTP_RECEIVE_STATUS_FULL;
+                    isotp_receive_complete(link, receive_status);
                 } else {
-                    /* send fc when bs reaches limit */
-                    if (0 == --link->receive_bs_count) {
-                        link->receive_bs_count = ISO_TP_DEFAULT_BLOCK_SIZE;
-                        isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, ISO_TP_DEFAULT_ST_MIN);
+                    /* send fc when bs reaches limit. Block size 0: no further fc */
+                    if (0 != link->receive_block_size && 0 == --link->receive_bs_count) {
+                        link->receive_bs_count = link->receive_block_size;
+                        isotp_send_flow_control(link, PCI_FLOW_STATUS_CONTINUE, link->receive_bs_count, link->receive_st_min);
                     }
                 }
             }
@@ -396,7 +619,8 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
             
             if (ISOTP_RET_OK == ret) {
                 /* refresh bs timer */
-                link->send_timer_bs = link->isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+                uint32_t now = link->isotp_user_get_ms();
+                link->send_timer_bs = now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
 
                 /* overflow */
                 if (PCI_FLOW_STATUS_OVERFLOW == message.as.flow_control.FS) {
@@ -423,6 +647,11 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
                     }
                     link->send_st_min = isotp_st_min_to_ms(message.as.flow_control.STmin);
                     link->send_wtf_count = 0;
+#if ISO_TP_METRICS
+                    link->metrics_send_time = now;
+                    isotp_histogram_add(&link->metrics.fc_wait,
+                                        link->metrics_send_time - link->metrics_fc_wait_start);
+#endif
                 }
             }
             break;
@@ -434,21 +663,112 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len) {
 }
 
 int isotp_receive(IsoTpLink *link, uint8_t *payload, const uint16_t payload_size, uint16_t *out_size) {
+    const uint8_t *data;
     uint16_t copylen;
     
-    if (ISOTP_RECEIVE_STATUS_FULL != link->receive_status) {
+    if (ISOTP_RET_OK != isotp_receive_peek(link, &data, &copylen)) {
         return ISOTP_RET_NO_DATA;
     }
 
-    copylen = link->receive_size;
     if (copylen > payload_size) {
         copylen = payload_size;
     }
 
-    memcpy(payload, link->receive_buffer, copylen);
+    if (payload != data) {
+        (void) memcpy(payload, data, copylen);
+    }
     *out_size = copylen;
 
-    link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+    isotp_receive_release(link);
+
+    return ISOTP_RET_OK;
+}
+
+int isotp_receive_peek(IsoTpLink *link, const uint8_t **payload, uint16_t *size) {
+    if (ISOTP_RECEIVE_STATUS_FULL != link->receive_status) {
+        return ISOTP_RET_NO_DATA;
+    }
+
+    link->receive_borrowed = 1;
+    *payload = link->receive_full_buffer;
+    *size = link->receive_full_size;
+
+    return ISOTP_RET_OK;
+}
+
+void isotp_receive_release(IsoTpLink *link) {
+    uint8_t *buffer;
+
+    link->receive_borrowed = 0;
+
+    if (ISOTP_RECEIVE_STATUS_FULL != link->receive_status) {
+        return;
+    }
+
+    if (NULL == link->receive_alt_buffer || ISOTP_RECEIVE_STATUS_IDLE == link->receive_next_status) {
+        link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+    } else if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_next_status) {
+        /* the next message is still being assembled */
+        link->receive_status = ISOTP_RECEIVE_STATUS_INPROGRESS;
+        link->receive_next_status = ISOTP_RECEIVE_STATUS_IDLE;
+    } else {
+        /* the next message is complete, swap buffers again */
+        link->receive_full_buffer = link->receive_buffer;
+        link->receive_full_size = link->receive_size;
+        buffer = link->receive_buffer;
+        link->receive_buffer = link->receive_alt_buffer;
+        link->receive_alt_buffer = buffer;
+        link->receive_next_status = ISOTP_RECEIVE_STATUS_IDLE;
+    }
+}
+
+void isotp_set_flow_control(IsoTpLink *link, uint8_t block_size, uint8_t st_min_ms) {
+    link->receive_block_size = block_size;
+    link->receive_st_min = st_min_ms;
+}
+
+void isotp_set_pdu_mode(IsoTpLink *link,
+                        int (*isotp_user_send_pdu)(const uint32_t arbitration_id,
+                                                   const IsoTpSegment* segments, const uint8_t count)) {
+    link->isotp_user_send_pdu = isotp_user_send_pdu;
+}
+
+int isotp_on_pdu(IsoTpLink *link, const uint8_t *data, uint16_t len) {
+    uint8_t *receive_status = isotp_assembly_status(link);
+
+    if (isotp_receive_buffer_busy(link, receive_status)) {
+        link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    if (len > link->receive_buf_size) {
+        link->isotp_user_debug("Message too large for receiving buffer.");
+        link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_BUFFER_OVFLW;
+        return ISOTP_RET_OVERFLOW;
+    }
+
+    (void) memcpy(link->receive_buffer, data, len);
+    link->receive_size = len;
+    link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_OK;
+    isotp_receive_complete(link, receive_status);
+    return ISOTP_RET_OK;
+}
+
+void isotp_set_receive_double_buffer(IsoTpLink *link, uint8_t *recvbuf2) {
+    link->receive_alt_buffer = recvbuf2;
+    link->receive_next_status = ISOTP_RECEIVE_STATUS_IDLE;
+}
+
+int isotp_set_tx_dl(IsoTpLink *link, uint8_t tx_dl) {
+    if (tx_dl < ISOTP_CAN_DL || tx_dl > ISO_TP_MAX_DL || isotp_can_dl_round_up(tx_dl) != tx_dl) {
+        return ISOTP_RET_LENGTH;
+    }
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        return ISOTP_RET_INPROGRESS;
+    }
+
+    link->tx_dl = tx_dl;
 
     return ISOTP_RET_OK;
 }
@@ -469,9 +789,14 @@ void isotp_init_link(
     link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
     link->send_status = ISOTP_SEND_STATUS_IDLE;
     link->send_arbitration_id = sendid;
+    link->tx_dl = ISOTP_CAN_DL;
+    link->rx_dl = ISOTP_CAN_DL;
+    link->receive_block_size = ISO_TP_DEFAULT_BLOCK_SIZE;
+    link->receive_st_min = ISO_TP_DEFAULT_ST_MIN;
     link->send_buffer = sendbuf;
     link->send_buf_size = sendbufsize;
     link->receive_buffer = recvbuf;
+    link->receive_full_buffer = recvbuf;
     link->receive_buf_size = recvbufsize;
     link->isotp_user_get_ms = isotp_user_get_ms;
     link->isotp_user_send_can = isotp_user_send_can;
@@ -480,52 +805,119 @@ void isotp_init_link(
     return;
 }
 
+int isotp_get_next_deadline(IsoTpLink *link, uint32_t *deadline) {
+    int ret = 0;
+
+    if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
+        *deadline = link->send_timer_bs;
+        ret = 1;
+        /* next consecutive frame, unless waiting for a flow control frame */
+        if ((ISOTP_INVALID_BS == link->send_bs_remain || link->send_bs_remain > 0) &&
+            IsoTpTimeAfter(*deadline, link->send_timer_st)) {
+            *deadline = link->send_timer_st;
+        }
+    }
+
+    if (ISOTP_RECEIVE_STATUS_INPROGRESS == *isotp_assembly_status(link)) {
+        if (0 == ret || IsoTpTimeAfter(*deadline, link->receive_timer_cr)) {
+            *deadline = link->receive_timer_cr;
+        }
+        ret = 1;
+    }
+
+    return ret;
+}
+
 void isotp_poll(IsoTpLink *link) {
+    /* nothing to do while idle */
+    if (ISOTP_SEND_STATUS_INPROGRESS != link->send_status &&
+        ISOTP_RECEIVE_STATUS_INPROGRESS != *isotp_assembly_status(link)) {
+        return;
+    }
+
+    isotp_poll_at(link, link->isotp_user_get_ms());
+}
+
+void isotp_poll_at(IsoTpLink *link, uint32_t now) {
+    uint16_t burst;
     int ret;
 
     /* only polling when operation in progress */
     if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status) {
 
-        /* continue send data */
-        if (/* send data if bs_remain is invalid or bs_remain large than zero */
-        (ISOTP_INVALID_BS == link->send_bs_remain || link->send_bs_remain > 0) &&
-        /* and if st_min is zero or go beyond interval time */
-        (0 == link->send_st_min || (0 != link->send_st_min && IsoTpTimeAfter(link->isotp_user_get_ms(), link->send_timer_st)))) {
-            
-            ret = isotp_send_consecutive_frame(link);
-            if (ISOTP_RET_OK == ret) {
-                if (ISOTP_INVALID_BS != link->send_bs_remain) {
-                    link->send_bs_remain -= 1;
-                }
-                link->send_timer_bs = link->isotp_user_get_ms() + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
-                link->send_timer_st = link->isotp_user_get_ms() + link->send_st_min;
+        /* continue send data, up to ISO_TP_MAX_CF_BURST frames in a row */
+        for (burst = 0; burst < ISO_TP_MAX_CF_BURST; burst++) {
+            if (!(/* send data if bs_remain is invalid or bs_remain large than zero */
+            (ISOTP_INVALID_BS == link->send_bs_remain || link->send_bs_remain > 0) &&
+            /* and if st_min is zero or go beyond interval time */
+            (0 == link->send_st_min || (0 != link->send_st_min && IsoTpTimeAfter(now, link->send_timer_st))))) {
+                break;
+            }
 
-                /* check if send finish */
-                if (link->send_offset >= link->send_size) {
-                    link->send_status = ISOTP_SEND_STATUS_IDLE;
-                }
-            } else {
+            ret = isotp_send_consecutive_frame(link);
+            if (ISOTP_RET_NOSPACE == ret) {
+                /* tx mailbox full, retry on the next poll */
+                break;
+            } else if (ISOTP_RET_OK != ret) {
                 link->send_status = ISOTP_SEND_STATUS_ERROR;
+                break;
+            }
+
+            if (ISOTP_INVALID_BS != link->send_bs_remain) {
+                link->send_bs_remain -= 1;
+            }
+            link->send_timer_bs = now + ISO_TP_DEFAULT_RESPONSE_TIMEOUT;
+            link->send_timer_st = now + link->send_st_min;
+#if ISO_TP_METRICS
+            link->metrics.cf_sent++;
+            isotp_histogram_add(&link->metrics.cf_tx_gap, now - link->metrics_send_time);
+            link->metrics_send_time = now;
+            if (0 == link->send_bs_remain) {
+                link->metrics_fc_wait_start = now;
+            }
+#endif
+
+            /* check if send finish */
+            if (link->send_offset >= link->send_size) {
+                link->send_status = ISOTP_SEND_STATUS_IDLE;
+                break;
             }
         }
 
         /* check timeout */
-        if (IsoTpTimeAfter(link->isotp_user_get_ms(), link->send_timer_bs)) {
+        if (ISOTP_SEND_STATUS_INPROGRESS == link->send_status && IsoTpTimeAfter(now, link->send_timer_bs)) {
             link->send_protocol_result = ISOTP_PROTOCOL_RESULT_TIMEOUT_BS;
             link->send_status = ISOTP_SEND_STATUS_ERROR;
+#if ISO_TP_METRICS
+            link->metrics.n_bs_timeouts++;
+#endif
         }
     }
 
     /* only polling when operation in progress */
-    if (ISOTP_RECEIVE_STATUS_INPROGRESS == link->receive_status) {
+    if (ISOTP_RECEIVE_STATUS_INPROGRESS == *isotp_assembly_status(link)) {
         
         /* check timeout */
-        if (IsoTpTimeAfter(link->isotp_user_get_ms(), link->receive_timer_cr)) {
+        if (IsoTpTimeAfter(now, link->receive_timer_cr)) {
             link->receive_protocol_result = ISOTP_PROTOCOL_RESULT_TIMEOUT_CR;
-            link->receive_status = ISOTP_RECEIVE_STATUS_IDLE;
+            *isotp_assembly_status(link) = ISOTP_RECEIVE_STATUS_IDLE;
+#if ISO_TP_METRICS
+            link->metrics.n_cr_timeouts++;
+#endif
         }
     }
 
     return;
 }
 
+void isotp_histogram_add(IsoTpHistogram *histogram, uint32_t ms) {
+    uint8_t bucket = 0;
+
+    while (ms >> bucket && bucket < ISOTP_HISTOGRAM_BUCKETS - 1) {
+        bucket++;
+    }
+    histogram->count[bucket]++;
+    if (ms > histogram->max) {
+        histogram->max = ms;
+    }
+}
@@ -10,8 +10,8 @@
 extern "C" {
 #endif
 
-#include "isotp_defines.h"
 #include "isotp_config.h"
+#include "isotp_defines.h"
 
 /**
  * @brief Struct containing the data for linking an application to a CAN instance.
@@ -21,11 +21,14 @@ extern "C" {
 typedef struct IsoTpLink {
     /* sender paramters */
     uint32_t                    send_arbitration_id; /* used to reply consecutive frame */
+    uint8_t                     tx_dl;          /* CAN frame data length used for sending, 8 (classic CAN) up to 64 (CAN FD) */
     /* message buffer */
     uint8_t*                    send_buffer;
     uint16_t                    send_buf_size;
     uint16_t                    send_size;
     uint16_t                    send_offset;
+    IsoTpSegment                send_segments[ISO_TP_MAX_SEND_SEGMENTS]; /* message pieces, see isotp_send_segments() */
+    uint8_t                     send_segment_count; /* 0: the message is in send_buffer */
     /* multi-frame flags */
     uint8_t                     send_sn;
     uint16_t                    send_bs_remain; /* Remaining block size */
@@ -40,25 +43,43 @@ typedef struct IsoTpLink {
 
     /* receiver paramters */
     uint32_t                    receive_arbitration_id;
+    uint8_t                     rx_dl;          /* CAN frame data length of the sender, taken from the first frame */
     /* message buffer */
-    uint8_t*                    receive_buffer;
+    uint8_t*                    receive_buffer;       /* messages are assembled here */
+    uint8_t*                    receive_alt_buffer;   /* optional second buffer of receive_buf_size bytes (double buffering) */
+    uint8_t*                    receive_full_buffer;  /* the complete message, valid while receive_status is FULL */
     uint16_t                    receive_buf_size;
     uint16_t                    receive_size;
+    uint16_t                    receive_full_size;
     uint16_t                    receive_offset;
     /* multi-frame control */
     uint8_t                     receive_sn;
     uint8_t                     receive_bs_count; /* Maximum number of FC.Wait frame transmissions  */
+    uint8_t                     receive_block_size; /* BS sent in flow control frames, 0: no further flow control */
+    uint8_t                     receive_st_min; /* STmin sent in flow control frames, unit millis */
     uint32_t                    receive_timer_cr; /* Time until transmission of the next ConsecutiveFrame N_PDU
                                                      start at sending FC, receive CF 
                                                      end at receive FC */
     int                         receive_protocol_result;
     uint8_t                     receive_status;                                                     
+    uint8_t                     receive_borrowed; /* receive_full_buffer is lent out by isotp_receive_peek() */
+    uint8_t                     receive_next_status; /* double buffering: status of the message assembled while receive_status is FULL */
 
     /* user implemented callback functions */
     uint32_t                    (*isotp_user_get_ms)(void); /* get millisecond */
     int                         (*isotp_user_send_can)(const uint32_t arbitration_id,
-                            const uint8_t* data, const uint8_t size); /* send can message. should return ISOTP_RET_OK when success.  */
+                            const uint8_t* data, const uint8_t size); /* send can message. should return ISOTP_RET_OK when success,
+                                                                                 ISOTP_RET_NOSPACE when the TX mailbox is full */
     void                        (*isotp_user_debug)(const char* message, ...); /* print debug message */
+    int                         (*isotp_user_send_pdu)(const uint32_t arbitration_id,
+                            const IsoTpSegment* segments, const uint8_t count); /* optional: sends whole messages, see isotp_set_pdu_mode() */
+
+#if ISO_TP_METRICS
+    IsoTpLinkMetrics            metrics;
+    uint32_t                    metrics_send_time;     /* last FF/CF sent or FC received */
+    uint32_t                    metrics_receive_time;  /* last FF/CF received */
+    uint32_t                    metrics_fc_wait_start; /* FF or last CF of a block sent */
+#endif
 } IsoTpLink;
 
 /**
@@ -72,6 +93,7 @@ typedef struct IsoTpLink {
  * @param recvbufsize The size of the buffer area.
  * @param isotp_user_get_ms A pointer to a function which returns the current time as milliseconds.
  * @param isotp_user_send_can A pointer to a function which sends a can message. should return ISOTP_RET_OK when success.
+ * Returning ISOTP_RET_NOSPACE from a consecutive frame ends the current burst, the frame is retried in the next isotp_poll().
  * @param isotp_user_debug A pointer to a function which prints a debug message.
  */
 void isotp_init_link(
@@ -89,18 +111,28 @@ void isotp_init_link(
 
 /**
  * @brief Polling function; call this function periodically to handle timeouts, send consecutive frames, etc.
+ * Consecutive frames are sent in bursts of up to ISO_TP_MAX_CF_BURST frames per call.
  *
  * @param link The @code IsoTpLink @endcode instance used.
  */
 void isotp_poll(IsoTpLink *link);
 
+/**
+ * @brief Same as isotp_poll(), with the current time passed in instead of read from
+ * isotp_user_get_ms(). Lets a caller polling several links read the clock once.
+ *
+ * @param link The @code IsoTpLink @endcode instance used.
+ * @param now The current time in the time base of isotp_user_get_ms().
+ */
+void isotp_poll_at(IsoTpLink *link, uint32_t now);
+
 /**
  * @brief Handles incoming CAN messages.
  * Determines whether an incoming message is a valid ISO-TP frame or not and handles it accordingly.
  *
  * @param link The @code IsoTpLink @endcode instance used for transceiving data.
  * @param data The data received via CAN.
- * @param len The length of the data received.
+ * @param len The length of the data received. (Up to ISO_TP_MAX_DL bytes).
  */
 void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len);
 
@@ -111,7 +143,8 @@ void isotp_on_can_message(IsoTpLink *link, uint8_t *data, uint8_t len);
  * Multi-frame messages will be sent consecutively when calling isotp_poll.
  *
  * @param link The @code IsoTpLink @endcode instance used for transceiving data.
- * @param payload The payload to be sent. (Up to 4095 bytes).
+ * @param payload The payload to be sent. (Up to 65535 bytes, payloads larger than 4095 bytes use
+ * the first frame escape sequence).
  * @param size The size of the payload to be sent.
  *
  * @return Possible return values:
@@ -127,6 +160,26 @@ int isotp_send(IsoTpLink *link, const uint8_t payload[], uint16_t size);
  */
 int isotp_send_with_id(IsoTpLink *link, uint32_t id, const uint8_t payload[], uint16_t size);
 
+/**
+ * @brief Scatter-gather alternative to isotp_send(). Sends the concatenation of the segments
+ * without copying them into the send buffer: frames are filled directly from the segment data.
+ * The segment data must stay valid and unchanged until the transmission has completed
+ * (send_status is no longer ISOTP_SEND_STATUS_INPROGRESS). Segments may point into the link's
+ * own send buffer.
+ *
+ * @param link The @code IsoTpLink @endcode instance used for transceiving data.
+ * @param id The arbitration ID of the first or single frame.
+ * @param segments Up to ISO_TP_MAX_SEND_SEGMENTS segments. The list itself is copied.
+ * @param count The number of segments.
+ *
+ * @return Possible return values:
+ *  - @code ISOTP_RET_OVERFLOW @endcode if the message is longer than 65535 bytes or count is too large
+ *  - @code ISOTP_RET_INPROGRESS @endcode
+ *  - @code ISOTP_RET_OK @endcode
+ *  - The return value of the user shim function isotp_user_send_can().
+ */
+int isotp_send_segments(IsoTpLink *link, uint32_t id, const IsoTpSegment segments[], uint8_t count);
+
 /**
  * @brief Receives and parses the received data and copies the parsed data in to the internal buffer.
  * @param link The @link IsoTpLink @endlink instance used to transceive data.
@@ -140,6 +193,110 @@ int isotp_send_with_id(IsoTpLink *link, uint32_t id, const uint8_t payload[], ui
  */
 int isotp_receive(IsoTpLink *link, uint8_t *payload, const uint16_t payload_size, uint16_t *out_size);
 
+/**
+ * @brief Zero-copy alternative to isotp_receive(). Lends the received message to the caller.
+ * The message stays valid in the link buffer until isotp_receive_release() is called. While it is
+ * lent out, new single frames are dropped and new first frames are answered with FC.OVFLW.
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ * @param payload set to the start of the received message
+ * @param size set to the size of the received message
+ *
+ * @return Possible return values:
+ *      - @link ISOTP_RET_OK @endlink
+ *      - @link ISOTP_RET_NO_DATA @endlink
+ */
+int isotp_receive_peek(IsoTpLink *link, const uint8_t **payload, uint16_t *size);
+
+/**
+ * @brief Gives a message obtained with isotp_receive_peek() back to the link so that the next
+ * message can be received.
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ */
+void isotp_receive_release(IsoTpLink *link);
+
+/**
+ * @brief Sets the block size and STmin the link asks for in its flow control frames. The
+ * defaults are ISO_TP_DEFAULT_BLOCK_SIZE and ISO_TP_DEFAULT_ST_MIN. Call after isotp_init_link().
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ * @param block_size Consecutive frames the sender may send before the next flow control frame.
+ * 0: all of them.
+ * @param st_min_ms Minimum gap between consecutive frames.
+ */
+void isotp_set_flow_control(IsoTpLink *link, uint8_t block_size, uint8_t st_min_ms);
+
+/**
+ * @brief Hands segmentation to the user, e.g. to a Linux CAN_ISOTP socket. Messages sent on the
+ * link are passed whole to isotp_user_send_pdu(), as the segments given to isotp_send_segments()
+ * or as one segment of the send buffer, and the send status stays idle. Received messages are
+ * passed in with isotp_on_pdu(). isotp_poll() and isotp_on_can_message() are not used.
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ * @param isotp_user_send_pdu Sends a message on arbitration_id. The segments are only valid during
+ * the call. Should return ISOTP_RET_OK when success. NULL: segment on CAN frames again.
+ */
+void isotp_set_pdu_mode(IsoTpLink *link,
+                        int (*isotp_user_send_pdu)(const uint32_t arbitration_id,
+                                                   const IsoTpSegment* segments, const uint8_t count));
+
+/**
+ * @brief Receives a whole message in PDU mode, see isotp_set_pdu_mode(). The message is copied to
+ * the receive buffer and received with isotp_receive() or isotp_receive_peek() as usual.
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ * @param data The message.
+ * @param len The length of the message.
+ *
+ * @return Possible return values:
+ *  - @code ISOTP_RET_OK @endcode
+ *  - @code ISOTP_RET_OVERFLOW @endcode the message is larger than the receive buffer
+ *  - @code ISOTP_RET_INPROGRESS @endcode no receive buffer is free, the message was dropped
+ */
+int isotp_on_pdu(IsoTpLink *link, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Adds a second receive buffer to a link. While one message waits to be received, for
+ * example lent out with isotp_receive_peek(), the next message is assembled in the other buffer.
+ * Only when both buffers hold a message are new messages refused. Call after isotp_init_link().
+ * @param link The @link IsoTpLink @endlink instance used to transceive data.
+ * @param recvbuf2 A buffer of the same size as the receive buffer passed to isotp_init_link().
+ */
+void isotp_set_receive_double_buffer(IsoTpLink *link, uint8_t *recvbuf2);
+
+/**
+ * @brief Sets the transmit data length (TX_DL) of a link. The default set by isotp_init_link() is 8
+ * (classic CAN). Larger values select CAN FD framing: single frames carry up to TX_DL - 2 bytes,
+ * first and consecutive frames are TX_DL bytes long and the last frame is padded to the next valid
+ * CAN FD data length.
+ *
+ * @param link The @code IsoTpLink @endcode instance used for transceiving data.
+ * @param tx_dl 8, 12, 16, 20, 24, 32, 48 or 64. Must not be larger than ISO_TP_MAX_DL.
+ *
+ * @return Possible return values:
+ *  - @code ISOTP_RET_OK @endcode
+ *  - @code ISOTP_RET_LENGTH @endcode tx_dl is not a valid CAN FD data length
+ *  - @code ISOTP_RET_INPROGRESS @endcode a multi-frame transmission is in progress
+ */
+int isotp_set_tx_dl(IsoTpLink *link, uint8_t tx_dl);
+
+/**
+ * @brief Gets the time at which isotp_poll() has work to do next: the next consecutive frame
+ * (STmin), the flow control timeout (N_Bs) or the consecutive frame timeout (N_Cr). Lets the
+ * caller sleep until a CAN frame arrives or this deadline passes instead of polling periodically.
+ *
+ * @param link The @code IsoTpLink @endcode instance used for transceiving data.
+ * @param deadline Set to the deadline in the time base of isotp_user_get_ms(). May be in the past.
+ *
+ * @return 1 if a deadline was set, 0 if the link only needs polling after a CAN frame is received.
+ */
+int isotp_get_next_deadline(IsoTpLink *link, uint32_t *deadline);
+
+/**
+ * @brief Counts a millisecond value in its bucket. Used for IsoTpLink.metrics, also available to
+ * the layers above.
+ *
+ * @param histogram The histogram.
+ * @param ms The value.
+ */
+void isotp_histogram_add(IsoTpHistogram *histogram, uint32_t ms);
+
 #ifdef __cplusplus
 }
 #endif
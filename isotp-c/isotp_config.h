@@ -25,5 +25,36 @@
  */
 #define ISO_TP_FRAME_PADDING
 
+/* Maximum number of consecutive frames isotp_poll() sends in one call. A burst
+ * also ends when the block size is used up, when STmin has to elapse or when
+ * isotp_user_send_can() returns ISOTP_RET_NOSPACE (TX mailbox full). Set to 1
+ * to send one consecutive frame per poll.
+ */
+#ifndef ISO_TP_MAX_CF_BURST
+#define ISO_TP_MAX_CF_BURST         64
+#endif
+
+/* Largest CAN frame data length a link can send or receive. 64 allows CAN FD
+ * links; set to 8 to save stack and RAM on classic CAN only targets.
+ */
+#ifndef ISO_TP_MAX_DL
+#define ISO_TP_MAX_DL               64
+#endif
+
+/* Maximum number of segments isotp_send_segments() accepts. Each link keeps a
+ * copy of the segment list while the message is sent.
+ */
+#ifndef ISO_TP_MAX_SEND_SEGMENTS
+#define ISO_TP_MAX_SEND_SEGMENTS    8
+#endif
+
+/* Set to 1 to count consecutive frames and N_Bs/N_Cr timeouts and to record
+ * consecutive frame gaps and flow control waits in IsoTpLink.metrics. Adds a
+ * clock read per received frame.
+ */
+#ifndef ISO_TP_METRICS
+#define ISO_TP_METRICS              0
+#endif
+
 #endif
 
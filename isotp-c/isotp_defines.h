@@ -39,6 +39,7 @@
 #define ISOTP_RET_NO_DATA      -5
 #define ISOTP_RET_TIMEOUT      -6
 #define ISOTP_RET_LENGTH       -7
+#define ISOTP_RET_NOSPACE      -8
 
 /* return logic true if 'a' is after 'b' */
 #define IsoTpTimeAfter(a,b) ((int32_t)((int32_t)(b) - (int32_t)(a)) < 0)
@@ -46,6 +47,14 @@
 /*  invalid bs */
 #define ISOTP_INVALID_BS       0xFFFF
 
+/* data length of a classic CAN frame */
+#define ISOTP_CAN_DL           8
+
+/* largest FF_DL that fits the 12 bit first frame length field. Longer messages use the
+ * escape sequence (FF_DL = 0 followed by a 32 bit length)
+ */
+#define ISOTP_FF_DL_12BIT_MAX  4095
+
 /* ISOTP sender status */
 typedef enum {
     ISOTP_SEND_STATUS_IDLE,
@@ -65,26 +74,26 @@ typedef enum {
 typedef struct {
     uint8_t reserve_1:4;
     uint8_t type:4;
-    uint8_t reserve_2[7];
+    uint8_t reserve_2[ISO_TP_MAX_DL - 1];
 } IsoTpPciType;
 
 typedef struct {
     uint8_t SF_DL:4;
     uint8_t type:4;
-    uint8_t data[7];
+    uint8_t data[ISO_TP_MAX_DL - 1];
 } IsoTpSingleFrame;
 
 typedef struct {
     uint8_t FF_DL_high:4;
     uint8_t type:4;
     uint8_t FF_DL_low;
-    uint8_t data[6];
+    uint8_t data[ISO_TP_MAX_DL - 2];
 } IsoTpFirstFrame;
 
 typedef struct {
     uint8_t SN:4;
     uint8_t type:4;
-    uint8_t data[7];
+    uint8_t data[ISO_TP_MAX_DL - 1];
 } IsoTpConsecutiveFrame;
 
 typedef struct {
@@ -92,7 +101,7 @@ typedef struct {
     uint8_t type:4;
     uint8_t BS;
     uint8_t STmin;
-    uint8_t reserve[5];
+    uint8_t reserve[ISO_TP_MAX_DL - 3];
 } IsoTpFlowControl;
 
 #else
@@ -100,7 +109,7 @@ typedef struct {
 typedef struct {
     uint8_t type:4;
     uint8_t reserve_1:4;
-    uint8_t reserve_2[7];
+    uint8_t reserve_2[ISO_TP_MAX_DL - 1];
 } IsoTpPciType;
 
 /*
@@ -116,7 +125,7 @@ typedef struct {
 typedef struct {
     uint8_t type:4;
     uint8_t SF_DL:4;
-    uint8_t data[7];
+    uint8_t data[ISO_TP_MAX_DL - 1];
 } IsoTpSingleFrame;
 
 /*
@@ -133,7 +142,7 @@ typedef struct {
     uint8_t type:4;
     uint8_t FF_DL_high:4;
     uint8_t FF_DL_low;
-    uint8_t data[6];
+    uint8_t data[ISO_TP_MAX_DL - 2];
 } IsoTpFirstFrame;
 
 /*
@@ -149,7 +158,7 @@ typedef struct {
 typedef struct {
     uint8_t type:4;
     uint8_t SN:4;
-    uint8_t data[7];
+    uint8_t data[ISO_TP_MAX_DL - 1];
 } IsoTpConsecutiveFrame;
 
 /*
@@ -167,15 +176,41 @@ typedef struct {
     uint8_t FS:4;
     uint8_t BS;
     uint8_t STmin;
-    uint8_t reserve[5];
+    uint8_t reserve[ISO_TP_MAX_DL - 3];
 } IsoTpFlowControl;
 
 #endif
 
 typedef struct {
-    uint8_t ptr[8];
+    uint8_t ptr[ISO_TP_MAX_DL];
 } IsoTpDataArray;
 
+/* one piece of a message sent with isotp_send_segments() */
+typedef struct {
+    const uint8_t *data;
+    uint16_t len;
+} IsoTpSegment;
+
+/* fixed-bucket histogram of millisecond values: bucket 0 counts 0 ms, bucket i
+ * counts [2^(i-1), 2^i) ms and the last bucket counts everything longer */
+#define ISOTP_HISTOGRAM_BUCKETS 12
+
+typedef struct {
+    uint32_t count[ISOTP_HISTOGRAM_BUCKETS];
+    uint32_t max;
+} IsoTpHistogram;
+
+/* counters and timings of a link, kept when ISO_TP_METRICS is 1 */
+typedef struct {
+    uint32_t                    cf_sent;
+    uint32_t                    cf_received;
+    uint32_t                    n_bs_timeouts;  /* no flow control frame in time */
+    uint32_t                    n_cr_timeouts;  /* no consecutive frame in time */
+    IsoTpHistogram              cf_tx_gap;      /* from the previous FF/CF sent or FC received to a CF sent */
+    IsoTpHistogram              cf_rx_gap;      /* from the previous FF/CF received to a CF received */
+    IsoTpHistogram              fc_wait;        /* from the FF or the last CF of a block to the FC that continues it */
+} IsoTpLinkMetrics;
+
 typedef struct {
     union {
         IsoTpPciType          common;
@@ -175,7 +175,8 @@ static enum Iso14229CANRxStatus mockClientCANRxPoll(uint32_t *arb_id, uint8_t *d
         ISO14229USERDEBUG("%06d c<0x%03x [%02d]: ", g.ms, msg->arbId, g.clientRecvQueueIdx);
         PRINTHEX(msg->data, msg->size);
         g.clientRecvQueueIdx--;
-        memmove(g.clientRecvQueue, &g.clientRecvQueue[1], sizeof(struct CANMessage));
+        memmove(g.clientRecvQueue, &g.clientRecvQueue[1],
+                g.clientRecvQueueIdx * sizeof(struct CANMessage));
         return kCANRxSome;
     }
     return kCANRxNone;
@@ -187,10 +188,13 @@ static enum Iso14229CANRxStatus mockClientCANRxPoll(uint32_t *arb_id, uint8_t *d
 
 /**
  * @brief Sends CAN messages from client to an in-memory FIFO queue
+ * @return ISOTP_RET_NOSPACE when the queue is full, like a full TX mailbox
  */
 int mockClientSendCAN(const uint32_t arbitration_id, const uint8_t *data, const uint8_t size) {
-    assert(size <= 8);
-    assert(g.serverRecvQueueIdx < CAN_MESSAGE_QUEUE_SIZE);
+    assert(size <= ISO_TP_MAX_DL);
+    if (g.serverRecvQueueIdx >= CAN_MESSAGE_QUEUE_SIZE) {
+        return ISOTP_RET_NOSPACE;
+    }
     struct CANMessage *msg = &g.serverRecvQueue[g.serverRecvQueueIdx++];
     memmove(msg->data, data, size);
     msg->arbId = arbitration_id;
@@ -207,7 +211,7 @@ int mockClientSendCAN(const uint32_t arbitration_id, const uint8_t *data, const
  * @brief Sends CAN messages from server to an in-memory FIFO queue
  */
 int mockServerCANTransmit(const uint32_t arbitration_id, const uint8_t *data, const uint8_t size) {
-    assert(size <= 8);
+    assert(size <= ISO_TP_MAX_DL);
     assert(g.clientRecvQueueIdx < CAN_MESSAGE_QUEUE_SIZE);
     struct CANMessage *msg = &g.clientRecvQueue[g.clientRecvQueueIdx++];
     memmove(msg->data, data, size);
@@ -230,7 +234,8 @@ enum Iso14229CANRxStatus mockServerCANRxPoll(uint32_t *arbitration_id, uint8_t *
         // ISO14229USERDEBUG("%06d s<0x%03x [%02d]: ", g.ms, msg->arbId, g.serverRecvQueueIdx);
         // PRINTHEX(msg->data, msg->size);
         g.serverRecvQueueIdx--;
-        memmove(g.serverRecvQueue, &g.serverRecvQueue[1], sizeof(struct CANMessage));
+        memmove(g.serverRecvQueue, &g.serverRecvQueue[1],
+                g.serverRecvQueueIdx * sizeof(struct CANMessage));
         return kCANRxSome;
     }
     return kCANRxNone;
@@ -238,7 +243,7 @@ enum Iso14229CANRxStatus mockServerCANRxPoll(uint32_t *arbitration_id, uint8_t *
 
 void fixtureClientLinkProcess() {
     uint32_t arb_id;
-    uint8_t data[8], dlc;
+    uint8_t data[ISO_TP_MAX_DL], dlc;
 
     switch (mockClientCANRxPoll(&arb_id, data, &dlc)) {
     case kCANRxSome:
@@ -254,7 +259,7 @@ void fixtureClientLinkProcess() {
 
 void fixtureSrvLinksProcess() {
     uint32_t arb_id;
-    uint8_t data[8], dlc;
+    uint8_t data[ISO_TP_MAX_DL], dlc;
 
     switch (mockServerCANRxPoll(&arb_id, data, &dlc)) {
     case kCANRxSome:
@@ -278,10 +283,481 @@ void fixtureSrvLinksProcess() {
     isotp_poll(&g.srvFuncLink);
 }
 
+/**
+ * @brief Moves the frames sent by the client into an RX ring, as a CAN RX interrupt would
+ */
+void fixtureMoveServerQueueToRing(Iso14229CANRxRing *ring) {
+    for (int i = 0; i < g.serverRecvQueueIdx; i++) {
+        struct CANMessage *msg = &g.serverRecvQueue[i];
+        Iso14229CANRxRingPush(ring, msg->arbId, msg->data, msg->size);
+    }
+    g.serverRecvQueueIdx = 0;
+}
+
+// ================================================
+// ISO-TP tests
+// ================================================
+
+void testIsoTpCanFD() {
+    TEST_SETUP();
+    static uint8_t txBuf[5000], rxBuf[5000];
+    struct IsoTpLinkConfig clientCfg = CLIENT_LINK_DEFAULT_CONFIG;
+    struct IsoTpLinkConfig srvCfg = SRV_PHYS_LINK_DEFAULT_CONFIG;
+    clientCfg.send_buffer = txBuf;
+    clientCfg.send_buf_size = sizeof(txBuf);
+    srvCfg.recv_buffer = rxBuf;
+    srvCfg.recv_buf_size = sizeof(rxBuf);
+    IsoTpInitLink(&g.clientLink, &clientCfg);
+    IsoTpInitLink(&g.srvPhysLink, &srvCfg);
+    ASSERT_INT_EQUAL(isotp_set_tx_dl(&g.clientLink, 9), ISOTP_RET_LENGTH);
+    ASSERT_INT_EQUAL(isotp_set_tx_dl(&g.clientLink, 64), ISOTP_RET_OK);
+
+    for (unsigned int i = 0; i < sizeof(txBuf); i++) {
+        g.scratch[i % sizeof(g.scratch)] = (uint8_t)(i * 7);
+    }
+
+    // a 40 byte payload uses the single frame escape sequence and is padded to a 48 byte frame
+    ASSERT_INT_EQUAL(isotp_send(&g.clientLink, g.scratch, 40), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(g.serverRecvQueue[0].size, 48);
+    ASSERT_INT_EQUAL(g.serverRecvQueue[0].data[0], 0x00);
+    ASSERT_INT_EQUAL(g.serverRecvQueue[0].data[1], 40);
+    fixtureSrvLinksProcess();
+    ASSERT_INT_EQUAL(isotp_receive(&g.srvPhysLink, rxBuf, sizeof(rxBuf), &g.size), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(g.size, 40);
+    ASSERT_MEMORY_EQUAL(rxBuf, g.scratch, 40);
+
+    // payloads larger than 4095 bytes use the first frame escape sequence
+    for (unsigned int i = 0; i < sizeof(txBuf); i++) {
+        txBuf[i] = (uint8_t)(i * 7);
+    }
+    ASSERT_INT_EQUAL(isotp_send(&g.clientLink, txBuf, sizeof(txBuf)), ISOTP_RET_OK);
+    const uint8_t ESCAPED_FF[] = {0x10, 0x00, 0x00, 0x00, 0x13, 0x88};
+    ASSERT_INT_EQUAL(g.serverRecvQueue[0].size, 64);
+    ASSERT_MEMORY_EQUAL(g.serverRecvQueue[0].data, ESCAPED_FF, sizeof(ESCAPED_FF));
+
+    while (ISOTP_RECEIVE_STATUS_FULL != g.srvPhysLink.receive_status) {
+        fixtureSrvLinksProcess();
+        fixtureClientLinkProcess();
+        assert(g.ms++ < 1000);
+    }
+    ASSERT_INT_EQUAL(g.srvPhysLink.rx_dl, 64);
+    ASSERT_INT_EQUAL(isotp_receive(&g.srvPhysLink, rxBuf, sizeof(rxBuf), &g.size), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(g.size, sizeof(txBuf));
+    ASSERT_MEMORY_EQUAL(rxBuf, txBuf, sizeof(txBuf));
+    TEST_TEARDOWN();
+}
+
+void testIsoTpBurstSend() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+
+    // 100 bytes: a first frame carrying 6 bytes followed by 14 consecutive frames
+    ASSERT_INT_EQUAL(isotp_send(&g.clientLink, g.scratch, 100), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, 1);
+
+    // the receiver answers with a flow control frame allowing a block of 8 frames
+    fixtureSrvLinksProcess();
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+
+    // the whole block is sent in a single poll
+    fixtureClientLinkProcess();
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, 8);
+    ASSERT_INT_EQUAL(g.clientLink.send_bs_remain, 0);
+
+    // resetting the link and sending again, this time with unlimited block size
+    g.serverRecvQueueIdx = 0;
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    ASSERT_INT_EQUAL(isotp_send(&g.clientLink, g.scratch, 100), ISOTP_RET_OK);
+    const uint8_t FC_CTS_UNLIMITED[] = {0x30, 0x00, 0x00};
+    isotp_on_can_message(&g.clientLink, (uint8_t *)FC_CTS_UNLIMITED, sizeof(FC_CTS_UNLIMITED));
+
+    // the burst stops when the TX mailbox is full
+    isotp_poll(&g.clientLink);
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, CAN_MESSAGE_QUEUE_SIZE);
+    ASSERT_INT_EQUAL(g.clientLink.send_status, ISOTP_SEND_STATUS_INPROGRESS);
+
+    // and resumes on the next poll once there is space again
+    g.serverRecvQueueIdx = 0;
+    isotp_poll(&g.clientLink);
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, 14 - (CAN_MESSAGE_QUEUE_SIZE - 1));
+    ASSERT_INT_EQUAL(g.clientLink.send_status, ISOTP_SEND_STATUS_IDLE);
+    TEST_TEARDOWN();
+}
+
+void testIsoTpSendSegments() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    uint8_t a[5], b[20], c[3], expected[sizeof(a) + sizeof(b) + sizeof(c)];
+    for (unsigned i = 0; i < sizeof(expected); i++) {
+        expected[i] = i;
+    }
+    memmove(a, expected, sizeof(a));
+    memmove(b, expected + sizeof(a), sizeof(b));
+    memmove(c, expected + sizeof(a) + sizeof(b), sizeof(c));
+    const IsoTpSegment segments[] = {{a, sizeof(a)}, {b, sizeof(b)}, {c, sizeof(c)}};
+
+    // the segments are sent as one message without being copied into the send buffer
+    memset(g.clientLink.send_buffer, 0xFF, g.clientLink.send_buf_size);
+    ASSERT_INT_EQUAL(isotp_send_segments(&g.clientLink, g.clientLink.send_arbitration_id,
+                                         segments, 3),
+                     ISOTP_RET_OK);
+    while (ISOTP_RET_OK != isotp_receive(&g.srvPhysLink, g.scratch, sizeof(g.scratch), &g.size)) {
+        fixtureSrvLinksProcess();
+        fixtureClientLinkProcess();
+        assert(g.ms++ < 10);
+    }
+    ASSERT_INT_EQUAL(g.size, sizeof(expected));
+    ASSERT_MEMORY_EQUAL(g.scratch, expected, sizeof(expected));
+    ASSERT_INT_EQUAL(g.clientLink.send_buffer[0], 0xFF);
+
+    // too many segments
+    IsoTpSegment many[ISO_TP_MAX_SEND_SEGMENTS + 1] = {0};
+    ASSERT_INT_EQUAL(isotp_send_segments(&g.clientLink, g.clientLink.send_arbitration_id, many,
+                                         ISO_TP_MAX_SEND_SEGMENTS + 1),
+                     ISOTP_RET_OVERFLOW);
+    TEST_TEARDOWN();
+}
+
+void testIsoTpNextDeadline() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    uint32_t deadline = 0;
+
+    // an idle link has no deadline
+    ASSERT_INT_EQUAL(isotp_get_next_deadline(&g.clientLink, &deadline), 0);
+
+    // after the first frame, the sender waits for flow control until N_Bs
+    g.ms = 1000;
+    ASSERT_INT_EQUAL(isotp_send(&g.clientLink, g.scratch, 100), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(isotp_get_next_deadline(&g.clientLink, &deadline), 1);
+    ASSERT_INT_EQUAL(deadline, 1000 + ISO_TP_DEFAULT_RESPONSE_TIMEOUT);
+
+    // the receiver of the first frame waits for a consecutive frame until N_Cr
+    fixtureSrvLinksProcess();
+    ASSERT_INT_EQUAL(isotp_get_next_deadline(&g.srvPhysLink, &deadline), 1);
+    ASSERT_INT_EQUAL(deadline, 1000 + ISO_TP_DEFAULT_RESPONSE_TIMEOUT);
+
+    // with STmin = 10ms, the next consecutive frame is due 10ms after the previous one
+    g.clientRecvQueueIdx = 0;
+    const uint8_t FC_CTS_STMIN_10[] = {0x30, 0x00, 0x0A};
+    isotp_on_can_message(&g.clientLink, (uint8_t *)FC_CTS_STMIN_10, sizeof(FC_CTS_STMIN_10));
+    g.ms = 1020;
+    isotp_poll(&g.clientLink);
+    ASSERT_INT_EQUAL(isotp_get_next_deadline(&g.clientLink, &deadline), 1);
+    ASSERT_INT_EQUAL(deadline, 1020 + 10);
+    TEST_TEARDOWN();
+}
+
+void testIsoTpReceivePeek() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    const uint8_t *payload = NULL;
+    uint16_t size = 0;
+    uint8_t SF1[] = {0x02, 0x3E, 0x00};
+    uint8_t SF2[] = {0x02, 0x10, 0x03};
+    uint8_t FF[] = {0x10, 0x10, 0x2E, 0x01, 0x02, 0x03, 0x04, 0x05};
+
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_NO_DATA);
+    isotp_on_can_message(&g.srvPhysLink, SF1, sizeof(SF1));
+
+    // the message is lent out in place, without a copy
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_PTR_EQUAL((void *)payload, g.srvPhysLinkRxBuf);
+    ASSERT_INT_EQUAL(size, 2);
+
+    // while lent out, new messages do not overwrite it
+    isotp_on_can_message(&g.srvPhysLink, SF2, sizeof(SF2));
+    isotp_on_can_message(&g.srvPhysLink, FF, sizeof(FF));
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[0], 0x32); // FC.OVFLW
+    ASSERT_MEMORY_EQUAL(payload, SF1 + 1, 2);
+
+    // after release the next message is received
+    isotp_receive_release(&g.srvPhysLink);
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_NO_DATA);
+    isotp_on_can_message(&g.srvPhysLink, SF2, sizeof(SF2));
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_MEMORY_EQUAL(payload, SF2 + 1, 2);
+    TEST_TEARDOWN();
+}
+
+void testIsoTpReceiveDoubleBuffer() {
+    TEST_SETUP();
+    static uint8_t rxBuf2[DEFAULT_ISOTP_BUFSIZE];
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    isotp_set_receive_double_buffer(&g.srvPhysLink, rxBuf2);
+    const uint8_t *payload = NULL;
+    uint16_t size = 0;
+    uint8_t SF1[] = {0x02, 0x3E, 0x00};
+    uint8_t SF2[] = {0x02, 0x10, 0x03};
+    uint8_t SF3[] = {0x02, 0x11, 0x01};
+    uint8_t FF[] = {0x10, 0x0A, 0x2E, 0x01, 0x02, 0x03, 0x04, 0x05};
+    uint8_t CF[] = {0x21, 0x06, 0x07, 0x08, 0x09};
+
+    isotp_on_can_message(&g.srvPhysLink, SF1, sizeof(SF1));
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_MEMORY_EQUAL(payload, SF1 + 1, 2);
+
+    // while SF1 is lent out, SF2 is received into the second buffer and SF3 is dropped
+    isotp_on_can_message(&g.srvPhysLink, SF2, sizeof(SF2));
+    isotp_on_can_message(&g.srvPhysLink, SF3, sizeof(SF3));
+    ASSERT_MEMORY_EQUAL(payload, SF1 + 1, 2);
+
+    isotp_receive_release(&g.srvPhysLink);
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_PTR_EQUAL((void *)payload, rxBuf2);
+    ASSERT_MEMORY_EQUAL(payload, SF2 + 1, 2);
+
+    // a multi-frame message is assembled while SF2 is lent out
+    isotp_on_can_message(&g.srvPhysLink, FF, sizeof(FF));
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[0], 0x30); // FC.CTS
+    isotp_receive_release(&g.srvPhysLink);
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_NO_DATA);
+    isotp_on_can_message(&g.srvPhysLink, CF, sizeof(CF));
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_PTR_EQUAL((void *)payload, g.srvPhysLinkRxBuf);
+    ASSERT_INT_EQUAL(size, 10);
+    ASSERT_MEMORY_EQUAL(payload, FF + 2, 6);
+    ASSERT_MEMORY_EQUAL(payload + 6, CF + 1, 4);
+    isotp_receive_release(&g.srvPhysLink);
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_NO_DATA);
+    TEST_TEARDOWN();
+}
+
+void testIsoTpSetFlowControl() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    isotp_set_flow_control(&g.srvPhysLink, 0, 5);
+    uint8_t FF[] = {0x10, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    uint8_t CF[] = {0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+    // the first frame is answered with the configured BS and STmin
+    isotp_on_can_message(&g.srvPhysLink, FF, sizeof(FF));
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[0], 0x30);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[1], 0);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[2], 5);
+
+    // with block size 0, all consecutive frames follow without another flow control frame
+    for (uint8_t sn = 1; sn <= 14; sn++) {
+        CF[0] = 0x20 | (sn & 0x0F);
+        isotp_on_can_message(&g.srvPhysLink, CF, sizeof(CF));
+    }
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(isotp_receive(&g.srvPhysLink, g.scratch, sizeof(g.scratch), &g.size),
+                     ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(g.size, 100);
+    TEST_TEARDOWN();
+}
+
+static struct {
+    uint32_t id;
+    uint8_t count;
+    uint8_t buf[256];
+    uint16_t len;
+} pduSent;
+
+static int mockSendPDU(const uint32_t arbitration_id, const IsoTpSegment *segments,
+                       const uint8_t count) {
+    pduSent.id = arbitration_id;
+    pduSent.count = count;
+    pduSent.len = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        memmove(pduSent.buf + pduSent.len, segments[i].data, segments[i].len);
+        pduSent.len += segments[i].len;
+    }
+    return ISOTP_RET_OK;
+}
+
+void testIsoTpPDUMode() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    isotp_set_pdu_mode(&g.srvPhysLink, mockSendPDU);
+    memset(&pduSent, 0, sizeof(pduSent));
+    uint8_t msg[100];
+    for (uint8_t i = 0; i < sizeof(msg); i++) {
+        msg[i] = i;
+    }
+
+    // a multi-frame message is passed on whole, without CAN frames or flow control
+    ASSERT_INT_EQUAL(isotp_send(&g.srvPhysLink, msg, sizeof(msg)), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(pduSent.id, g.srvPhysLink.send_arbitration_id);
+    ASSERT_INT_EQUAL(pduSent.count, 1);
+    ASSERT_INT_EQUAL(pduSent.len, sizeof(msg));
+    ASSERT_MEMORY_EQUAL(pduSent.buf, msg, sizeof(msg));
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 0);
+    ASSERT_INT_EQUAL(g.srvPhysLink.send_status, ISOTP_SEND_STATUS_IDLE);
+
+    // and so are segments
+    const IsoTpSegment segments[] = {{msg, 3}, {msg + 3, 4}};
+    ASSERT_INT_EQUAL(isotp_send_segments(&g.srvPhysLink, 0x123, segments, 2), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(pduSent.id, 0x123);
+    ASSERT_INT_EQUAL(pduSent.count, 2);
+    ASSERT_INT_EQUAL(pduSent.len, 7);
+    ASSERT_MEMORY_EQUAL(pduSent.buf, msg, 7);
+
+    // a received message is complete at once
+    ASSERT_INT_EQUAL(isotp_on_pdu(&g.srvPhysLink, msg, sizeof(msg)), ISOTP_RET_OK);
+    const uint8_t *payload = NULL;
+    uint16_t size = 0;
+    ASSERT_INT_EQUAL(isotp_receive_peek(&g.srvPhysLink, &payload, &size), ISOTP_RET_OK);
+    ASSERT_INT_EQUAL(size, sizeof(msg));
+    ASSERT_MEMORY_EQUAL(payload, msg, sizeof(msg));
+
+    // no free buffer while it is lent out
+    ASSERT_INT_EQUAL(isotp_on_pdu(&g.srvPhysLink, msg, 1), ISOTP_RET_INPROGRESS);
+    isotp_receive_release(&g.srvPhysLink);
+    ASSERT_INT_EQUAL(isotp_receive(&g.srvPhysLink, g.scratch, sizeof(g.scratch), &g.size),
+                     ISOTP_RET_NO_DATA);
+
+    // larger than the receive buffer
+    ASSERT_INT_EQUAL(isotp_on_pdu(&g.srvPhysLink, g.scratch, g.srvPhysLink.receive_buf_size + 1),
+                     ISOTP_RET_OVERFLOW);
+    ASSERT_INT_EQUAL(isotp_receive(&g.srvPhysLink, g.scratch, sizeof(g.scratch), &g.size),
+                     ISOTP_RET_NO_DATA);
+    TEST_TEARDOWN();
+}
+
 // ================================================
 // Server tests
 // ================================================
 
+void testALFID() {
+    size_t memoryAddress = 0;
+    size_t memorySize = 0;
+    uint8_t buf[16];
+
+    // lengths of 0 or larger than size_t are invalid
+    ASSERT_INT_EQUAL(Iso14229ALFIDLength(0x44), 8);
+    ASSERT_INT_EQUAL(Iso14229ALFIDLength(0x40), 0);
+    ASSERT_INT_EQUAL(Iso14229ALFIDLength(0x04), 0);
+    ASSERT_INT_EQUAL(Iso14229ALFIDLength(0x90), 0);
+
+    // 4 byte addresses with the top bit set
+    const uint8_t FIELDS[] = {0xFF, 0x12, 0x34, 0x56, 0x01, 0x02};
+    Iso14229DecodeALFID(0x24, FIELDS, &memoryAddress, &memorySize);
+    ASSERT_INT_EQUAL(memoryAddress == 0xFF123456, 1);
+    ASSERT_INT_EQUAL(memorySize, 0x0102);
+
+    // encoding is the inverse
+    ASSERT_INT_EQUAL(Iso14229EncodeALFID(0x24, buf, 0xFF123456, 0x0102), 6);
+    ASSERT_MEMORY_EQUAL(buf, FIELDS, sizeof(FIELDS));
+
+    // and pads or truncates to the requested lengths
+    const uint8_t PADDED[] = {0x00, 0x00, 0x34, 0x56, 0x02};
+    ASSERT_INT_EQUAL(Iso14229EncodeALFID(0x14, buf, 0x3456, 0x0102), 5);
+    ASSERT_MEMORY_EQUAL(buf, PADDED, sizeof(PADDED));
+}
+
+void testDigest() {
+    Iso14229Digest d;
+    uint8_t out[ISO14229_DIGEST_MAX_LEN];
+    static uint8_t data[1000];
+    for (int i = 0; i < 1000; i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+
+    // CRC-32 check value
+    Iso14229DigestInit(&d, kIso14229DigestCRC32);
+    Iso14229DigestUpdate(&d, (const uint8_t *)"123456789", 9);
+    ASSERT_INT_EQUAL(Iso14229DigestFinal(&d, out), 4);
+    const uint8_t CRCCheck[] = {0xCB, 0xF4, 0x39, 0x26};
+    ASSERT_MEMORY_EQUAL(out, CRCCheck, sizeof(CRCCheck));
+
+    // CRC-32 updated in pieces
+    Iso14229DigestInit(&d, kIso14229DigestCRC32);
+    Iso14229DigestUpdate(&d, data, 333);
+    Iso14229DigestUpdate(&d, data + 333, 667);
+    Iso14229DigestFinal(&d, out);
+    const uint8_t CRCPattern[] = {0x11, 0x4A, 0xD5, 0xFF};
+    ASSERT_MEMORY_EQUAL(out, CRCPattern, sizeof(CRCPattern));
+
+    // SHA-256 of "abc" (FIPS 180-2 example)
+    Iso14229DigestInit(&d, kIso14229DigestSHA256);
+    Iso14229DigestUpdate(&d, (const uint8_t *)"abc", 3);
+    ASSERT_INT_EQUAL(Iso14229DigestFinal(&d, out), 32);
+    const uint8_t SHAabc[] = {
+        0xBA, 0x78, 0x16, 0xBF, 0x8F, 0x01, 0xCF, 0xEA, 0x41, 0x41, 0x40, 0xDE, 0x5D, 0xAE, 0x22,
+        0x23, 0xB0, 0x03, 0x61, 0xA3, 0x96, 0x17, 0x7A, 0x9C, 0xB4, 0x10, 0xFF, 0x61, 0xF2, 0x00,
+        0x15, 0xAD};
+    ASSERT_MEMORY_EQUAL(out, SHAabc, sizeof(SHAabc));
+
+    // SHA-256 updated in pieces that do not line up with its 64 byte blocks
+    Iso14229DigestInit(&d, kIso14229DigestSHA256);
+    for (int i = 0; i < 1000; i += 37) {
+        Iso14229DigestUpdate(&d, data + i, 1000 - i < 37 ? 1000 - i : 37);
+    }
+    Iso14229DigestFinal(&d, out);
+    const uint8_t SHAPattern[] = {
+        0x89, 0xF4, 0xFF, 0x56, 0xA2, 0x5D, 0xD1, 0xDB, 0x06, 0xA4, 0xCE, 0x60, 0x33, 0x60, 0x37,
+        0x75, 0xD7, 0x05, 0xFB, 0x96, 0xF3, 0x0F, 0x86, 0x93, 0x73, 0x3F, 0xEF, 0x60, 0x2A, 0x1C,
+        0xA5, 0x32};
+    ASSERT_MEMORY_EQUAL(out, SHAPattern, sizeof(SHAPattern));
+}
+
+// runs of equal bytes with an incompressible stretch every 2 KiB
+static uint8_t testLZSSImageByte(size_t i) {
+    if (3 == (i / 512) % 4) {
+        return (uint8_t)((i * 2654435761u) >> 13);
+    }
+    return (uint8_t)(i / 64);
+}
+
+void testLZSS() {
+    static Iso14229LZSSEncoder enc;
+    static Iso14229LZSSDecoder dec;
+    static uint8_t compressed[20000];
+    static uint8_t decoded[20000];
+    const size_t imageSize = 20000;
+    size_t read = 0, clen = 0, dlen = 0;
+
+    // compressing the image fed in odd sized pieces
+    Iso14229LZSSEncoderInit(&enc);
+    for (;;) {
+        uint16_t space;
+        uint8_t *buf = Iso14229LZSSEncoderBuffer(&enc, &space);
+        uint16_t n = imageSize - read < 333 ? imageSize - read : 333;
+        if (n > space) {
+            n = space;
+        }
+        for (uint16_t i = 0; i < n; i++) {
+            buf[i] = testLZSSImageByte(read + i);
+        }
+        Iso14229LZSSEncoderCommit(&enc, n);
+        read += n;
+        bool final = read == imageSize;
+        uint16_t out = Iso14229LZSSEncode(&enc, compressed + clen, 61, final);
+        clen += out;
+        if (final && 0 == out) {
+            break;
+        }
+    }
+
+    // shrinks it by more than half
+    assert(clen < imageSize / 2);
+
+    // and decoding it in odd sized pieces gives the image back
+    Iso14229LZSSDecoderInit(&dec);
+    for (size_t off = 0; off < clen || dlen < imageSize;) {
+        uint16_t len = clen - off < 77 ? clen - off : 77;
+        const uint8_t *out;
+        uint16_t outLen;
+        off += Iso14229LZSSDecode(&dec, compressed + off, len, &out, &outLen);
+        assert(dlen + outLen <= imageSize);
+        memcpy(decoded + dlen, out, outLen);
+        dlen += outLen;
+        if (off == clen && 0 == outLen) {
+            break;
+        }
+    }
+    ASSERT_INT_EQUAL(dlen, imageSize);
+    for (size_t i = 0; i < imageSize; i++) {
+        ASSERT_INT_EQUAL(decoded[i], testLZSSImageByte(i));
+    }
+}
+
 void testServerInit() {
     TEST_SETUP();
     Iso14229Server srv;
@@ -290,6 +766,117 @@ void testServerInit() {
     TEST_TEARDOWN();
 }
 
+void testServerCANRxRing() {
+    TEST_SETUP();
+    static Iso14229CANRxRing ring;
+    Iso14229CANRxRingInit(&ring);
+
+    // the ring holds ISO14229_CAN_RX_RING_SIZE frames and keeps working across wrap-around
+    const uint8_t FRAME[] = {0x02, 0x3E, 0x00};
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < ISO14229_CAN_RX_RING_SIZE; i++) {
+            assert(Iso14229CANRxRingPush(&ring, i, FRAME, sizeof(FRAME)));
+        }
+        assert(!Iso14229CANRxRingPush(&ring, 0, FRAME, sizeof(FRAME)));
+        for (int i = 0; i < ISO14229_CAN_RX_RING_SIZE; i++) {
+            const struct Iso14229CANFrame *frame = Iso14229CANRxRingPeek(&ring);
+            assert(frame);
+            ASSERT_INT_EQUAL(frame->arb_id, i);
+            ASSERT_INT_EQUAL(frame->size, sizeof(FRAME));
+            Iso14229CANRxRingPop(&ring);
+        }
+        ASSERT_PTR_EQUAL((void *)Iso14229CANRxRingPeek(&ring), NULL);
+    }
+    ASSERT_INT_EQUAL(ring.dropped, 3);
+
+    // a server reading from the ring
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userCANRxPoll = NULL;
+    cfg.rxRing = &ring;
+    cfg.userRDBIHandler = mockUserRdbiHandler;
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    // sending a multi-frame request. The frames are moved into the ring as the driver would.
+    const uint8_t REQUEST[] = {0x22, 0xF1, 0x90, 0x01, 0x0A, 0x01, 0x10, 0xF1, 0x90};
+    isotp_send(&g.clientLink, REQUEST, sizeof(REQUEST));
+    fixtureMoveServerQueueToRing(&ring);
+    Iso14229ServerPoll(&server);
+
+    // the client receives the flow control frame and sends the rest of the request
+    fixtureClientLinkProcess();
+    fixtureMoveServerQueueToRing(&ring);
+
+    // a single poll drains the ring and handles the request
+    Iso14229ServerPoll(&server);
+    ASSERT_PTR_EQUAL((void *)Iso14229CANRxRingPeek(&ring), NULL);
+    while (ISOTP_RET_OK != isotp_receive(&g.clientLink, g.scratch, sizeof(g.scratch), &g.size)) {
+        fixtureMoveServerQueueToRing(&ring);
+        Iso14229ServerPoll(&server);
+        fixtureClientLinkProcess();
+        assert(g.ms++ < 10);
+    }
+    ASSERT_INT_EQUAL(g.scratch[0], 0x62);
+    ASSERT_INT_EQUAL(g.size, 1 + 4 * 2 + 17 + 11 + 1 + 17);
+    TEST_TEARDOWN();
+}
+
+void testServerDrainsCANRxQueue() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    Iso14229ServerInit(&server, &cfg);
+
+    // several frames waiting in the driver queue
+    const uint8_t TESTER_PRESENT[] = {0x02, 0x3E, 0x80};
+    for (int i = 0; i < 4; i++) {
+        mockClientSendCAN(SERVER_FUNC_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    }
+
+    // are all taken in one poll
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, 0);
+    TEST_TEARDOWN();
+}
+
+void testServerGetTimeoutms() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userCANRxPoll = NULL; // frames are passed in as they arrive
+    Iso14229ServerInit(&server, &cfg);
+
+    // an idle server in the default session has nothing scheduled
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), UINT32_MAX);
+
+    // outside the default session, the next deadline is the S3 timeout
+    server.nodes[0].status.sessionType = kExtendedDiagnostic;
+    server.nodes[0].s3_session_timeout_timer = g.ms + 100;
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), 101);
+
+    // a complete request is processed by the next poll
+    const uint8_t TESTER_PRESENT[] = {0x02, 0x3E, 0x00};
+    Iso14229ServerReceiveCANFrame(&server, SERVER_PHYS_RECV_ID, TESTER_PRESENT,
+                                  sizeof(TESTER_PRESENT));
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), 0);
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t RESP[] = {0x02, 0x7E, 0x00};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, RESP, sizeof(RESP));
+
+    // which restarted S3
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), cfg.s3_ms + 1);
+
+    // a first frame: the server waits for the next consecutive frame until N_Cr
+    g.ms += 10;
+    const uint8_t FF[] = {0x10, 0x09, 0x22, 0xF1, 0x90, 0x01, 0x0A, 0x01};
+    Iso14229ServerReceiveCANFrame(&server, SERVER_PHYS_RECV_ID, FF, sizeof(FF));
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), ISO_TP_DEFAULT_RESPONSE_TIMEOUT + 1);
+    TEST_TEARDOWN();
+}
+
 void testServer0x10DiagnosticSessionControlIsDisabledByDefault() {
     TEST_SETUP();
     Iso14229Server server;
@@ -388,6 +975,537 @@ void testServer0x22RDBI1() {
     TEST_TEARDOWN();
 }
 
+enum Iso14229ResponseCode mockDIDRead(const struct Iso14229ServerStatus *status,
+                                      const struct Iso14229DataIdentifier *entry, uint8_t *buf,
+                                      uint16_t *len) {
+    (void)status;
+    (void)entry;
+    assert(*len >= 1);
+    buf[0] = 0xCC;
+    *len = 1;
+    return kPositiveResponse;
+}
+
+void testServer0x22DIDTable() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    uint8_t did0100 = 0xAA;
+    uint8_t did0300 = 0x55;
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0x0100,
+         .len = 1,
+         .data = &did0100,
+         .readSessions = ISO14229_ALL_SESSIONS,
+         .writeSessions = ISO14229_SESSION_BIT(kDefaultSession)},
+        {.did = 0x0200, .len = 1, .readSessions = ISO14229_ALL_SESSIONS, .read = mockDIDRead},
+        {.did = 0x0300,
+         .len = 1,
+         .data = &did0300,
+         .readSessions = ISO14229_ALL_SESSIONS,
+         .readSecurityLevel = 2},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    Iso14229ServerInit(&server, &cfg);
+
+    // several DIDs are answered in one response without a user handler
+    const uint8_t REQ_MULTI[] = {0x05, 0x22, 0x01, 0x00, 0x02, 0x00};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_MULTI, sizeof(REQ_MULTI));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t RESP_MULTI[] = {0x07, 0x62, 0x01, 0x00, 0xAA, 0x02, 0x00, 0xCC};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, RESP_MULTI, sizeof(RESP_MULTI));
+
+    // a locked DID gets securityAccessDenied
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_LOCKED[] = {0x03, 0x22, 0x03, 0x00};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_LOCKED, sizeof(REQ_LOCKED));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x33[] = {0x03, 0x7F, 0x22, 0x33};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x33, sizeof(NRC_0x33));
+
+    // an unknown DID gets requestOutOfRange
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_UNKNOWN[] = {0x03, 0x22, 0x01, 0x01};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_UNKNOWN, sizeof(REQ_UNKNOWN));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x31[] = {0x03, 0x7F, 0x22, 0x31};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x31, sizeof(NRC_0x31));
+
+    // a writable DID is copied to its data record
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_WRITE[] = {0x04, 0x2E, 0x01, 0x00, 0x42};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_WRITE, sizeof(REQ_WRITE));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t RESP_WRITE[] = {0x03, 0x6E, 0x01, 0x00};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, RESP_WRITE, sizeof(RESP_WRITE));
+    ASSERT_INT_EQUAL(did0100, 0x42);
+
+    // a read-only DID is not written
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_WRITE_RO[] = {0x04, 0x2E, 0x02, 0x00, 0x42};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_WRITE_RO, sizeof(REQ_WRITE_RO));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_WRITE_RO[] = {0x03, 0x7F, 0x2E, 0x31};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_WRITE_RO, sizeof(NRC_WRITE_RO));
+    TEST_TEARDOWN();
+}
+
+void testServer0x22ScatterGather() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    static uint8_t record[20];
+    static uint8_t huge[DEFAULT_ISOTP_BUFSIZE];
+    for (unsigned i = 0; i < sizeof(record); i++) {
+        record[i] = i;
+    }
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0x0100, .len = sizeof(record), .data = record, .readSessions = 0xFF},
+        {.did = 0x0200, .len = 1, .readSessions = 0xFF, .read = mockDIDRead},
+        {.did = 0x0300, .len = sizeof(huge), .data = huge, .readSessions = 0xFF},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    // the record is sent from where it is, around the DID headers in the send buffer
+    const uint8_t REQ[] = {0x22, 0x02, 0x00, 0x01, 0x00, 0x02, 0x00};
+    isotp_send(&g.clientLink, REQ, sizeof(REQ));
+    while (ISOTP_RET_OK != isotp_receive(&g.clientLink, g.scratch, sizeof(g.scratch), &g.size)) {
+        Iso14229ServerPoll(&server);
+        fixtureClientLinkProcess();
+        assert(g.ms++ < 10);
+    }
+    ASSERT_INT_EQUAL(g.size, 1 + 3 + 2 + sizeof(record) + 3);
+    const uint8_t HEAD[] = {0x62, 0x02, 0x00, 0xCC, 0x01, 0x00};
+    const uint8_t TAIL[] = {0x02, 0x00, 0xCC};
+    ASSERT_MEMORY_EQUAL(g.scratch, HEAD, sizeof(HEAD));
+    ASSERT_MEMORY_EQUAL(g.scratch + sizeof(HEAD), record, sizeof(record));
+    ASSERT_MEMORY_EQUAL(g.scratch + sizeof(HEAD) + sizeof(record), TAIL, sizeof(TAIL));
+    ASSERT_INT_EQUAL(g.srvPhysLink.send_segment_count, 3);
+
+    // a response larger than the send buffer is refused before any record is read
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_HUGE[] = {0x03, 0x22, 0x03, 0x00};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_HUGE, sizeof(REQ_HUGE));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x14[] = {0x03, 0x7F, 0x22, 0x14};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x14, sizeof(NRC_0x14));
+    TEST_TEARDOWN();
+}
+
+void testServer0x2APeriodic() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    uint8_t didF201 = 0xAA;
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0xF201, .len = 1, .data = &didF201, .readSessions = ISO14229_ALL_SESSIONS},
+        {.did = 0xF202, .len = 1, .readSessions = ISO14229_ALL_SESSIONS, .read = mockDIDRead},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    cfg.periodic_send_id = 0x7;
+    cfg.periodic_slow_ms = 100;
+    cfg.periodic_fast_ms = 10;
+    Iso14229ServerInit(&server, &cfg);
+
+    // not available in the default session
+    const uint8_t REQ_FAST[] = {0x04, 0x2A, 0x03, 0x01, 0x02};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_FAST, sizeof(REQ_FAST));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x7F[] = {0x03, 0x7F, 0x2A, 0x7F};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x7F, sizeof(NRC_0x7F));
+
+    // scheduling at the fast rate: the response is followed by the first periodic messages
+    server.nodes[0].status.sessionType = kExtendedDiagnostic;
+    g.clientRecvQueueIdx = 0;
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_FAST, sizeof(REQ_FAST));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 3);
+    const uint8_t RESP[] = {0x01, 0x6A};
+    const uint8_t PERIODIC_01[] = {0x01, 0xAA};
+    const uint8_t PERIODIC_02[] = {0x02, 0xCC};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, RESP, sizeof(RESP));
+    ASSERT_INT_EQUAL(g.clientRecvQueue[1].arbId, 0x7);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[1].size, sizeof(PERIODIC_01));
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[1].data, PERIODIC_01, sizeof(PERIODIC_01));
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[2].data, PERIODIC_02, sizeof(PERIODIC_02));
+
+    // nothing is sent before the period has elapsed
+    g.clientRecvQueueIdx = 0;
+    g.ms += 5;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 0);
+
+    // the next messages keep the phase of the first ones
+    g.ms += 5;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    ASSERT_INT_EQUAL(server.nodes[0].periodic[0].due, g.ms + 10);
+
+    // 0x01 moves to the slow rate, behind 0x02
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_SLOW[] = {0x03, 0x2A, 0x01, 0x01};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_SLOW, sizeof(REQ_SLOW));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(server.nodes[0].numPeriodic, 2);
+    ASSERT_INT_EQUAL(server.nodes[0].periodic[0].pdid, 0x02);
+    ASSERT_INT_EQUAL(server.nodes[0].periodic[1].pdid, 0x01);
+    ASSERT_INT_EQUAL(server.nodes[0].periodic[1].period_ms, 100);
+
+    // stopping all periodic transmissions
+    g.clientRecvQueueIdx = 0;
+    const uint8_t REQ_STOP[] = {0x02, 0x2A, 0x04};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_STOP, sizeof(REQ_STOP));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(server.nodes[0].numPeriodic, 0);
+    g.clientRecvQueueIdx = 0;
+    g.ms += 200;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 0);
+
+    // an unknown periodicDataIdentifier gets requestOutOfRange
+    const uint8_t REQ_UNKNOWN[] = {0x03, 0x2A, 0x03, 0x09};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_UNKNOWN, sizeof(REQ_UNKNOWN));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x31[] = {0x03, 0x7F, 0x2A, 0x31};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x31, sizeof(NRC_0x31));
+
+    // without a periodic_send_id nothing is scheduled: the periodic frames would be sent on
+    // send_id, where the client takes them for ISO-TP frames
+    cfg.periodic_send_id = 0;
+    Iso14229ServerInit(&server, &cfg);
+    server.nodes[0].status.sessionType = kExtendedDiagnostic;
+    g.clientRecvQueueIdx = 0;
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQ_FAST, sizeof(REQ_FAST));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x22[] = {0x03, 0x7F, 0x2A, 0x22};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x22, sizeof(NRC_0x22));
+    ASSERT_INT_EQUAL(server.nodes[0].numPeriodic, 0);
+    g.ms += 200;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    TEST_TEARDOWN();
+}
+
+// send a request on the client link and run the server until the client has the response
+static void fixtureServerExchange(Iso14229Server *server, const uint8_t *req, uint16_t len) {
+    uint32_t start = g.ms;
+    isotp_send(&g.clientLink, req, len);
+    while (ISOTP_RET_OK != isotp_receive(&g.clientLink, g.scratch, sizeof(g.scratch), &g.size)) {
+        Iso14229ServerPoll(server);
+        fixtureClientLinkProcess();
+        assert(g.ms++ - start < 100);
+    }
+}
+
+#if ISO14229_SERVER_METRICS && ISO_TP_METRICS
+static uint32_t metricAt(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void testServerMetrics() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    uint8_t did0100[] = {0x01, 0x02, 0x03, 0x04};
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0x0100, .len = 4, .data = did0100, .readSessions = ISO14229_ALL_SESSIONS},
+        {.did = 0xF1F0,
+         .len = 512,
+         .data = &server,
+         .readSessions = ISO14229_ALL_SESSIONS,
+         .read = Iso14229ServerMetricsRead},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    // histogram buckets are powers of two
+    IsoTpHistogram h = {0};
+    isotp_histogram_add(&h, 0);
+    isotp_histogram_add(&h, 1);
+    isotp_histogram_add(&h, 3);
+    isotp_histogram_add(&h, 4);
+    isotp_histogram_add(&h, 100000);
+    ASSERT_INT_EQUAL(h.count[0], 1);
+    ASSERT_INT_EQUAL(h.count[1], 1);
+    ASSERT_INT_EQUAL(h.count[2], 1);
+    ASSERT_INT_EQUAL(h.count[3], 1);
+    ASSERT_INT_EQUAL(h.count[ISOTP_HISTOGRAM_BUCKETS - 1], 1);
+    ASSERT_INT_EQUAL(h.max, 100000);
+
+    // A positive response, an unsupported service and an unknown SID
+    const uint8_t READ_0100[] = {0x22, 0x01, 0x00};
+    const uint8_t CLEAR_DTC[] = {0x14, 0xFF, 0xFF, 0xFF};
+    const uint8_t UNKNOWN[] = {0xBA};
+    fixtureServerExchange(&server, READ_0100, sizeof(READ_0100));
+    fixtureServerExchange(&server, CLEAR_DTC, sizeof(CLEAR_DTC));
+    fixtureServerExchange(&server, UNKNOWN, sizeof(UNKNOWN));
+
+    // are counted per service and NRC
+    const Iso14229ServerMetrics *m = &server.metrics;
+    ASSERT_INT_EQUAL(m->requests[kIso14229MetricsSID_READ_DATA_BY_IDENTIFIER], 1);
+    ASSERT_INT_EQUAL(m->negativeResponses[kIso14229MetricsSID_READ_DATA_BY_IDENTIFIER], 0);
+    ASSERT_INT_EQUAL(m->requests[kIso14229MetricsSID_CLEAR_DIAGNOSTIC_INFORMATION], 1);
+    ASSERT_INT_EQUAL(m->requests[kIso14229MetricsOtherSID], 1);
+    ASSERT_INT_EQUAL(m->negativeResponses[kIso14229MetricsOtherSID], 1);
+    ASSERT_INT_EQUAL(m->nrcs[ISO14229_SERVER_METRICS_NRC_SLOT(kServiceNotSupported)], 2);
+    // and each request is answered in the poll that finds it
+    ASSERT_INT_EQUAL(m->latency.count[0], 3);
+
+    // Reading the metrics DID returns a multi-frame record
+    const uint8_t READ_METRICS[] = {0x22, 0xF1, 0xF0};
+    fixtureServerExchange(&server, READ_METRICS, sizeof(READ_METRICS));
+    ASSERT_INT_EQUAL(g.scratch[0], 0x62);
+    const uint8_t *rec = g.scratch + 3;
+    ASSERT_INT_EQUAL(metricAt(rec), 3);     // requests before this one
+    ASSERT_INT_EQUAL(metricAt(rec + 4), 2); // negative responses
+    const uint8_t *sids = rec + 12 + 4 * (ISOTP_HISTOGRAM_BUCKETS + 1);
+    ASSERT_INT_EQUAL(sids[0], 3);
+    ASSERT_INT_EQUAL(sids[1], 0x14); // in ISO14229_SID_LIST order, SIDs the server doesn't know last
+    ASSERT_INT_EQUAL(sids[10], 0x22);
+    ASSERT_INT_EQUAL(sids[19], 0x00);
+    const uint8_t *nrcs = sids + 1 + 9 * 3;
+    ASSERT_INT_EQUAL(nrcs[0], 1);
+    ASSERT_INT_EQUAL(nrcs[1], kServiceNotSupported);
+    ASSERT_INT_EQUAL(metricAt(nrcs + 2), 2);
+    ASSERT_INT_EQUAL(g.size, (nrcs + 6 - g.scratch) + 16 + 3 * 4 * (ISOTP_HISTOGRAM_BUCKETS + 1));
+
+    // The ISO-TP link counted the consecutive frames of that response and the flow control waits,
+    // one per block of ISO_TP_DEFAULT_BLOCK_SIZE frames
+    const IsoTpLinkMetrics *link = &server.nodes[0].phys_link->metrics;
+    ASSERT_INT_EQUAL(link->cf_sent, (g.size - 6 + 6) / 7);
+    uint32_t fcWaits = 0;
+    for (int i = 0; i < ISOTP_HISTOGRAM_BUCKETS; i++) {
+        fcWaits += link->fc_wait.count[i];
+    }
+    ASSERT_INT_EQUAL(fcWaits,
+                     (link->cf_sent + ISO_TP_DEFAULT_BLOCK_SIZE - 1) / ISO_TP_DEFAULT_BLOCK_SIZE);
+
+    // A first frame which is never continued is an N_Cr timeout
+    const uint8_t FIRST_FRAME[] = {0x10, 0x0A, 0x22, 0x01, 0x00, 0x01, 0x00, 0x01};
+    isotp_on_can_message(server.nodes[0].phys_link, (uint8_t *)FIRST_FRAME, sizeof(FIRST_FRAME));
+    for (int i = 0; i < ISO_TP_DEFAULT_RESPONSE_TIMEOUT + 2; i++) {
+        g.ms++;
+        Iso14229ServerPoll(&server);
+    }
+    ASSERT_INT_EQUAL(link->n_cr_timeouts, 1);
+    TEST_TEARDOWN();
+}
+#endif
+
+void testServer0x2CDynamicDID() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    uint8_t did0100[] = {0x01, 0x02, 0x03, 0x04};
+    uint8_t did0200[] = {0x05, 0x06};
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0x0100, .len = 4, .data = did0100, .readSessions = ISO14229_ALL_SESSIONS},
+        {.did = 0x0200, .len = 2, .data = did0200, .readSessions = ISO14229_ALL_SESSIONS},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    // 0xF201 := 0x0100[1..2] + 0x0100[3] + 0x0200[0..1]
+    const uint8_t DEFINE_F201[] = {0x2C, 0x01, 0xF2, 0x01, 0x01, 0x00, 0x02, 0x02,
+                                   0x01, 0x00, 0x04, 0x01, 0x02, 0x00, 0x01, 0x02};
+    fixtureServerExchange(&server, DEFINE_F201, sizeof(DEFINE_F201));
+    const uint8_t DEFINE_F201_RESP[] = {0x6C, 0x01, 0xF2, 0x01};
+    ASSERT_INT_EQUAL(g.size, sizeof(DEFINE_F201_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, DEFINE_F201_RESP, sizeof(DEFINE_F201_RESP));
+
+    // the adjacent ranges of 0x0100 were compiled into one copy step
+    ASSERT_INT_EQUAL(server.nodes[0].dynamicDIDs[0].numSteps, 2);
+    ASSERT_INT_EQUAL(server.nodes[0].dynamicDIDs[0].entry.len, 5);
+
+    // reading it copies the current source data
+    did0100[1] = 0x22;
+    const uint8_t READ_F201[] = {0x22, 0xF2, 0x01};
+    fixtureServerExchange(&server, READ_F201, sizeof(READ_F201));
+    const uint8_t READ_F201_RESP[] = {0x62, 0xF2, 0x01, 0x22, 0x03, 0x04, 0x05, 0x06};
+    ASSERT_INT_EQUAL(g.size, sizeof(READ_F201_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, READ_F201_RESP, sizeof(READ_F201_RESP));
+
+    // a second definition survives clearing the first one
+    const uint8_t DEFINE_F202[] = {0x2C, 0x01, 0xF2, 0x02, 0x02, 0x00, 0x02, 0x01};
+    fixtureServerExchange(&server, DEFINE_F202, sizeof(DEFINE_F202));
+    const uint8_t CLEAR_F201[] = {0x2C, 0x03, 0xF2, 0x01};
+    fixtureServerExchange(&server, CLEAR_F201, sizeof(CLEAR_F201));
+    ASSERT_INT_EQUAL(server.nodes[0].numDDDISteps, 1);
+    const uint8_t READ_F202[] = {0x22, 0xF2, 0x02};
+    fixtureServerExchange(&server, READ_F202, sizeof(READ_F202));
+    const uint8_t READ_F202_RESP[] = {0x62, 0xF2, 0x02, 0x06};
+    ASSERT_INT_EQUAL(g.size, sizeof(READ_F202_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, READ_F202_RESP, sizeof(READ_F202_RESP));
+
+    // a source range outside of the source record is refused
+    const uint8_t DEFINE_BAD[] = {0x2C, 0x01, 0xF2, 0x03, 0x02, 0x00, 0x02, 0x02};
+    fixtureServerExchange(&server, DEFINE_BAD, sizeof(DEFINE_BAD));
+    const uint8_t NRC_0x31[] = {0x7F, 0x2C, 0x31};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+
+    // clearing all definitions
+    const uint8_t CLEAR_ALL[] = {0x2C, 0x03};
+    fixtureServerExchange(&server, CLEAR_ALL, sizeof(CLEAR_ALL));
+    const uint8_t CLEAR_ALL_RESP[] = {0x6C, 0x03};
+    ASSERT_INT_EQUAL(g.size, sizeof(CLEAR_ALL_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, CLEAR_ALL_RESP, sizeof(CLEAR_ALL_RESP));
+    fixtureServerExchange(&server, READ_F202, sizeof(READ_F202));
+    const uint8_t READ_NRC_0x31[] = {0x7F, 0x22, 0x31};
+    ASSERT_MEMORY_EQUAL(g.scratch, READ_NRC_0x31, sizeof(READ_NRC_0x31));
+    TEST_TEARDOWN();
+}
+
+static uint8_t testServerMemory[64];
+static uint8_t testServerWriteOnlyMemory[8];
+
+static enum Iso14229ResponseCode mockMemoryRead(const struct Iso14229ServerStatus *status,
+                                                const Iso14229MemoryRegion *region, size_t offset,
+                                                uint8_t *buf, uint16_t len) {
+    (void)status;
+    (void)region;
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = 0x80 + offset + i;
+    }
+    return kPositiveResponse;
+}
+
+static const Iso14229MemoryRegion testServerMemoryRegions[] = {
+    {.base = 0x1000,
+     .size = sizeof(testServerMemory),
+     .data = testServerMemory,
+     .readSessions = ISO14229_ALL_SESSIONS},
+    {.base = 0x2000, .size = 16, .read = mockMemoryRead, .readSessions = ISO14229_ALL_SESSIONS,
+     .readSecurityLevel = 1},
+    {.base = 0xFF003000,
+     .size = sizeof(testServerWriteOnlyMemory),
+     .data = testServerWriteOnlyMemory,
+     .writeSessions = ISO14229_ALL_SESSIONS},
+};
+
+void testServer0x23ReadMemoryByAddress() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.memoryRegions = testServerMemoryRegions;
+    cfg.numMemoryRegions = ARRAY_SZ(testServerMemoryRegions);
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    for (unsigned i = 0; i < sizeof(testServerMemory); i++) {
+        testServerMemory[i] = i;
+    }
+
+    // a multi-frame response sent straight from the region
+    const uint8_t READ_0x1010[] = {0x23, 0x12, 0x10, 0x10, 0x20};
+    fixtureServerExchange(&server, READ_0x1010, sizeof(READ_0x1010));
+    ASSERT_INT_EQUAL(g.size, 1 + 0x20);
+    ASSERT_INT_EQUAL(g.scratch[0], 0x63);
+    ASSERT_MEMORY_EQUAL(&g.scratch[1], &testServerMemory[0x10], 0x20);
+
+    // reads must not run past the end of a region
+    const uint8_t READ_PAST_END[] = {0x23, 0x12, 0x10, 0x30, 0x11};
+    fixtureServerExchange(&server, READ_PAST_END, sizeof(READ_PAST_END));
+    const uint8_t NRC_0x31[] = {0x7F, 0x23, 0x31};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+
+    // nor below the first region, nor in a region that is not readable
+    const uint8_t READ_LOW[] = {0x23, 0x12, 0x00, 0x10, 0x01};
+    fixtureServerExchange(&server, READ_LOW, sizeof(READ_LOW));
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+    const uint8_t READ_WRITE_ONLY[] = {0x23, 0x14, 0xFF, 0x00, 0x30, 0x00, 0x01};
+    fixtureServerExchange(&server, READ_WRITE_ONLY, sizeof(READ_WRITE_ONLY));
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+
+    // the accessor of a protected region requires its security level
+    const uint8_t READ_0x2004[] = {0x23, 0x12, 0x20, 0x04, 0x02};
+    fixtureServerExchange(&server, READ_0x2004, sizeof(READ_0x2004));
+    const uint8_t NRC_0x33[] = {0x7F, 0x23, 0x33};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x33, sizeof(NRC_0x33));
+    server.nodes[0].status.securityLevel = 1;
+    fixtureServerExchange(&server, READ_0x2004, sizeof(READ_0x2004));
+    const uint8_t READ_0x2004_RESP[] = {0x63, 0x84, 0x85};
+    ASSERT_INT_EQUAL(g.size, sizeof(READ_0x2004_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, READ_0x2004_RESP, sizeof(READ_0x2004_RESP));
+
+    // malformed requests
+    const uint8_t BAD_ALFID[] = {0x23, 0x02, 0x10, 0x00};
+    fixtureServerExchange(&server, BAD_ALFID, sizeof(BAD_ALFID));
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+    const uint8_t BAD_LEN[] = {0x23, 0x12, 0x10, 0x00, 0x01, 0x00};
+    fixtureServerExchange(&server, BAD_LEN, sizeof(BAD_LEN));
+    const uint8_t NRC_0x13[] = {0x7F, 0x23, 0x13};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x13, sizeof(NRC_0x13));
+
+    // a dynamic DID defined by memory address
+    const uint8_t DEFINE_F210[] = {0x2C, 0x02, 0xF2, 0x10, 0x12, 0x10, 0x02,
+                                   0x02, 0x10, 0x04, 0x01, 0x10, 0x00, 0x01};
+    fixtureServerExchange(&server, DEFINE_F210, sizeof(DEFINE_F210));
+    const uint8_t DEFINE_F210_RESP[] = {0x6C, 0x02, 0xF2, 0x10};
+    ASSERT_INT_EQUAL(g.size, sizeof(DEFINE_F210_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, DEFINE_F210_RESP, sizeof(DEFINE_F210_RESP));
+    ASSERT_INT_EQUAL(server.nodes[0].dynamicDIDs[0].numSteps, 2); // adjacent ranges merged
+    testServerMemory[0x02] = 0xAA;
+    const uint8_t READ_F210[] = {0x22, 0xF2, 0x10};
+    fixtureServerExchange(&server, READ_F210, sizeof(READ_F210));
+    const uint8_t READ_F210_RESP[] = {0x62, 0xF2, 0x10, 0xAA, 0x03, 0x04, 0x00};
+    ASSERT_INT_EQUAL(g.size, sizeof(READ_F210_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, READ_F210_RESP, sizeof(READ_F210_RESP));
+    TEST_TEARDOWN();
+}
+
+void testServer0x3DWriteMemoryByAddress() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.memoryRegions = testServerMemoryRegions;
+    cfg.numMemoryRegions = ARRAY_SZ(testServerMemoryRegions);
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    memset(testServerWriteOnlyMemory, 0, sizeof(testServerWriteOnlyMemory));
+
+    // the response echoes the address and size
+    const uint8_t WRITE[] = {0x3D, 0x14, 0xFF, 0x00, 0x30, 0x02, 0x03, 0x11, 0x22, 0x33};
+    fixtureServerExchange(&server, WRITE, sizeof(WRITE));
+    const uint8_t WRITE_RESP[] = {0x7D, 0x14, 0xFF, 0x00, 0x30, 0x02, 0x03};
+    ASSERT_INT_EQUAL(g.size, sizeof(WRITE_RESP));
+    ASSERT_MEMORY_EQUAL(g.scratch, WRITE_RESP, sizeof(WRITE_RESP));
+    const uint8_t WRITTEN[] = {0x00, 0x00, 0x11, 0x22, 0x33, 0x00};
+    ASSERT_MEMORY_EQUAL(testServerWriteOnlyMemory, WRITTEN, sizeof(WRITTEN));
+
+    // memorySize must match the data record
+    const uint8_t WRITE_SHORT[] = {0x3D, 0x14, 0xFF, 0x00, 0x30, 0x00, 0x03, 0x11, 0x22};
+    fixtureServerExchange(&server, WRITE_SHORT, sizeof(WRITE_SHORT));
+    const uint8_t NRC_0x13[] = {0x7F, 0x3D, 0x13};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x13, sizeof(NRC_0x13));
+
+    // read-only and unknown memory is refused
+    const uint8_t WRITE_READ_ONLY[] = {0x3D, 0x12, 0x10, 0x00, 0x01, 0x55};
+    fixtureServerExchange(&server, WRITE_READ_ONLY, sizeof(WRITE_READ_ONLY));
+    const uint8_t NRC_0x31[] = {0x7F, 0x3D, 0x31};
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+    const uint8_t WRITE_PAST_END[] = {0x3D, 0x14, 0xFF, 0x00, 0x30, 0x07, 0x02, 0x55, 0x66};
+    fixtureServerExchange(&server, WRITE_PAST_END, sizeof(WRITE_PAST_END));
+    ASSERT_MEMORY_EQUAL(g.scratch, NRC_0x31, sizeof(NRC_0x31));
+    TEST_TEARDOWN();
+}
+
 enum Iso14229ResponseCode mockSecurityAccessGenerateSeed(const struct Iso14229ServerStatus *status,
                                                          uint8_t level, const uint8_t *in_data,
                                                          uint16_t in_size, uint8_t *out_data,
@@ -436,7 +1554,7 @@ void testServer0x27SecurityAccess() {
     const uint8_t UNLOCK_RESPONSE[] = {0x67, 0x02};
 
     // the server security level after initialization should be 0
-    ASSERT_INT_EQUAL(server.status.securityLevel, 0);
+    ASSERT_INT_EQUAL(server.nodes[0].status.securityLevel, 0);
 
     // sending a seed request
     isotp_send(&g.clientLink, SEED_REQUEST, sizeof(SEED_REQUEST));
@@ -467,7 +1585,7 @@ void testServer0x27SecurityAccess() {
     ASSERT_MEMORY_EQUAL(UNLOCK_RESPONSE, g.scratch, sizeof(UNLOCK_RESPONSE));
 
     // Additionally, the security level should now be 1
-    ASSERT_INT_EQUAL(server.status.securityLevel, 1);
+    ASSERT_INT_EQUAL(server.nodes[0].status.securityLevel, 1);
     TEST_TEARDOWN();
 }
 
@@ -485,7 +1603,7 @@ void testServer0x27SecurityAccessAlreadyUnlocked() {
     const uint8_t ALREADY_UNLOCKED_RESPONSE[] = {0x67, 0x01, 0x00, 0x00};
 
     // when the security level is already set to 1
-    server.status.securityLevel = 1;
+    server.nodes[0].status.securityLevel = 1;
 
     // sending a seed request
     isotp_send(&g.clientLink, SEED_REQUEST, sizeof(SEED_REQUEST));
@@ -574,6 +1692,285 @@ void testServer0x31RCRRP() {
     TEST_TEARDOWN();
 }
 
+static int testServerRCRRPCalls;
+
+static enum Iso14229ResponseCode
+testServerRCRRPCountingRoutineControl(const struct Iso14229ServerStatus *status,
+                                      enum RoutineControlType routineControlType,
+                                      uint16_t routineIdentifier, Iso14229RoutineControlArgs *args) {
+    (void)status;
+    (void)routineControlType;
+    (void)routineIdentifier;
+    (void)args;
+    testServerRCRRPCalls++;
+    return g.userResponse;
+}
+
+void testServerRCRRPKeepalive() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userRoutineControlHandler = testServerRCRRPCountingRoutineControl;
+    cfg.rcrrp_recall_ms = 100;
+    Iso14229ServerInit(&server, &cfg);
+    testServerRCRRPCalls = 0;
+
+    // a routine that keeps working for two P2* periods
+    g.userResponse = kRequestCorrectlyReceived_ResponsePending;
+    const uint8_t REQUEST[] = {0x04, 0x31, 0x01, 0x12, 0x34};
+    const uint8_t RCRRP[] = {0x03, 0x7F, 0x31, 0x78};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQUEST, sizeof(REQUEST));
+    int numRCRRP = 0;
+    g.t0 = g.ms;
+    while (g.ms - g.t0 < 2 * SERVER_DEFAULT_P2_STAR_MS) {
+        Iso14229ServerPoll(&server);
+        for (int i = 0; i < g.clientRecvQueueIdx; i++) {
+            ASSERT_MEMORY_EQUAL(g.clientRecvQueue[i].data, RCRRP, sizeof(RCRRP));
+            numRCRRP++;
+        }
+        g.clientRecvQueueIdx = 0;
+        g.ms++;
+    }
+
+    // gets one 0x78 right away and one before every P2* would expire, not one per poll
+    ASSERT_INT_EQUAL(numRCRRP, 2 * 100 / ISO14229_SERVER_RCRRP_KEEPALIVE_PERCENT);
+    // and is called every rcrrp_recall_ms
+    ASSERT_INT_EQUAL(testServerRCRRPCalls, 2 * SERVER_DEFAULT_P2_STAR_MS / 100);
+
+    // when it finishes, the final response follows within rcrrp_recall_ms
+    g.userResponse = kPositiveResponse;
+    for (int i = 0; i < 100; i++) {
+        Iso14229ServerPoll(&server);
+        g.ms++;
+    }
+    assert(g.clientRecvQueueIdx > 0);
+    const uint8_t POSITIVE_RESPONSE[] = {0x04, 0x71, 0x01, 0x12, 0x34};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[g.clientRecvQueueIdx - 1].data, POSITIVE_RESPONSE,
+                        sizeof(POSITIVE_RESPONSE));
+    ASSERT_INT_EQUAL(server.nodes[0].status.RCRRP, false);
+    TEST_TEARDOWN();
+}
+
+static enum Iso14229ResponseCode testServerJobErase(Iso14229ServerJob *job) {
+    (*(int *)job->ctx)++;
+    return kPositiveResponse;
+}
+
+static int testServerJobNotifications;
+static void testServerJobNotify(Iso14229ServerJob *job) {
+    (void)job;
+    testServerJobNotifications++;
+}
+
+static Iso14229ServerJob testServerJob;
+
+static enum Iso14229ResponseCode
+testServerJobRoutineControl(const struct Iso14229ServerStatus *status,
+                            enum RoutineControlType routineControlType, uint16_t routineIdentifier,
+                            Iso14229RoutineControlArgs *args) {
+    (void)status;
+    (void)routineControlType;
+    (void)routineIdentifier;
+    (void)args;
+    return Iso14229ServerJobStep(&testServerJob);
+}
+
+void testServerJobHandoff() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userRoutineControlHandler = testServerJobRoutineControl;
+    Iso14229ServerInit(&server, &cfg);
+    int erased = 0;
+    testServerJob = (Iso14229ServerJob){
+        .run = testServerJobErase,
+        .notify = testServerJobNotify,
+        .ctx = &erased,
+    };
+    testServerJobNotifications = 0;
+
+    // the handler queues the job and the server answers 0x78
+    const uint8_t REQUEST[] = {0x04, 0x31, 0x01, 0x12, 0x34};
+    const uint8_t RCRRP[] = {0x03, 0x7F, 0x31, 0x78};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, REQUEST, sizeof(REQUEST));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, RCRRP, sizeof(RCRRP));
+    ASSERT_INT_EQUAL(testServerJobNotifications, 1);
+
+    // polling does not run the job
+    for (int i = 0; i < 10; i++) {
+        g.ms++;
+        Iso14229ServerPoll(&server);
+    }
+    ASSERT_INT_EQUAL(erased, 0);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+
+    // the worker does, once
+    ASSERT_INT_EQUAL(Iso14229ServerJobRun(&testServerJob), true);
+    ASSERT_INT_EQUAL(Iso14229ServerJobRun(&testServerJob), false);
+    ASSERT_INT_EQUAL(erased, 1);
+
+    // and the next call of the handler returns its result
+    g.ms++;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    const uint8_t POSITIVE_RESPONSE[] = {0x04, 0x71, 0x01, 0x12, 0x34};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[1].data, POSITIVE_RESPONSE, sizeof(POSITIVE_RESPONSE));
+    ASSERT_INT_EQUAL(testServerJob.state, kIso14229JobIdle);
+    ASSERT_INT_EQUAL(testServerJobNotifications, 1);
+    TEST_TEARDOWN();
+}
+
+static enum Iso14229ResponseCode
+testServerRCRRPSessionControl(const struct Iso14229ServerStatus *status,
+                              enum Iso14229DiagnosticSessionType type) {
+    (void)status;
+    (void)type;
+    return g.userResponse;
+}
+
+// ISO14229-1:2013 7.5: once a 0x78 has been sent, the final response is not suppressed
+void testServerRCRRPNotSuppressed() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userRoutineControlHandler = testServerRCRRPCountingRoutineControl;
+    cfg.userDiagnosticSessionControlHandler = testServerRCRRPSessionControl;
+    Iso14229ServerInit(&server, &cfg);
+
+    // suppressPosRspMsgIndicationBit set
+    g.userResponse = kRequestCorrectlyReceived_ResponsePending;
+    const uint8_t SUPPRESSED[] = {0x02, 0x10, 0x83};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, SUPPRESSED, sizeof(SUPPRESSED));
+    Iso14229ServerPoll(&server);
+    g.userResponse = kPositiveResponse;
+    g.ms++;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    const uint8_t POSITIVE_RESPONSE[] = {0x06, 0x50, 0x03, 0x00, 0x32, 0x00, 0xC8};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[1].data, POSITIVE_RESPONSE, sizeof(POSITIVE_RESPONSE));
+
+    // functionally addressed, ending in requestOutOfRange
+    g.clientRecvQueueIdx = 0;
+    g.userResponse = kRequestCorrectlyReceived_ResponsePending;
+    const uint8_t REQUEST[] = {0x04, 0x31, 0x01, 0x12, 0x34};
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, REQUEST, sizeof(REQUEST));
+    Iso14229ServerPoll(&server);
+    g.userResponse = kRequestOutOfRange;
+    g.ms++;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    const uint8_t NRC_0x31[] = {0x03, 0x7F, 0x31, 0x31};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[1].data, NRC_0x31, sizeof(NRC_0x31));
+    TEST_TEARDOWN();
+}
+
+void testServerSchedulesRequestsWithoutP2Gap() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userRoutineControlHandler = testServer0x31RCRRPMockRoutineControl;
+    Iso14229ServerInit(&server, &cfg);
+    const uint8_t TESTER_PRESENT[] = {0x02, 0x3E, 0x00};
+    const uint8_t TESTER_PRESENT_RESPONSE[] = {0x02, 0x7E, 0x00};
+
+    // a physical and a functional request arriving together
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+
+    // are both answered in the same poll
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, TESTER_PRESENT_RESPONSE,
+                        sizeof(TESTER_PRESENT_RESPONSE));
+
+    // and the next request is answered right away, not p2 later
+    g.clientRecvQueueIdx = 0;
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(server.nodes[0].linkStats[kAddressingSchemePhysical].requests, 2);
+    ASSERT_INT_EQUAL(server.nodes[0].linkStats[kAddressingSchemeFunctional].requests, 1);
+    ASSERT_INT_EQUAL(server.nodes[0].linkStats[kAddressingSchemePhysical].deferred, 0);
+
+    // a functional request arriving while a physical one is served with RCRRP
+    g.clientRecvQueueIdx = 0;
+    g.userResponse = kRequestCorrectlyReceived_ResponsePending;
+    const uint8_t ROUTINE_CONTROL[] = {0x04, 0x31, 0x01, 0x12, 0x34};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, ROUTINE_CONTROL, sizeof(ROUTINE_CONTROL));
+    Iso14229ServerPoll(&server);
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    for (int i = 0; i < cfg.p2_ms; i++) {
+        Iso14229ServerPoll(&server);
+        g.clientRecvQueueIdx = 0;
+        g.ms++;
+    }
+    g.userResponse = kPositiveResponse;
+    Iso14229ServerPoll(&server);
+    Iso14229ServerPoll(&server);
+
+    // waits for it and is counted as too late for p2
+    const struct Iso14229ServerLinkStats *func =
+        &server.nodes[0].linkStats[kAddressingSchemeFunctional];
+    ASSERT_INT_EQUAL(func->requests, 2);
+    ASSERT_INT_EQUAL(func->deferred, 1);
+    ASSERT_INT_EQUAL(func->maxWaitMs, cfg.p2_ms);
+    ASSERT_INT_EQUAL(func->p2Missed, 1);
+    ASSERT_INT_EQUAL(server.nodes[0].linkStats[kAddressingSchemePhysical].requests, 3);
+    TEST_TEARDOWN();
+}
+
+void testServerSharedSendBuffer() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    static uint8_t record[20];
+    for (unsigned i = 0; i < sizeof(record); i++) {
+        record[i] = i;
+    }
+    const Iso14229DataIdentifier didTable[] = {
+        {.did = 0x0100, .len = sizeof(record), .data = record, .readSessions = 0xFF},
+    };
+    cfg.didTable = didTable;
+    cfg.didTableSize = sizeof(didTable) / sizeof(didTable[0]);
+    cfg.func_link_send_buffer = NULL;
+    cfg.func_link_send_buf_size = 0;
+    Iso14229ServerInit(&server, &cfg);
+    ASSERT_INT_EQUAL(server.nodes[0].sharedSendBuffer, true);
+    ASSERT_INT_EQUAL(g.srvFuncLink.send_buffer == g.srvPhysLinkTxBuf, true);
+
+    // a multi-frame physical response is waiting for the client's flow control
+    const uint8_t RDBI[] = {0x03, 0x22, 0x01, 0x00};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, RDBI, sizeof(RDBI));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[0], 0x10);
+
+    // a functional request is deferred: its response would overwrite the physical one
+    const uint8_t TESTER_PRESENT[] = {0x02, 0x3E, 0x00};
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(server.nodes[0].linkStats[kAddressingSchemeFunctional].deferred, 1);
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server) > 0, true);
+
+    // and answered once the physical response has been sent unchanged
+    const uint8_t FLOW_CONTROL[] = {0x30, 0x00, 0x00};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, FLOW_CONTROL, sizeof(FLOW_CONTROL));
+    for (int i = 0; i < 10 && g.clientRecvQueueIdx < 5; i++) {
+        Iso14229ServerPoll(&server);
+        g.ms++;
+    }
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 5);
+    const uint8_t LAST_CF[] = {0x23, 17, 18, 19};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[3].data, LAST_CF, sizeof(LAST_CF));
+    const uint8_t TESTER_PRESENT_RESPONSE[] = {0x02, 0x7E, 0x00};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[4].data, TESTER_PRESENT_RESPONSE,
+                        sizeof(TESTER_PRESENT_RESPONSE));
+    TEST_TEARDOWN();
+}
+
 void testServer0x34NotEnabled() {
     TEST_SETUP();
     Iso14229Server server;
@@ -641,32 +2038,144 @@ static enum Iso14229ResponseCode testServer0x34DownloadDataMockuserRequestDownlo
     return kPositiveResponse;
 }
 
-void testServer0x34DownloadData() {
+void testServer0x34DownloadData() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    // when a handler is installed that implements ISO14229-1:2013 Table 415
+    cfg.userRequestDownloadHandler = testServer0x34DownloadDataMockuserRequestDownloadHandler;
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    const uint8_t REQUEST_DOWNLOAD_REQUEST[] = {0x34, 0x11, 0x33, 0x60, 0x20,
+                                                0x00, 0x00, 0xFF, 0xFF};
+    const uint8_t POSITIVE_RESPONSE[] = {0x74, 0x20, 0x00, 0x81};
+
+    // sending this request to the server
+    isotp_send(&g.clientLink, REQUEST_DOWNLOAD_REQUEST, sizeof(REQUEST_DOWNLOAD_REQUEST));
+
+    // should result in a response
+    while (ISOTP_RET_OK != isotp_receive(&g.clientLink, g.scratch, sizeof(g.scratch), &g.size)) {
+        Iso14229ServerPoll(&server);
+        fixtureClientLinkProcess();
+        assert(g.ms++ < cfg.p2_ms); // in less than p2 ms
+    }
+
+    // a positive response matching ISO14229-1:2013 Table 415
+    ASSERT_INT_EQUAL(sizeof(POSITIVE_RESPONSE), g.size);
+    ASSERT_MEMORY_EQUAL(POSITIVE_RESPONSE, g.scratch, sizeof(POSITIVE_RESPONSE));
+    TEST_TEARDOWN();
+}
+
+static uint8_t testServer0x35Memory[300];
+static Iso14229UploadHandler testServer0x35Handler;
+static int testServer0x35Transfers;
+
+static enum Iso14229ResponseCode
+testServer0x35OnTransfer(const struct Iso14229ServerStatus *status, void *userCtx, uint8_t *buf,
+                         uint16_t len, uint16_t *out_len) {
+    (void)status;
+    (void)userCtx;
+    // the first block is not ready within p2
+    if (1 == ++testServer0x35Transfers) {
+        return kRequestCorrectlyReceived_ResponsePending;
+    }
+    memset(buf, 0xA5, len);
+    *out_len = len;
+    return kPositiveResponse;
+}
+
+static enum Iso14229ResponseCode
+testServer0x35MockRequestUploadHandler(const struct Iso14229ServerStatus *status,
+                                       void *memoryAddress, size_t memorySize,
+                                       uint8_t dataFormatIdentifier,
+                                       Iso14229UploadHandler **handler,
+                                       uint16_t *maxNumberOfBlockLength) {
+    (void)status;
+    (void)dataFormatIdentifier;
+    ASSERT_INT_EQUAL((size_t)memoryAddress, 0x00602000);
+    if (memorySize > sizeof(testServer0x35Memory)) {
+        return kRequestOutOfRange;
+    }
+    *handler = &testServer0x35Handler;
+    *maxNumberOfBlockLength = 0x0082;
+    return kPositiveResponse;
+}
+
+void testServer0x35Upload() {
     TEST_SETUP();
     Iso14229Server server;
     Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
-    // when a handler is installed that implements ISO14229-1:2013 Table 415
-    cfg.userRequestDownloadHandler = testServer0x34DownloadDataMockuserRequestDownloadHandler;
+    cfg.userRequestUploadHandler = testServer0x35MockRequestUploadHandler;
     Iso14229ServerInit(&server, &cfg);
     IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    for (unsigned i = 0; i < sizeof(testServer0x35Memory); i++) {
+        testServer0x35Memory[i] = i * 3;
+    }
+    memset(&testServer0x35Handler, 0, sizeof(testServer0x35Handler));
+    testServer0x35Handler.memory = testServer0x35Memory;
+
+    const uint8_t REQUEST_UPLOAD[] = {0x35, 0x00, 0x44, 0x00, 0x60, 0x20,
+                                      0x00, 0x00, 0x00, 0x01, 0x2C};
+    const uint8_t POSITIVE_RESPONSE[] = {0x75, 0x20, 0x00, 0x82};
+    fixtureServerExchange(&server, REQUEST_UPLOAD, sizeof(REQUEST_UPLOAD));
+    ASSERT_INT_EQUAL(g.size, sizeof(POSITIVE_RESPONSE));
+    ASSERT_MEMORY_EQUAL(g.scratch, POSITIVE_RESPONSE, sizeof(POSITIVE_RESPONSE));
+
+    // a second transfer cannot be requested while this one is active
+    fixtureServerExchange(&server, REQUEST_UPLOAD, sizeof(REQUEST_UPLOAD));
+    const uint8_t CONDITIONS_NOT_CORRECT[] = {0x7F, 0x35, 0x22};
+    ASSERT_MEMORY_EQUAL(g.scratch, CONDITIONS_NOT_CORRECT, sizeof(CONDITIONS_NOT_CORRECT));
+
+    // blocks of 128 bytes, sent straight from the memory
+    uint16_t offset = 0;
+    for (uint8_t bsc = 1; bsc <= 3; bsc++) {
+        const uint8_t TRANSFER_DATA[] = {0x36, bsc};
+        uint16_t len = sizeof(testServer0x35Memory) - offset;
+        if (len > 128) {
+            len = 128;
+        }
+        fixtureServerExchange(&server, TRANSFER_DATA, sizeof(TRANSFER_DATA));
+        ASSERT_INT_EQUAL(g.size, 2 + len);
+        ASSERT_INT_EQUAL(g.scratch[0], 0x76);
+        ASSERT_INT_EQUAL(g.scratch[1], bsc);
+        ASSERT_MEMORY_EQUAL(&g.scratch[2], &testServer0x35Memory[offset], len);
+        offset += len;
+    }
 
-    const uint8_t REQUEST_DOWNLOAD_REQUEST[] = {0x34, 0x11, 0x33, 0x60, 0x20,
-                                                0x00, 0x00, 0xFF, 0xFF};
-    const uint8_t POSITIVE_RESPONSE[] = {0x74, 0x20, 0x00, 0x81};
-
-    // sending this request to the server
-    isotp_send(&g.clientLink, REQUEST_DOWNLOAD_REQUEST, sizeof(REQUEST_DOWNLOAD_REQUEST));
-
-    // should result in a response
+    // there is nothing left to upload
+    const uint8_t TRANSFER_DATA_4[] = {0x36, 0x04};
+    fixtureServerExchange(&server, TRANSFER_DATA_4, sizeof(TRANSFER_DATA_4));
+    const uint8_t SEQUENCE_ERROR[] = {0x7F, 0x36, 0x24};
+    ASSERT_MEMORY_EQUAL(g.scratch, SEQUENCE_ERROR, sizeof(SEQUENCE_ERROR));
+    ASSERT_INT_EQUAL(server.nodes[0].uploadHandler == NULL, 1);
+
+    // a callback producing the data straight into the send buffer
+    memset(&testServer0x35Handler, 0, sizeof(testServer0x35Handler));
+    testServer0x35Handler.onTransfer = testServer0x35OnTransfer;
+    testServer0x35Transfers = 0;
+    fixtureServerExchange(&server, REQUEST_UPLOAD, sizeof(REQUEST_UPLOAD));
+    ASSERT_MEMORY_EQUAL(g.scratch, POSITIVE_RESPONSE, sizeof(POSITIVE_RESPONSE));
+
+    const uint8_t TRANSFER_DATA_1[] = {0x36, 0x01};
+    fixtureServerExchange(&server, TRANSFER_DATA_1, sizeof(TRANSFER_DATA_1));
+    const uint8_t RESPONSE_PENDING[] = {0x7F, 0x36, 0x78};
+    ASSERT_MEMORY_EQUAL(g.scratch, RESPONSE_PENDING, sizeof(RESPONSE_PENDING));
     while (ISOTP_RET_OK != isotp_receive(&g.clientLink, g.scratch, sizeof(g.scratch), &g.size)) {
         Iso14229ServerPoll(&server);
         fixtureClientLinkProcess();
-        assert(g.ms++ < cfg.p2_ms); // in less than p2 ms
+        assert(g.ms++ < 10000);
     }
-
-    // a positive response matching ISO14229-1:2013 Table 415
-    ASSERT_INT_EQUAL(sizeof(POSITIVE_RESPONSE), g.size);
-    ASSERT_MEMORY_EQUAL(POSITIVE_RESPONSE, g.scratch, sizeof(POSITIVE_RESPONSE));
+    ASSERT_INT_EQUAL(g.size, 130);
+    ASSERT_INT_EQUAL(g.scratch[1], 0x01);
+    ASSERT_INT_EQUAL(g.scratch[129], 0xA5);
+    ASSERT_INT_EQUAL(testServer0x35Handler.numBytesTransferred, 128);
+
+    const uint8_t REQUEST_TRANSFER_EXIT[] = {0x37};
+    fixtureServerExchange(&server, REQUEST_TRANSFER_EXIT, sizeof(REQUEST_TRANSFER_EXIT));
+    ASSERT_INT_EQUAL(g.size, 1);
+    ASSERT_INT_EQUAL(g.scratch[0], 0x77);
+    ASSERT_INT_EQUAL(server.nodes[0].uploadHandler == NULL, 1);
     TEST_TEARDOWN();
 }
 
@@ -742,6 +2251,257 @@ void testServer0x3ESuppressPositiveResponse() {
     TEST_TEARDOWN();
 }
 
+// check the response the client received in fixtureServerExchange()
+#define ASSERT_RESPONSE(expected)                                                                  \
+    do {                                                                                           \
+        ASSERT_INT_EQUAL(g.size, sizeof(expected));                                                \
+        ASSERT_MEMORY_EQUAL(g.scratch, expected, sizeof(expected));                                \
+    } while (0)
+
+void testServer0x19ReadDTCInformation() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    Iso14229DTCStore store;
+    const uint32_t dtcs[] = {0x010203, 0x123456, 0xC10000};
+    Iso14229DTCStoreInit(&store, dtcs, 3, 0x7F);
+    cfg.dtcStore = &store;
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+
+    // 0x123456 fails, 0xC10000 fails and passes again, 0x010203 has not been tested
+    ASSERT_INT_EQUAL(Iso14229DTCStoreReportResult(&store, 0x123456, true), true);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreReportResult(&store, 0xC10000, true), true);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreReportResult(&store, 0xC10000, false), true);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreReportResult(&store, 0x999999, true), false);
+    const uint8_t SNAPSHOT[] = {0x01, 0xF1, 0x90, 0xAB}; // one DID: 0xF190 = 0xAB
+    ASSERT_INT_EQUAL(Iso14229DTCStoreSnapshot(&store, 0x123456, SNAPSHOT, sizeof(SNAPSHOT)), true);
+
+    // the number of DTCs with testFailed set
+    const uint8_t COUNT_FAILED[] = {0x19, 0x01, 0x01};
+    const uint8_t COUNT_FAILED_RESP[] = {0x59, 0x01, 0x7F, 0x01, 0x00, 0x01};
+    fixtureServerExchange(&server, COUNT_FAILED, sizeof(COUNT_FAILED));
+    ASSERT_RESPONSE(COUNT_FAILED_RESP);
+
+    // the confirmed DTCs, in DTC order
+    const uint8_t CONFIRMED[] = {0x19, 0x02, 0x08};
+    const uint8_t CONFIRMED_RESP[] = {0x59, 0x02, 0x7F, 0x12, 0x34, 0x56, 0x2F,
+                                      0xC1, 0x00, 0x00, 0x2E};
+    fixtureServerExchange(&server, CONFIRMED, sizeof(CONFIRMED));
+    ASSERT_RESPONSE(CONFIRMED_RESP);
+
+    // status bits outside the availability mask match nothing
+    const uint8_t WARNING[] = {0x19, 0x02, 0x80};
+    const uint8_t WARNING_RESP[] = {0x59, 0x02, 0x7F};
+    fixtureServerExchange(&server, WARNING, sizeof(WARNING));
+    ASSERT_RESPONSE(WARNING_RESP);
+
+    // all DTCs
+    const uint8_t SUPPORTED[] = {0x19, 0x0A};
+    const uint8_t SUPPORTED_RESP[] = {0x59, 0x0A, 0x7F, 0x01, 0x02, 0x03, 0x50, 0x12,
+                                      0x34, 0x56, 0x2F, 0xC1, 0x00, 0x00, 0x2E};
+    fixtureServerExchange(&server, SUPPORTED, sizeof(SUPPORTED));
+    ASSERT_RESPONSE(SUPPORTED_RESP);
+
+    // snapshot records
+    const uint8_t SNAPSHOT_IDS[] = {0x19, 0x03};
+    const uint8_t SNAPSHOT_IDS_RESP[] = {0x59, 0x03, 0x12, 0x34, 0x56, 0x01};
+    fixtureServerExchange(&server, SNAPSHOT_IDS, sizeof(SNAPSHOT_IDS));
+    ASSERT_RESPONSE(SNAPSHOT_IDS_RESP);
+
+    const uint8_t SNAPSHOT_01[] = {0x19, 0x04, 0x12, 0x34, 0x56, 0x01};
+    const uint8_t SNAPSHOT_01_RESP[] = {0x59, 0x04, 0x12, 0x34, 0x56, 0x2F,
+                                        0x01, 0x01, 0xF1, 0x90, 0xAB};
+    fixtureServerExchange(&server, SNAPSHOT_01, sizeof(SNAPSHOT_01));
+    ASSERT_RESPONSE(SNAPSHOT_01_RESP);
+
+    const uint8_t SNAPSHOT_NONE[] = {0x19, 0x04, 0x01, 0x02, 0x03, 0xFF};
+    const uint8_t SNAPSHOT_NONE_RESP[] = {0x59, 0x04, 0x01, 0x02, 0x03, 0x50};
+    fixtureServerExchange(&server, SNAPSHOT_NONE, sizeof(SNAPSHOT_NONE));
+    ASSERT_RESPONSE(SNAPSHOT_NONE_RESP);
+
+    const uint8_t SNAPSHOT_02[] = {0x19, 0x04, 0x12, 0x34, 0x56, 0x02};
+    const uint8_t NRC_0x31[] = {0x7F, 0x19, 0x31};
+    fixtureServerExchange(&server, SNAPSHOT_02, sizeof(SNAPSHOT_02));
+    ASSERT_RESPONSE(NRC_0x31);
+
+    // extended data records: occurrence and aging counters
+    const uint8_t EXT_ALL[] = {0x19, 0x06, 0x12, 0x34, 0x56, 0xFF};
+    const uint8_t EXT_ALL_RESP[] = {0x59, 0x06, 0x12, 0x34, 0x56, 0x2F, 0x01, 0x01, 0x02, 0x00};
+    fixtureServerExchange(&server, EXT_ALL, sizeof(EXT_ALL));
+    ASSERT_RESPONSE(EXT_ALL_RESP);
+
+    const uint8_t EXT_UNKNOWN_DTC[] = {0x19, 0x06, 0x99, 0x99, 0x99, 0x01};
+    fixtureServerExchange(&server, EXT_UNKNOWN_DTC, sizeof(EXT_UNKNOWN_DTC));
+    ASSERT_RESPONSE(NRC_0x31);
+
+    // unsupported reportType, wrong length
+    const uint8_t REPORT_0x42[] = {0x19, 0x42};
+    const uint8_t NRC_0x12[] = {0x7F, 0x19, 0x12};
+    fixtureServerExchange(&server, REPORT_0x42, sizeof(REPORT_0x42));
+    ASSERT_RESPONSE(NRC_0x12);
+
+    const uint8_t NO_MASK[] = {0x19, 0x02};
+    const uint8_t NRC_0x13[] = {0x7F, 0x19, 0x13};
+    fixtureServerExchange(&server, NO_MASK, sizeof(NO_MASK));
+    ASSERT_RESPONSE(NRC_0x13);
+    TEST_TEARDOWN();
+}
+
+void testServer0x14ClearAnd0x85ControlDTCSetting() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    Iso14229DTCStore store;
+    const uint32_t dtcs[] = {0x010203, 0x123456};
+    Iso14229DTCStoreInit(&store, dtcs, 2, 0xFF);
+    cfg.dtcStore = &store;
+    Iso14229ServerInit(&server, &cfg);
+    IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
+    const uint8_t SNAPSHOT[] = {0x00};
+
+    // with DTC setting off, the statuses and snapshots are frozen
+    const uint8_t SETTING_OFF[] = {0x85, 0x02};
+    const uint8_t SETTING_OFF_RESP[] = {0xC5, 0x02};
+    fixtureServerExchange(&server, SETTING_OFF, sizeof(SETTING_OFF));
+    ASSERT_RESPONSE(SETTING_OFF_RESP);
+    Iso14229DTCStoreReportResult(&store, 0x123456, true);
+    Iso14229DTCStoreSnapshot(&store, 0x123456, SNAPSHOT, sizeof(SNAPSHOT));
+    ASSERT_INT_EQUAL(store.records[1].status, ISO14229_DTC_STATUS_CLEARED);
+    ASSERT_INT_EQUAL(store.records[1].snapshotLen, 0);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCTestFailed), 0);
+
+    // until it is turned on again
+    const uint8_t SETTING_ON[] = {0x85, 0x01};
+    const uint8_t SETTING_ON_RESP[] = {0xC5, 0x01};
+    fixtureServerExchange(&server, SETTING_ON, sizeof(SETTING_ON));
+    ASSERT_RESPONSE(SETTING_ON_RESP);
+    Iso14229DTCStoreReportResult(&store, 0x010203, true);
+    Iso14229DTCStoreReportResult(&store, 0x123456, true);
+    Iso14229DTCStoreSnapshot(&store, 0x123456, SNAPSHOT, sizeof(SNAPSHOT));
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCTestFailed), 2);
+    ASSERT_INT_EQUAL(store.records[1].occurrences, 1);
+    ASSERT_INT_EQUAL(store.records[1].snapshotLen, 1);
+
+    const uint8_t SETTING_0x03[] = {0x85, 0x03};
+    const uint8_t NRC_0x12[] = {0x7F, 0x85, 0x12};
+    fixtureServerExchange(&server, SETTING_0x03, sizeof(SETTING_0x03));
+    ASSERT_RESPONSE(NRC_0x12);
+
+    // clearing a single DTC
+    const uint8_t CLEAR_123456[] = {0x14, 0x12, 0x34, 0x56};
+    const uint8_t CLEAR_RESP[] = {0x54};
+    fixtureServerExchange(&server, CLEAR_123456, sizeof(CLEAR_123456));
+    ASSERT_RESPONSE(CLEAR_RESP);
+    ASSERT_INT_EQUAL(store.records[1].status, ISO14229_DTC_STATUS_CLEARED);
+    ASSERT_INT_EQUAL(store.records[1].occurrences, 0);
+    ASSERT_INT_EQUAL(store.records[1].snapshotLen, 0);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCTestFailed), 1);
+
+    // and all of them
+    const uint8_t CLEAR_ALL[] = {0x14, 0xFF, 0xFF, 0xFF};
+    fixtureServerExchange(&server, CLEAR_ALL, sizeof(CLEAR_ALL));
+    ASSERT_RESPONSE(CLEAR_RESP);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCTestFailed), 0);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCTestNotCompletedSinceLastClear), 2);
+
+    const uint8_t CLEAR_UNKNOWN[] = {0x14, 0x99, 0x99, 0x99};
+    const uint8_t NRC_0x31[] = {0x7F, 0x14, 0x31};
+    fixtureServerExchange(&server, CLEAR_UNKNOWN, sizeof(CLEAR_UNKNOWN));
+    ASSERT_RESPONSE(NRC_0x31);
+
+    const uint8_t CLEAR_SHORT[] = {0x14, 0xFF, 0xFF};
+    const uint8_t NRC_0x13[] = {0x7F, 0x14, 0x13};
+    fixtureServerExchange(&server, CLEAR_SHORT, sizeof(CLEAR_SHORT));
+    ASSERT_RESPONSE(NRC_0x13);
+    TEST_TEARDOWN();
+}
+
+static struct {
+    Iso14229DTCRecord records[ISO14229_DTC_MAX_DTCS];
+    uint16_t writes;
+    uint16_t written; // records
+    int fail;         // the result of the next write
+} nvm;
+
+static int mockNVMWrite(void *ctx, uint16_t index, const Iso14229DTCRecord *records,
+                        uint16_t count) {
+    (void)ctx;
+    if (nvm.fail) {
+        nvm.fail = 0;
+        return -1;
+    }
+    memmove(&nvm.records[index], records, count * sizeof(Iso14229DTCRecord));
+    nvm.writes++;
+    nvm.written += count;
+    return 0;
+}
+
+void testServerDTCStoreWriteBack() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    Iso14229DTCStore store;
+    const uint32_t dtcs[] = {0x000001, 0x000002, 0x000003, 0x000004};
+    Iso14229DTCStoreInit(&store, dtcs, 4, 0xFF);
+    store.nvmWrite = mockNVMWrite;
+    store.nvmWriteDelayms = 100;
+    cfg.dtcStore = &store;
+    Iso14229ServerInit(&server, &cfg);
+    memset(&nvm, 0, sizeof(nvm));
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), UINT32_MAX);
+
+    // changes are collected for nvmWriteDelayms
+    Iso14229DTCStoreReportResult(&store, 0x000001, true);
+    Iso14229DTCStoreReportResult(&store, 0x000004, true);
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), 101);
+    g.ms += 50;
+    Iso14229DTCStoreReportResult(&store, 0x000002, true);
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(nvm.writes, 0);
+
+    // and then written with one write per run of adjacent records
+    g.ms += 51;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(nvm.writes, 2);
+    ASSERT_INT_EQUAL(nvm.written, 3);
+    ASSERT_INT_EQUAL(Iso14229ServerGetTimeoutms(&server), UINT32_MAX);
+
+    // a failed write is retried nvmWriteDelayms later
+    nvm.fail = 1;
+    Iso14229DTCStoreReportResult(&store, 0x000001, false);
+    Iso14229ServerPoll(&server);
+    g.ms += 101;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(store.nvmErrors, 1);
+    ASSERT_INT_EQUAL(nvm.writes, 2);
+    g.ms += 101;
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(nvm.writes, 3);
+
+    // DTCs which failed in the last operation cycle stay pending
+    Iso14229DTCStoreNewOperationCycle(&store);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCPendingDTC), 3);
+    ASSERT_INT_EQUAL(store.records[0].aging, 0);
+
+    // after a cycle without failures they are no longer pending and age
+    Iso14229DTCStoreNewOperationCycle(&store);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCPendingDTC), 0);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&store, kDTCConfirmedDTC), 3);
+    ASSERT_INT_EQUAL(store.records[0].aging, 1);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreFlush(&store), true);
+
+    // the records written are restored at the next start
+    Iso14229DTCStore restored;
+    Iso14229DTCStoreInit(&restored, dtcs, 4, 0xFF);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreLoad(&restored, nvm.records, 4), 3); // 0x000003 unchanged
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&restored, kDTCConfirmedDTC), 3);
+    ASSERT_INT_EQUAL(Iso14229DTCStoreCount(&restored, kDTCTestFailed), 2);
+    ASSERT_INT_EQUAL(restored.records[1].occurrences, 1);
+    TEST_TEARDOWN();
+}
+
 void testServer0x83DiagnosticSessionControl() {
     TEST_SETUP();
     Iso14229Server server;
@@ -751,7 +2511,7 @@ void testServer0x83DiagnosticSessionControl() {
     IsoTpInitLink(&g.clientLink, &CLIENT_LINK_DEFAULT_CONFIG);
 
     // the server sessionType after initialization should be kDefaultSession.
-    ASSERT_INT_EQUAL(server.status.sessionType, kDefaultSession);
+    ASSERT_INT_EQUAL(server.nodes[0].status.sessionType, kDefaultSession);
 
     // When the suppressPositiveResponse bit is set
     const uint8_t REQUEST[] = {0x10, 0x83};
@@ -769,8 +2529,103 @@ void testServer0x83DiagnosticSessionControl() {
     }
 
     // and the server sessionType should have changed
-    ASSERT_INT_EQUAL(server.status.sessionType, kExtendedDiagnostic);
+    ASSERT_INT_EQUAL(server.nodes[0].status.sessionType, kExtendedDiagnostic);
+
+    TEST_TEARDOWN();
+}
+
+void testServerServiceTable() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    Iso14229ServerInit(&server, &cfg);
+
+    // an unsupported SID gets serviceNotSupported
+    const uint8_t UNSUPPORTED[] = {0x01, 0x38};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, UNSUPPORTED, sizeof(UNSUPPORTED));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x11[] = {0x03, 0x7F, 0x38, 0x11};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x11, sizeof(NRC_0x11));
+
+    // a service with sub-function but without the sub-function byte gets
+    // incorrectMessageLengthOrInvalidFormat
+    g.clientRecvQueueIdx = 0;
+    const uint8_t TOO_SHORT[] = {0x01, 0x3E};
+    mockClientSendCAN(SERVER_PHYS_RECV_ID, TOO_SHORT, sizeof(TOO_SHORT));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    const uint8_t NRC_0x13[] = {0x03, 0x7F, 0x3E, 0x13};
+    ASSERT_MEMORY_EQUAL(g.clientRecvQueue[0].data, NRC_0x13, sizeof(NRC_0x13));
+
+    // functionally addressed unsupported services are not answered (ISO14229-1 2013 7.5.5)
+    g.clientRecvQueueIdx = 0;
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, UNSUPPORTED, sizeof(UNSUPPORTED));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 0);
+    TEST_TEARDOWN();
+}
 
+void testServerMultipleNodes() {
+    TEST_SETUP();
+    static IsoTpLink physLinks[2], funcLinks[2];
+    static uint8_t bufs[2][4][64];
+    Iso14229ServerNodeConfig nodes[2];
+    for (int i = 0; i < 2; i++) {
+        nodes[i] = (Iso14229ServerNodeConfig){
+            .phys_recv_id = 0x10 * (i + 1),
+            // node 1 shares the functional ID of node 0
+            .func_recv_id = 0 == i ? SERVER_FUNC_RECV_ID : 0x21,
+            .send_id = 0x10 * (i + 1) + 8,
+            .phys_link = &physLinks[i],
+            .func_link = &funcLinks[i],
+            .phys_link_receive_buffer = bufs[i][0],
+            .phys_link_recv_buf_size = sizeof(bufs[i][0]),
+            .phys_link_send_buffer = bufs[i][1],
+            .phys_link_send_buf_size = sizeof(bufs[i][1]),
+            .func_link_receive_buffer = bufs[i][2],
+            .func_link_recv_buf_size = sizeof(bufs[i][2]),
+            .func_link_send_buffer = bufs[i][3],
+            .func_link_send_buf_size = sizeof(bufs[i][3]),
+        };
+    }
+    Iso14229Server server;
+    Iso14229ServerConfig cfg = DEFAULT_SERVER_CONFIG();
+    cfg.userDiagnosticSessionControlHandler = mockDiagnosticSessionControlHandler;
+    cfg.nodes = nodes;
+    cfg.numNodes = 2;
+    Iso14229ServerInit(&server, &cfg);
+    ASSERT_INT_EQUAL(server.numNodes, 3);
+
+    // a session change on one node
+    const uint8_t DSC_REQUEST[] = {0x02, 0x10, 0x03};
+    mockClientSendCAN(0x20, DSC_REQUEST, sizeof(DSC_REQUEST));
+    Iso14229ServerPoll(&server);
+
+    // is answered by that node only
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 1);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].arbId, 0x28);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].data[1], 0x50);
+
+    // and the other nodes stay in their own sessions
+    ASSERT_INT_EQUAL(server.nodes[0].status.sessionType, kDefaultSession);
+    ASSERT_INT_EQUAL(server.nodes[1].status.sessionType, kDefaultSession);
+    ASSERT_INT_EQUAL(server.nodes[2].status.sessionType, kExtendedDiagnostic);
+
+    // a functional request on a shared ID reaches every node listening on it
+    g.clientRecvQueueIdx = 0;
+    const uint8_t TESTER_PRESENT[] = {0x02, 0x3E, 0x00};
+    mockClientSendCAN(SERVER_FUNC_RECV_ID, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 2);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[0].arbId, SERVER_SEND_ID);
+    ASSERT_INT_EQUAL(g.clientRecvQueue[1].arbId, 0x18);
+
+    // frames for other IDs are ignored
+    g.clientRecvQueueIdx = 0;
+    mockClientSendCAN(0x30, TESTER_PRESENT, sizeof(TESTER_PRESENT));
+    Iso14229ServerPoll(&server);
+    ASSERT_INT_EQUAL(g.clientRecvQueueIdx, 0);
     TEST_TEARDOWN();
 }
 
@@ -871,6 +2726,117 @@ void testClientBusy() {
     TEST_TEARDOWN();
 }
 
+void testClientRequestQueue() {
+    TEST_SETUP();
+    Iso14229Client client;
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    iso14229ClientInit(&client, &cfg);
+    const uint8_t TESTER_PRESENT[] = {0x3E, 0x00};
+    const uint8_t COMM_CONTROL[] = {0x28, 0x03, 0x01};
+    const uint8_t DTC_SETTING_OFF[] = {0x85, 0x02};
+    const enum Iso14229ClientOptions opts = SUPPRESS_POS_RESP | FUNCTIONAL;
+
+    // Requests that expect a response can't be queued
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS,
+                     Iso14229ClientQueueRequest(&client, TESTER_PRESENT, 2, FUNCTIONAL));
+
+    // Queueing requests while another request awaits its response
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK, ECUReset(&client, kHardReset));
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK,
+                     Iso14229ClientQueueRequest(&client, TESTER_PRESENT, 2, opts));
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK,
+                     Iso14229ClientQueueRequest(&client, COMM_CONTROL, 3, opts));
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK,
+                     Iso14229ClientQueueRequest(&client, DTC_SETTING_OFF, 2, opts));
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK,
+                     Iso14229ClientQueueRequest(&client, TESTER_PRESENT, 2, opts));
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_ERR_REQ_NOT_SENT_SEND_IN_PROGRESS,
+                     Iso14229ClientQueueRequest(&client, TESTER_PRESENT, 2, opts));
+    g.serverRecvQueueIdx = 0;
+
+    // should hold them back until that request has finished (here: timed out)
+    while (kRequestStateIdle != client.state) {
+        g.ms++;
+        Iso14229ClientPoll(&client);
+    }
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_ERR_REQ_TIMED_OUT, client.err);
+    ASSERT_INT_EQUAL(0, client.queueCount);
+
+    // and then send all of them back-to-back in a single poll
+    ASSERT_INT_EQUAL(4, g.serverRecvQueueIdx);
+    const uint8_t EXPECTED_COMM_CONTROL[] = {0x03, 0x28, 0x83, 0x01};
+    ASSERT_INT_EQUAL(CLIENT_FUNC_SEND_ID, g.serverRecvQueue[1].arbId);
+    ASSERT_MEMORY_EQUAL(g.serverRecvQueue[1].data, EXPECTED_COMM_CONTROL,
+                        sizeof(EXPECTED_COMM_CONTROL));
+    for (int i = 0; i < 4; i++) {
+        ASSERT_INT_EQUAL(CLIENT_FUNC_SEND_ID, g.serverRecvQueue[i].arbId);
+        ASSERT_INT_EQUAL(0x80, g.serverRecvQueue[i].data[2] & 0x80);
+    }
+
+    // A full TX mailbox keeps the rest queued for the next poll
+    g.serverRecvQueueIdx = CAN_MESSAGE_QUEUE_SIZE;
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK,
+                     Iso14229ClientQueueRequest(&client, TESTER_PRESENT, 2, opts));
+    Iso14229ClientPoll(&client);
+    ASSERT_INT_EQUAL(1, client.queueCount);
+    ASSERT_INT_EQUAL(0, Iso14229ClientGetTimeoutms(&client));
+
+    // and requests made with the service functions wait for the queue to empty
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_ERR_REQ_NOT_SENT_SEND_IN_PROGRESS,
+                     ECUReset(&client, kHardReset));
+    g.serverRecvQueueIdx = 0;
+    Iso14229ClientPoll(&client);
+    ASSERT_INT_EQUAL(0, client.queueCount);
+    ASSERT_INT_EQUAL(1, g.serverRecvQueueIdx);
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK, ECUReset(&client, kHardReset));
+    TEST_TEARDOWN();
+}
+
+void testClientTesterPresentKeepalive() {
+    TEST_SETUP();
+    Iso14229Client client;
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    cfg.tester_present_ms = 2000;
+    iso14229ClientInit(&client, &cfg);
+    const uint8_t KEEPALIVE[] = {0x02, 0x3E, 0x80};
+    const uint8_t COMM_CONTROL[] = {0x28, 0x03, 0x01};
+    uint32_t sentAt[8] = {0};
+    int sent = 0;
+
+    // Running a client with a keepalive period for 5 s. A functional request at 2500 ms and a
+    // physical request awaiting its response from 4450 ms until it times out
+    while (g.ms++ < 5000) {
+        if (2500 == g.ms) {
+            Iso14229ClientQueueRequest(&client, COMM_CONTROL, sizeof(COMM_CONTROL),
+                                       SUPPRESS_POS_RESP | FUNCTIONAL);
+        }
+        if (4450 == g.ms) {
+            ASSERT_INT_EQUAL(kISO14229_CLIENT_OK, ECUReset(&client, kHardReset));
+        }
+        Iso14229ClientPoll(&client);
+        for (int i = 0; i < g.serverRecvQueueIdx; i++) {
+            if (0 == memcmp(g.serverRecvQueue[i].data, KEEPALIVE, sizeof(KEEPALIVE))) {
+                ASSERT_INT_EQUAL(CLIENT_FUNC_SEND_ID, g.serverRecvQueue[i].arbId);
+                assert(sent < 8);
+                sentAt[sent++] = g.ms;
+            }
+        }
+        g.serverRecvQueueIdx = 0;
+    }
+
+    // should send 3E 80 once the period has passed since the last functional request
+    ASSERT_INT_EQUAL(2, sent);
+    ASSERT_INT_EQUAL(2001, sentAt[0]);
+    // and hold it back while the physical request is in progress
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_ERR_REQ_TIMED_OUT, client.err);
+    uint32_t timedOutAt = 4450U + cfg.p2_ms;
+    assert(sentAt[1] > timedOutAt);
+    assert(sentAt[1] <= timedOutAt + 2);
+    TEST_TEARDOWN();
+}
+
 void testClientUnexpectedResponse() {
     TEST_SETUP();
     Iso14229Client client;
@@ -942,6 +2908,41 @@ void testClient0x11ECUResetNegativeResponse() {
     TEST_TEARDOWN();
 }
 
+void testClientCANRxRing() {
+    TEST_SETUP();
+    static Iso14229CANRxRing ring;
+    Iso14229CANRxRingInit(&ring);
+    Iso14229Client client;
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    cfg.userCANRxPoll = NULL;
+    cfg.rxRing = &ring;
+    iso14229ClientInit(&client, &cfg);
+    ECUReset(&client, kHardReset);
+
+    // the response is moved into the ring as the driver would, next to a frame for another node
+    const uint8_t OTHER[] = {0x02, 0x51, 0x01};
+    Iso14229CANRxRingPush(&ring, 0x123, OTHER, sizeof(OTHER));
+    const uint8_t RESPONSE[] = {0x51, 0x01};
+    isotp_send(&g.srvPhysLink, RESPONSE, sizeof(RESPONSE));
+    for (int i = 0; i < g.clientRecvQueueIdx; i++) {
+        struct CANMessage *msg = &g.clientRecvQueue[i];
+        Iso14229CANRxRingPush(&ring, msg->arbId, msg->data, msg->size);
+    }
+    g.clientRecvQueueIdx = 0;
+    ASSERT_INT_EQUAL(Iso14229ClientGetTimeoutms(&client), 0);
+
+    // the client drains the ring and completes the request
+    Iso14229ClientPoll(&client);
+    ASSERT_PTR_EQUAL((void *)Iso14229CANRxRingPeek(&ring), NULL);
+    while (kRequestStateIdle != client.state) {
+        Iso14229ClientPoll(&client);
+        assert(g.ms++ < cfg.p2_ms);
+    }
+    ASSERT_INT_EQUAL(client.err, kISO14229_CLIENT_OK);
+    TEST_TEARDOWN();
+}
+
 void testClient0x11ECUResetNegativeResponseNoError() {
     TEST_SETUP();
     Iso14229Client client;
@@ -1056,6 +3057,23 @@ void testClient0x31RequestCorrectlyReceivedResponsePending() {
     TEST_TEARDOWN();
 }
 
+void testClient0x23ReadMemoryByAddress() {
+    TEST_SETUP();
+    IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
+    Iso14229Client client;
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    iso14229ClientInit(&client, &cfg);
+
+    // a 4 byte address with the top bit set
+    ASSERT_INT_EQUAL(kISO14229_CLIENT_OK, ReadMemoryByAddress(&client, 0x24, 0xFF123456, 0x0102));
+
+    // the address and size are sent big-endian
+    const uint8_t CORRECT_REQUEST[] = {0x23, 0x24, 0xFF, 0x12, 0x34, 0x56, 0x01, 0x02};
+    ASSERT_MEMORY_EQUAL(g.clientLinkTxBuf, CORRECT_REQUEST, sizeof(CORRECT_REQUEST));
+    ASSERT_INT_EQUAL(sizeof(CORRECT_REQUEST), g.clientLink.send_size);
+    TEST_TEARDOWN();
+}
+
 void testClient0x34RequestDownload() {
     TEST_SETUP();
     IsoTpInitLink(&g.srvPhysLink, &SRV_PHYS_LINK_DEFAULT_CONFIG);
@@ -1210,36 +3228,412 @@ void testClient0x36TransferData() {
     TEST_TEARDOWN();
 }
 
+static Iso14229Server *testClientWaitRxServer;
+static uint32_t testClientWaitRxMaxTimeout;
+static int testClientWaitRxCalls;
+
+static void mockClientWaitRx(uint32_t timeout_ms) {
+    testClientWaitRxCalls++;
+    if (timeout_ms > testClientWaitRxMaxTimeout) {
+        testClientWaitRxMaxTimeout = timeout_ms;
+    }
+    Iso14229ServerPoll(testClientWaitRxServer);
+    g.ms++;
+}
+
+static enum Iso14229ClientError testClientWaitRxSendTesterPresent(Iso14229Client *client,
+                                                                  void *args) {
+    (void)args;
+    return TesterPresent(client);
+}
+
+void testClientWaitRx() {
+    TEST_SETUP();
+    testClientWaitRxMaxTimeout = 0;
+    testClientWaitRxCalls = 0;
+    Iso14229Server server;
+    Iso14229ServerConfig srvCfg = DEFAULT_SERVER_CONFIG();
+    Iso14229ServerInit(&server, &srvCfg);
+    testClientWaitRxServer = &server;
+    Iso14229Client client;
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    cfg.yield_period_ms = ISO14229_CLIENT_DEFAULT_YIELD_PERIOD_MS;
+    cfg.userWaitRx = mockClientWaitRx;
+    iso14229ClientInit(&client, &cfg);
+
+    // an idle client has nothing to do for yield_period_ms
+    ASSERT_INT_EQUAL(Iso14229ClientGetTimeoutms(&client), ISO14229_CLIENT_DEFAULT_YIELD_PERIOD_MS);
+
+    // a sequence run with userWaitRx instead of userYieldms
+    Iso14229ClientCallback callbacks[] = {testClientWaitRxSendTesterPresent,
+                                          Iso14229ClientAwaitIdle};
+    struct Iso14229Sequence seq = {.list = callbacks, .len = 2};
+    struct Iso14229Runner runner = {0};
+    ASSERT_INT_EQUAL(iso14229SequenceRunBlocking(&seq, &client, &runner), kISO14229_CLIENT_OK);
+
+    // completes in a few waits, none of them longer than yield_period_ms
+    assert(testClientWaitRxCalls < 5);
+    assert(testClientWaitRxMaxTimeout <= ISO14229_CLIENT_DEFAULT_YIELD_PERIOD_MS);
+    TEST_TEARDOWN();
+}
+
+void testClientMux() {
+    TEST_SETUP();
+    static IsoTpLink links[3];
+    static uint8_t rxBufs[3][64], txBufs[3][64];
+    static const uint32_t RECV_IDS[3] = {0x7E9, 0x7E8, 0x7EA};
+    Iso14229Client clients[3];
+    struct Iso14229ClientMuxEntry table[3];
+    Iso14229ClientMux mux;
+    Iso14229ClientMuxInit(&mux, table, 3, mockClientCANRxPoll);
+
+    for (int i = 0; i < 3; i++) {
+        struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+        cfg.phys_send_id = RECV_IDS[i] - 8;
+        cfg.recv_id = RECV_IDS[i];
+        cfg.link = &links[i];
+        cfg.link_receive_buffer = rxBufs[i];
+        cfg.link_recv_buf_size = sizeof(rxBufs[i]);
+        cfg.link_send_buffer = txBufs[i];
+        cfg.link_send_buf_size = sizeof(txBufs[i]);
+        cfg.userCANRxPoll = NULL;
+        iso14229ClientInit(&clients[i], &cfg);
+        ASSERT_INT_EQUAL(Iso14229ClientMuxAdd(&mux, &clients[i]), kISO14229_CLIENT_OK);
+    }
+
+    // the table is full, and recv_ids must be unique
+    ASSERT_INT_EQUAL(Iso14229ClientMuxAdd(&mux, &clients[0]),
+                     kISO14229_CLIENT_ERR_REQ_NOT_SENT_BUF_TOO_SMALL);
+    mux.tableSize = 4;
+    ASSERT_INT_EQUAL(Iso14229ClientMuxAdd(&mux, &clients[0]),
+                     kISO14229_CLIENT_ERR_REQ_NOT_SENT_INVALID_ARGS);
+    mux.tableSize = 3;
+
+    // all three clients send a request at the same time
+    for (int i = 0; i < 3; i++) {
+        ASSERT_INT_EQUAL(TesterPresent(&clients[i]), kISO14229_CLIENT_OK);
+    }
+    Iso14229ClientMuxPoll(&mux);
+    ASSERT_INT_EQUAL(g.serverRecvQueueIdx, 3);
+
+    // the responses arrive out of order, mixed with a frame for another node
+    const uint8_t RESPONSE[] = {0x02, 0x7E, 0x00};
+    mockServerCANTransmit(0x7EA, RESPONSE, sizeof(RESPONSE));
+    mockServerCANTransmit(0x7EF, RESPONSE, sizeof(RESPONSE));
+    mockServerCANTransmit(0x7E8, RESPONSE, sizeof(RESPONSE));
+    mockServerCANTransmit(0x7E9, RESPONSE, sizeof(RESPONSE));
+
+    // and each one reaches its own client
+    for (int i = 0; i < 3; i++) {
+        Iso14229ClientMuxPoll(&mux);
+    }
+    for (int i = 0; i < 3; i++) {
+        ASSERT_INT_EQUAL(clients[i].state, kRequestStateIdle);
+        ASSERT_INT_EQUAL(clients[i].err, kISO14229_CLIENT_OK);
+    }
+    ASSERT_INT_EQUAL(mux.droppedFrames, 1);
+    TEST_TEARDOWN();
+}
+
+static int32_t testClientDownloadRead(void *ctx, size_t offset, uint8_t *buf, uint16_t len) {
+    (void)ctx;
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = (offset + i) & 0xFF;
+    }
+    return len;
+}
+
+static size_t testClientDownloadReceived;
+static int testClientDownloadTransfers;
+
+static enum Iso14229ResponseCode
+testClientDownloadMockHandlerOnTransfer(const struct Iso14229ServerStatus *status, void *userCtx,
+                                        const uint8_t *data, uint32_t len) {
+    (void)status;
+    (void)userCtx;
+    // the third block takes longer than p2 to write
+    if (3 == ++testClientDownloadTransfers) {
+        return kRequestCorrectlyReceived_ResponsePending;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        ASSERT_INT_EQUAL(data[i], (testClientDownloadReceived + i) & 0xFF);
+    }
+    testClientDownloadReceived += len;
+    return kPositiveResponse;
+}
+
+void testClientDownload() {
+    TEST_SETUP();
+    testClientDownloadReceived = 0;
+    testClientDownloadTransfers = 0;
+    Iso14229Server server;
+    Iso14229ServerConfig srvCfg = DEFAULT_SERVER_CONFIG();
+    srvCfg.userRequestDownloadHandler = testServer0x34DownloadDataMockuserRequestDownloadHandler;
+    Iso14229ServerInit(&server, &srvCfg);
+    Iso14229Client client;
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    iso14229ClientInit(&client, &cfg);
+
+    Iso14229DownloadHandler *handler = NULL;
+    uint16_t maxNumberOfBlockLength = 0;
+    testServer0x34DownloadDataMockuserRequestDownloadHandler(NULL, (void *)0x602000, 0x00FFFF, 0x11,
+                                                             &handler, &maxNumberOfBlockLength);
+    handler->onTransfer = testClientDownloadMockHandlerOnTransfer;
+    Iso14229Digest serverDigest = {.type = kIso14229DigestCRC32};
+    handler->digest = &serverDigest;
+
+    static uint8_t prefetchBuf[256];
+    Iso14229Digest digest = {.type = kIso14229DigestCRC32};
+    Iso14229ClientDownload dl;
+    struct Iso14229ClientDownloadConfig dlCfg = {
+        .dataFormatIdentifier = 0x11,
+        .addressAndLengthFormatIdentifier = 0x33,
+        .memoryAddress = 0x602000,
+        .memorySize = 0x00FFFF,
+        .read = testClientDownloadRead,
+        .prefetchBuffer = prefetchBuf,
+        .prefetchBufferSize = sizeof(prefetchBuf),
+        .digest = &digest,
+    };
+    Iso14229ClientDownloadInit(&dl, &dlCfg);
+
+    // running the download to completion
+    enum Iso14229ClientError err;
+    while (kISO14229_CLIENT_SEQUENCE_RUNNING == (err = Iso14229ClientDownloadPoll(&client, &dl))) {
+        Iso14229ServerPoll(&server);
+        assert(g.ms++ < 60000);
+    }
+
+    // transfers the whole image in blocks of maxNumberOfBlockLength, despite the response pending,
+    // and the CRC in the 0x37 response matches
+    ASSERT_INT_EQUAL(err, kISO14229_CLIENT_OK);
+    ASSERT_INT_EQUAL(dl.blockLength, 0x81);
+    ASSERT_INT_EQUAL(dl.bytesTransferred, 0x00FFFF);
+    ASSERT_INT_EQUAL(testClientDownloadReceived, 0x00FFFF);
+    ASSERT_INT_EQUAL(testClientDownloadTransfers, 517 + 1); // 14.5.5.1.1, one response pending
+    assert(dl.bytesPerSecond > 0);
+    handler->onTransfer = testServer0x34DownloadDataMockHandlerOnTransfer;
+    handler->digest = NULL;
+    TEST_TEARDOWN();
+}
+
+static int32_t testClientDownloadCompressedRead(void *ctx, size_t offset, uint8_t *buf,
+                                                uint16_t len) {
+    (void)ctx;
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = testLZSSImageByte(offset + i);
+    }
+    return len;
+}
+
+static enum Iso14229ResponseCode
+testClientDownloadCompressedOnTransfer(const struct Iso14229ServerStatus *status, void *userCtx,
+                                       const uint8_t *data, uint32_t len) {
+    (void)status;
+    (void)userCtx;
+    // the third write takes longer than p2
+    if (3 == ++testClientDownloadTransfers) {
+        return kRequestCorrectlyReceived_ResponsePending;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        ASSERT_INT_EQUAL(data[i], testLZSSImageByte(testClientDownloadReceived + i));
+    }
+    testClientDownloadReceived += len;
+    return kPositiveResponse;
+}
+
+static Iso14229LZSSDecoder testClientDownloadCompressedDecoder;
+
+static enum Iso14229ResponseCode testClientDownloadCompressedRequestDownloadHandler(
+    const struct Iso14229ServerStatus *status, void *memoryAddress, size_t memorySize,
+    uint8_t dataFormatIdentifier, Iso14229DownloadHandler **handler,
+    uint16_t *maxNumberOfBlockLength) {
+    (void)status;
+    (void)memoryAddress;
+    (void)memorySize;
+    static Iso14229Digest digest = {.type = kIso14229DigestSHA256};
+    static Iso14229DownloadHandler mockHandler = {
+        .onExit = testServer0x34DownloadDataMockHandlerOnExit,
+        .onTransfer = testClientDownloadCompressedOnTransfer,
+        .digest = &digest,
+    };
+    mockHandler.decoder =
+        ISO14229_DFI_LZSS == dataFormatIdentifier ? &testClientDownloadCompressedDecoder : NULL;
+    *handler = &mockHandler;
+    *maxNumberOfBlockLength = 0x0081;
+    return kPositiveResponse;
+}
+
+void testClientDownloadCompressed() {
+    TEST_SETUP();
+    testClientDownloadReceived = 0;
+    testClientDownloadTransfers = 0;
+    Iso14229Server server;
+    Iso14229ServerConfig srvCfg = DEFAULT_SERVER_CONFIG();
+    srvCfg.userRequestDownloadHandler = testClientDownloadCompressedRequestDownloadHandler;
+    Iso14229ServerInit(&server, &srvCfg);
+    Iso14229Client client;
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    iso14229ClientInit(&client, &cfg);
+
+    static uint8_t prefetchBuf[256];
+    static Iso14229LZSSEncoder encoder;
+    Iso14229Digest digest = {.type = kIso14229DigestSHA256};
+    Iso14229ClientDownload dl;
+    struct Iso14229ClientDownloadConfig dlCfg = {
+        .dataFormatIdentifier = ISO14229_DFI_LZSS,
+        .addressAndLengthFormatIdentifier = 0x33,
+        .memoryAddress = 0x602000,
+        .memorySize = 0x00FFFF,
+        .read = testClientDownloadCompressedRead,
+        .prefetchBuffer = prefetchBuf,
+        .prefetchBufferSize = sizeof(prefetchBuf),
+        .encoder = &encoder,
+        .digest = &digest,
+    };
+    Iso14229ClientDownloadInit(&dl, &dlCfg);
+
+    // when the download runs to completion
+    enum Iso14229ClientError err;
+    while (kISO14229_CLIENT_SEQUENCE_RUNNING == (err = Iso14229ClientDownloadPoll(&client, &dl))) {
+        Iso14229ServerPoll(&server);
+        assert(g.ms++ < 60000);
+    }
+
+    // the server writes the whole uncompressed image after less than half of it was sent, and
+    // its SHA-256 over the decompressed data matches the client's
+    ASSERT_INT_EQUAL(err, kISO14229_CLIENT_OK);
+    ASSERT_INT_EQUAL(dl.bytesRead, 0x00FFFF);
+    assert(dl.bytesTransferred < 0x00FFFF / 2);
+    ASSERT_INT_EQUAL(testClientDownloadReceived, 0x00FFFF);
+    ASSERT_INT_EQUAL(server.nodes[0].downloadHandler == NULL, 1);
+    TEST_TEARDOWN();
+}
+
+static int32_t testClientUploadWrite(void *ctx, size_t offset, const uint8_t *data,
+                                     uint16_t len) {
+    uint8_t *image = (uint8_t *)ctx;
+    memcpy(&image[offset], data, len);
+    return len;
+}
+
+void testClientUpload() {
+    TEST_SETUP();
+    Iso14229Server server;
+    Iso14229ServerConfig srvCfg = DEFAULT_SERVER_CONFIG();
+    srvCfg.userRequestUploadHandler = testServer0x35MockRequestUploadHandler;
+    Iso14229ServerInit(&server, &srvCfg);
+    Iso14229Client client;
+    struct Iso14229ClientConfig cfg = DEFAULT_CLIENT_CONFIG();
+    iso14229ClientInit(&client, &cfg);
+    for (unsigned i = 0; i < sizeof(testServer0x35Memory); i++) {
+        testServer0x35Memory[i] = i * 5;
+    }
+    memset(&testServer0x35Handler, 0, sizeof(testServer0x35Handler));
+    testServer0x35Handler.memory = testServer0x35Memory;
+
+    static uint8_t image[sizeof(testServer0x35Memory)];
+    Iso14229ClientUpload ul;
+    struct Iso14229ClientUploadConfig ulCfg = {
+        .dataFormatIdentifier = 0x00,
+        .addressAndLengthFormatIdentifier = 0x33,
+        .memoryAddress = 0x602000,
+        .memorySize = sizeof(image),
+        .write = testClientUploadWrite,
+        .writeCtx = image,
+    };
+    Iso14229ClientUploadInit(&ul, &ulCfg);
+
+    // running the upload to completion
+    enum Iso14229ClientError err;
+    while (kISO14229_CLIENT_SEQUENCE_RUNNING == (err = Iso14229ClientUploadPoll(&client, &ul))) {
+        Iso14229ServerPoll(&server);
+        assert(g.ms++ < 10000);
+    }
+
+    ASSERT_INT_EQUAL(err, kISO14229_CLIENT_OK);
+    ASSERT_INT_EQUAL(ul.blockLength, 0x82);
+    ASSERT_INT_EQUAL(ul.bytesReceived, sizeof(image));
+    ASSERT_INT_EQUAL(ul.blockSequenceCounter, 4);
+    ASSERT_MEMORY_EQUAL(image, testServer0x35Memory, sizeof(image));
+    ASSERT_INT_EQUAL(server.nodes[0].uploadHandler == NULL, 1);
+    TEST_TEARDOWN();
+}
+
 /**
  * @brief run all tests
  */
 int main() {
+    testIsoTpCanFD();
+    testIsoTpBurstSend();
+    testIsoTpSendSegments();
+    testIsoTpNextDeadline();
+    testIsoTpReceivePeek();
+    testIsoTpReceiveDoubleBuffer();
+    testIsoTpSetFlowControl();
+    testIsoTpPDUMode();
+
+    testALFID();
+    testLZSS();
+    testDigest();
     testServerInit();
+    testServerCANRxRing();
+    testServerDrainsCANRxQueue();
+    testServerGetTimeoutms();
     testServer0x10DiagnosticSessionControlIsDisabledByDefault();
     testServer0x11DoesNotSendOrReceiveMessagesAfterECUReset();
     testServer0x22RDBI1();
+    testServer0x22DIDTable();
+    testServer0x22ScatterGather();
+    testServer0x2APeriodic();
+#if ISO14229_SERVER_METRICS && ISO_TP_METRICS
+    testServerMetrics();
+#endif
+    testServer0x2CDynamicDID();
+    testServer0x23ReadMemoryByAddress();
+    testServer0x3DWriteMemoryByAddress();
     testServer0x27SecurityAccess();
     testServer0x27SecurityAccessAlreadyUnlocked();
     testServer0x31RCRRP();
+    testServerSchedulesRequestsWithoutP2Gap();
+    testServerSharedSendBuffer();
+    testServerRCRRPKeepalive();
+    testServerJobHandoff();
+    testServerRCRRPNotSuppressed();
     testServer0x34NotEnabled();
     testServer0x34DownloadData();
+    testServer0x35Upload();
     // testServer0x36TransferData();
     testServer0x3ESuppressPositiveResponse();
+    testServer0x19ReadDTCInformation();
+    testServer0x14ClearAnd0x85ControlDTCSetting();
+    testServerDTCStoreWriteBack();
     testServer0x83DiagnosticSessionControl();
+    testServerServiceTable();
+    testServerMultipleNodes();
 
     testClientInit();
     testClientP2TimeoutExceeded();
     testClientP2TimeoutNotExceeded();
     testClientSuppressPositiveResponse();
     testClientBusy();
+    testClientRequestQueue();
+    testClientTesterPresentKeepalive();
     testClientUnexpectedResponse();
     testClient0x11ECUReset();
     testClient0x11ECUResetNegativeResponse();
+    testClientCANRxRing();
     testClient0x11ECUResetNegativeResponseNoError();
     testClient0x22RDBITxBufferTooSmall();
     testClient0x22RDBIUnpackResponse();
     testClient0x31RequestCorrectlyReceivedResponsePending();
+    testClient0x23ReadMemoryByAddress();
     testClient0x34RequestDownload();
     testClient0x34UnpackRequestDownloadResponse();
     testClient0x36TransferData();
+    testClientMux();
+    testClientDownload();
+    testClientDownloadCompressed();
+    testClientUpload();
+    testClientWaitRx();
 }
@@ -134,7 +134,7 @@ static inline void IsoTpInitLink(IsoTpLink *link, const struct IsoTpLinkConfig *
 
 struct CANMessage {
     uint32_t arbId;
-    uint8_t data[8];
+    uint8_t data[ISO_TP_MAX_DL];
     uint8_t size;
 };
 
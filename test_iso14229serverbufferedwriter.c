@@ -21,15 +21,59 @@ uint8_t g_buffer[LOGICAL_PARTITION_SIZE] = {0};
 
 uint8_t g_mockData[LOGICAL_PARTITION_SIZE] = {0};
 
+int g_directWrites; // pages written straight from the input, without a copy to g_buffer
+
 int writeFunc(void *addr, const uint8_t *data, uint32_t length) {
     BUFFEREDWRITER_DEBUG_PRINTF("writeFunc writing at offset %u\n",
                                 addr - (void *)g_logicalPartition);
     assert((uint8_t *)addr >= g_logicalPartition);
     assert((uint8_t *)addr + length <= g_logicalPartition + sizeof(g_logicalPartition));
+    if (data != g_buffer) {
+        g_directWrites++;
+    }
     memmove(addr, data, length);
     return 0;
 }
 
+// asynchronous flash mock: every operation takes a few polls
+struct {
+    void *addr;
+    const uint8_t *data;
+    uint32_t length;
+    int busyPolls;
+    int erases;
+} g_flash;
+
+int eraseStart(void *addr, uint32_t length) {
+    assert(0 == g_flash.busyPolls);
+    memset(addr, 0xFF, length);
+    g_flash.data = NULL;
+    g_flash.busyPolls = 2;
+    g_flash.erases++;
+    return 0;
+}
+
+int programStart(void *addr, const uint8_t *data, uint32_t length) {
+    assert(0 == g_flash.busyPolls);
+    g_flash.addr = addr;
+    g_flash.data = data;
+    g_flash.length = length;
+    g_flash.busyPolls = 3;
+    return 0;
+}
+
+int flashPoll(void) {
+    if (g_flash.busyPolls && --g_flash.busyPolls) {
+        return BUFFERED_WRITER_BUSY;
+    }
+    if (g_flash.data) {
+        // the source must stay untouched until the operation completes
+        writeFunc(g_flash.addr, g_flash.data, g_flash.length);
+        g_flash.data = NULL;
+    }
+    return 0;
+}
+
 static inline void print_diff(int addr) {
     int min = addr - 5 < 0 ? 0 : addr - 5;
     int max = addr + 5 > LOGICAL_PARTITION_SIZE ? LOGICAL_PARTITION_SIZE : addr + 5;
@@ -43,16 +87,22 @@ static inline void print_diff(int addr) {
     }
 }
 
-void run_test(size_t pageBufferSize, size_t chunkSize) {
-    printf("pageBufferSize:  %05x, chunkSize: %05x\n", pageBufferSize, chunkSize);
+void run_test_with(size_t pageBufferSize, size_t chunkSize, bool async) {
+    printf("pageBufferSize:  %05x, chunkSize: %05x, async: %d\n", pageBufferSize, chunkSize,
+           async);
     memset(g_logicalPartition, 0, sizeof(g_logicalPartition));
+    memset(&g_flash, 0, sizeof(g_flash));
+    g_directWrites = 0;
     BufferedWriter bw = {0};
     BufferedWriterConfig cfg = {
-        .writeFunc = writeFunc,
+        .writeFunc = async ? NULL : writeFunc,
         .logicalPartitionStartAddr = g_logicalPartition,
         .logicalPartitionSize = sizeof(g_logicalPartition),
         .pageBufferSize = pageBufferSize,
         .pageBuffer = g_buffer,
+        .eraseStart = async ? eraseStart : NULL,
+        .programStart = async ? programStart : NULL,
+        .flashPoll = async ? flashPoll : NULL,
     };
 
     bufferedWriterInit(&bw, &cfg);
@@ -98,6 +148,46 @@ void run_test(size_t pageBufferSize, size_t chunkSize) {
         fflush(stdout);
         assert(0);
     }
+    assert(0 == bw.err);
+
+    // chunks holding whole pages skip the page buffer
+    if (chunkSize % pageBufferSize == 0) {
+        assert(g_directWrites == LOGICAL_PARTITION_SIZE / pageBufferSize);
+    }
+    if (async) {
+        assert(g_flash.erases == LOGICAL_PARTITION_SIZE / pageBufferSize);
+    }
+}
+
+void run_test(size_t pageBufferSize, size_t chunkSize) {
+    run_test_with(pageBufferSize, chunkSize, false);
+}
+
+// the unused end of the last, partial page is cleared
+void run_test_partial_page() {
+    const uint32_t pageBufferSize = 2048;
+    const uint32_t size = 3 * pageBufferSize + 100;
+    printf("partial page\n");
+    memset(g_logicalPartition, 0xAA, sizeof(g_logicalPartition));
+    memset(g_buffer, 0xAA, sizeof(g_buffer));
+    BufferedWriter bw = {0};
+    BufferedWriterConfig cfg = {
+        .writeFunc = writeFunc,
+        .logicalPartitionStartAddr = g_logicalPartition,
+        .logicalPartitionSize = sizeof(g_logicalPartition),
+        .pageBufferSize = pageBufferSize,
+        .pageBuffer = g_buffer,
+    };
+    bufferedWriterInit(&bw, &cfg);
+    while (BufferedWriterProcess(&bw, g_mockData, size)) {
+    }
+    while (BufferedWriterProcess(&bw, NULL, 0)) {
+    }
+    assert(0 == memcmp(g_logicalPartition, g_mockData, size));
+    for (uint32_t i = size; i < 4 * pageBufferSize; i++) {
+        assert(0 == g_logicalPartition[i]);
+    }
+    assert(0xAA == g_logicalPartition[4 * pageBufferSize]);
 }
 
 void setup() {
@@ -120,5 +210,10 @@ int main(int ac, char **av) {
     run_test(8192, 8192);
     run_test(8192, 8193);
     run_test(8192, 10000);
+    run_test_with(2048, 1000, true);
+    run_test_with(2048, 2048, true);
+    run_test_with(2048, 10000, true);
+    run_test_with(8192, 8193, true);
+    run_test_partial_page();
     printf("pass\n");
 }
\ No newline at end of file